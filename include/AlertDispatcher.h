@@ -0,0 +1,113 @@
+#pragma once
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "AlertOutbox.h"
+#include "utils/bounded_queue.hpp"
+
+namespace httplib { class Client; }
+
+namespace alerts {
+
+    // Одно событие для вебхука: уже сериализованный JSON-объект
+    struct Event {
+        std::string stream;        // имя канала (пусто — общесистемное)
+        std::string body;          // JSON-объект полезной нагрузки
+        int64_t     enq_ms = 0;    // steady-время постановки в очередь
+    };
+
+    struct DispatcherStats {
+        size_t   queue_depth = 0;
+        size_t   queue_capacity = 0;
+        uint64_t enqueued = 0;
+        uint64_t dropped = 0;         // очередь переполнена
+        uint64_t discarded = 0;       // вебхук выключен в настройках
+        uint64_t sent_events = 0;
+        uint64_t sent_batches = 0;
+        uint64_t failed_batches = 0;
+        uint64_t dead_letters = 0;    // приёмник отверг навсегда (4xx кроме 408/429): в dead-letter.log
+        double   last_send_ms = 0.0;  // длительность последнего POST
+        double   avg_send_ms = 0.0;   // EWMA длительности POST
+        double   max_send_ms = 0.0;
+        double   last_queue_ms = 0.0; // ожидание в очереди первого события пачки
+
+        size_t   outbox_pending = 0;  // записано, но не доставлено
+        uint64_t outbox_bytes = 0;
+        uint64_t outbox_dropped = 0;  // вытеснено по потолку диска
+        bool     outbox_durable = false;
+        uint64_t retries = 0;
+        int      backoff_ms = 0;      // текущая пауза перед повтором (0 — приёмник доступен)
+    };
+
+    // Асинхронная отправка вебхуков: производители (watchdog, Metrics) только кладут событие
+    // в ограниченную MPSC-очередь и никогда не ждут сеть. Отдельный поток перекладывает события
+    // в дисковый Outbox, собирает пришедшие в пределах batch_window_ms в один POST по постоянному
+    // keep-alive соединению и подтверждает их только после 2xx. Пока приёмник недоступен (5xx,
+    // 408/429, ошибка соединения) — повторы с экспоненциальной паузой, алерты копятся на диске.
+    // Остальные ответы не-2xx окончательны: запись уходит в dead-letter, очередь идёт дальше.
+    class Dispatcher {
+    public:
+        static Dispatcher& instance();
+
+        void start();
+        void stop();
+
+        // Неблокирующая постановка в очередь; false — очередь полна (событие учтено в dropped)
+        bool enqueue(std::string stream, std::string body) noexcept;
+
+        DispatcherStats stats() const;
+
+    private:
+        Dispatcher();
+        ~Dispatcher();
+
+        void run();
+        int  post_batch(const std::vector<Outbox::Record>& batch);   // HTTP-статус, 0 — нет ответа
+        void publish_outbox_stats() noexcept;
+        void ensure_client(const std::string& url, int timeout_ms);
+        void note_send_latency(double ms) noexcept;
+
+        util::BoundedQueue<Event> m_q;
+
+        std::thread             m_thr;
+        std::atomic<bool>       m_run{ false };
+        std::mutex              m_wait_mx;
+        std::condition_variable m_cv;
+
+        // соединение живёт только в потоке отправки
+        Outbox m_outbox;
+        std::unique_ptr<httplib::Client> m_cli;
+        std::string m_cli_url;
+        std::string m_cli_path;
+        int         m_cli_timeout_ms = 0;
+
+        std::atomic<uint64_t> m_enqueued{ 0 };
+        std::atomic<uint64_t> m_dropped{ 0 };
+        std::atomic<uint64_t> m_discarded{ 0 };
+        std::atomic<uint64_t> m_sent_events{ 0 };
+        std::atomic<uint64_t> m_sent_batches{ 0 };
+        std::atomic<uint64_t> m_failed_batches{ 0 };
+        std::atomic<uint64_t> m_dead_letters{ 0 };
+        std::atomic<uint64_t> m_retries{ 0 };
+        std::atomic<int>      m_backoff_ms{ 0 };
+
+        // зеркало состояния Outbox для stats() (сам Outbox трогает только поток отправки)
+        std::atomic<size_t>   m_ob_pending{ 0 };
+        std::atomic<uint64_t> m_ob_bytes{ 0 };
+        std::atomic<uint64_t> m_ob_dropped{ 0 };
+        std::atomic<bool>     m_ob_durable{ false };
+
+        mutable std::mutex m_lat_mx;
+        double m_last_send_ms = 0.0;
+        double m_avg_send_ms = 0.0;
+        double m_max_send_ms = 0.0;
+        double m_last_queue_ms = 0.0;
+    };
+
+} // namespace alerts
@@ -0,0 +1,94 @@
+#pragma once
+#include <cstdint>
+#include <cstdio>
+#include <deque>
+#include <string>
+#include <vector>
+
+namespace alerts {
+
+    // Дисковая очередь исходящих вебхуков: append-only сегменты seg-<N>.log в каталоге outbox.
+    // Запись: magic | len | crc32 | stream_len | stream | body. После сбоя хвост с битой CRC
+    // отрезается, позиция чтения восстанавливается из файла cursor (пишется через tmp + rename).
+    // Порядок записей глобальный FIFO, значит и порядок внутри одного стрима сохраняется.
+    // Если новый сегмент создать не удалось, запись переходит в память, а уже записанные сегменты
+    // дочитываются первыми (FIFO сохраняется).
+    // Не потокобезопасен: используется только потоком alerts::Dispatcher.
+    class Outbox {
+    public:
+        struct Record {
+            std::string stream;
+            std::string body;
+        };
+
+        Outbox() = default;
+        ~Outbox();
+
+        Outbox(const Outbox&) = delete;
+        Outbox& operator=(const Outbox&) = delete;
+
+        // Открыть/восстановить каталог. При ошибке работает в памяти (durable() == false).
+        bool open(const std::string& dir, uint64_t segment_bytes, uint64_t max_bytes);
+        void close();
+
+        bool append(const std::string& stream, const std::string& body);
+
+        // Сбросить буферы и fsync текущего сегмента (вызывается пачкой, не на каждую запись)
+        void sync();
+
+        // Прочитать до max записей от позиции чтения, не сдвигая её
+        size_t peek(size_t max, std::vector<Record>& out);
+        // Подтвердить первые n записей последнего peek (доставлены)
+        void commit(size_t n);
+        // Приёмник отверг запись навсегда (4xx): строка в dead-letter.log каталога; подтверждать — через commit
+        void dead_letter(const Record& r, int status);
+
+        size_t   pending() const noexcept { return m_pending; }
+        uint64_t bytes() const noexcept { return m_total_bytes; }
+        uint64_t dropped() const noexcept { return m_dropped; }
+        bool     durable() const noexcept { return m_durable; }
+
+    private:
+        struct Segment {
+            uint64_t index = 0;
+            uint64_t size = 0;
+            uint64_t records = 0;
+        };
+
+        struct Pos {
+            uint64_t seg = 0;
+            uint64_t off = 0;
+        };
+
+        std::string seg_path(uint64_t index) const;
+        bool        roll_segment();
+        void        enforce_cap();
+        void        drop_front_segment();
+        void        forget_disk();
+        void        commit_disk(size_t n);
+        size_t      disk_pending() const noexcept;
+        void        save_cursor();
+        bool        load_cursor(Pos& p) const;
+        bool        read_record(std::FILE* f, Record* out, uint64_t& rec_size) const;
+
+        std::string m_dir;
+        uint64_t    m_segment_bytes = 1u << 20;
+        uint64_t    m_max_bytes = 64u << 20;
+        bool        m_durable = false;
+
+        std::deque<Segment> m_segs;
+        std::FILE*  m_wr = nullptr;            // текущий (последний) сегмент
+        Pos         m_rd{};                    // позиция чтения
+        uint64_t    m_rd_consumed = 0;         // записей прочитано в сегменте m_rd.seg
+        std::vector<Pos> m_peek_end;           // позиция после каждой записи последнего peek (с диска)
+
+        size_t   m_pending = 0;
+        uint64_t m_total_bytes = 0;
+        uint64_t m_dropped = 0;
+
+        // запасной режим без диска (после сегментов, если они остались)
+        std::deque<Record> m_mem;
+        uint64_t m_mem_bytes = 0;
+    };
+
+} // namespace alerts
@@ -0,0 +1,92 @@
+#pragma once
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string_view>
+
+namespace alerts {
+
+    // Условие, по которому ведётся отдельный автомат состояния
+    enum class Condition : uint8_t {
+        Fps = 0,
+        Bitrate,
+        Stall,
+        CcErrors,
+        PcrJitter,
+        MdiDf,
+        MdiMlr,
+        Count
+    };
+
+    enum class Level : uint8_t {
+        Ok = 0,
+        Warn = 1,
+        Crit = 2
+    };
+
+    const char* to_string(Condition c) noexcept;
+    const char* to_string(Level l) noexcept;
+
+    // Итог одного шага автомата
+    struct Transition {
+        Level level = Level::Ok;     // текущий (устоявшийся) уровень
+        Level prev = Level::Ok;
+        bool  changed = false;       // уровень сменился на этом шаге
+        bool  notify = false;        // стоит отправить алерт (смена без флаппинга, начало/конец флаппинга)
+        bool  flapping = false;      // условие «дребезжит», обычные уведомления подавлены
+        int64_t recheck_at_ms = 0;   // когда автомату нужна повторная оценка (выдержка, конец флаппинга); 0 — не нужна
+    };
+
+    struct StateEngineStats {
+        size_t   capacity = 0;
+        size_t   used = 0;
+        uint64_t evictions = 0;
+        uint64_t rejected = 0;        // таблица полна и вытеснить некого
+        uint64_t suppressed = 0;      // смены уровня, скрытые флап-фильтром
+    };
+
+    // Автоматы состояния по ключу (stream, condition) в таблице фиксированного размера.
+    // Вход в более тяжёлый уровень требует enter_dwell_ms подряд, выход — exit_dwell_ms
+    // и запаса hysteresis_pct от порога. Частые смены уровня переводят ключ в режим flapping.
+    class StateEngine {
+    public:
+        static StateEngine& instance();
+
+        // lower_is_worse: true для fps-ratio/битрейта, false для stall/CC
+        Transition evaluate(std::string_view stream, Condition cond, double value,
+            double warn, double crit, bool lower_is_worse, int64_t now_ms);
+
+        Level level(std::string_view stream, Condition cond) const;
+
+        // Удалить все автоматы канала (при удалении стрима)
+        void forget(std::string_view stream);
+
+        // То же по числовому id стрима (StreamRegistry): имя не хешируется и не сравнивается
+        Transition evaluate(uint32_t stream_id, Condition cond, double value,
+            double warn, double crit, bool lower_is_worse, int64_t now_ms);
+        Level level(uint32_t stream_id, Condition cond) const;
+        void forget(uint32_t stream_id);
+
+        StateEngineStats stats() const;
+
+    private:
+        StateEngine();
+
+        struct Entry;
+        Transition evaluate_at(uint64_t h, std::string_view key, Condition cond, double value,
+            double warn, double crit, bool lower_is_worse, int64_t now_ms);
+        Level level_at(uint64_t h, std::string_view key, Condition cond) const;
+        void forget_at(std::string_view key, const uint64_t* hashes); // hashes[Condition::Count]
+        Entry* find_or_insert(uint64_t h, std::string_view stream, Condition cond, int64_t now_ms);
+        const Entry* find(uint64_t h, std::string_view stream, Condition cond) const;
+
+        mutable std::mutex       m_mx;
+        std::unique_ptr<Entry[]> m_tab;
+        size_t                   m_mask = 0;
+        size_t                   m_used = 0;
+        uint64_t                 m_evictions = 0;
+        uint64_t                 m_rejected = 0;
+        uint64_t                 m_suppressed = 0;
+    };
+
+} // namespace alerts
@@ -10,12 +10,21 @@ namespace alerts {
         Critical = 2
     };
 
-    // Единый способ отправки вебхуков
+    // Единый способ отправки вебхуков.
+    // Не блокирует: событие ставится в очередь alerts::Dispatcher; false — очередь переполнена.
     bool send_webhook(const std::string& title,
         const std::string& message,
         Severity level,
         int64_t now_ms = -1);
 
+    // То же с ключом кулдауна: повтором считается тот же ключ и уровень, а не тот же текст.
+    // Заголовки с текущими значениями (мс простоя, FPS) передают сюда стрим и вид условия
+    bool send_webhook(const std::string& title,
+        const std::string& message,
+        Severity level,
+        const std::string& cooldown_key,
+        int64_t now_ms = -1);
+
     // На отладку можно переопределить cooldown
     void set_cooldown_override(int seconds);
 
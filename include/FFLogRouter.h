@@ -1,33 +1,111 @@
 #pragma once
-#include <unordered_map>
+#include <array>
+#include <atomic>
+#include <cstdarg>
+#include <cstdint>
 #include <functional>
-#include <mutex>
 #include <string>
 
 extern "C" {
 #include <libavutil/log.h>
 }
 
+// Маршрутизатор логов FFmpeg.
+// Колбэк вызывается на каждый av_log любого уровня (включая DEBUG/TRACE), поэтому:
+//  - уровень и известные шаблоны проверяются по fmt ДО форматирования строки;
+//  - источник ищется в lock-free таблице (контекст FFmpeg -> Source), без мьютекса;
+//  - на каждый источник — токен-бакет (GCRA на одном атомике), подавленные строки
+//    суммируются и выводятся одной строкой;
+//  - известные сообщения (continuity check, ошибки PES, ошибки декодера) считаются
+//    в счётчики источника независимо от лимита и уровня вывода.
 class FFLogRouter {
 public:
     using Handler = std::function<void(int level, const std::string& line)>;
 
+    // Счётчики, извлечённые из сообщений FFmpeg
+    struct Counters {
+        std::atomic<uint64_t> cc_errors{ 0 };        // mpegts: Continuity check failed
+        std::atomic<uint64_t> pes_errors{ 0 };       // PES packet size mismatch / Packet corrupt
+        std::atomic<uint64_t> decode_errors{ 0 };    // AV_LOG_ERROR и хуже от декодера
+        std::atomic<uint64_t> lines{ 0 };            // выведено строк
+        std::atomic<uint64_t> suppressed{ 0 };       // срезано лимитом (всего)
+    };
+
+    // Источник сообщений — обычно один на стрим; живёт дольше своих контекстов FFmpeg
+    struct Source {
+        uint32_t    stream = 0xFFFFFFFFu;   // id для структурного журнала (kNoStream — нет)
+        std::string name;
+        Handler     handler;                // пусто — в Logger с logcode::FFmpeg
+        Counters    counters;
+
+        std::atomic<int64_t>  tat_us{ 0 };      // GCRA: теоретическое время прихода
+        std::atomic<uint64_t> pending{ 0 };     // подавлено с последней сводки
+    };
+
+    // Глобальные счётчики ведутся только для прошедших ранний фильтр (горячий путь без общих атомиков)
+    struct Stats {
+        uint64_t formatted = 0;
+        uint64_t suppressed = 0;
+        uint64_t unattributed = 0;   // источник не найден
+    };
+
     static FFLogRouter& instance();
 
-    //   callback FFmpeg (, )
+    // Устанавливает глобальный callback FFmpeg (однократно, потокобезопасно)
     void install();
 
-    //      (, AVFormatContext*)
-    void registerSource(void* ctx, Handler h);
-    void unregisterSource(void* ctx);
+    // Уровень вывода (AV_LOG_*) и лимит строк на источник
+    void configure(int max_level, int rate_per_sec, int burst);
+
+    // Привязать контекст FFmpeg (AVFormatContext*, AVCodecContext*) к источнику.
+    // false — таблица переполнена: сообщения атрибутируются через Scope текущего потока.
+    bool registerSource(const void* ctx, Source* src);
+    void unregisterSource(const void* ctx);
+
+    // Сводка подавленных строк источника (вызывать при закрытии входа)
+    void flush(Source& src);
+
+    // Источник по умолчанию для текущего потока: сообщения AVIO/http/протоколов,
+    // чьи контексты не регистрировались явно
+    class Scope {
+    public:
+        explicit Scope(Source* src);
+        ~Scope();
+        Scope(const Scope&) = delete;
+        Scope& operator=(const Scope&) = delete;
+    private:
+        Source* prev_;
+    };
+
+    Stats stats() const noexcept;
 
 private:
-    //  FFmpeg callback
+    FFLogRouter() = default;
+
+    // Глобальный FFmpeg callback
     static void ffCallback(void* avcl, int level, const char* fmt, va_list vl);
-    //     (  static)
-    void dispatch(void* avcl, int level, const std::string& line);
 
-    std::mutex mtx_;
-    std::unordered_map<void*, Handler> handlers_;
-    bool installed_ = false;
+    Source* lookup(const void* ctx) const noexcept;
+    Source* resolve(void* avcl) const noexcept;
+    bool    admit(Source& src) noexcept;
+    void    emit(Source* src, int level, const char* line);
+
+    static constexpr size_t kSlots = 8192;   // степень двойки
+    static constexpr size_t kProbe = 32;     // длина пробы: поиск и вставка ограничены
+
+    struct Slot {
+        std::atomic<const void*> key{ nullptr };   // nullptr — пусто, kTomb — удалено
+        std::atomic<Source*>     src{ nullptr };
+    };
+    std::array<Slot, kSlots> slots_{};
+
+    std::atomic<int>      max_level_{ AV_LOG_WARNING };
+    std::atomic<int64_t>  interval_us_{ 100000 };    // 10 строк/с
+    std::atomic<int64_t>  tolerance_us_{ 2900000 };  // всплеск до 30 строк
+    std::atomic<bool>     installed_{ false };
+    const AVClass*        codec_class_ = nullptr;
+
+    Source orphan_;   // сообщения без источника: общий лимит
+
+    std::atomic<uint64_t> formatted_{ 0 }, suppressed_{ 0 }, unattributed_{ 0 };
 };
@@ -0,0 +1,81 @@
+#pragma once
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <vector>
+
+extern "C" {
+#include <libavformat/avformat.h>
+#include <libavcodec/avcodec.h>
+}
+
+namespace multiscreen {
+
+    struct GopStats {
+        bool     valid = false;         // кэш начинается с ключевого кадра
+        uint32_t packets = 0;           // видео и аудио от последнего ключевого кадра
+        uint64_t bytes = 0;
+        int      duration_ms = 0;       // от ключевого кадра до последнего видеопакета
+        bool     params = false;        // известны SPS/PPS/VPS
+        uint64_t gops = 0;              // ключевых кадров за всё время
+        uint64_t overflows = 0;         // GOP не влез в предел стрима или общий: кэш пуст до ключевого кадра
+    };
+
+    // Последний GOP стрима в памяти: пакеты демультиплексора (видео и аудио) от последнего
+    // ключевого кадра видео, по ссылке (av_packet_ref — буферы демультиплексора не копируются),
+    // плюс текущие наборы параметров видео. Новый потребитель (предпросмотр, миниатюра)
+    // берёт снимок и начинает декод сразу, а не со следующего ключевого кадра.
+    // Память ограничена на стрим и на процесс; GOP, не влезший в предел, не кэшируется целиком.
+    class GopCache {
+    public:
+        // Снимок: свои ссылки на пакеты (time_base заполнен), освобождаются в деструкторе
+        struct Snapshot {
+            std::vector<AVPacket*> packets;  // packets[0] — ключевой кадр видео
+            std::string params;              // SPS/PPS/VPS в формате входа (Annex B или extradata)
+            uint64_t gop = 0;                // номер GOP (GopStats::gops): тот же — тот же снимок
+            Snapshot() = default;
+            ~Snapshot();
+            Snapshot(const Snapshot&) = delete;
+            Snapshot& operator=(const Snapshot&) = delete;
+        };
+
+        // Секция "gop_cache" config.json
+        static void set_defaults(bool enable, size_t stream_bytes, size_t total_bytes) noexcept;
+        static bool enabled() noexcept;
+        static uint64_t total_bytes() noexcept;    // по всем стримам
+
+        GopCache() = default;
+        ~GopCache();
+        GopCache(const GopCache&) = delete;
+        GopCache& operator=(const GopCache&) = delete;
+
+        // --- поток стрима ---
+        void push(const AVFormatContext* in, int video_index, const AVPacket* pkt);
+        // Вход закрыт: индексы потоков и параметры больше не действительны
+        void reset();
+
+        // false — кэш пуст или не начинается с ключевого кадра
+        bool snapshot(Snapshot& out) const;
+        GopStats stats() const;
+
+    private:
+        void drop();                  // под m_mx
+        void scan_params(AVCodecID codec, const AVPacket* pkt);   // под m_mx
+
+        mutable std::mutex m_mx;
+        std::vector<AVPacket*> m_pkts;
+        std::vector<AVPacket*> m_spare;   // отпущенные пакеты: без av_packet_alloc на каждый
+        uint64_t m_bytes = 0;
+        bool     m_valid = false;
+        bool     m_init = false;          // параметры взяты из codecpar текущего входа
+        int64_t  m_key_ts = AV_NOPTS_VALUE;
+        int64_t  m_last_ts = AV_NOPTS_VALUE;
+        AVRational m_video_tb{ 1, 90000 };
+        std::string m_params;
+        uint64_t m_gops = 0;
+        uint64_t m_overflows = 0;
+    };
+
+} // namespace multiscreen
@@ -0,0 +1,109 @@
+#pragma once
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "GopCache.h"
+
+extern "C" {
+#include <libavformat/avformat.h>
+#include <libavcodec/avcodec.h>
+}
+
+namespace multiscreen {
+
+    struct PreviewStats {
+        bool     active = false;        // кто-то смотрел в пределах idle_timeout: пакеты идут в мультиплексор
+        uint32_t segments = 0;          // в кольце
+        uint64_t ring_bytes = 0;
+        uint64_t sequence = 0;          // номер последнего готового сегмента
+        uint64_t produced = 0;          // сегментов за всё время
+        uint64_t requests = 0;          // запросов плейлиста и сегментов
+        uint64_t mux_errors = 0;        // мультиплексор отказал (скачок dts и т.п.): сегмент с разрывом
+    };
+
+    // Предпросмотр канала в браузере: уже демультиплексированные пакеты стрима без декода
+    // и кодирования перепаковываются в MPEG-TS в памяти и режутся на сегменты HLS по ключевым
+    // кадрам видео. Готовые сегменты лежат в ограниченном кольце, WebServer отдаёт их и плейлист.
+    // Мультиплексор создаётся по первому запросу и закрывается, когда запросов не было
+    // idle_timeout секунд; без зрителей поток стрима платит одну атомарную загрузку на пакет.
+    class HlsPreview {
+    public:
+        struct Segment {
+            uint64_t seq = 0;
+            double   duration = 0.0;    // с
+            bool     discontinuity = false;
+            std::string data;
+        };
+
+        // Секция "preview" config.json
+        static void set_defaults(bool enable, double segment_seconds, int segments, int idle_timeout_s) noexcept;
+        static bool enabled() noexcept;
+
+        // gop — кэш последнего GOP стрима: первый сегмент собирается из него без ожидания ключевого кадра
+        explicit HlsPreview(const std::string& name, std::shared_ptr<GopCache> gop = nullptr);
+        ~HlsPreview();
+        HlsPreview(const HlsPreview&) = delete;
+        HlsPreview& operator=(const HlsPreview&) = delete;
+
+        // --- поток стрима ---
+        bool active() const noexcept { return m_active.load(std::memory_order_relaxed); }
+        void feed(const AVFormatContext* in, const AVPacket* pkt);
+        // Вход закрыт: мультиплексор закрывается, следующий сегмент — с разрывом
+        void reset();
+
+        // --- потоки HTTP: каждый запрос продлевает предпросмотр ---
+        // Первый запрос ждёт первый сегмент (ключевой кадр + segment_seconds);
+        // пустая строка — сегмент так и не появился или предпросмотр выключен
+        std::string playlist();
+        std::shared_ptr<const Segment> segment(uint64_t seq);
+
+        PreviewStats stats() const;
+
+    private:
+        void touch() noexcept;
+        bool open_mux(const AVFormatContext* in, const std::string& params);
+        void prime(const AVFormatContext* in, const GopCache::Snapshot& snap);
+        void write(const AVFormatContext* in, const AVPacket* pkt);
+        void close_mux();
+        void cut(double duration);
+        void idle();
+        static int write_cb(void* opaque, const uint8_t* buf, int size);
+
+        const std::string m_name;
+        const std::shared_ptr<GopCache> m_gop;
+
+        // поток стрима
+        AVFormatContext* m_oc = nullptr;
+        AVPacket*        m_pkt = nullptr;
+        std::vector<int> m_map;                 // индекс входного потока -> выходного (-1 — не берём)
+        int              m_lead = -1;           // по нему режем: видео, без видео — первый аудио
+        AVRational       m_lead_tb{ 1, 90000 };
+        int64_t          m_seg_start = AV_NOPTS_VALUE;   // в m_lead_tb
+        int64_t          m_lead_end = AV_NOPTS_VALUE;    // конец последнего записанного пакета m_lead
+        std::string      m_cur;                 // собирается write_cb
+        bool             m_discontinuity = false;
+        bool             m_failed = false;      // мультиплексор не открылся: до следующего входа не пробуем
+        uint64_t         m_bad_gop = 0;         // GOP кэша, на котором мультиплексор отказал: им не праймим
+        uint64_t         m_next_seq = 0;
+        uint64_t         m_errors = 0;
+
+        std::atomic<bool>    m_active{ false };
+        std::atomic<int64_t> m_last_access_ms{ 0 };   // steady
+        std::atomic<uint64_t> m_requests{ 0 };
+        std::atomic<uint64_t> m_errors_pub{ 0 };
+
+        mutable std::mutex m_mx;                // кольцо
+        std::condition_variable m_cv;           // новый сегмент
+        std::deque<std::shared_ptr<const Segment>> m_ring;
+        uint64_t m_ring_bytes = 0;
+        uint64_t m_produced = 0;
+        uint64_t m_disc_seq = 0;                // разрывов, ушедших из кольца (EXT-X-DISCONTINUITY-SEQUENCE)
+    };
+
+} // namespace multiscreen
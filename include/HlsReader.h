@@ -0,0 +1,132 @@
+#pragma once
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace httplib { class Client; }
+
+namespace multiscreen {
+
+    struct HlsStats {
+        std::string playlist;           // медиаплейлист (после выбора варианта из master)
+        int64_t  bandwidth = 0;         // BANDWIDTH выбранного варианта; 0 — master не было
+        bool     live = true;           // нет #EXT-X-ENDLIST
+        double   target_duration_s = 0.0;
+        int64_t  sequence = -1;         // media sequence сегмента, который сейчас отдаётся
+        uint64_t segments = 0;          // скачано сегментов
+        uint64_t bytes = 0;
+        uint64_t missing = 0;           // пропущено: выпали из плейлиста до скачивания или не скачались
+        uint64_t download_errors = 0;   // неудачных запросов сегментов (повторы тоже)
+        uint64_t slow_segments = 0;     // качался дольше собственной длительности
+        uint64_t discontinuities = 0;   // #EXT-X-DISCONTINUITY на отданных сегментах
+        uint64_t playlist_reloads = 0;
+        uint64_t playlist_errors = 0;
+        double   last_download_ms = 0.0;
+        double   avg_download_ms = 0.0; // EWMA
+        double   max_download_ms = 0.0;
+        int      stale_ms = 0;          // с последнего появления нового сегмента в плейлисте (live)
+        uint32_t inflight = 0;          // качается сейчас
+        uint32_t ready = 0;             // скачано и ждёт демультиплексора
+    };
+
+    // Собственный приём HLS (только MPEG-TS сегменты без шифрования): плейлист разбирается здесь,
+    // следующие сегменты качаются заранее несколькими потоками, у каждого своё keep-alive
+    // соединение. Демультиплексору сегменты отдаются по порядку media sequence одним потоком TS.
+    // Поток плейлиста перечитывает его раз в target duration (половину — если не изменился,
+    // RFC 8216, 6.3.4). Потоки создаются в open() и завершаются в close().
+    // read() — из одного потока (потока стрима); stats() — из любого.
+    class HlsReader {
+    public:
+        static constexpr int kMaxPrefetch = 8;
+
+        // Секция ingest.hls config.json: сегментов вперёд, таймаут запроса, старт live с N-го с конца
+        static void set_defaults(int prefetch, int timeout_ms, int live_start_segments) noexcept;
+        // http:// всегда; https:// — если httplib собран с OpenSSL
+        static bool supported(const std::string& url) noexcept;
+
+        HlsReader();
+        ~HlsReader();
+        HlsReader(const HlsReader&) = delete;
+        HlsReader& operator=(const HlsReader&) = delete;
+
+        // Первый плейлист (master -> вариант с наибольшим BANDWIDTH) и запуск потоков; id — номер
+        // стрима для записей лога. 0 или -errno; -ENOTSUP — плейлист не для этого приёма
+        // (шифрование, fMP4, byte-range): вход открывает FFmpeg
+        int  open(const std::string& url, const std::string& name, uint32_t id, std::string& err);
+        void close() noexcept;
+
+        // Байты TS подряд по сегментам: > 0 — сколько, 0 — за timeout_ms ничего, -ENODATA — конец VOD
+        int  read(uint8_t* buf, int size, int timeout_ms);
+
+        HlsStats stats() const;
+
+    private:
+        using Clock = std::chrono::steady_clock;
+        enum class SegState : uint8_t { Queued = 0, Loading, Ready, Failed };
+        struct Segment {
+            std::string uri;
+            double      duration = 0.0;
+            bool        discontinuity = false;
+            SegState    state = SegState::Queued;
+            int         attempts = 0;
+            Clock::time_point retry_at{};
+            std::string data;
+        };
+        struct Playlist;
+
+        static bool parse(const std::string& text, const std::string& base, Playlist& out);
+        void playlist_loop();
+        void worker_loop(int slot);
+        int  fetch(int slot, const std::string& url, std::string& body, std::string& final_url, std::string& err);
+        void apply(const Playlist& pl);   // под m_mx
+
+        // одно keep-alive соединение на поток: [0] — плейлист, дальше — загрузчики
+        struct Http {
+            std::unique_ptr<httplib::Client> cli;
+            std::string origin;
+            bool busy = false;           // Get в полёте: close() повторяет stop(), пока не вернётся
+        };
+        std::array<Http, kMaxPrefetch + 1> m_http;
+        std::mutex m_http_mx;            // клиенты, busy и проверка m_stop перед Get против close()
+
+        std::string m_name;
+        uint32_t    m_id = 0;
+        std::string m_playlist_url;
+        int         m_prefetch = 3;
+        int         m_timeout_ms = 5000;
+        int         m_live_start = 3;
+
+        std::thread m_playlist_thr;
+        std::vector<std::thread> m_workers;
+
+        mutable std::mutex m_mx;
+        std::condition_variable m_work_cv;    // загрузчикам: новые сегменты или сдвиг окна
+        std::condition_variable m_ready_cv;   // read(): сегмент скачан или провален
+        std::condition_variable m_reload_cv;  // потоку плейлиста: только остановка
+        std::atomic<bool> m_stop{ true };
+        std::map<int64_t, Segment> m_segments;   // от m_next_out вперёд
+        uint64_t    m_gen = 0;               // сброс нумерации: загрузки старого поколения выбрасываются
+        bool        m_positioned = false;
+        int64_t     m_next_out = 0;          // следующий сегмент для read()
+        int64_t     m_last_listed = -1;      // наибольший номер, который уже был в плейлисте
+        bool        m_ended = false;
+        double      m_target_s = 0.0;
+        Clock::time_point m_last_growth{};
+        bool        m_playlist_down = false;
+        HlsStats    m_stats;                 // под m_mx (кроме stale_ms/inflight/ready)
+        uint32_t    m_inflight = 0;
+
+        // текущий сегмент — только поток read()
+        std::string m_cur;
+        size_t      m_cur_pos = 0;
+    };
+
+} // namespace multiscreen
@@ -0,0 +1,79 @@
+#pragma once
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <string_view>
+#include <vector>
+
+#include "Logger.h"
+
+namespace multiscreen {
+
+    // Структурная запись журнала фиксированного размера (без аллокаций на запись)
+    struct LogRecord {
+        static constexpr size_t kMsgMax = 216;   // длиннее — обрезается
+
+        uint64_t seq = 0;         // сквозной номер в кольце, с 1
+        int64_t  ts_ms = 0;       // unix-время, мс
+        uint64_t prev = 0;        // seq предыдущей записи того же стрима (индекс по стриму)
+        uint32_t stream = kNoStream;
+        uint16_t code = 0;        // logcode::*
+        uint8_t  level = 0;       // LogLevel
+        uint8_t  len = 0;
+        char     msg[kMsgMax];
+
+        std::string_view message() const noexcept { return { msg, len }; }
+    };
+
+    struct LogQuery {
+        uint32_t stream = kNoStream;   // kNoStream = все
+        LogLevel min_level = LogLevel::Debug;
+        uint16_t code = 0;             // 0 = любой
+        int64_t  since_ms = 0;         // 0 = без нижней границы
+        int64_t  until_ms = 0;         // 0 = без верхней границы
+        uint64_t after_seq = 0;
+        size_t   limit = 200;
+    };
+
+    // Кольцо последних записей лога, выделенное заранее. Пишет только поток записи Logger
+    // (пакетом, в порядке seq), читают HTTP-обработчики. Для каждого стрима записи связаны
+    // цепочкой prev от головы heads[id], так что выборка по стриму не просматривает чужие записи.
+    class LogRing {
+    public:
+        static LogRing& instance();
+
+        // Ёмкость (записей); при смене кольцо очищается
+        void reserve(size_t capacity);
+        size_t capacity() const;
+
+        void append(int64_t ts_ms, LogLevel level, uint32_t stream, uint16_t code, std::string_view msg);
+        void publish();   // разбудить ожидающих tail после пакета
+
+        // Последние limit подходящих записей с seq > after_seq, по возрастанию seq
+        std::vector<LogRecord> latest(const LogQuery& q) const;
+        // Первые limit подходящих записей после after_seq, по возрастанию seq (для tail).
+        // *scanned — до какого seq кольцо просмотрено: с него продолжать следующий запрос.
+        std::vector<LogRecord> after(const LogQuery& q, uint64_t* scanned) const;
+
+        // Ждать записей новее after_seq; false — таймаут
+        bool wait(uint64_t after_seq, std::chrono::milliseconds timeout) const;
+        uint64_t last_seq() const;
+
+        // id стрима выдан заново — старая история к новому стриму не цепляется
+        void forget_stream(uint32_t stream);
+
+    private:
+        LogRing();
+
+        bool match(const LogRecord& r, const LogQuery& q) const noexcept;
+        const LogRecord* at_unlocked(uint64_t seq) const noexcept;
+
+        mutable std::mutex              m_mx;
+        mutable std::condition_variable m_cv;
+        std::vector<LogRecord> m_slots;
+        std::vector<uint64_t>  m_heads;   // индекс = id стрима, значение = seq последней записи
+        uint64_t               m_last = 0;
+    };
+
+} // namespace multiscreen
@@ -1,44 +1,97 @@
 #pragma once
 #include <string>
-#include <fstream>
-#include <deque>
 #include <vector>
-#include <mutex>
 #include <chrono>
-#include <filesystem>
+#include <cstdint>
 
 namespace multiscreen {
 
     enum class LogLevel { Debug, Info, Warning, Error };
 
+    // id стрима в реестре для записей вне контекста стрима
+    inline constexpr uint32_t kNoStream = 0xFFFFFFFFu;
+
+    // Коды событий для структурного журнала (/api/logs?code=…); 0 — произвольное сообщение
+    namespace logcode {
+        inline constexpr uint16_t None = 0;
+        inline constexpr uint16_t StreamOpened = 100;
+        inline constexpr uint16_t StreamOpenFailed = 101;
+        inline constexpr uint16_t StreamInputLost = 102;
+        inline constexpr uint16_t StreamStopped = 103;
+        inline constexpr uint16_t StreamRemoved = 104;
+        inline constexpr uint16_t Watchdog = 200;
+        inline constexpr uint16_t FFmpeg = 300;
+    }
+
     struct LogEntry {
         std::chrono::system_clock::time_point ts;
         LogLevel level;
         std::string message;
     };
 
+    // Параметры записи и ротации (секция "logging" в config.json)
+    struct LogOptions {
+        std::string file = "logs/app.log";
+        LogLevel    min_level = LogLevel::Debug;
+        uint64_t    max_bytes = 64ull << 20;   // ротация по размеру (0 = выкл.)
+        int         max_files = 5;             // app.log.1 … app.log.N
+        int         rotate_hours = 24;         // ротация по времени (0 = выкл.)
+        int         flush_ms = 200;            // максимум задержки записи на диск
+        size_t      thread_buffer = 256;       // записей в буфере одного потока
+        size_t      ring_capacity = 8192;      // записей в памяти для /api/logs (см. LogRing)
+    };
+
+    struct LogStats {
+        uint64_t written = 0;     // строк записано в файл
+        uint64_t dropped = 0;     // потеряно из-за переполнения буферов потоков
+        uint64_t bytes = 0;       // размер текущего файла
+        uint64_t rotations = 0;
+        uint64_t batches = 0;     // число пакетных записей (write + flush)
+        size_t   threads = 0;     // потоков с активным буфером
+    };
+
+    // Асинхронный логгер: log() кладёт запись в lock-free буфер своего потока и не трогает файл;
+    // фоновый поток собирает буферы пакетом, форматирует (время кэшируется по секундам),
+    // пишет одним write + flush и ротирует файл по размеру/времени.
+    // При переполнении буфера запись не теряется молча: растёт счётчик dropped, а в лог
+    // попадает строка с числом потерь.
     class Logger {
     public:
-        // /    log()
         static void initialize(const std::string& filename = "logs/app.log");
+        static void initialize(const LogOptions& opts);
+        // Сменить параметры на лету (уровень, ротация; новый файл — со следующего пакета)
+        static void configure(const LogOptions& opts);
+        // Дописывает всё накопленное и останавливает поток записи
         static void shutdown();
 
+        // Без явного стрима запись берёт id из StreamScope текущего потока
         static void log(LogLevel level, const std::string& message);
+        static void log(LogLevel level, uint32_t stream, uint16_t code, const std::string& message);
         static inline void debug(const std::string& m) { log(LogLevel::Debug, m); }
         static inline void info(const std::string& m) { log(LogLevel::Info, m); }
         static inline void warning(const std::string& m) { log(LogLevel::Warning, m); }
         static inline void error(const std::string& m) { log(LogLevel::Error, m); }
 
         static std::vector<LogEntry> getRecentLogs(size_t count = 50);
+        static LogStats stats();
 
-    private:
-        // : recursive_mutex + try_lock      
-        static std::recursive_mutex s_mutex;
-        static std::ofstream        s_file;
-        static std::deque<LogEntry> s_recent;
-        static constexpr size_t     s_max_recent = 1000;
+        static LogLevel parseLevel(const std::string& s, LogLevel def = LogLevel::Info);
+        static const char* levelName(LogLevel l) { return levelToStr(l); }
 
+        // Контекст потока: всё, что поток стрима пишет в лог, привязывается к его id
+        class StreamScope {
+        public:
+            explicit StreamScope(uint32_t stream);
+            ~StreamScope();
+            StreamScope(const StreamScope&) = delete;
+            StreamScope& operator=(const StreamScope&) = delete;
+        private:
+            uint32_t m_prev;
+        };
+
+    private:
         static const char* levelToStr(LogLevel l);
+        static void writer_loop();
     };
 
 } // namespace multiscreen
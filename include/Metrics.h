@@ -2,34 +2,36 @@
 #include <cstdint>
 #include <cstddef>
 #include <deque>
-#include <unordered_map>
 #include <mutex>
 #include <atomic>
+#include <utility>
+
+#include "TsScanner.h"
 
 namespace multiscreen {
 
-    //     /.
-    //    :
-    //  - onFrameRendered(pts_ms)        ( FPS  stall)
-    //  - onPacketTs(pkt, len)          TS- 188  ( CC errors)
-    //  - onBytesReceived(bytes)         ( stall)
-    //  - pollAndAlert(name)               
+    // Универсальные метрики для одного процесса/инстанса.
+    // Вызывайте из своих обработчиков:
+    //  - onFrameRendered(pts_ms)    — когда кадр показан (для FPS и stall)
+    //  - onPacketTs(data, len)      — TS-данные любыми кусками, лучше пачкой пакетов (для CC errors)
+    //  - onBytesReceived(bytes)     — при сетевом прогрессе (для stall)
+    //  - pollAndAlert(name)         — периодическая проверка порогов и отправка алертов
     //
-    //  UI    renderFps(), ccErrorsPerMin(), stallMsNow().
+    // В UI можете дергать геттеры renderFps(), ccErrorsPerMin(), stallMsNow().
     class Metrics {
     public:
         static Metrics& instance();
 
-        // ---   ---
+        // --- Интеграционные вызовы ---
         void setExpectedFps(int fps) noexcept;
         void onFrameRendered(int64_t pts_ms) noexcept;
         void onBytesReceived(size_t bytes) noexcept;
         void onPacketTs(const uint8_t* pkt, size_t len) noexcept;
 
-        // ---     ---
+        // --- Периодический опрос и алерты ---
         void pollAndAlert(const char* name);
 
-        // ---   UI/REST ---
+        // --- Геттеры для UI/REST ---
         double  renderFps(double window_sec = 2.0) const noexcept;
         int     ccErrorsPerMin() const noexcept;
         int64_t stallMsNow() const noexcept;
@@ -46,24 +48,17 @@ namespace multiscreen {
         std::atomic<int64_t> m_last_progress_ms_{ 0 };
 
         // ====== CC errors ======
-        struct CcState {
-            bool     valid = false;
-            uint8_t  last_cc = 0;
-        };
+        // Разбор TS пачкой (TsScanner); мьютекс берётся один раз на вызов, а не на пакет
         mutable std::mutex m_cc_mu_;
-        std::unordered_map<uint16_t, CcState> m_cc_map_;
-        //   const- ccErrorsPerMin()   mutable
-        mutable std::deque<int64_t> m_cc_err_times_ms_;
+        TsScanner m_ts_;
+        uint64_t  m_ts_cc_seen_ = 0;
+        // (время, число ошибок); модифицируется в const-методе ccErrorsPerMin() — помечаем mutable
+        mutable std::deque<std::pair<int64_t, uint32_t>> m_cc_err_times_ms_;
 
         // ====== helpers ======
         static int64_t nowMsSteady() noexcept;
 
-        void handleTsPacket(const uint8_t* pkt, size_t len) noexcept;
-        static bool tsParseHeader(const uint8_t* pkt, size_t len,
-            uint16_t& pid, bool& payload_present,
-            bool& discontinuity, uint8_t& cc) noexcept;
-
-        void noteCcError() noexcept;
+        void noteCcErrors(uint32_t count) noexcept;
         void gcWindows_() noexcept;
     };
 
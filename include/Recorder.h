@@ -0,0 +1,221 @@
+#pragma once
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <deque>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "TsScanner.h"
+
+namespace multiscreen {
+
+    // Секция "recorder" config.json
+    struct RecorderOptions {
+        bool        enable = false;
+        std::string dir = "recordings";
+        std::vector<std::string> streams;   // пусто — все стримы
+        uint64_t    segment_bytes = 64ull << 20;
+        uint64_t    buffer_bytes = 8ull << 20;        // кольцо блоков на стрим
+        uint64_t    stream_quota_bytes = 4096ull << 20;
+        uint64_t    total_quota_bytes = 32768ull << 20;
+        int         max_age_hours = 0;                // 0 — только квоты
+        int         flush_ms = 5000;                  // неполный блок уходит на диск не позже
+        bool        direct_io = true;                 // O_DIRECT, где ФС его принимает
+    };
+
+    struct RecordStats {
+        bool     active = false;        // стрим записывается
+        bool     direct_io = false;     // текущий сегмент пишется мимо page cache
+        uint64_t bytes_in = 0;          // принято от TsScanner
+        uint64_t written = 0;           // записано на диск
+        uint64_t dropped_bytes = 0;     // отброшено: кольцо полно (диск не успевает) или ошибка записи
+        uint64_t drop_events = 0;
+        uint64_t write_errors = 0;
+        uint32_t buffer_blocks = 0;
+        uint32_t buffer_used = 0;       // блоков ждут записи
+        uint32_t segments = 0;          // файлов на диске
+        uint64_t disk_bytes = 0;
+        int64_t  oldest_ms = 0;         // unix-мс начала самой старой записи
+        int64_t  newest_ms = 0;         // unix-мс конца последнего записанного блока
+    };
+
+    struct RecorderTotals {
+        bool     enabled = false;
+        std::string dir;
+        uint32_t streams = 0;           // каталогов стримов (в том числе без живого канала)
+        uint32_t segments = 0;
+        uint64_t disk_bytes = 0;
+        uint64_t total_quota_bytes = 0;
+        uint64_t deleted_segments = 0;  // вытеснено квотами и сроком хранения
+        double   avg_write_ms = 0.0;    // EWMA записи одного блока
+        double   max_write_ms = 0.0;
+    };
+
+    struct RecordSegmentInfo {
+        int64_t  start_ms = 0;
+        int64_t  end_ms = 0;
+        uint64_t bytes = 0;
+    };
+
+    // Кусок файла для выдачи записи за интервал
+    struct RecordPiece {
+        std::string path;
+        uint64_t    offset = 0;
+        uint64_t    length = 0;
+    };
+
+    // Запись одного стрима. Поток стрима (через TsScanner) копирует проверенные пакеты в кольцо
+    // блоков kBlock, выровненных под O_DIRECT; полный блок отдаётся потоку Recorder.
+    // Свободного блока нет — данные отбрасываются с учётом, ingest никогда не ждёт диск.
+    // Блок — целое число пакетов TS, так что каждый блок и каждый сегмент начинаются с 0x47.
+    class RecordChannel final : public TsPacketSink {
+    public:
+        static constexpr size_t kAlign = 4096;
+        static constexpr size_t kBlock = TsScanner::kPacket * kAlign;   // 752 КБ
+
+        RecordChannel(std::string name, std::string key, size_t blocks, int64_t flush_us);
+        ~RecordChannel() override;
+        RecordChannel(const RecordChannel&) = delete;
+        RecordChannel& operator=(const RecordChannel&) = delete;
+
+        const std::string& name() const noexcept { return m_name; }
+
+        void on_ts_packets(const uint8_t* base, const uint32_t* keys, size_t n, int64_t now_us) noexcept override;
+        void on_ts_sync_error(int64_t) noexcept override {}
+        void on_ts_chunk(int64_t now_us) noexcept override;
+
+        // Отдать неполный блок (вход закрыт): из потока стрима
+        void flush() noexcept;
+
+    private:
+        friend class Recorder;
+
+        struct Block {
+            uint8_t* data = nullptr;
+            uint32_t len = 0;
+            int64_t  first_ms = 0;      // unix-мс первого пакета
+            int64_t  last_ms = 0;       // unix-мс запечатывания
+        };
+
+        void append(const uint8_t* p, size_t len, int64_t now_us) noexcept;
+        void seal() noexcept;
+
+        const std::string m_name;
+        const std::string m_key;        // каталог стрима
+        const int64_t     m_flush_us;
+        std::unique_ptr<uint8_t, void (*)(uint8_t*)> m_slab;
+        std::vector<Block> m_blocks;
+
+        // кольцо SPSC: [m_tail, m_head) запечатаны и ждут записи
+        std::atomic<uint64_t> m_head{ 0 };
+        std::atomic<uint64_t> m_tail{ 0 };
+
+        // поток стрима
+        bool     m_open = false;        // блок m_head заполняется
+        bool     m_dropping = false;
+        int64_t  m_open_us = 0;
+        uint64_t m_in = 0, m_dropped = 0, m_drop_events = 0;
+
+        // поток Recorder
+        struct Writer {
+            bool     open = false;
+            bool     direct = false;
+            int      fd = -1;
+            std::FILE* file = nullptr; // без O_DIRECT на других платформах
+            std::FILE* idx = nullptr;
+            int64_t  seg_start = 0;     // SegFile::start_ms текущего сегмента
+            uint64_t offset = 0;
+            int64_t  retry_ms = 0;      // после ошибки: не открывать сегмент раньше
+            bool     failing = false;   // ошибка уже в журнале
+        } m_w;
+        std::atomic<bool> m_closed{ false };
+
+        struct Shared {
+            std::atomic<uint64_t> in{ 0 }, dropped{ 0 }, drop_events{ 0 }, written{ 0 }, write_errors{ 0 }, writer_dropped{ 0 };
+            std::atomic<bool>     direct{ false };
+        } m_shared;
+    };
+
+    // Непрерывная запись сырого TS стримов в сегменты фиксированного размера:
+    //   <dir>/<стрим>/<unix-мс начала>.ts и рядом .idx — смещение и время каждого блока.
+    // Один поток пишет блоки всех каналов (O_DIRECT для полных блоков; неполный переводит
+    // остаток сегмента на обычную запись), закрывает сегменты и вытесняет старые по квоте
+    // стрима, общей квоте и сроку хранения. Каталог переживает перезапуск: индекс читается в start().
+    class Recorder {
+    public:
+        static Recorder& instance();
+
+        void configure(const RecorderOptions& opts);   // до start() и до создания стримов
+        void start();
+        void stop();
+        bool enabled() const noexcept { return m_enabled.load(std::memory_order_relaxed); }
+
+        // Канал записи стрима; nullptr — запись выключена или стрим не в списке
+        std::shared_ptr<RecordChannel> attach(const std::string& stream);
+        // Поток стрима завершён: дописать остаток и закрыть сегмент
+        void detach(const std::shared_ptr<RecordChannel>& ch);
+
+        RecordStats stats(const RecordChannel& ch) const;
+        RecorderTotals totals() const;
+        std::vector<RecordSegmentInfo> segments(const std::string& stream) const;
+        // Куски файлов, покрывающие [from_ms, to_ms] (unix-мс) с точностью до блока;
+        // данные ещё в кольце не входят. false — записей стрима нет
+        bool find(const std::string& stream, int64_t from_ms, int64_t to_ms, std::vector<RecordPiece>& out) const;
+
+    private:
+        Recorder() = default;
+        ~Recorder();
+
+        struct IndexEntry {
+            uint64_t offset = 0;
+            int64_t  first_ms = 0;
+        };
+        struct SegFile {
+            std::string path;
+            int64_t  start_ms = 0;
+            int64_t  end_ms = 0;
+            uint64_t bytes = 0;
+            bool     open = false;      // пишется каналом: не вытесняется
+            std::vector<IndexEntry> index;
+        };
+        struct Store {
+            std::deque<SegFile> segs;   // по времени начала
+            uint64_t bytes = 0;
+        };
+
+        void run();
+        bool drain(RecordChannel& ch);
+        SegFile* current(RecordChannel& ch);   // под m_mx
+        void write_block(RecordChannel& ch, const RecordChannel::Block& b);
+        bool open_segment(RecordChannel& ch, int64_t start_ms);
+        void close_segment(RecordChannel& ch);
+        void enforce_retention();          // под m_mx
+        void drop_front(Store& st);        // под m_mx
+        void scan_dir();
+
+        RecorderOptions m_opts;
+        uint64_t m_segment_bytes = 0;     // кратно RecordChannel::kBlock
+        std::atomic<bool> m_enabled{ false };
+
+        std::thread m_thr;
+        std::atomic<bool> m_run{ false };
+        std::mutex m_wait_mx;
+        std::condition_variable m_cv;
+
+        mutable std::mutex m_mx;                              // m_stores, m_channels, итоги
+        std::map<std::string, Store> m_stores;                // ключ — каталог стрима
+        std::vector<std::shared_ptr<RecordChannel>> m_channels;
+        uint64_t m_total_bytes = 0;
+        uint64_t m_deleted = 0;
+        double   m_avg_write_ms = 0.0;
+        double   m_max_write_ms = 0.0;
+    };
+
+} // namespace multiscreen
@@ -0,0 +1,73 @@
+#pragma once
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+
+namespace multiscreen {
+
+    class RtpReorder;
+
+    // Декодер SMPTE 2022-1 (столбцы и строки XOR, заголовок FEC из RFC 2733 с расширением):
+    // FEC-пакеты хранятся в кольце фиксированного размера, защищаемые пакеты берутся из окна
+    // RtpReorder. Когда в группе не хватает ровно одного номера и он уже дыра (после него
+    // что-то пришло), номер собирается XOR полезных нагрузок и ложится в окно; восстановленный
+    // пакет может закрыть группу другого направления (строка <-> столбец).
+    // Живёт внутри RtpReorder и вызывается только из его потока.
+    class RtpFec {
+    public:
+        static constexpr size_t kEntries = 64;
+
+        explicit RtpFec(RtpReorder& owner);
+        RtpFec(const RtpFec&) = delete;
+        RtpFec& operator=(const RtpFec&) = delete;
+
+        void reset() noexcept;
+        bool active() const noexcept { return m_packets != 0; }
+
+        // Новый номер в окне (принят или восстановлен)
+        void media(uint16_t seq) noexcept;
+        // FEC-пакет целиком (RTP + заголовок FEC); false — не FEC 2022-1
+        bool fec(const uint8_t* data, uint32_t len, int64_t arrival_us) noexcept;
+        // Перебрать группы, которых коснулись media()/fec(), и восстановить что можно
+        void resolve(int64_t now_us) noexcept;
+
+        uint64_t packets() const noexcept { return m_packets; }
+        uint64_t recovered() const noexcept { return m_recovered; }
+        uint32_t cols() const noexcept { return m_cols; }
+        uint32_t rows() const noexcept { return m_rows; }
+
+    private:
+        struct Entry {
+            uint16_t base = 0;          // SNBase
+            uint8_t  offset = 0;        // шаг номеров: L для столбца, 1 для строки
+            uint8_t  na = 0;            // сколько пакетов защищено
+            uint16_t len_rec = 0;       // XOR длин полезных нагрузок
+            uint32_t len = 0;           // длина полезной нагрузки FEC
+            uint16_t wait_seq = 0;      // единственный недостающий, пока он ещё не дыра
+            bool     pending = false;   // группа не закрыта
+            bool     check = false;     // пересмотреть при resolve()
+            bool     waiting = false;
+        };
+
+        bool covers(const Entry& e, uint16_t seq) const noexcept;
+        bool try_recover(Entry& e, size_t index, int64_t now_us) noexcept;
+        uint8_t* entry_data(size_t i) noexcept { return m_slab.get() + i * kPayload; }
+
+        static constexpr size_t kPayload = 2048;
+        using XorFn = void (*)(uint8_t* dst, const uint8_t* src, size_t n) noexcept;
+
+        RtpReorder& m_owner;
+        XorFn    m_xor;
+        std::unique_ptr<uint8_t[]> m_slab;     // kEntries * kPayload
+        std::array<uint8_t, kPayload> m_work{};
+        std::array<Entry, kEntries> m_entries{};
+        size_t   m_next = 0;                   // куда ляжет следующий FEC-пакет
+        bool     m_dirty = false;
+        uint64_t m_packets = 0;
+        uint64_t m_recovered = 0;
+        uint32_t m_cols = 0;
+        uint32_t m_rows = 0;
+    };
+
+} // namespace multiscreen
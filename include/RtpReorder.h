@@ -0,0 +1,202 @@
+#pragma once
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+
+#include "UdpReceiver.h"
+
+namespace multiscreen {
+
+    class RtpFec;
+
+    // Одна ветвь входа (для слияния SMPTE 2022-7 — их две)
+    struct RtpLegStats {
+        uint64_t packets = 0;
+        uint64_t lost = 0;          // ожидалось по номерам минус принято (RFC 3550, прил. A.3)
+        double   jitter_ms = 0.0;   // interarrival jitter (RFC 3550, 6.4.1), часы 90 кГц
+        bool     up = false;        // пакеты были за последнюю секунду
+    };
+
+    struct RtpStats {
+        uint64_t packets = 0;       // датаграмм с корректным заголовком RTP (все ветви)
+        uint64_t lost = 0;          // номеров, которые так и не пришли (пропущены по окну или таймауту)
+        uint64_t reordered = 0;     // пришли после большего номера, но успели в окно
+        uint64_t duplicates = 0;    // повтор в той же ветви; копия из другой ветви — не дубль
+        uint64_t late = 0;          // пришли, когда их номер уже пропущен
+        uint64_t invalid = 0;       // не RTP v2, битый заголовок, скачок номера
+        uint32_t resyncs = 0;       // смена SSRC или скачок номера (RFC 3550, прил. A.1)
+        uint32_t ssrc = 0;
+        int      payload_type = -1;
+        double   jitter_ms = 0.0;   // jitter основной ветви
+        uint32_t held = 0;          // сейчас задержано в буфере
+
+        // слияние SMPTE 2022-7
+        bool     merge = false;
+        std::array<RtpLegStats, 2> legs{};
+        uint64_t recovered = 0;     // номеров, которые основная ветвь так и не принесла
+        double   skew_ms = 0.0;     // приход (запасная - основная), сглаженный; > 0 — запасная отстаёт
+        double   skew_max_ms = 0.0; // наибольший |skew| за последнюю секунду
+
+        // SMPTE 2022-1 FEC
+        bool     fec = false;             // FEC-пакеты приходят
+        uint64_t fec_packets = 0;
+        uint64_t fec_recovered = 0;       // номеров восстановлено XOR
+        uint64_t fec_unrecoverable = 0;   // дыр, которые FEC не закрыл (входят в lost)
+        uint32_t fec_cols = 0;            // L и D матрицы по заголовкам FEC
+        uint32_t fec_rows = 0;
+    };
+
+    // Полезная нагрузка RTP в порядке номеров; data живёт до следующего push()
+    struct RtpPayload {
+        const uint8_t* data = nullptr;
+        uint32_t       len = 0;
+        int64_t        arrival_us = 0;
+    };
+
+    // Буфер переупорядочивания RTP фиксированного размера: ячейки по kSlotSize, выделяются
+    // в конструкторе. Пакет со следующим номером отдаётся прямо из датаграммы (без копии),
+    // копируются только пришедшие раньше своей очереди. Дыра ждёт, пока задержанных меньше
+    // окна и самый старый из них моложе предельной задержки; потом считается потерей.
+    //
+    // В режиме слияния (merge) пакеты двух ветвей с одинаковой нумерацией идут в один буфер:
+    // первая пришедшая копия отдаётся, вторая только учитывается (расхождение ветвей по
+    // времени). Окно — ingest.rtp.merge_packets (до kMaxMergeSlots), задержка — max_skew_ms.
+    //
+    // С FEC (SMPTE 2022-1) окно заодно служит историей для XOR: пока приходят FEC-пакеты,
+    // каждый пакет копируется в ячейку, а восстановленные RtpFec номера ложатся в дыры.
+    //
+    // Все методы — из одного потока; stats() — из любого.
+    // Порядок работы: push() только когда peek() вернул nullptr; push() == false —
+    // сначала выбрать peek()/pop() то, что буфер отпустил, и повторить push() с той же датаграммой.
+    class RtpReorder {
+    public:
+        static constexpr size_t kSlots = 64;
+        static constexpr size_t kMaxMergeSlots = 8192;
+        static constexpr size_t kSlotSize = UdpReceiver::kMaxDatagram;
+        static constexpr int    kLegs = 2;
+
+        // Глубина окна (пакетов, 1..kSlots) и предельная задержка дыры (секция ingest.rtp config.json)
+        static void set_defaults(int depth, int max_delay_ms) noexcept;
+        // Окно слияния (пакетов) и допустимое расхождение ветвей; окно действует на новые буферы
+        static void set_merge_defaults(int slots, int max_skew_ms) noexcept;
+        // FEC: разбирать ли столбцы/строки (порты +2/+4), окно и ожидание дыры при живом FEC
+        static void set_fec_defaults(bool enable, int slots, int max_delay_ms) noexcept;
+        static bool fec_enabled() noexcept;
+
+        explicit RtpReorder(bool merge = false, bool fec = false);
+        ~RtpReorder();
+        RtpReorder(const RtpReorder&) = delete;
+        RtpReorder& operator=(const RtpReorder&) = delete;
+
+        bool merge() const noexcept { return m_merge; }
+        bool fec() const noexcept { return m_fec != nullptr; }
+
+        // Новый вход: номер, SSRC и задержанное забываются, счётчики сохраняются
+        void reset() noexcept;
+
+        bool push(const uint8_t* data, uint32_t len, int64_t arrival_us, int leg = 0) noexcept;
+        // Датаграмма из потока FEC (столбцы или строки); можно звать в любой момент
+        void push_fec(const uint8_t* data, uint32_t len, int64_t arrival_us) noexcept;
+        // Отпустить дыры, которые ждут дольше предельной задержки (зовётся и без новых пакетов)
+        void expire(int64_t now_us) noexcept;
+
+        const RtpPayload* peek() noexcept;
+        void pop() noexcept;
+
+        RtpStats stats() const noexcept;
+
+    private:
+        struct Slot {
+            uint32_t len = 0;
+            int64_t  arrival_us = 0;    // первой копии
+            uint16_t seq = 0;
+            uint8_t  legs = 0;          // ветви, от которых номер пришёл; kFecLeg — восстановлен
+            bool     used = false;      // данные лежат в ячейке и ещё не отданы
+            bool     kept = false;      // в ячейке полезная нагрузка именно seq (история для FEC)
+            bool     skipped = false;   // номер пропущен как потерянный: повтор — опоздание
+        };
+
+        // Нумерация ветви (RFC 3550, прил. A.1/A.3) и jitter
+        struct Leg {
+            bool     started = false;
+            uint16_t max_seq = 0;
+            uint32_t cycles = 0;
+            uint32_t base = 0;
+            uint64_t received = 0;      // с начала текущей нумерации
+            uint64_t lost_before = 0;   // потери предыдущих нумераций
+            uint32_t ssrc = 0;
+            int32_t  bad_seq = -1;      // кандидат на перезапуск нумерации
+            bool     jit_valid = false;
+            double   jit_transit = 0.0;
+            double   jitter = 0.0;      // тики 90 кГц
+            int64_t  last_us = 0;
+            uint64_t packets = 0;
+            uint64_t lost() const noexcept;
+        };
+
+        friend class RtpFec;
+        static constexpr uint8_t kFecLeg = 0x80;
+        static constexpr uint8_t kLegMask = (1u << kLegs) - 1;
+
+        // для RtpFec: полезная нагрузка принятого номера, нужен ли номер, вставка восстановленного
+        const uint8_t* fec_payload(uint16_t seq, uint32_t& len) noexcept;
+        bool fec_wanted(uint16_t seq) noexcept;
+        void fec_insert(uint16_t seq, const uint8_t* data, uint32_t len, int64_t arrival_us) noexcept;
+
+        void leg_sequence(Leg& l, uint16_t seq) noexcept;
+        void skew_sample(int leg, int64_t first_us, int64_t arrival_us) noexcept;
+        void skip_one() noexcept;
+        void publish() noexcept;
+        Slot& slot(uint16_t seq) noexcept { return m_slots[seq % m_capacity]; }
+        uint8_t* slot_data(uint16_t seq) noexcept { return m_slab.get() + (seq % m_capacity) * kSlotSize; }
+
+        const bool m_merge;
+        const size_t m_capacity;
+        std::unique_ptr<uint8_t[]> m_slab;
+        std::unique_ptr<Slot[]> m_slots;
+        size_t   m_depth = 32;
+        int64_t  m_max_delay_us = 50000;
+        int64_t  m_fec_delay_us = 0;    // ожидание дыры, пока FEC жив
+        std::unique_ptr<RtpFec> m_fec;
+
+        bool     m_started = false;
+        uint16_t m_expected = 0;        // следующий отдаваемый номер
+        uint32_t m_held = 0;
+        std::array<Leg, kLegs> m_legs{};
+
+        RtpPayload m_direct;            // пакет с номером m_expected прямо из датаграммы
+        bool     m_has_direct = false;
+        RtpPayload m_view;              // выдача из ячейки
+
+        bool     m_skipping = false;    // отпускаем окно до m_skip_to
+        uint16_t m_skip_to = 0;
+        bool     m_flush = false;       // перезапуск: отпустить всё задержанное
+
+        // расхождение ветвей
+        double   m_skew_us = 0.0;
+        bool     m_skew_valid = false;
+        double   m_skew_peak_us = 0.0;
+        double   m_skew_max_us = 0.0;   // опубликованный максимум прошлого окна
+        int64_t  m_skew_win_us = 0;
+
+        RtpStats m_local;
+        struct Shared {
+            std::atomic<uint64_t> packets{ 0 }, lost{ 0 }, reordered{ 0 }, duplicates{ 0 }, late{ 0 }, invalid{ 0 }, recovered{ 0 };
+            std::atomic<uint32_t> resyncs{ 0 }, ssrc{ 0 }, held{ 0 };
+            std::atomic<int>      payload_type{ -1 };
+            std::atomic<double>   skew_ms{ 0.0 }, skew_max_ms{ 0.0 };
+            std::atomic<bool>     fec{ false };
+            std::atomic<uint64_t> fec_packets{ 0 }, fec_recovered{ 0 }, fec_unrecoverable{ 0 };
+            std::atomic<uint32_t> fec_cols{ 0 }, fec_rows{ 0 };
+            struct LegShared {
+                std::atomic<uint64_t> packets{ 0 }, lost{ 0 };
+                std::atomic<double>   jitter_ms{ 0.0 };
+                std::atomic<int64_t>  last_us{ 0 };
+            };
+            std::array<LegShared, kLegs> legs;
+        } m_shared;
+    };
+
+} // namespace multiscreen
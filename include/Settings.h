@@ -1,6 +1,8 @@
 #pragma once
 #include <string>
 #include <cstdint>
+#include <memory>
+#include <atomic>
 
 namespace multiscreen {
 
@@ -8,45 +10,97 @@ namespace multiscreen {
         // Singleton
         static Settings& instance();
 
-        //  UI-  config/settings.json
-        //  true   (    ).
+        // Загрузка UI-схемы из config/settings.json.
+        // Разбирает файл один раз, собирает новый неизменяемый снимок и атомарно его публикует.
+        // Возвращает true при успехе (при ошибке — остаётся предыдущий снимок/дефолты).
         bool load(const std::string& path);
 
-        // ---  (UI)   ---
+        // --- ЕДИНАЯ (UI) схема настроек ---
         struct Thresholds {
-            struct FPS { double warn_ratio = 0.75; double crit_ratio = 0.50; } fps;
-            struct Bitrate { int    warn_kbps = 1500; int    crit_kbps = 500; } bitrate;
-            struct Stall { int    warn_ms = 1000; int    crit_ms = 3000; } stall;
+            struct FPS { double warn_ratio = 0.70; double crit_ratio = 0.40; } fps;
+            struct Bitrate { int    warn_kbps = 300; int    crit_kbps = 100; } bitrate;
+            struct Stall { int    warn_ms = 3000; int    crit_ms = 7000; } stall;
+            // тайминг входа по TS-ответвлению; 0 — порог не проверяется
+            struct PcrJitter { double warn_ms = 25.0; double crit_ms = 100.0; } pcr_jitter;
+            struct Mdi {
+                double df_warn_ms = 50.0;  double df_crit_ms = 150.0;   // delay factor
+                double mlr_warn = 1.0;     double mlr_crit = 10.0;      // потерянных пакетов TS/с
+            } mdi;
         };
 
         struct Webhook {
             bool        enabled = false;
             std::string url;
-            int         timeout_ms = 2000;
-            int         cooldown_sec = 60; //  cooldown  
+            int         timeout_ms = 1500;
+            int         cooldown_sec = 60; // поддерживаем cooldown для совместимости
+            int         batch_window_ms = 200; // события в пределах окна уходят одним POST
+            int         max_batch = 50;
+            int         queue_capacity = 1024; // читается один раз при старте диспетчера
         };
 
-        const Thresholds& thresholds() const noexcept { return m_thresholds; }
-        const Webhook& webhook()   const noexcept { return m_webhook; }
+        // Дисковая очередь недоставленных вебхуков
+        struct Outbox {
+            bool        enabled = true;
+            std::string dir = "alerts_outbox";
+            int         segment_kb = 1024;
+            int         max_mb = 64;             // потолок на диске; сверх него — вытеснение старых
+            int         backoff_initial_ms = 500;
+            int         backoff_max_ms = 60000;
+        };
+
+        // Автоматы алертов по (stream, condition): гистерезис, выдержка, подавление флаппинга
+        struct AlertState {
+            int enter_dwell_ms = 1000;     // столько подряд нужно быть хуже порога, чтобы войти в уровень
+            int exit_dwell_ms = 5000;      // столько подряд лучше порога (с запасом), чтобы выйти
+            int hysteresis_pct = 10;       // запас от порога для выхода из уровня
+            int flap_window_ms = 60000;
+            int flap_transitions = 6;      // столько смен уровня в окне => flapping
+            int flap_hold_ms = 120000;     // тишина после последней смены, чтобы снять flapping
+            int table_size = 4096;         // фиксированная ёмкость таблицы (читается при старте)
+        };
+
+        // legacy-пороги (thresholds.decode_fps_min и т.п.), 0 = не заданы
+        struct Legacy {
+            int decode_fps_min = 0;
+            int bitrate_drop_pct = 0;
+            int cc_errors_per_min = 0;
+        };
+
+        // Неизменяемый снимок настроек. Читатели держат shared_ptr и не видят полузаписанных данных.
+        struct Snapshot {
+            Thresholds  thresholds{};
+            Webhook     webhook{};
+            Outbox      outbox{};
+            AlertState  alert_state{};
+            Legacy      legacy{};
+            std::string source_path;
+            std::string json_text;     // эффективные настройки для /api/settings (сериализованы один раз)
+            uint64_t    version = 0;   // растёт с каждой успешной загрузкой
+        };
+        using SnapshotPtr = std::shared_ptr<const Snapshot>;
+
+        // Текущий снимок: без мьютекса и без файлового I/O
+        SnapshotPtr snapshot() const noexcept { return m_snap.load(std::memory_order_acquire); }
+
+        Thresholds thresholds() const noexcept { return snapshot()->thresholds; }
+        Webhook    webhook()    const { return snapshot()->webhook; }
 
-        // --- Back-compat     ---
+        // --- Back-compat геттеры для старого кода ---
         int decode_fps_min()    const noexcept;   // legacy: thresholds.decode_fps_min
         int bitrate_drop_pct()  const noexcept;   // legacy: thresholds.bitrate_drop_pct
         int cc_errors_per_min() const noexcept;   // legacy: thresholds.cc_errors_per_min
 
-        //     Settings::alerts_webhook_url()
-        const std::string& alerts_webhook_url() const noexcept { return m_webhook.url; }
-        int alerts_cooldown_sec() const noexcept { return m_webhook.cooldown_sec; }
+        // Для старых вызовов вроде Settings::alerts_webhook_url()
+        std::string alerts_webhook_url() const { return snapshot()->webhook.url; }
+        int alerts_cooldown_sec() const noexcept { return snapshot()->webhook.cooldown_sec; }
 
-        // 
-        const std::string& source_path() const noexcept { return m_source_path; }
+        // Диагностика
+        std::string source_path() const { return snapshot()->source_path; }
 
     private:
-        Settings() = default;
+        Settings();
 
-        Thresholds  m_thresholds{};
-        Webhook     m_webhook{};
-        std::string m_source_path;
+        std::atomic<SnapshotPtr> m_snap;
     };
 
 } // namespace multiscreen
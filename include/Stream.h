@@ -6,6 +6,27 @@
 #include <thread>
 #include <chrono>
 #include <cstdint>
+#include <functional>
+#include <algorithm>
+#include <condition_variable>
+#include <deque>
+#include <array>
+#include <memory>
+
+#include "WatchEvents.h"
+#include "Logger.h"
+#include "FFLogRouter.h"
+#include "TsScanner.h"
+#include "Tr101290.h"
+#include "TsTiming.h"
+#include "UdpReceiver.h"
+#include "RtpReorder.h"
+#include "HlsReader.h"
+#include "Recorder.h"
+#include "TsCapture.h"
+#include "TsFanout.h"
+#include "GopCache.h"
+#include "HlsPreview.h"
 
 extern "C" {
 #include <libavformat/avformat.h>
@@ -14,26 +35,59 @@ extern "C" {
 
 namespace multiscreen {
 
-    //  /   WebServer'
+    // Жизненный цикл стрима. Состоянием владеет только поток стрима; снаружи приходят команды.
+    //   Idle -> Opening -> Running -> (ошибка входа) Backoff -> Opening ...
+    //   любая команда Stop/Restart прерывает I/O и ведёт через Draining (закрытие входа).
+    enum class StreamState : uint8_t { Idle = 0, Opening, Running, Draining, Backoff };
+    const char* to_string(StreamState s) noexcept;
+
+    enum class StreamCommand : uint8_t { Start = 0, Stop, Restart };
+
+    // Собираемые метрики/поля – используются WebServer'ом
     struct StreamStats {
         std::string name;
         std::string url;
 
         bool   running = false;
-        double input_fps = 0.0;   //  stream->avg_frame_rate/r_frame_rate
-        double decode_fps = 0.0;   //  EWMA
-        double render_fps = 0.0;   //  0 (  )
+        std::string state;         // idle/opening/running/draining/backoff
+        uint32_t reconnects = 0;   // сколько раз вход терялся и переоткрывался
+        double input_fps = 0.0;   // по stream->avg_frame_rate/r_frame_rate
+        double decode_fps = 0.0;   // сглаженный EWMA
+        double render_fps = 0.0;   // пока 0 (если нет отрисовки)
 
-        int bitrate_kbps = 0;     //  kbps
-        int v_kbps = 0;     //  kbps
-        int a_kbps = 0;     //  kbps
+        int bitrate_kbps = 0;     // общий kbps
+        int v_kbps = 0;     // видео kbps
+        int a_kbps = 0;     // аудио kbps
 
-        std::string rate_mode;       // "VBR"/"CBR" (  kbps)
-        std::string decoder;         // "CPU"  "GPU(D3D11VA)"  ..
+        std::string rate_mode;       // "VBR"/"CBR" (по вариативности kbps)
+        std::string decoder;         // "CPU" или "GPU(D3D11VA)" и т.п.
 
-        uint64_t cc_errors = 0;     //   TEI/CC  
+        uint64_t cc_errors = 0;     // continuity check: TsScanner, без ответвления — из лога демультиплексора
+        bool     ts_tap = false;    // сырой TS входа разбирается TsScanner
+        uint64_t ts_packets = 0;
+        uint64_t ts_sync_losses = 0;
+        uint64_t ts_tei = 0;        // пакетов с transport_error_indicator
+        uint32_t ts_pids = 0;
+        TrIndicators tr101290{};    // сводка TR 101 290 (last_ms — unix-мс)
+        TsTimingSnapshot timing;    // PCR jitter и MDI по времени прихода
+        bool     udp_native = false; // вход udp:// или rtp:// читается UdpReceiver, а не FFmpeg
+        UdpStats udp;
+        bool     rtp_mode = false;   // rtp://: TS снимается с RTP буфером переупорядочивания
+        RtpStats rtp;
+        UdpStats udp_secondary;      // запасная ветвь слияния SMPTE 2022-7 (rtp.merge)
+        bool     hls_native = false; // HLS читает HlsReader (свой разбор плейлиста, предзагрузка сегментов)
+        HlsStats hls;
+        RecordStats record;          // непрерывная запись TS на диск (active = стрим записывается)
+        CaptureStats capture;        // окно TS в памяти для захвата по тревоге
+        FanoutStats live;            // раздача /live/<стрим>.ts
+        PreviewStats preview;        // HLS-предпросмотр /preview/<стрим>/
+        GopStats gop;                // кэш последнего GOP
+        uint64_t pes_errors = 0;    // битые/несогласованные PES-пакеты
+        uint64_t decode_errors = 0; // ошибки декодера (AV_LOG_ERROR)
+        uint64_t log_suppressed = 0; // строк FFmpeg срезано лимитом
+        int stall_ms = 0;           // мс без прогресса ingest/декода (0 — стрим не запущен)
 
-        // PSI / PID  
+        // PSI / PID – ДЕСЯТИЧНЫЕ
         int sid = -1;
         int pmt_pid = -1;
         int pcr_pid = -1;
@@ -42,42 +96,144 @@ namespace multiscreen {
         std::string service_name;
 
         std::string last_error;
-        std::string status;          // ok/warn/crit   watchdog
+        std::string status;          // ok/warn/crit – для watchdog
         std::string status_reason;
     };
 
     class Stream {
     public:
-        Stream(const std::string& name, const std::string& url);
+        // id — номер в реестре StreamManager: им помечаются записи лога из потока стрима
+        Stream(const std::string& name, const std::string& url, uint32_t id = kNoStream);
         ~Stream();
 
-        void start();
-        void stop();
+        // Асинхронное управление: команда уходит в очередь потока стрима и не ждёт I/O.
+        // Результат команды с job != 0 приходит в JobSink (из потока стрима).
+        using JobSink = std::function<void(uint64_t job, bool ok, const std::string& msg)>;
+        void set_job_sink(JobSink sink) { m_job_sink = std::move(sink); }
+        void post(StreamCommand cmd, uint64_t job = 0);
+
+        void start() { post(StreamCommand::Start); }
+        void stop();                 // Stop + ожидание Idle (для shutdown)
+        void wait_idle();
+        void retire() noexcept;      // завершить поток стрима без ожидания; см. finished()
+        bool finished() const noexcept { return m_exited.load(std::memory_order_acquire); }
+
+        const std::string& name() const noexcept { return m_name; }
+        uint32_t    id() const noexcept { return m_id; }
+        StreamState state() const noexcept { return m_state.load(std::memory_order_relaxed); }
+        uint64_t    uid() const noexcept { return m_uid; } // уникален на процесс (имя может переиспользоваться)
+
+        StreamStats stats(); // потокобезопасно
+
+        // Прогресс ingest (steady-мс, lock-free): последний принятый пакет и последний кадр декода.
+        // progress_ms() — более старая из двух меток; 0 — вход ещё не открывался.
+        int64_t last_byte_ms() const noexcept { return m_last_byte_ms.load(std::memory_order_relaxed); }
+        int64_t last_frame_ms() const noexcept { return m_last_frame_ms.load(std::memory_order_relaxed); }
+        int64_t progress_ms() const noexcept { return std::min(last_byte_ms(), last_frame_ms()); }
+
+        // Приёмник событий для watchdog; задаётся до start()
+        using WatchSink = std::function<void(WatchEvent&&)>;
+        void set_watch_sink(WatchSink sink) { m_sink = std::move(sink); }
+
+        // Ответвление сырого TS через собственный AVIOContext (секция "ingest" config.json);
+        // действует на следующие открытия входа
+        static void set_ts_tap(bool on) noexcept;
+        // udp:// и rtp:// через собственный UdpReceiver (recvmmsg, метки времени ядра); только вместе с ответвлением
+        static void set_udp_native(bool on) noexcept;
+        // HLS (.m3u8 по http://) через собственный HlsReader; тоже только вместе с ответвлением
+        static void set_hls_native(bool on) noexcept;
 
-        StreamStats stats(); // 
+        // Подробный отчёт TR 101 290 по PID (потокобезопасно)
+        Tr101290Report tr101290() const { return m_tr.report(); }
+        // Файл с окном TS до тревоги и post_seconds после; пусто — захват выключен
+        std::string capture(const std::string& reason, bool critical);
+        // Раздача /live/<стрим>.ts: клиенты подписываются сами, источник не открывается второй раз
+        std::shared_ptr<TsFanout> fanout() const { return m_fanout; }
+        // HLS-предпросмотр для веб-интерфейса: перепаковка пакетов демультиплексора без декода
+        std::shared_ptr<HlsPreview> preview() const { return m_preview; }
+        // Последний GOP и наборы параметров: новый потребитель начинает декод без ожидания ключевого кадра
+        std::shared_ptr<GopCache> gop() const { return m_gop; }
 
     private:
-        // ---   ---
+        // --- базовая информация ---
         std::string m_name;
         std::string m_url;
+        uint32_t    m_id = kNoStream;
 
-        // --- ffmpeg  ---
+        // --- ffmpeg объекты ---
         AVFormatContext* m_fmt = nullptr;
-        AVCodecContext* m_vdec = nullptr;   // - (  )
+        AVCodecContext* m_vdec = nullptr;   // видео-декодер (для подсчёта кадров)
         int                m_vst_index = -1;
 
-        // --- / ---
+        // --- ответвление TS: демультиплексор читает m_tap, тот — реальный вход m_io ---
+        AVIOContext*       m_io = nullptr;
+        AVIOContext*       m_tap = nullptr;
+        TsScanner          m_ts;               // пишет только поток стрима (из tap_read)
+        Tr101290           m_tr;               // анализатор TR 101 290, получает пакеты от m_ts
+        TsTiming           m_timing;           // PCR jitter и MDI DF:MLR, тоже от m_ts
+        std::atomic<bool>  m_ts_active{ false };
+
+        // --- собственный приём udp:// и rtp:// вместо m_io (создаётся при первом открытии) ---
+        struct UdpLeg {
+            std::unique_ptr<UdpReceiver> rx;
+            size_t next = 0;                   // первая ещё не отданная датаграмма пачки
+            size_t count = 0;
+        };
+        std::array<UdpLeg, 4> m_legs;          // [1] — запасная ветвь 2022-7; [2], [3] — FEC 2022-1 (столбцы, строки)
+        int                m_leg_count = 0;    // ветвей с медиа
+        int                m_fec_legs = 0;     // открытых FEC-ветвей
+        std::atomic<bool>  m_udp_active{ false };
+        std::shared_ptr<RtpReorder> m_rtp;     // rtp://: нумерация, переупорядочивание, jitter (поток стрима)
+        std::atomic<std::shared_ptr<RtpReorder>> m_rtp_pub;   // тот же объект для stats(): при замене старый живёт до конца чтения
+        std::atomic<bool>  m_rtp_mode{ false };
+
+        // --- собственный приём HLS вместо m_io ---
+        std::unique_ptr<HlsReader> m_hls;
+        std::atomic<bool>  m_hls_active{ false };
+        bool               m_hls_ffmpeg = false;   // плейлист не для HlsReader: дальше — демультиплексор HLS FFmpeg
+
+        // --- запись TS на диск: ещё один получатель пакетов m_ts (nullptr — стрим не записывается) ---
+        std::shared_ptr<RecordChannel> m_rec;
+        std::shared_ptr<TsChunkRing>   m_chunks;    // TS чанками: окно захвата по тревоге и очереди раздачи
+        std::shared_ptr<TsFanout>      m_fanout;    // раздача принятого TS клиентам HTTP (чанки m_chunks)
+        std::shared_ptr<GopCache>      m_gop;       // пакеты от последнего ключевого кадра; пишет только поток стрима
+        std::shared_ptr<HlsPreview>    m_preview;   // сегменты HLS в памяти; пишет только поток стрима
+
+        // --- поток/синхронизация ---
+        const uint64_t     m_uid;
         std::thread        m_thr;
-        std::atomic<bool>  m_run{ false };
-        std::mutex         m_mx;     //   /
+        std::mutex         m_mx;     // защищает поля статистики/состояния
+
+        // --- автомат жизненного цикла ---
+        struct Command {
+            StreamCommand cmd;
+            uint64_t      job;
+        };
+        std::atomic<StreamState> m_state{ StreamState::Idle };
+        std::atomic<bool>  m_interrupt{ false };  // прервать I/O (AVIOInterruptCB): пришла Stop/Restart или retire
+        std::atomic<bool>  m_exited{ false };
+        bool               m_quit = false;        // под m_cmd_mx
+        std::mutex         m_cmd_mx;
+        std::condition_variable m_cmd_cv;
+        std::deque<Command> m_cmds;
+        std::vector<uint64_t> m_start_jobs;       // ждут результата открытия; только поток стрима
+        bool               m_active = false;      // между Started и Stopped; только поток стрима
+        int                m_backoff_ms = 0;
+        int                m_av_err = 0;          // последний код ошибки FFmpeg; только поток стрима
+        uint32_t           m_reconnects = 0;      // под m_mx
+        JobSink            m_job_sink;
 
-        // --- / ---
-        //  ( 1 )
+        // метки прогресса: пишет только поток стрима, читают stats()/watchdog
+        std::atomic<int64_t> m_last_byte_ms{ 0 };
+        std::atomic<int64_t> m_last_frame_ms{ 0 };
+
+        // --- счётчики/метрики ---
+        // битрейт (за 1с окно)
         std::chrono::steady_clock::time_point m_bw_t0{};
         uint64_t m_bw_bits_total = 0;
         int      m_kbps = 0, m_vkbps = 0, m_akbps = 0;
 
-        //  VBR/CBR      kbps
+        // режим VBR/CBR – простая эвристика по дисперсии kbps
         int      m_kbps_win_sum = 0;
         int      m_kbps_win_cnt = 0;
         std::string m_rate_mode = "VBR";
@@ -85,10 +241,10 @@ namespace multiscreen {
         // decoder label
         std::string m_decoder_label = "CPU";
 
-        //  CC (  TS)   
-        uint64_t m_cc_errors = 0;
+        // лог FFmpeg этого стрима: атрибуция, лимит строк, счётчики CC/PES/decode
+        FFLogRouter::Source m_fflog;
 
-        // PSI/PID  
+        // PSI/PID – ЧИСЛА
         int m_sid = -1;
         int m_pmt_pid = -1;
         int m_pcr_pid = -1;
@@ -96,27 +252,52 @@ namespace multiscreen {
         std::vector<int> m_audio_pids;
         std::string m_service_name;
 
-        // fps:    decode
+        // fps: входной и сглаженный decode
         double m_input_fps_hint = 0.0;
         std::chrono::steady_clock::time_point m_dec_sample_t0{};
         int    m_dec_sample_frames = 0;
         double m_dec_fps_ema = 0.0;
 
-        // render fps (  )  
+        // render fps (если появится рендер) – оставлено
         double m_render_fps = 0.0;
 
         std::string m_last_error;
 
+        // watchdog: последние опубликованные полосы (255 — ещё не публиковали)
+        WatchSink m_sink;
+        uint8_t   m_fps_band = 255;
+        uint8_t   m_kbps_band = 255;
+        uint8_t   m_timing_band = kNoTiming;   // пишет только поток стрима
+
     private:
         void thread_loop();
+        StreamState drain();          // разбор очереди команд после закрытия входа
+        void read_loop();
         bool open_input();
         void close_input();
+        void set_state(StreamState st) noexcept;
+        void finish_job(uint64_t job, bool ok, const std::string& msg);
+        void finish_start_jobs(bool ok, const std::string& msg);
+        static int interrupt_cb(void* opaque);
+
+        int  open_tap();              // 0 или код ошибки FFmpeg
+        int  open_udp();
+        int  open_hls();
+        void close_tap();
+        int  udp_read(uint8_t* buf, int size);
+        int  udp_receive();
+        int  hls_read(uint8_t* buf, int size);
+        static int     tap_read(void* opaque, uint8_t* buf, int size);
+        static int64_t tap_seek(void* opaque, int64_t offset, int whence);
 
         void pick_input_fps(AVStream* st);
         void on_video_frame_decoded();
         void update_bitrate_window(int pkt_bits, bool is_video, bool is_audio);
 
-        void probe_program_info(); //  SID/PMT/PCR/ES PID  service_name ( )
+        void probe_program_info(); // заполняет SID/PMT/PCR/ES PID и service_name (если доступно)
+
+        double decode_fps_unlocked() const; // EWMA с clamp к input_fps; под m_mx
+        void   publish(WatchKind kind, uint8_t band = 0);
     };
 
 } // namespace multiscreen
@@ -8,58 +8,101 @@
 #include <atomic>
 #include <deque>
 #include <chrono>
+#include <condition_variable>
 
 #include "Stream.h"
+#include "StreamRegistry.h"
+#include "WatchEvents.h"
+#include "utils/bounded_queue.hpp"
 
 namespace multiscreen {
 
+    // Асинхронная команда управления стримом (/api/jobs)
+    struct StreamJob {
+        uint64_t    id = 0;
+        std::string stream;
+        std::string action;         // start/stop/restart
+        std::string state;          // queued/done/failed
+        std::string message;
+        int64_t     created_ms = 0; // system_clock, мс
+        int64_t     finished_ms = 0;
+    };
+
     class StreamManager {
     public:
         ~StreamManager();
 
-        //  
+        // управление составом
         bool  addStream(const std::string& name, const std::string& url);
-        // >>> :   decoder (   WebServer)
-        // : 3-     2- .
+        // >>> ДОБАВЛЕНО: перегрузка с decoder (для совместимости с WebServer)
+        // Минимальная: 3-й аргумент игнорируется и вызывает 2-аргументную версию.
         bool  addStream(const std::string& name, const std::string& url, const std::string& decoder);
         bool  removeStream(const std::string& name);
 
-        // / 
+        // запуск/остановка всех
         void  startAll();
         void  stopAll();
 
-        //   
-        bool  startStream(const std::string& name);
-        bool  stopStream(const std::string& name);
-        bool  restartStream(const std::string& name);
+        // управление одним стримом: не ждёт I/O, возвращает id задания (0 — стрима нет)
+        uint64_t startStream(const std::string& name);
+        uint64_t stopStream(const std::string& name);
+        uint64_t restartStream(const std::string& name);
 
-        // 
+        // отчёты
         std::vector<StreamStats> getAllStats();
+        bool  getTr101290(const std::string& name, Tr101290Report& out) const;
+        // Захват окна TS по запросу оператора; path пуст — захват выключен
+        bool  captureStream(const std::string& name, std::string& path);
+        // Раздача принятого TS стрима; nullptr — стрима нет
+        std::shared_ptr<TsFanout> liveFeed(const std::string& name) const;
+        // HLS-предпросмотр стрима; nullptr — стрима нет
+        std::shared_ptr<HlsPreview> preview(const std::string& name) const;
+        std::vector<StreamJob>   getJobs() const;
+        bool  getJob(uint64_t id, StreamJob& out) const;
+        // События стримов, потерянные на переполнении очереди watchdog
+        uint64_t watchEventsDropped() const noexcept { return m_events_dropped.load(std::memory_order_relaxed); }
 
-        // 
+        // конфиги
         bool  loadConfig(const std::string& jsonPath);
         void  loadFromList(const std::vector<std::pair<std::string, std::string>>& items);
         size_t size() const;
 
+        // Номер стрима в реестре по имени (kNoStream — нет такого) и обратно; для /api/logs
+        uint32_t streamId(const std::string& name) const;
+        std::string streamName(uint32_t id) const;
+
     private:
         void  monitor_loop();
         void  restart_stream_unlocked(const std::string&);
 
-        struct WDState {
-            int low_decode_consec = 0;
-            std::deque<int> kbps_hist;
-            std::uint64_t last_cc = 0;
-            std::chrono::steady_clock::time_point last_cc_t{};
-            std::string last_status;
-        };
+        // watchdog событийный: стримы публикуют смены полос/heartbeat, монитор спит до события или таймера
+        std::shared_ptr<Stream> make_stream(uint32_t id, const std::string& name, const std::string& url);
+        void  post_event(WatchEvent&& ev);
+
+        // стрим убран из карты: его поток завершается сам, объект освобождается после finished()
+        void  retire_unlocked(StreamHandlePtr h);
+        void  reap_retired();
 
-        std::unordered_map<std::string, std::shared_ptr<Stream>> m_streams;
-        mutable std::mutex m_mutex;
+        uint64_t submit(const std::string& name, StreamCommand cmd);
+        void  finish_job(uint64_t id, bool ok, const std::string& msg);
+
+        StreamRegistry m_reg;           // состав: чтение без замков (снимок), запись копированием
+        mutable std::mutex m_mutex;     // сериализует add/remove/reload и m_retired
 
         std::thread m_mon;
         std::atomic<bool> m_mon_run{ false };
 
-        std::unordered_map<std::string, WDState> m_wd;
+        std::vector<StreamHandlePtr> m_retired;   // под m_mutex
+
+        mutable std::mutex      m_jobs_mx;
+        std::deque<StreamJob>   m_jobs;                   // последние kJobsKept заданий
+        uint64_t                m_next_job = 1;
+
+        util::BoundedQueue<WatchEvent> m_events{ 8192 };
+        std::mutex              m_ev_mx;
+        std::condition_variable m_ev_cv;
+        bool                    m_ev_pending = false;
+        std::atomic<uint64_t>   m_events_dropped{ 0 };
     };
 
 } // namespace multiscreen
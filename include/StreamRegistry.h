@@ -0,0 +1,75 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "Stream.h"
+
+namespace multiscreen {
+
+    // Итог watchdog по стриму: пишет только монитор, читают API/статистика — без замков
+    struct WatchStatus {
+        static constexpr uint8_t kFlapping = 0x80;    // бит в reasons поверх битов alerts::Condition
+
+        std::atomic<uint8_t> level{ 0 };      // alerts::Level
+        std::atomic<uint8_t> reasons{ 0 };    // 1 << Condition для условий не в ok (+ kFlapping)
+        std::atomic<uint8_t> notified{ 0 };   // alerts::Level последнего отправленного вебхука
+    };
+
+    // Неизменяемая запись реестра; живёт, пока на неё ссылается хоть один снимок
+    struct StreamHandle {
+        uint32_t                id = 0;      // плотный числовой id, переиспользуется только после reap
+        std::string             name;
+        std::shared_ptr<Stream> stream;
+        mutable WatchStatus     wd;
+    };
+    using StreamHandlePtr = std::shared_ptr<const StreamHandle>;
+
+    // RCU-реестр стримов: читатели берут неизменяемый снимок одной атомарной загрузкой,
+    // писатели (add/remove/reload — редкие) копируют снимок под m_write_mx и публикуют новый.
+    class StreamRegistry {
+    public:
+        struct Snapshot {
+            std::vector<StreamHandlePtr> list;                           // порядок добавления
+            std::unordered_map<std::string, StreamHandlePtr> by_name;
+            std::vector<StreamHandlePtr> by_id;                          // индекс = id, дыры — nullptr
+            uint64_t version = 0;
+        };
+        using SnapshotPtr = std::shared_ptr<const Snapshot>;
+        using Factory = std::function<std::shared_ptr<Stream>(uint32_t id, const std::string& name, const std::string& url)>;
+
+        StreamRegistry();
+
+        SnapshotPtr snapshot() const noexcept { return m_snap.load(std::memory_order_acquire); }
+
+        StreamHandlePtr find(const std::string& name) const;
+        StreamHandlePtr find(uint32_t id) const;
+        size_t size() const noexcept { return snapshot()->list.size(); }
+
+        // Добавить/заменить стрим. Factory получает id новой записи (вызывается под замком записи).
+        // Возвращает новую запись; вытесненная (если была) — в *replaced.
+        StreamHandlePtr insert(const std::string& name, const std::string& url, const Factory& make, StreamHandlePtr* replaced);
+        StreamHandlePtr erase(const std::string& name);
+        // Полная замена состава (имя, url); возвращает все прежние записи
+        std::vector<StreamHandlePtr> reset(const std::vector<std::pair<std::string, std::string>>& items, const Factory& make);
+
+        // id снятой записи можно выдавать снова, когда её поток завершён (см. StreamManager::reap_retired)
+        void release_id(uint32_t id);
+
+    private:
+        uint32_t alloc_id_unlocked();
+        void publish_unlocked(std::shared_ptr<Snapshot> next);
+
+        std::atomic<SnapshotPtr> m_snap;
+        std::mutex               m_write_mx;
+        std::vector<uint32_t>    m_free_ids;
+        uint32_t                 m_next_id = 0;
+    };
+
+} // namespace multiscreen
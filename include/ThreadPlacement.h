@@ -0,0 +1,91 @@
+#pragma once
+#include <nlohmann/json.hpp>
+
+#include <array>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace multiscreen {
+
+    // Классы потоков, для которых в config.json задаются CPU-наборы ("cpu": {...})
+    enum class ThreadRole : uint8_t { Ingest = 0, Decode, Control, Web };
+    inline constexpr size_t kThreadRoleCount = 4;
+    const char* to_string(ThreadRole r) noexcept;
+
+    // Размещение потоков по CPU: профили из конфига, пересечённые с тем, что реально
+    // разрешено процессу (affinity + cgroup cpuset), имена потоков и отчёт для /api/system/threads.
+    // Linux: pthread affinity/имена + /proc и /sys/fs/cgroup; Windows: маска группы 0 и SetThreadDescription.
+    class ThreadPlacement {
+    public:
+        static ThreadPlacement& instance();
+
+        // Разбор секции "cpu" из config.json; вызывается один раз до старта рабочих потоков.
+        // Пустой/отсутствующий набор роли = поток не закрепляется (плавает по разрешённым CPU).
+        void configure(const nlohmann::json& cpu);
+
+        // Закрепить текущий поток за ролью и назвать его (имя режется до 15 байт — предел pthread)
+        void bind_current(ThreadRole role, const std::string& name);
+        void unbind_current();
+
+        // Рекомендуемые размеры с учётом cpuset и квоты cgroup
+        size_t effective_cpus() const;
+        int decode_threads() const;   // AVCodecContext::thread_count для видеодекодера
+        int web_threads() const;      // размер пула httplib
+
+        // Фактическое размещение: все потоки процесса (вместе с потоками FFmpeg) и профили
+        nlohmann::json report() const;
+
+        // RAII: поток закреплён на время жизни объекта (поток stream/монитора/диспетчера)
+        class Scope {
+        public:
+            Scope(ThreadRole role, const std::string& name) { instance().bind_current(role, name); }
+            ~Scope() { instance().unbind_current(); }
+            Scope(const Scope&) = delete;
+            Scope& operator=(const Scope&) = delete;
+        };
+
+        // Временно переводит текущий поток на набор decode с именем name: потоки, порождённые
+        // в это время (frame/slice-потоки FFmpeg в avcodec_open2), наследуют маску и имя.
+        // На Windows потоки маску не наследуют — там это no-op.
+        class DecodeSpawn {
+        public:
+            explicit DecodeSpawn(const std::string& name);
+            ~DecodeSpawn();
+            DecodeSpawn(const DecodeSpawn&) = delete;
+            DecodeSpawn& operator=(const DecodeSpawn&) = delete;
+        private:
+            bool        m_active = false;
+            std::string m_saved_name;
+            std::vector<int> m_saved_cpus;
+        };
+
+    private:
+        ThreadPlacement();
+
+        struct Entry {
+            std::string name;
+            ThreadRole  role = ThreadRole::Control;
+            std::vector<int> cpus;   // что запросили (пусто = без закрепления)
+            bool        pinned = false;
+        };
+
+        void probe_system();
+        std::vector<int> effective_set_unlocked(ThreadRole role) const;
+
+        mutable std::mutex m_mx;
+        std::array<std::vector<int>, kThreadRoleCount> m_profiles{};   // как в конфиге
+        std::vector<int> m_allowed;          // affinity процесса на старте (уже учитывает cpuset)
+        std::string      m_cgroup_cpuset;    // cpuset.cpus.effective, если нашли
+        double           m_quota_cpus = 0;   // cpu.max / cfs_quota, 0 = без квоты
+        int              m_online = 0;
+        int              m_decode_threads = 1;
+        int              m_web_threads = 0;  // 0 = авто
+        bool             m_name_threads = true;
+
+        std::unordered_map<uint64_t, Entry> m_threads;   // tid -> запись
+    };
+
+} // namespace multiscreen
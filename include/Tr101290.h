@@ -0,0 +1,178 @@
+#pragma once
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "TsScanner.h"
+
+namespace multiscreen {
+
+    // Индикаторы ETSI TR 101 290, приоритеты 1 и 2
+    enum class TrCheck : uint8_t {
+        TsSyncLoss = 0,     // 1.1
+        SyncByte,           // 1.2
+        Pat,                // 1.3 (PAT_error_2)
+        Cc,                 // 1.4
+        Pmt,                // 1.5 (PMT_error_2)
+        Pid,                // 1.6
+        Transport,          // 2.1
+        Crc,                // 2.2
+        PcrRepetition,      // 2.3a
+        PcrDiscontinuity,   // 2.3b
+        PcrAccuracy,        // 2.4
+        Pts,                // 2.5
+        Count
+    };
+    inline constexpr size_t kTrChecks = static_cast<size_t>(TrCheck::Count);
+    const char* to_string(TrCheck c) noexcept;
+    int priority(TrCheck c) noexcept;
+
+    struct TrIndicator {
+        uint64_t count = 0;
+        int64_t  last_ms = 0;   // внутри анализатора — steady-мс; в отчёте — unix-мс (0 — не было)
+    };
+    using TrIndicators = std::array<TrIndicator, kTrChecks>;
+
+    // Пороги (секция ingest.tr101290 в config.json); применяются при следующем открытии входа
+    struct TrLimits {
+        int pat_ms = 500;
+        int pmt_ms = 500;
+        int pid_ms = 5000;
+        int pcr_repetition_ms = 100;
+        int pcr_discontinuity_ms = 100;
+        int pcr_accuracy_ns = 500;    // 0 — не проверять
+        int pts_ms = 700;
+    };
+
+    struct TrPidReport {
+        uint16_t     pid = 0;
+        uint16_t     program = 0;
+        std::string  kind;            // pat / pmt / si / pcr / video / audio / es, через '+'
+        TrIndicators ind{};
+    };
+
+    // Снимок для StreamStats и API (строится по запросу)
+    struct Tr101290Report {
+        bool         active = false;  // анализатор получает TS
+        TrIndicators total{};
+        std::vector<TrPidReport> pids;
+        uint32_t     untracked = 0;   // PID без отдельных счётчиков (таблица заполнена)
+    };
+
+    // Потоковый анализатор TR 101 290 поверх TsScanner (подключается через add_sink).
+    // Вся память выделяется в конструкторе: таблица PID -> слот, до kMaxTracked слотов
+    // с индикаторами и сроками, пул буферов сборки секций PSI/SI. На пакет неотслеживаемого
+    // PID — один поиск в таблице. PSI разбирается только при смене версии/CRC.
+    // Время — момент прихода куска данных (steady), поэтому для файлов, читаемых быстрее
+    // реального времени, проверки периодичности не срабатывают.
+    // Поток TsScanner пишет; report() — из любого потока (снимок публикуется раз в 100 мс).
+    class Tr101290 final : public TsPacketSink {
+    public:
+        static constexpr size_t kMaxTracked = 128;
+        static constexpr size_t kMaxPmt = 64;
+
+        Tr101290();
+
+        static void     set_limits(const TrLimits& l);
+        static TrLimits limits();
+
+        // Новый вход: PSI, сроки и PCR забываются, счётчики сохраняются
+        void restart() noexcept;
+
+        Tr101290Report report() const;
+        TrIndicators   totals() const;   // только сводные индикаторы (для списка стримов)
+
+        void on_ts_packets(const uint8_t* base, const uint32_t* keys, size_t n, int64_t now_us) noexcept override;
+        void on_ts_sync_error(int64_t now_us) noexcept override;
+        void on_ts_chunk(int64_t now_us) noexcept override;
+
+    private:
+        enum Kind : uint8_t { kPat = 1, kPmt = 2, kSi = 4, kPcr = 8, kEs = 16 };
+        enum EsClass : uint8_t { kEsUnknown = 0, kEsVideo, kEsAudio };
+
+        // Сборка одной секции PSI/SI в буфере из пула
+        struct Section {
+            uint8_t* buf = nullptr;
+            uint16_t cap = 0;
+            uint16_t have = 0;
+            bool     active = false;
+        };
+
+        struct Slot {
+            uint16_t pid = 0;
+            uint16_t program = 0;
+            uint8_t  kind = 0;
+            uint8_t  es = kEsUnknown;
+            int16_t  section = -1;           // индекс в m_sections
+            int16_t  version = -1;           // PAT/PMT: версия последней разобранной секции
+            uint32_t crc = 0;
+            uint32_t pat_gen = 0;            // поколение разбора PAT/PMT, в котором слот упомянут
+            uint32_t pmt_gen = 0;
+            bool     pcr_valid = false;
+            uint64_t pcr = 0;
+            uint64_t pcr_idx = 0;            // номер пакета с последним PCR
+            double   pcr_rate = 0.0;         // тиков 27 МГц на пакет по последнему интервалу
+            std::array<int64_t, kTrChecks> due{};   // срок следующего появления (0 — не ждём)
+            TrIndicators ind{};
+        };
+
+        Slot* track(uint16_t pid) noexcept;
+        void  attach_section(Slot& s, uint16_t cap) noexcept;
+
+        void raise(Slot* s, TrCheck c, int64_t now) noexcept;
+        void seen(Slot& s, TrCheck c, int64_t now, int period_ms) noexcept;
+
+        void packet(Slot& s, const uint8_t* pkt, uint32_t key, int64_t now, uint64_t idx) noexcept;
+        void pcr(Slot& s, const uint8_t* pkt, uint32_t key, int64_t now, uint64_t idx) noexcept;
+        void pes_start(Slot& s, const uint8_t* p, size_t len, int64_t now) noexcept;
+        void section_data(Slot& s, const uint8_t* p, size_t len, bool pusi, int64_t now) noexcept;
+        size_t section_append(Slot& s, Section& sec, const uint8_t* p, size_t len, int64_t now) noexcept;
+        void section_done(Slot& s, const uint8_t* sec, size_t len, int64_t now) noexcept;
+        void parse_pat(const uint8_t* sec, size_t len, int64_t now) noexcept;
+        void parse_pmt(Slot& s, const uint8_t* sec, size_t len, int64_t now) noexcept;
+
+        void tick(int64_t now) noexcept;
+        void publish() noexcept;
+
+        TrLimits m_lim;
+        std::array<uint8_t, TsScanner::kPids> m_slot_of{};   // 0 — не отслеживается, иначе индекс + 1
+        std::array<Slot, kMaxTracked> m_slots{};
+        size_t   m_nslots = 0;
+        uint32_t m_untracked = 0;
+
+        std::unique_ptr<uint8_t[]> m_section_mem;
+        std::array<Section, kMaxPmt + 8> m_sections{};
+        size_t   m_nsections = 0;
+        size_t   m_section_used = 0;          // байт пула занято
+
+        TrIndicators m_total{};
+        uint64_t m_idx = 0;                   // сквозной номер пакета (для точности PCR)
+        uint32_t m_gen = 0;
+        bool     m_started = false;
+        bool     m_in_sync = false;
+        uint32_t m_good_run = 0;              // пакетов подряд с верным sync byte
+        int64_t  m_null_ms = 0;               // последний null-пакет: признак CBR-мультиплекса
+        int64_t  m_tick_ms = 0;
+        int64_t  m_pub_ms = 0;
+
+        // опубликованный снимок
+        struct PubSlot {
+            uint16_t pid = 0;
+            uint16_t program = 0;
+            uint8_t  kind = 0;
+            uint8_t  es = 0;
+            TrIndicators ind{};
+        };
+        mutable std::mutex m_pub_mx;
+        TrIndicators m_pub_total{};
+        std::array<PubSlot, kMaxTracked> m_pub_slots{};
+        size_t   m_pub_nslots = 0;
+        uint32_t m_pub_untracked = 0;
+        bool     m_pub_active = false;
+    };
+
+} // namespace multiscreen
@@ -0,0 +1,189 @@
+#pragma once
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "TsScanner.h"
+
+namespace multiscreen {
+
+    class TsFanout;
+
+    // Секция "capture" config.json
+    struct CaptureOptions {
+        bool        enable = false;
+        std::string dir = "captures";
+        int         pre_seconds = 30;             // сколько держать в памяти до тревоги
+        int         post_seconds = 30;            // сколько дописать после
+        uint64_t    buffer_bytes = 16ull << 20;   // пул чанков на стрим: ограничивает pre при большом битрейте
+        uint64_t    total_quota_bytes = 2048ull << 20;   // все файлы захвата; старые удаляются
+        bool        on_warning = true;            // false — только crit
+    };
+
+    struct CaptureStats {
+        bool     active = false;        // кольцо есть
+        bool     capturing = false;     // файл сейчас дописывается
+        uint32_t chunks = 0;            // размер пула
+        uint32_t ring_chunks = 0;       // чанков в окне до тревоги
+        uint64_t ring_bytes = 0;
+        int      ring_ms = 0;           // сколько времени реально покрывает окно
+        uint64_t dropped_bytes = 0;     // свободного чанка не нашлось: все держат незаписанные захваты
+        uint64_t captures = 0;
+        std::string last_path;
+    };
+
+    struct CaptureFile {
+        std::string stream;
+        std::string path;
+        std::string reason;
+        int64_t  start_ms = 0;          // unix-мс первого пакета
+        int64_t  trigger_ms = 0;        // unix-мс тревоги
+        uint64_t bytes = 0;
+        bool     complete = false;      // post_seconds истекли, файл закрыт
+    };
+
+    // Сырой TS стрима чанками в памяти — для захвата по тревоге и для раздачи /live (TsFanout).
+    // Пул чанков kChunk выделяется один раз; поток стрима копирует пакеты в текущий чанк ровно
+    // один раз, закрытый чанк уходит клиентам раздачи и в кольцо окна, старые чанки выходят
+    // по возрасту или когда пул кончился. Чанк — со счётчиком ссылок: захват и очереди клиентов
+    // берут ссылки, поток записи и потоки HTTP отпускают их. Занятый чанк повторно не используется;
+    // если свободных нет — данные отбрасываются с учётом.
+    // Пул = окно захвата + запас раздачи (TsFanout::pool_chunks()). Без окна (захват выключен)
+    // пул выделяется при первом клиенте, а без клиентов on_ts_packets() сразу возвращается.
+    class TsChunkRing final : public TsPacketSink {
+    public:
+        static constexpr size_t kChunk = TsScanner::kPacket * 348;   // 64 КБ без 112 байт
+
+        struct Chunk {
+            uint32_t len = 0;
+            int64_t  first_ms = 0;
+            int64_t  last_ms = 0;
+            uint8_t* data = nullptr;
+            std::atomic<uint32_t> refs{ 0 };   // кольцо + захваты + очереди клиентов; 0 — свободен
+        };
+
+        // window_chunks = 0 — без окна захвата, только раздача
+        TsChunkRing(size_t window_chunks, int64_t pre_ms, size_t live_chunks);
+        TsChunkRing(const TsChunkRing&) = delete;
+        TsChunkRing& operator=(const TsChunkRing&) = delete;
+
+        bool window() const noexcept { return m_window; }
+        uint64_t dropped() const noexcept { return m_dropped_pub.load(std::memory_order_relaxed); }
+
+        void on_ts_packets(const uint8_t* base, const uint32_t* keys, size_t n, int64_t now_us) noexcept override;
+        void on_ts_sync_error(int64_t) noexcept override {}
+        void on_ts_chunk(int64_t now_us) noexcept override;
+
+        // Закрыть неполный чанк (вход закрыт): из потока стрима
+        void flush() noexcept;
+
+        static void unref(Chunk* c) noexcept { c->refs.fetch_sub(1, std::memory_order_release); }
+
+    private:
+        friend class IncidentCapture;
+        friend class TsFanout;
+        static constexpr uint32_t kNone = 0xFFFFFFFFu;
+
+        // Захват: ссылки на чанки ждут потока записи в pending (под m_mx)
+        struct Job {
+            std::string path;
+            int64_t  until_ms = 0;      // чанки, закрытые позже, в файл не идут
+            bool     closed = false;
+            std::vector<uint32_t> pending;
+        };
+
+        bool     allocate() noexcept;  // под мьютексом TsFanout, если пул ленивый
+        uint8_t* data(uint32_t i) noexcept { return m_chunks[i].data; }
+        uint32_t acquire() noexcept;
+        bool     live() const noexcept;
+        void     seal(int64_t now_ms) noexcept;
+        void     unref(uint32_t i) noexcept { unref(&m_chunks[i]); }
+        void     evict_front() noexcept;   // под m_mx
+
+        const bool    m_window;
+        const size_t  m_count;
+        const int64_t m_pre_ms;
+        std::unique_ptr<uint8_t[]> m_slab;
+        std::unique_ptr<Chunk[]>   m_chunks;
+        TsFanout* m_fanout = nullptr;     // задаёт TsFanout при создании; живёт дольше потока стрима
+
+        // поток стрима
+        uint32_t m_cur = kNone;
+        int64_t  m_open_us = 0;
+        size_t   m_scan = 0;
+        uint64_t m_dropped = 0;
+
+        // кольцо окна (индексы чанков по порядку) и текущий захват
+        mutable std::mutex m_mx;
+        std::vector<uint32_t> m_ring;
+        size_t   m_first = 0;
+        size_t   m_size = 0;
+        std::shared_ptr<Job> m_job;
+
+        std::atomic<uint64_t> m_dropped_pub{ 0 };
+        std::atomic<uint64_t> m_captures{ 0 };
+        std::string m_last_path;          // под m_mx
+    };
+
+    // Файлы захвата: <dir>/<стрим>/<unix-мс тревоги>_<уровень>.ts. trigger() только берёт ссылки
+    // на окно и сразу возвращает путь (его кладут в вебхук); файл пишет отдельный поток, дописывает
+    // post_seconds после тревоги и закрывает. Повторная тревога во время захвата продлевает его.
+    class IncidentCapture {
+    public:
+        static IncidentCapture& instance();
+
+        void configure(const CaptureOptions& opts);   // до start() и до создания стримов
+        void start();
+        void stop();
+        bool enabled() const noexcept { return m_enabled.load(std::memory_order_relaxed); }
+        int  post_seconds() const noexcept { return m_opts.post_seconds; }
+
+        // Кольцо для нового стрима с запасом live_chunks под раздачу; nullptr — захват выключен
+        std::shared_ptr<TsChunkRing> attach(size_t live_chunks);
+        // Путь файла захвата; пусто — захват выключен, уровень ниже порога или кольца нет
+        std::string trigger(const std::shared_ptr<TsChunkRing>& ring, const std::string& stream,
+            const std::string& reason, bool critical);
+
+        CaptureStats stats(const TsChunkRing& ring) const;
+        std::vector<CaptureFile> files() const;
+
+    private:
+        IncidentCapture() = default;
+        ~IncidentCapture();
+
+        struct Active {
+            std::shared_ptr<TsChunkRing> ring;
+            std::shared_ptr<TsChunkRing::Job> job;
+            std::FILE* file = nullptr;
+            bool     failed = false;
+        };
+
+        void run();
+        bool pump(Active& a, int64_t now_ms);   // true — захват закончен
+        void account(const Active& a, uint64_t bytes, bool complete);
+        void enforce_quota();              // под m_mx
+        void scan_dir();
+
+        CaptureOptions m_opts;
+        std::atomic<bool> m_enabled{ false };
+
+        std::thread m_thr;
+        std::atomic<bool> m_run{ false };
+        std::mutex m_wait_mx;
+        std::condition_variable m_cv;
+
+        mutable std::mutex m_mx;                  // m_new, m_files, m_total_bytes
+        std::vector<Active> m_new;                // ещё не подхвачены потоком записи
+        std::deque<CaptureFile> m_files;          // по времени тревоги
+        uint64_t m_total_bytes = 0;
+    };
+
+} // namespace multiscreen
@@ -0,0 +1,93 @@
+#pragma once
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include "TsCapture.h"
+
+namespace multiscreen {
+
+    struct FanoutStats {
+        uint32_t clients = 0;
+        uint64_t sessions = 0;          // подключений за всё время
+        uint64_t chunks = 0;            // разослано чанков (один чанк — всем клиентам сразу)
+        uint64_t bytes = 0;
+        uint64_t evicted = 0;           // медленных клиентов отключено: очередь переполнилась
+        uint64_t dropped_bytes = 0;     // свободного чанка не было
+    };
+
+    // Раздача уже принятого TS клиентам HTTP (/live/<стрим>.ts) без второго подключения к источнику.
+    // Своего пула нет: поток стрима копирует пакеты один раз в чанки TsChunkRing (общие с захватом
+    // по тревоге), закрытый чанк ставится в очередь каждого клиента по ссылке, поток HTTP пишет его
+    // в сокет и отпускает. Очередь клиента ограничена: не успевает — клиент отключается, остальные
+    // и ingest не ждут. Очереди — хвосты одной последовательности, в них вместе не больше
+    // queue_chunks разных чанков; ещё по одному держит каждый клиент в записи и один заполняется,
+    // отсюда запас в пуле кольца: pool_chunks() = queue_chunks + max_clients + 1.
+    // Новый клиент получает поток со следующего чанка, а не с ключевого кадра: GopCache хранит
+    // пакеты демультиплексора, и их перепаковка дала бы клиенту другие PID и счётчики
+    // непрерывности, чем у сырого TS следом. Плеер ждёт ключевой кадр сам; мгновенный старт — /preview.
+    class TsFanout {
+    public:
+        using Chunk = TsChunkRing::Chunk;
+
+        class Client {
+        public:
+            // Следующий чанк (ссылка переходит вызывающему, вернуть через TsFanout::release)
+            // или nullptr: за timeout_ms ничего не пришло либо клиент отключён
+            Chunk* wait(int timeout_ms);
+            bool   evicted() const noexcept { return m_evicted.load(std::memory_order_acquire); }
+
+        private:
+            friend class TsFanout;
+            std::mutex m_mx;
+            std::condition_variable m_cv;
+            std::vector<Chunk*> m_q;           // кольцо ёмкостью queue_chunks
+            size_t m_first = 0;
+            size_t m_size = 0;
+            std::atomic<bool> m_evicted{ false };
+        };
+
+        // Секция "live" config.json: раздача, предел клиентов на процесс, очередь клиента
+        static void set_defaults(bool enable, int max_clients, size_t queue_bytes) noexcept;
+        static bool enabled() noexcept;
+        static int  max_clients() noexcept;
+        // Запас чанков в пуле кольца под раздачу одного стрима; 0 — раздача выключена
+        static size_t pool_chunks() noexcept;
+
+        // ring — кольцо стрима (TsChunkRing); nullptr — раздача выключена
+        explicit TsFanout(std::shared_ptr<TsChunkRing> ring);
+        ~TsFanout();
+        TsFanout(const TsFanout&) = delete;
+        TsFanout& operator=(const TsFanout&) = delete;
+
+        // nullptr — раздача выключена, предел клиентов или стрим удаляется
+        std::shared_ptr<Client> subscribe();
+        void unsubscribe(const std::shared_ptr<Client>& c);
+        void release(Chunk* c) noexcept { TsChunkRing::unref(c); }
+        // Стрим удаляется: все клиенты отключаются
+        void close();
+
+        FanoutStats stats() const;
+
+    private:
+        friend class TsChunkRing;
+        // Закрытый чанк — в очереди клиентов: из потока стрима (TsChunkRing::seal)
+        void publish(Chunk* c) noexcept;
+
+        const std::shared_ptr<TsChunkRing> m_ring;   // клиенты держат TsFanout, а с ним и пул
+        const size_t m_queue;                   // ёмкость очереди клиента, чанков
+
+        mutable std::mutex m_mx;                // m_clients, выделение пула кольца
+        std::vector<std::shared_ptr<Client>> m_clients;
+        std::atomic<uint32_t> m_nclients{ 0 };
+        bool     m_closed = false;
+        uint64_t m_sessions = 0;
+        std::atomic<uint64_t> m_evicted{ 0 };
+        std::atomic<uint64_t> m_chunks{ 0 }, m_bytes{ 0 };
+    };
+
+} // namespace multiscreen
@@ -0,0 +1,119 @@
+#pragma once
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+
+namespace multiscreen {
+
+    // Состояние одного PID; таблица плоская, индекс = PID (13 бит)
+    struct TsPidState {
+        uint64_t packets = 0;
+        uint32_t cc_errors = 0;
+        uint8_t  last_cc = 0;
+        uint8_t  flags = 0;      // TsScanner::kCcValid | kCcDup
+        uint16_t reserved = 0;
+    };
+
+    // Сводные счётчики; читаются из других потоков (обновляются раз на feed())
+    struct TsScanSnapshot {
+        uint64_t packets = 0;
+        uint64_t bytes = 0;
+        uint64_t cc_errors = 0;
+        uint64_t tei = 0;           // transport_error_indicator
+        uint64_t sync_losses = 0;   // потерь синхронизации (0x47 не на месте)
+        uint64_t skipped_bytes = 0; // отброшено при поиске синхронизации
+        uint32_t pids = 0;          // PID, встреченных хотя бы раз
+    };
+
+    // Потребитель проверенных пакетов (анализаторы поверх TsScanner); вызывается в потоке feed()
+    class TsPacketSink {
+    public:
+        virtual ~TsPacketSink() = default;
+        // n пакетов подряд по адресу base + i * 188 с ключами keys[i] (см. TsScanner::ExtractFn);
+        // now_us — steady-время прихода куска данных (мкс), снимается один раз на feed()
+        virtual void on_ts_packets(const uint8_t* base, const uint32_t* keys, size_t n, int64_t now_us) noexcept = 0;
+        // sync byte не на месте: синхронизация потеряна, дальше — поиск
+        virtual void on_ts_sync_error(int64_t now_us) noexcept = 0;
+        // конец feed(): место для проверок по таймаутам и публикации
+        virtual void on_ts_chunk(int64_t now_us) noexcept = 0;
+    };
+
+    // Пакетный разбор MPEG-TS (188 байт): проверка sync byte и извлечение PID/AFC/CC
+    // сразу для 8 (AVX2) или 4 (SSE2) пакетов, затем последовательное обновление
+    // плоской таблицы PID. После потери синхронизации — поиск 0x47 через memchr
+    // с подтверждением на следующих пакетах. Пакеты могут быть разрезаны между вызовами.
+    // feed() и pid() — только из одного потока (владельца), snapshot() — из любого.
+    class TsScanner {
+    public:
+        static constexpr size_t   kPacket = 188;
+        static constexpr uint16_t kPids = 8192;
+        static constexpr uint16_t kNullPid = 0x1FFF;
+        static constexpr uint8_t  kCcValid = 0x01;
+        static constexpr uint8_t  kCcDup = 0x02;
+        static constexpr size_t   kMaxSinks = 6;
+
+        enum class Isa : uint8_t { Scalar = 0, Sse2, Avx2 };
+        static const char* to_string(Isa isa) noexcept;
+        // Набор инструкций для новых сканеров: выбранный select_isa() или, для "auto",
+        // быстрейший по короткому замеру при первом вызове
+        static Isa isa() noexcept;
+        // "auto" | "avx2" | "sse2" | "scalar"; недоступный набор понижается до доступного
+        static void select_isa(const std::string& name);
+
+        explicit TsScanner(Isa isa = TsScanner::isa());
+
+        // Новый вход или переход по файлу: сбросить незаконченный пакет и ожидания CC
+        // (счётчики сохраняются)
+        void restart() noexcept;
+        void feed(const uint8_t* data, size_t len) noexcept;
+        // То же с известным временем прихода (steady, мкс), например меткой ядра для датаграммы
+        void feed(const uint8_t* data, size_t len, int64_t arrival_us) noexcept;
+
+        // Анализаторы, получающие каждый пакет после обновления таблицы PID, в порядке добавления;
+        // задаются до первого feed(). false — уже kMaxSinks
+        bool add_sink(TsPacketSink* sink) noexcept;
+
+        const TsPidState& pid(uint16_t pid) const noexcept { return m_pids[pid & (kPids - 1)]; }
+        TsScanSnapshot snapshot() const noexcept;
+        Isa active_isa() const noexcept { return m_isa; }
+
+        // Ключ пакета после извлечения: PID[0..12] | CC[13..16] | AFC[17..18] | TEI[19];
+        // после обновления таблицы PID добавляются kKeyCcError, kKeyDiscontinuity и
+        // число пропущенных пакетов по разрыву CC (по модулю 16) в битах [22..25]
+        static constexpr uint32_t kKeyTei = 1u << 19;
+        static constexpr uint32_t kKeyCcError = 1u << 20;
+        static constexpr uint32_t kKeyDiscontinuity = 1u << 21;
+        static constexpr unsigned kKeyCcGapShift = 22;
+        static constexpr uint32_t kKeyCcGapMask = 0x0Fu << kKeyCcGapShift;
+        using ExtractFn = size_t(*)(const uint8_t* p, size_t n, uint32_t* keys);
+
+    private:
+        size_t scan(const uint8_t* p, size_t n, int64_t now_us) noexcept;   // число обработанных пакетов до сбоя sync
+        void   sync_error(int64_t now_us) noexcept;
+        void   chunk_done(int64_t now_us) noexcept;
+        size_t resync(const uint8_t* p, size_t len) const noexcept;
+        void   publish() noexcept;
+
+        Isa       m_isa;
+        ExtractFn m_extract;
+        std::array<TsPacketSink*, kMaxSinks> m_sinks{};
+        size_t    m_nsinks = 0;
+        std::unique_ptr<TsPidState[]> m_pids;
+
+        uint8_t m_carry[kPacket];    // незаконченный пакет из прошлого feed()
+        size_t  m_carry_len = 0;
+        bool    m_locked = false;
+
+        // локальные счётчики владельца; публикуются в атомики в конце feed()
+        TsScanSnapshot m_local;
+        struct Shared {
+            std::atomic<uint64_t> packets{ 0 }, bytes{ 0 }, cc_errors{ 0 }, tei{ 0 },
+                sync_losses{ 0 }, skipped_bytes{ 0 };
+            std::atomic<uint32_t> pids{ 0 };
+        } m_shared;
+    };
+
+} // namespace multiscreen
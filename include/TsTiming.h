@@ -0,0 +1,99 @@
+#pragma once
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+
+#include "TsScanner.h"
+
+namespace multiscreen {
+
+    // Итоги последнего окна и максимумы за историю; значения в мс (MLR — пакетов/с)
+    struct TsTimingSnapshot {
+        bool     valid = false;        // есть свежее закрытое окно
+        uint16_t pcr_pid = 0;
+        double   media_kbps = 0.0;     // скорость мультиплекса по PCR
+        double   pcr_oj_ms = 0.0;      // PCR overall jitter (TR 101 290, прил. I)
+        double   mdi_df_ms = 0.0;      // MDI delay factor (RFC 4445)
+        double   mdi_mlr = 0.0;        // MDI media loss rate: потерянных пакетов TS в секунду
+        double   pcr_oj_max_ms = 0.0;  // максимумы за последние kHistory окон
+        double   mdi_df_max_ms = 0.0;
+        double   mdi_mlr_max = 0.0;
+    };
+
+    // Тайминг доставки поверх TsScanner (подключается через add_sink): время прихода
+    // каждого куска (один AVIO-read; для UDP — примерно одна датаграмма) сопоставляется
+    // с PCR и со скоростью мультиплекса.
+    //  - PCR_OJ: размах (время прихода - PCR) за окно после вычета дрейфа часов,
+    //    оценённого по предыдущим окнам;
+    //  - DF: размах виртуального буфера, который наполняется приходящими байтами
+    //    и опустошается со скоростью по PCR, делённый на эту скорость;
+    //  - MLR: пропущенные пакеты по разрывам CC (без null-пакетов) в секунду.
+    // Всё считается инкрементально, O(1) на пакет; окно — 1 с. Для файлов, читаемых
+    // быстрее реального времени, значения не показательны.
+    // Поток TsScanner пишет; snapshot() — из любого потока (итоги публикуются по закрытию окна).
+    class TsTiming final : public TsPacketSink {
+    public:
+        static constexpr int64_t kWindowUs = 1000000;
+        static constexpr size_t  kHistory = 60;
+
+        // Новый вход или переход по файлу: PCR, скорость и окно забываются, история сохраняется
+        void restart() noexcept;
+
+        TsTimingSnapshot snapshot() const;
+
+        void on_ts_packets(const uint8_t* base, const uint32_t* keys, size_t n, int64_t now_us) noexcept override;
+        void on_ts_sync_error(int64_t now_us) noexcept override;
+        void on_ts_chunk(int64_t now_us) noexcept override;
+
+    private:
+        void pcr(uint16_t pid, uint64_t value, bool discontinuity, uint64_t pos, int64_t now_us) noexcept;
+        void close_window(int64_t now_us) noexcept;
+
+        // PCR
+        static constexpr uint16_t kNoPid = 0xFFFF;
+        uint16_t m_pcr_pid = kNoPid;
+        int64_t  m_pcr_seen_us = 0;       // последний PCR выбранного PID
+        bool     m_pcr_valid = false;
+        uint64_t m_pcr = 0;               // последнее значение, тики 27 МГц
+        uint64_t m_pcr_pos = 0;           // байтовая позиция пакета с ним
+        int64_t  m_pcr_time = 0;          // PCR, развёрнутый через переполнения, тики
+
+        // поток
+        uint64_t m_bytes = 0;             // байт TS с начала входа
+        uint32_t m_chunk_bytes = 0;       // пришло в текущем куске
+        double   m_rate = 0.0;            // байт/мкс по PCR (сглаженная)
+        double   m_drift = 0.0;           // дрейф (приход - PCR), мкс/мкс
+
+        // текущее окно
+        int64_t  m_win_t0 = 0;            // 0 — окно не начато
+        uint64_t m_win_lost = 0;
+        uint64_t m_win_rate_bytes = 0;    // для скорости: байт между соседними PCR
+        uint64_t m_win_rate_ticks = 0;
+        int      m_win_pcrs = 0;
+        int64_t  m_oj_t0 = 0;             // первый PCR окна: время прихода и смещение
+        double   m_oj_first = 0.0;
+        double   m_oj_last = 0.0;
+        int64_t  m_oj_last_t = 0;
+        double   m_oj_min = 0.0, m_oj_max = 0.0;
+        int64_t  m_vb_t0 = 0;             // виртуальный буфер MDI: начало, пришло байт, размах
+        double   m_vb_bytes = 0.0;
+        double   m_vb_min = 0.0, m_vb_max = 0.0;
+        bool     m_vb_started = false;
+
+        // история и опубликованный снимок
+        struct Window {
+            double oj_ms = 0.0;
+            double df_ms = 0.0;
+            double mlr = 0.0;
+        };
+        std::array<Window, kHistory> m_hist{};
+        size_t   m_hist_n = 0;
+        size_t   m_hist_pos = 0;
+
+        mutable std::mutex m_pub_mx;
+        TsTimingSnapshot   m_pub;
+        int64_t            m_pub_us = 0;  // когда закрыто последнее окно
+    };
+
+} // namespace multiscreen
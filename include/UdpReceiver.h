@@ -0,0 +1,88 @@
+#pragma once
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace multiscreen {
+
+    // Адрес входа из URL вида udp://[@]group:port?sources=a,b&localaddr=ip|ifname&buffer_size=N&reuse=1
+    // (синтаксис udp:// FFmpeg; неизвестные параметры игнорируются)
+    struct UdpEndpoint {
+        std::string host;                 // группа, unicast-адрес или пусто (любой)
+        uint16_t    port = 0;
+        std::vector<std::string> sources; // source-specific multicast: принимать только от них
+        std::string localaddr;            // multicast: интерфейс для join (адрес или имя); unicast: адрес привязки
+        int         rcvbuf = 0;           // SO_RCVBUF, байт (0 — значение по умолчанию)
+        bool        reuse = true;
+
+        static bool parse(const std::string& url, UdpEndpoint& out, std::string& err);
+    };
+
+    // Одна датаграмма из последней пачки; arrival_us — steady-время приёма ядром (мкс)
+    struct UdpDatagram {
+        const uint8_t* data = nullptr;
+        uint32_t       len = 0;
+        int64_t        arrival_us = 0;
+    };
+
+    struct UdpStats {
+        uint64_t datagrams = 0;
+        uint64_t bytes = 0;
+        uint64_t batches = 0;             // recvmmsg с данными
+        uint64_t truncated = 0;           // датаграмма длиннее kMaxDatagram
+        uint64_t kernel_drops = 0;        // SO_RXQ_OVFL: отброшено ядром при полном буфере сокета
+        int      rcvbuf = 0;              // фактический SO_RCVBUF
+        bool     kernel_ts = false;       // приходят метки времени ядра
+    };
+
+    // Собственный приём UDP/multicast: join (в том числе source-specific), пачки через recvmmsg,
+    // настройка SO_RCVBUF и метки времени приёма ядром (SO_TIMESTAMPNS). Буферы выделяются
+    // в конструкторе, на приём — ни одной аллокации.
+    // Только Linux; на других платформах supported() == false и вход открывает FFmpeg.
+    // receive()/datagram() — из одного потока; stats() — из любого.
+    class UdpReceiver {
+    public:
+        static constexpr size_t kBatch = 64;
+        static constexpr size_t kMaxDatagram = 2048;   // TS по UDP/RTP: до 7 * 188 + заголовки
+
+        static bool supported() noexcept;
+        // SO_RCVBUF для URL без buffer_size (секция ingest.udp config.json)
+        static void set_default_rcvbuf(int bytes) noexcept;
+
+        UdpReceiver();
+        ~UdpReceiver();
+        UdpReceiver(const UdpReceiver&) = delete;
+        UdpReceiver& operator=(const UdpReceiver&) = delete;
+
+        // 0 или отрицательный errno; err — текст для журнала
+        int  open(const UdpEndpoint& ep, std::string& err);
+        void close() noexcept;
+        bool is_open() const noexcept { return m_fd >= 0; }
+
+        // Ждать данные до timeout_ms и забрать пачку: число датаграмм, 0 — таймаут, <0 — -errno
+        int receive(int timeout_ms) noexcept;
+        // Ждать данные на любом из открытых приёмников: >0 — есть, 0 — таймаут, <0 — -errno
+        static int wait_any(UdpReceiver* const* rx, size_t n, int timeout_ms) noexcept;
+        const UdpDatagram& datagram(size_t i) const noexcept { return m_dgrams[i]; }
+
+        UdpStats stats() const noexcept;
+
+    private:
+        int  m_fd = -1;
+        std::unique_ptr<uint8_t[]> m_slab;       // kBatch * kMaxDatagram
+        std::unique_ptr<uint8_t[]> m_control;    // cmsg для каждой датаграммы
+        std::unique_ptr<uint8_t[]> m_msgs;       // mmsghdr[kBatch] + iovec[kBatch] (платформенные типы)
+        std::array<UdpDatagram, kBatch> m_dgrams{};
+
+        struct Shared {
+            std::atomic<uint64_t> datagrams{ 0 }, bytes{ 0 }, batches{ 0 }, truncated{ 0 }, kernel_drops{ 0 };
+            std::atomic<int>      rcvbuf{ 0 };
+            std::atomic<bool>     kernel_ts{ false };
+        } m_shared;
+    };
+
+} // namespace multiscreen
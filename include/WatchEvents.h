@@ -0,0 +1,79 @@
+#pragma once
+#include <cstdint>
+
+#include "Settings.h"
+
+namespace multiscreen {
+
+    // События стрима для watchdog: публикуются только при смене «полосы» метрики
+    // (плюс редкий heartbeat с текущими значениями), а не опрашиваются по таймеру.
+    enum class WatchKind : uint8_t {
+        Started = 0,   // стрим запущен (start()); stall отсчитывается от этого момента
+        Stopped,       // стрим остановлен вручную
+        Removed,       // стрим удалён из менеджера (публикует StreamManager)
+        FpsBand,       // сменилась полоса decode/input fps
+        BitrateBand,   // сменилась полоса kbps
+        TimingBand,    // сменилась полоса PCR jitter / MDI
+        Heartbeat      // раз в окно битрейта: текущие значения для watchdog
+    };
+
+    struct WatchEvent {
+        uint32_t    id = 0;         // StreamHandle::id (проставляет StreamManager) — без строк на горячем пути
+        uint64_t    uid = 0;        // Stream::uid(): отличает пересозданный стрим с тем же id
+        WatchKind   kind = WatchKind::Heartbeat;
+        uint8_t     band = 0;
+        double      input_fps = 0.0;
+        double      decode_fps = 0.0;
+        int         kbps = 0;
+        bool        timing = false;     // есть свежие PCR jitter / MDI (TS-ответвление)
+        double      pcr_oj_ms = 0.0;
+        double      mdi_df_ms = 0.0;
+        double      mdi_mlr = 0.0;
+        int64_t     t_ms = 0;       // steady-время события
+    };
+
+    // Полосы с учётом гистерезиса автоматов: смена полосы — единственное, что может поменять
+    // уровень alerts::StateEngine, поэтому внутри полосы событий нет.
+    //   0: <= crit   1: (crit, crit+h]   2: (crit+h, warn]   3: (warn, warn+h]   4: > warn+h
+    inline uint8_t lower_is_worse_band(double v, double warn, double crit, double hyst) noexcept {
+        if (v <= crit) return 0;
+        if (v <= crit * (1.0 + hyst)) return 1;
+        if (v <= warn) return 2;
+        if (v <= warn * (1.0 + hyst)) return 3;
+        return 4;
+    }
+
+    // То же для метрик, где хуже — больше; нулевой порог не проверяется
+    inline uint8_t higher_is_worse_band(double v, double warn, double crit, double hyst) noexcept {
+        if (crit > 0.0 && v >= crit) return 0;
+        if (crit > 0.0 && v >= crit * (1.0 - hyst)) return 1;
+        if (warn > 0.0 && v >= warn) return 2;
+        if (warn > 0.0 && v >= warn * (1.0 - hyst)) return 3;
+        return 4;
+    }
+
+    inline uint8_t fps_band(double input_fps, double decode_fps, const Settings::Snapshot& s) noexcept {
+        const double ratio = (input_fps > 0.0001) ? decode_fps / input_fps : 1.0;
+        return lower_is_worse_band(ratio, s.thresholds.fps.warn_ratio, s.thresholds.fps.crit_ratio,
+            s.alert_state.hysteresis_pct / 100.0);
+    }
+
+    inline uint8_t bitrate_band(int kbps, const Settings::Snapshot& s) noexcept {
+        return lower_is_worse_band(kbps, s.thresholds.bitrate.warn_kbps, s.thresholds.bitrate.crit_kbps,
+            s.alert_state.hysteresis_pct / 100.0);
+    }
+
+    // Три метрики тайминга одним числом (5 * 5 * 5 полос); kNoTiming — данных нет
+    inline constexpr uint8_t kNoTiming = 125;
+    inline uint8_t timing_band(bool valid, double pcr_oj_ms, double mdi_df_ms, double mdi_mlr,
+        const Settings::Snapshot& s) noexcept {
+        if (!valid) return kNoTiming;
+        const auto& th = s.thresholds;
+        const double h = s.alert_state.hysteresis_pct / 100.0;
+        return static_cast<uint8_t>(
+            higher_is_worse_band(pcr_oj_ms, th.pcr_jitter.warn_ms, th.pcr_jitter.crit_ms, h) * 25 +
+            higher_is_worse_band(mdi_df_ms, th.mdi.df_warn_ms, th.mdi.df_crit_ms, h) * 5 +
+            higher_is_worse_band(mdi_mlr, th.mdi.mlr_warn, th.mdi.mlr_crit, h));
+    }
+
+} // namespace multiscreen
@@ -20,7 +20,7 @@ namespace multiscreen {
         void stop();
 
     private:
-        // :     (   unresolved externals)
+        // ВАЖНО: реализованы как методы класса (чтобы не было unresolved externals)
         static nlohmann::json parse_json(const std::string& body);
         static void persist_append_stream(const std::string& name, const std::string& url);
         static void persist_remove_stream(const std::string& name);
@@ -32,6 +32,7 @@ namespace multiscreen {
         std::unique_ptr<httplib::Server>    m_svr;
         std::thread                         m_thread;
         std::atomic<bool>                   m_running{ false };
+        std::atomic<int>                    m_tails{ 0 };   // открытые /api/logs/tail (каждый держит поток пула)
     };
 
 } // namespace multiscreen
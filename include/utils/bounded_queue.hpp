@@ -0,0 +1,97 @@
+// include/utils/bounded_queue.hpp
+#pragma once
+#include <atomic>
+#include <cstddef>
+#include <memory>
+#include <new>
+#include <optional>
+#include <utility>
+
+namespace util {
+
+    // Ограниченная lock-free очередь (схема Д. Вьюкова): много производителей, один/несколько потребителей.
+    // Ёмкость округляется вверх до степени двойки. try_push никогда не блокирует:
+    // при переполнении возвращает false, вызывающий сам ведёт учёт потерь.
+    template <class T>
+    class BoundedQueue {
+    public:
+        explicit BoundedQueue(size_t capacity) {
+            size_t cap = 2;
+            while (cap < capacity) cap <<= 1;
+            m_mask = cap - 1;
+            m_cells = std::make_unique<Cell[]>(cap);
+            for (size_t i = 0; i < cap; ++i) m_cells[i].seq.store(i, std::memory_order_relaxed);
+        }
+
+        BoundedQueue(const BoundedQueue&) = delete;
+        BoundedQueue& operator=(const BoundedQueue&) = delete;
+
+        bool try_push(T&& v) noexcept {
+            size_t pos = m_tail.load(std::memory_order_relaxed);
+            for (;;) {
+                Cell& c = m_cells[pos & m_mask];
+                const size_t seq = c.seq.load(std::memory_order_acquire);
+                const auto diff = static_cast<std::ptrdiff_t>(seq) - static_cast<std::ptrdiff_t>(pos);
+                if (diff == 0) {
+                    if (m_tail.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                        c.value = std::move(v);
+                        c.seq.store(pos + 1, std::memory_order_release);
+                        return true;
+                    }
+                }
+                else if (diff < 0) {
+                    return false; // полна
+                }
+                else {
+                    pos = m_tail.load(std::memory_order_relaxed);
+                }
+            }
+        }
+
+        std::optional<T> try_pop() noexcept {
+            size_t pos = m_head.load(std::memory_order_relaxed);
+            for (;;) {
+                Cell& c = m_cells[pos & m_mask];
+                const size_t seq = c.seq.load(std::memory_order_acquire);
+                const auto diff = static_cast<std::ptrdiff_t>(seq) - static_cast<std::ptrdiff_t>(pos + 1);
+                if (diff == 0) {
+                    if (m_head.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                        std::optional<T> out(std::move(c.value));
+                        c.value = T{};
+                        c.seq.store(pos + m_mask + 1, std::memory_order_release);
+                        return out;
+                    }
+                }
+                else if (diff < 0) {
+                    return std::nullopt; // пуста
+                }
+                else {
+                    pos = m_head.load(std::memory_order_relaxed);
+                }
+            }
+        }
+
+        // Приблизительная глубина (для метрик)
+        size_t size_approx() const noexcept {
+            const size_t t = m_tail.load(std::memory_order_relaxed);
+            const size_t h = m_head.load(std::memory_order_relaxed);
+            return (t >= h) ? (t - h) : 0;
+        }
+
+        size_t capacity() const noexcept { return m_mask + 1; }
+
+    private:
+        struct Cell {
+            std::atomic<size_t> seq{ 0 };
+            T value{};
+        };
+
+        static constexpr size_t kLine = 64;
+
+        std::unique_ptr<Cell[]> m_cells;
+        size_t m_mask = 0;
+        alignas(kLine) std::atomic<size_t> m_tail{ 0 };
+        alignas(kLine) std::atomic<size_t> m_head{ 0 };
+    };
+
+} // namespace util
@@ -0,0 +1,31 @@
+// include/utils/storage.hpp
+#pragma once
+#include <chrono>
+#include <cstdint>
+#include <string>
+
+namespace util {
+
+    // Общее для записи на диск (Recorder, TsCapture): часы в мс и имя каталога стрима
+
+    inline int64_t wall_ms() noexcept {
+        using namespace std::chrono;
+        return duration_cast<milliseconds>(system_clock::now().time_since_epoch()).count();
+    }
+
+    inline int64_t steady_ms() noexcept {
+        using namespace std::chrono;
+        return duration_cast<milliseconds>(steady_clock::now().time_since_epoch()).count();
+    }
+
+    // Имя стрима -> имя каталога или части имени файла: всё, кроме [A-Za-z0-9._-], заменяется на '_'
+    inline std::string dir_key(const std::string& stream) {
+        std::string k = stream;
+        for (char& c : k)
+            if (!((c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') || c == '-' || c == '_' || c == '.'))
+                c = '_';
+        if (k.empty() || k == "." || k == "..") k = "_" + k;
+        return k;
+    }
+
+} // namespace util
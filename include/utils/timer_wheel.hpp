@@ -0,0 +1,105 @@
+// include/utils/timer_wheel.hpp
+#pragma once
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+namespace util {
+
+    // Иерархическое колесо таймеров: 3 уровня по 256 слотов (тик 10 мс => ~46 ч горизонта).
+    // schedule/advance — O(1) амортизированно; отмены нет: владелец сверяет дедлайн при срабатывании
+    // и игнорирует устаревшие таймеры (ленивая отмена).
+    template <class Key>
+    class TimerWheel {
+    public:
+        explicit TimerWheel(int64_t tick_ms = 10, int64_t now_ms = 0)
+            : m_tick_ms(tick_ms > 0 ? tick_ms : 1), m_cur(now_ms / m_tick_ms) {
+        }
+
+        void schedule(int64_t deadline_ms, Key key) {
+            // тик срабатывания — округление вверх, но не раньше следующего тика
+            int64_t t = (deadline_ms + m_tick_ms - 1) / m_tick_ms;
+            if (t <= m_cur) t = m_cur + 1;
+            place(Timer{ t, std::move(key) });
+            ++m_size;
+        }
+
+        // Срабатывают все таймеры с дедлайном <= now_ms; on_expire(Key&) может планировать новые
+        template <class F>
+        void advance(int64_t now_ms, F&& on_expire) {
+            const int64_t target = now_ms / m_tick_ms;
+            while (m_cur < target) {
+                ++m_cur;
+                if ((m_cur & kMask) == 0) {
+                    if (((m_cur >> kBits) & kMask) == 0) cascade(2);
+                    cascade(1);
+                }
+                auto& slot = m_levels[0][static_cast<size_t>(m_cur & kMask)];
+                if (slot.empty()) continue;
+                m_fire.swap(slot);
+                for (auto& tm : m_fire) {
+                    --m_size;
+                    on_expire(tm.key);
+                }
+                m_fire.clear();
+            }
+        }
+
+        // Ближайший момент, когда advance() может что-то сделать (для таймаута ожидания)
+        int64_t next_expiry_ms() const noexcept {
+            for (int64_t t = m_cur + 1; t <= m_cur + static_cast<int64_t>(kSlots); ++t) {
+                if (!m_levels[0][static_cast<size_t>(t & kMask)].empty()) return t * m_tick_ms;
+                if ((t & kMask) == 0) return t * m_tick_ms; // каскад верхнего уровня
+            }
+            return (m_cur + static_cast<int64_t>(kSlots)) * m_tick_ms;
+        }
+
+        size_t size() const noexcept { return m_size; }
+        int64_t tick_ms() const noexcept { return m_tick_ms; }
+
+    private:
+        static constexpr int     kBits = 8;
+        static constexpr size_t  kSlots = size_t{ 1 } << kBits;
+        static constexpr int64_t kMask = static_cast<int64_t>(kSlots) - 1;
+        static constexpr int     kLevels = 3;
+
+        struct Timer {
+            int64_t tick;
+            Key     key;
+        };
+
+        void place(Timer&& tm) {
+            int64_t delta = tm.tick - m_cur;
+            if (delta < static_cast<int64_t>(kSlots)) {
+                m_levels[0][static_cast<size_t>(tm.tick & kMask)].push_back(std::move(tm));
+            }
+            else if (delta < (int64_t{ 1 } << (2 * kBits))) {
+                m_levels[1][static_cast<size_t>((tm.tick >> kBits) & kMask)].push_back(std::move(tm));
+            }
+            else {
+                const int64_t horizon = (int64_t{ 1 } << (3 * kBits)) - 1;
+                if (delta > horizon) tm.tick = m_cur + horizon;
+                m_levels[2][static_cast<size_t>((tm.tick >> (2 * kBits)) & kMask)].push_back(std::move(tm));
+            }
+        }
+
+        // Переносим слот верхнего уровня, чья очередь подошла, на уровни ниже
+        void cascade(int level) {
+            const int64_t idx = (m_cur >> (kBits * level)) & kMask;
+            auto& slot = m_levels[level][static_cast<size_t>(idx)];
+            if (slot.empty()) return;
+            std::vector<Timer> moving;
+            moving.swap(slot);
+            for (auto& tm : moving) place(std::move(tm));
+        }
+
+        int64_t m_tick_ms;
+        int64_t m_cur;
+        size_t  m_size = 0;
+        std::array<std::array<std::vector<Timer>, kSlots>, kLevels> m_levels{};
+        std::vector<Timer> m_fire;
+    };
+
+} // namespace util
@@ -0,0 +1,304 @@
+#include "AlertDispatcher.h"
+#include "Settings.h"
+#include "Logger.h"
+#include "ThreadPlacement.h"
+
+#include <httplib.h>
+
+#include <algorithm>
+#include <chrono>
+
+using namespace std::chrono_literals;
+
+namespace alerts {
+    namespace {
+        int64_t now_ms_steady() {
+            using namespace std::chrono;
+            return duration_cast<milliseconds>(steady_clock::now().time_since_epoch()).count();
+        }
+
+        // Повтор имеет смысл только при недоступности приёмника; прочие ответы он повторит и нам
+        bool retryable(int status) noexcept {
+            return status == 0 || status >= 500 || status == 408 || status == 429;
+        }
+
+        // "http://host:port/path" -> {"http://host:port", "/path"}
+        void split_url(const std::string& url, std::string& scheme_host_port, std::string& path) {
+            scheme_host_port.clear();
+            path = "/";
+            const auto ppos = url.find("://");
+            if (ppos == std::string::npos) return;
+            const auto slash = url.find('/', ppos + 3);
+            if (slash == std::string::npos) {
+                scheme_host_port = url;
+            }
+            else {
+                scheme_host_port = url.substr(0, slash);
+                path = url.substr(slash);
+            }
+        }
+    } // namespace
+
+    Dispatcher& Dispatcher::instance() {
+        static Dispatcher d;
+        return d;
+    }
+
+    Dispatcher::Dispatcher()
+        : m_q(static_cast<size_t>(std::max(16, multiscreen::Settings::instance().snapshot()->webhook.queue_capacity))) {
+    }
+
+    Dispatcher::~Dispatcher() { stop(); }
+
+    void Dispatcher::start() {
+        if (m_run.exchange(true)) return;
+        m_thr = std::thread([this] { run(); });
+    }
+
+    void Dispatcher::stop() {
+        if (!m_run.exchange(false)) return;
+        m_cv.notify_all();
+        if (m_thr.joinable()) m_thr.join();
+        m_cli.reset();
+    }
+
+    bool Dispatcher::enqueue(std::string stream, std::string body) noexcept {
+        Event ev;
+        try {
+            ev.stream = std::move(stream);
+            ev.body = std::move(body);
+        }
+        catch (...) {
+            m_dropped.fetch_add(1, std::memory_order_relaxed);
+            return false;
+        }
+        ev.enq_ms = now_ms_steady();
+
+        if (!m_q.try_push(std::move(ev))) {
+            m_dropped.fetch_add(1, std::memory_order_relaxed);
+            return false;
+        }
+        m_enqueued.fetch_add(1, std::memory_order_relaxed);
+        m_cv.notify_one();
+        return true;
+    }
+
+    DispatcherStats Dispatcher::stats() const {
+        DispatcherStats s;
+        s.queue_depth = m_q.size_approx();
+        s.queue_capacity = m_q.capacity();
+        s.enqueued = m_enqueued.load(std::memory_order_relaxed);
+        s.dropped = m_dropped.load(std::memory_order_relaxed);
+        s.discarded = m_discarded.load(std::memory_order_relaxed);
+        s.sent_events = m_sent_events.load(std::memory_order_relaxed);
+        s.sent_batches = m_sent_batches.load(std::memory_order_relaxed);
+        s.failed_batches = m_failed_batches.load(std::memory_order_relaxed);
+        s.dead_letters = m_dead_letters.load(std::memory_order_relaxed);
+        s.retries = m_retries.load(std::memory_order_relaxed);
+        s.backoff_ms = m_backoff_ms.load(std::memory_order_relaxed);
+        s.outbox_pending = m_ob_pending.load(std::memory_order_relaxed);
+        s.outbox_bytes = m_ob_bytes.load(std::memory_order_relaxed);
+        s.outbox_dropped = m_ob_dropped.load(std::memory_order_relaxed);
+        s.outbox_durable = m_ob_durable.load(std::memory_order_relaxed);
+
+        std::lock_guard<std::mutex> lk(m_lat_mx);
+        s.last_send_ms = m_last_send_ms;
+        s.avg_send_ms = m_avg_send_ms;
+        s.max_send_ms = m_max_send_ms;
+        s.last_queue_ms = m_last_queue_ms;
+        return s;
+    }
+
+    void Dispatcher::run() {
+        multiscreen::ThreadPlacement::Scope placement(multiscreen::ThreadRole::Control, "alerts");
+        {
+            const auto snap = multiscreen::Settings::instance().snapshot();
+            const auto& ob = snap->outbox;
+            m_outbox.open(ob.enabled ? ob.dir : std::string(),
+                static_cast<uint64_t>(ob.segment_kb) * 1024,
+                static_cast<uint64_t>(ob.max_mb) * 1024 * 1024);
+        }
+
+        std::vector<Outbox::Record> batch;
+        // восстановленное с диска отправляем сразу, без ожидания окна пачки
+        int64_t pending_since = m_outbox.pending() ? 0 : -1;
+        int64_t next_attempt = 0;
+        int     backoff = 0;
+        size_t  isolate = 0;   // после отказа пачки: столько записей шлём по одной, чтобы найти виновную
+
+        auto wait_ms = [this](int64_t ms) {
+            std::unique_lock<std::mutex> lk(m_wait_mx);
+            m_cv.wait_for(lk, std::chrono::milliseconds(std::clamp<int64_t>(ms, 1, 100)),
+                [this] { return !m_run.load() || m_q.size_approx() > 0; });
+            };
+
+        while (m_run.load()) {
+            // 1) очередь -> outbox (единственный писатель — этот поток)
+            size_t moved = 0;
+            while (auto ev = m_q.try_pop()) {
+                if (pending_since < 0) pending_since = ev->enq_ms;
+                if (!m_outbox.append(ev->stream, ev->body)) m_dropped.fetch_add(1, std::memory_order_relaxed);
+                ++moved;
+            }
+            if (moved) m_outbox.sync();
+            publish_outbox_stats();
+
+            if (m_outbox.pending() == 0) {
+                pending_since = -1;
+                wait_ms(100);
+                continue;
+            }
+
+            const auto snap = multiscreen::Settings::instance().snapshot();
+            const auto& wh = snap->webhook;
+            const int64_t now = now_ms_steady();
+
+            if (!wh.enabled || wh.url.empty()) {
+                // вебхук выключили — накопленное некуда доставлять
+                const size_t n = m_outbox.peek(m_outbox.pending(), batch);
+                m_outbox.commit(n);
+                m_discarded.fetch_add(n, std::memory_order_relaxed);
+                continue;
+            }
+
+            // 2) пауза после неудачи
+            if (now < next_attempt) {
+                wait_ms(next_attempt - now);
+                continue;
+            }
+
+            // 3) окно пачки: добираем события, пока не наберётся max_batch
+            const size_t max_batch = isolate ? 1 : static_cast<size_t>(std::max(1, wh.max_batch));
+            if (m_outbox.pending() < max_batch && pending_since > 0 && now < pending_since + wh.batch_window_ms) {
+                wait_ms(pending_since + wh.batch_window_ms - now);
+                continue;
+            }
+
+            // 4) отправка: подтверждаем только после 2xx, иначе повтор той же пачки (порядок сохраняется)
+            m_outbox.peek(max_batch, batch);
+            if (batch.empty()) {
+                wait_ms(100);
+                continue;
+            }
+            if (pending_since > 0) {
+                std::lock_guard<std::mutex> lk(m_lat_mx);
+                m_last_queue_ms = static_cast<double>(now - pending_since);
+            }
+
+            ensure_client(wh.url, wh.timeout_ms);
+            const int status = post_batch(batch);
+            if (status >= 200 && status < 300) {
+                m_outbox.commit(batch.size());
+                m_sent_batches.fetch_add(1, std::memory_order_relaxed);
+                m_sent_events.fetch_add(batch.size(), std::memory_order_relaxed);
+                if (isolate) --isolate;
+                backoff = 0;
+                next_attempt = 0;
+                pending_since = m_outbox.pending() ? 0 : -1;
+            }
+            else if (!retryable(status)) {
+                // приёмник отверг окончательно: повтор ничего не изменит и держал бы все алерты за этой записью
+                m_failed_batches.fetch_add(1, std::memory_order_relaxed);
+                if (batch.size() == 1) {
+                    m_outbox.dead_letter(batch.front(), status);
+                    m_outbox.commit(1);
+                    m_dead_letters.fetch_add(1, std::memory_order_relaxed);
+                    multiscreen::Logger::warning("alerts: webhook rejected alert for '" + batch.front().stream +
+                        "' (HTTP " + std::to_string(status) + "), moved to dead-letter");
+                    if (isolate) --isolate;
+                }
+                else {
+                    isolate = batch.size();
+                }
+                backoff = 0;
+                next_attempt = 0;
+                pending_since = m_outbox.pending() ? 0 : -1;
+            }
+            else {
+                m_failed_batches.fetch_add(1, std::memory_order_relaxed);
+                m_retries.fetch_add(1, std::memory_order_relaxed);
+                const auto& ob = snap->outbox;
+                backoff = backoff ? std::min(backoff * 2, ob.backoff_max_ms) : ob.backoff_initial_ms;
+                next_attempt = now_ms_steady() + backoff;
+                if (backoff >= ob.backoff_max_ms) m_cli.reset(); // переоткроем соединение с нуля
+            }
+            m_backoff_ms.store(backoff, std::memory_order_relaxed);
+        }
+
+        // остаток очереди — на диск, доставим после перезапуска
+        while (auto ev = m_q.try_pop()) m_outbox.append(ev->stream, ev->body);
+        publish_outbox_stats();
+        m_outbox.close();
+    }
+
+    void Dispatcher::publish_outbox_stats() noexcept {
+        m_ob_pending.store(m_outbox.pending(), std::memory_order_relaxed);
+        m_ob_bytes.store(m_outbox.bytes(), std::memory_order_relaxed);
+        m_ob_dropped.store(m_outbox.dropped(), std::memory_order_relaxed);
+        m_ob_durable.store(m_outbox.durable(), std::memory_order_relaxed);
+    }
+
+    void Dispatcher::ensure_client(const std::string& url, int timeout_ms) {
+        const int timeout_eff = timeout_ms > 0 ? timeout_ms : 1500;
+        if (m_cli && url == m_cli_url && timeout_eff == m_cli_timeout_ms) return;
+
+        // соединение пересоздаём только при смене адреса или таймаута в настройках
+        std::string shp;
+        split_url(url, shp, m_cli_path);
+        m_cli_url = url;
+        m_cli_timeout_ms = timeout_eff;
+        m_cli.reset();
+        if (shp.empty()) return;
+
+        m_cli = std::make_unique<httplib::Client>(shp);
+        if (!m_cli->is_valid()) {
+            multiscreen::Logger::warning("alerts: unsupported webhook url: " + url);
+            m_cli.reset();
+            return;
+        }
+        const auto timeout = std::chrono::milliseconds(timeout_eff);
+        m_cli->set_keep_alive(true);
+        m_cli->set_connection_timeout(timeout);
+        m_cli->set_read_timeout(timeout);
+        m_cli->set_write_timeout(timeout);
+    }
+
+    int Dispatcher::post_batch(const std::vector<Outbox::Record>& batch) {
+        if (!m_cli) return 0;
+
+        // одно событие уходит как есть (совместимо со старыми приёмниками), несколько — одним массивом
+        std::string body;
+        if (batch.size() == 1) {
+            body = batch.front().body;
+        }
+        else {
+            size_t total = 64;
+            for (const auto& ev : batch) total += ev.body.size() + 1;
+            body.reserve(total);
+            body += "{\"event\":\"batch\",\"count\":";
+            body += std::to_string(batch.size());
+            body += ",\"events\":[";
+            for (size_t i = 0; i < batch.size(); ++i) {
+                if (i) body += ',';
+                body += batch[i].body;
+            }
+            body += "]}";
+        }
+
+        const auto t0 = std::chrono::steady_clock::now();
+        auto res = m_cli->Post(m_cli_path, body, "application/json");
+        const double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t0).count();
+        note_send_latency(ms);
+
+        return res ? res->status : 0;
+    }
+
+    void Dispatcher::note_send_latency(double ms) noexcept {
+        std::lock_guard<std::mutex> lk(m_lat_mx);
+        m_last_send_ms = ms;
+        constexpr double alpha = 0.2;
+        m_avg_send_ms = (m_avg_send_ms <= 0.0) ? ms : (m_avg_send_ms + alpha * (ms - m_avg_send_ms));
+        if (ms > m_max_send_ms) m_max_send_ms = ms;
+    }
+
+} // namespace alerts
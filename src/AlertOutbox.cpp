@@ -0,0 +1,441 @@
+#include "AlertOutbox.h"
+#include "Logger.h"
+
+#include <algorithm>
+#include <array>
+#include <cinttypes>
+#include <cstring>
+#include <filesystem>
+#include <system_error>
+
+#if defined(_WIN32)
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+
+namespace fs = std::filesystem;
+
+namespace alerts {
+
+    namespace {
+        constexpr uint32_t kMagic = 0x424F534Du; // "MSOB"
+        constexpr uint32_t kMaxRecord = 16u << 20;
+        constexpr size_t   kHeader = 12;         // magic + len + crc
+
+        uint32_t crc32(const uint8_t* p, size_t n) noexcept {
+            static const auto table = [] {
+                std::array<uint32_t, 256> t{};
+                for (uint32_t i = 0; i < 256; ++i) {
+                    uint32_t c = i;
+                    for (int k = 0; k < 8; ++k) c = (c & 1) ? (0xEDB88320u ^ (c >> 1)) : (c >> 1);
+                    t[i] = c;
+                }
+                return t;
+            }();
+            uint32_t c = 0xFFFFFFFFu;
+            for (size_t i = 0; i < n; ++i) c = table[(c ^ p[i]) & 0xFF] ^ (c >> 8);
+            return c ^ 0xFFFFFFFFu;
+        }
+
+        void put_u32(uint8_t* p, uint32_t v) noexcept {
+            p[0] = static_cast<uint8_t>(v); p[1] = static_cast<uint8_t>(v >> 8);
+            p[2] = static_cast<uint8_t>(v >> 16); p[3] = static_cast<uint8_t>(v >> 24);
+        }
+
+        uint32_t get_u32(const uint8_t* p) noexcept {
+            return static_cast<uint32_t>(p[0]) | (static_cast<uint32_t>(p[1]) << 8) |
+                (static_cast<uint32_t>(p[2]) << 16) | (static_cast<uint32_t>(p[3]) << 24);
+        }
+
+        void fsync_file(std::FILE* f) noexcept {
+            if (!f) return;
+            std::fflush(f);
+#if defined(_WIN32)
+            _commit(_fileno(f));
+#else
+            ::fsync(fileno(f));
+#endif
+        }
+
+        bool parse_seg_name(const std::string& name, uint64_t& index) {
+            // seg-0000000000000001.log
+            if (name.size() != 24 || name.rfind("seg-", 0) != 0 || name.substr(20) != ".log") return false;
+            try { index = std::stoull(name.substr(4, 16)); }
+            catch (...) { return false; }
+            return true;
+        }
+    } // namespace
+
+    Outbox::~Outbox() { close(); }
+
+    std::string Outbox::seg_path(uint64_t index) const {
+        char name[32];
+        std::snprintf(name, sizeof(name), "seg-%016" PRIu64 ".log", index);
+        return (fs::path(m_dir) / name).string();
+    }
+
+    bool Outbox::read_record(std::FILE* f, Record* out, uint64_t& rec_size) const {
+        uint8_t hdr[kHeader];
+        if (std::fread(hdr, 1, kHeader, f) != kHeader) return false;
+        if (get_u32(hdr) != kMagic) return false;
+        const uint32_t len = get_u32(hdr + 4);
+        const uint32_t crc = get_u32(hdr + 8);
+        if (len < 2 || len > kMaxRecord) return false;
+
+        std::string payload(len, '\0');
+        if (std::fread(payload.data(), 1, len, f) != len) return false;
+        const auto* p = reinterpret_cast<const uint8_t*>(payload.data());
+        if (crc32(p, len) != crc) return false;
+
+        const size_t slen = static_cast<size_t>(p[0]) | (static_cast<size_t>(p[1]) << 8);
+        if (2 + slen > len) return false;
+        if (out) {
+            out->stream.assign(payload.data() + 2, slen);
+            out->body.assign(payload.data() + 2 + slen, len - 2 - slen);
+        }
+        rec_size = kHeader + len;
+        return true;
+    }
+
+    bool Outbox::open(const std::string& dir, uint64_t segment_bytes, uint64_t max_bytes) {
+        close();
+        m_segment_bytes = std::max<uint64_t>(segment_bytes, 4096);
+        m_max_bytes = std::max<uint64_t>(max_bytes, m_segment_bytes * 2);
+        m_dir = dir;
+        m_durable = false;
+
+        if (dir.empty()) return false;
+
+        std::error_code ec;
+        fs::create_directories(dir, ec);
+        if (ec) {
+            multiscreen::Logger::warning("alerts outbox: cannot create " + dir + ": " + ec.message() + "; using memory");
+            return false;
+        }
+
+        // 1) сегменты по порядку
+        std::vector<uint64_t> idx;
+        for (const auto& de : fs::directory_iterator(dir, ec)) {
+            uint64_t i = 0;
+            if (de.is_regular_file() && parse_seg_name(de.path().filename().string(), i)) idx.push_back(i);
+        }
+        std::sort(idx.begin(), idx.end());
+
+        // 2) проверка CRC, обрезка рваного хвоста
+        for (uint64_t i : idx) {
+            Segment s;
+            s.index = i;
+            const std::string path = seg_path(i);
+            if (std::FILE* f = std::fopen(path.c_str(), "rb")) {
+                uint64_t rs = 0;
+                while (read_record(f, nullptr, rs)) { s.size += rs; ++s.records; }
+                std::fclose(f);
+            }
+            std::error_code fe;
+            if (fs::file_size(path, fe) != s.size && !fe) {
+                multiscreen::Logger::warning("alerts outbox: truncating torn tail of " + path);
+                fs::resize_file(path, s.size, fe);
+            }
+            m_segs.push_back(s);
+            m_total_bytes += s.size;
+        }
+        if (m_segs.empty()) m_segs.push_back(Segment{ 1, 0, 0 });
+
+        // 3) позиция чтения
+        Pos cur{ m_segs.front().index, 0 };
+        Pos saved{};
+        if (load_cursor(saved)) {
+            if (saved.seg > m_segs.back().index) cur = { m_segs.back().index, m_segs.back().size };
+            else if (saved.seg >= m_segs.front().index) cur = saved;
+        }
+        // сегменты до курсора уже доставлены
+        while (m_segs.size() > 1 && m_segs.front().index < cur.seg) {
+            std::error_code re;
+            fs::remove(seg_path(m_segs.front().index), re);
+            m_total_bytes -= m_segs.front().size;
+            m_segs.pop_front();
+        }
+        if (cur.seg != m_segs.front().index) cur = { m_segs.front().index, 0 };
+
+        // выравниваем курсор по границе записи и считаем прочитанное в его сегменте
+        m_rd = { cur.seg, 0 };
+        m_rd_consumed = 0;
+        if (std::FILE* f = std::fopen(seg_path(cur.seg).c_str(), "rb")) {
+            uint64_t rs = 0;
+            while (m_rd.off + kHeader <= cur.off && read_record(f, nullptr, rs) && m_rd.off + rs <= cur.off) {
+                m_rd.off += rs;
+                ++m_rd_consumed;
+            }
+            std::fclose(f);
+        }
+
+        m_pending = 0;
+        for (const auto& s : m_segs) m_pending += static_cast<size_t>(s.records);
+        m_pending -= static_cast<size_t>(m_rd_consumed);
+
+        m_wr = std::fopen(seg_path(m_segs.back().index).c_str(), "ab");
+        if (!m_wr) {
+            multiscreen::Logger::warning("alerts outbox: cannot open segment in " + dir + "; using memory");
+            m_segs.clear();
+            m_total_bytes = 0;
+            m_pending = 0;
+            return false;
+        }
+        m_durable = true;
+        if (m_pending) {
+            multiscreen::Logger::info("alerts outbox: " + std::to_string(m_pending) + " undelivered alert(s) restored");
+        }
+        return true;
+    }
+
+    void Outbox::close() {
+        if (m_wr) {
+            fsync_file(m_wr);
+            std::fclose(m_wr);
+            m_wr = nullptr;
+        }
+        m_segs.clear();
+        m_mem.clear();
+        m_mem_bytes = 0;
+        m_peek_end.clear();
+        m_pending = 0;
+        m_total_bytes = 0;
+        m_durable = false;
+    }
+
+    bool Outbox::append(const std::string& stream, const std::string& body) {
+        const size_t slen = std::min<size_t>(stream.size(), 0xFFFF);
+        const size_t len = 2 + slen + body.size();
+        if (len > kMaxRecord) return false;
+
+        if (!m_durable) {
+            m_mem.push_back(Record{ stream.substr(0, slen), body });
+            m_total_bytes += kHeader + len;
+            m_mem_bytes += kHeader + len;
+            ++m_pending;
+            // сначала вытесняются недочитанные сегменты — они старше
+            enforce_cap();
+            while (m_total_bytes > m_max_bytes && m_mem.size() > 1) {
+                const uint64_t sz = kHeader + 2 + m_mem.front().stream.size() + m_mem.front().body.size();
+                m_total_bytes -= sz;
+                m_mem_bytes -= sz;
+                m_mem.pop_front();
+                --m_pending;
+                ++m_dropped;
+            }
+            return true;
+        }
+
+        std::string buf(kHeader + len, '\0');
+        auto* p = reinterpret_cast<uint8_t*>(buf.data());
+        p[kHeader] = static_cast<uint8_t>(slen);
+        p[kHeader + 1] = static_cast<uint8_t>(slen >> 8);
+        std::memcpy(p + kHeader + 2, stream.data(), slen);
+        std::memcpy(p + kHeader + 2 + slen, body.data(), body.size());
+        put_u32(p, kMagic);
+        put_u32(p + 4, static_cast<uint32_t>(len));
+        put_u32(p + 8, crc32(p + kHeader, len));
+
+        if (std::fwrite(buf.data(), 1, buf.size(), m_wr) != buf.size()) return false;
+        std::fflush(m_wr); // в ОС сразу; fsync — пачкой в sync()
+
+        auto& seg = m_segs.back();
+        seg.size += buf.size();
+        ++seg.records;
+        m_total_bytes += buf.size();
+        ++m_pending;
+
+        if (seg.size >= m_segment_bytes) roll_segment();
+        enforce_cap();
+        return true;
+    }
+
+    void Outbox::sync() {
+        if (m_durable) fsync_file(m_wr);
+    }
+
+    bool Outbox::roll_segment() {
+        fsync_file(m_wr);
+        std::fclose(m_wr);
+        const uint64_t next = m_segs.back().index + 1;
+        m_segs.push_back(Segment{ next, 0, 0 });
+        m_wr = std::fopen(seg_path(next).c_str(), "ab");
+        if (!m_wr) {
+            // дальше пишем в память; уже записанные сегменты peek() дочитывает первыми
+            multiscreen::Logger::error("alerts outbox: cannot create segment " + seg_path(next) + "; using memory");
+            m_segs.pop_back();
+            m_durable = false;
+            return false;
+        }
+        return true;
+    }
+
+    void Outbox::enforce_cap() {
+        bool dropped = false;
+        // пишущийся сегмент не трогаем; без записи на диск можно вытеснить все
+        while (m_total_bytes > m_max_bytes && m_segs.size() > (m_durable ? 1u : 0u)) {
+            drop_front_segment();
+            dropped = true;
+        }
+        if (dropped) save_cursor();
+    }
+
+    void Outbox::drop_front_segment() {
+        const Segment s = m_segs.front();
+        uint64_t lost = 0;
+        if (m_rd.seg == s.index) lost = s.records - m_rd_consumed;
+        m_pending -= static_cast<size_t>(lost);
+        m_dropped += lost;
+        if (lost) {
+            multiscreen::Logger::warning("alerts outbox: disk cap reached, dropped " + std::to_string(lost) + " oldest alert(s)");
+        }
+
+        std::error_code ec;
+        fs::remove(seg_path(s.index), ec);
+        m_total_bytes -= s.size;
+        m_segs.pop_front();
+        m_peek_end.clear();
+
+        if (m_segs.empty()) {
+            forget_disk();
+        }
+        else if (m_rd.seg <= s.index) {
+            m_rd = { m_segs.front().index, 0 };
+            m_rd_consumed = 0;
+        }
+    }
+
+    // Сегменты кончились в режиме памяти: курсор больше не относится ни к одному файлу
+    void Outbox::forget_disk() {
+        m_rd = {};
+        m_rd_consumed = 0;
+        std::error_code ec;
+        fs::remove(fs::path(m_dir) / "cursor", ec);
+    }
+
+    size_t Outbox::peek(size_t max, std::vector<Record>& out) {
+        out.clear();
+        m_peek_end.clear();
+
+        Pos pos = m_rd;
+        std::FILE* f = nullptr;
+        uint64_t f_seg = 0;
+        size_t si = 0;
+        while (si < m_segs.size() && m_segs[si].index != pos.seg) ++si;
+
+        while (out.size() < max && si < m_segs.size()) {
+            const Segment& s = m_segs[si];
+            if (pos.off >= s.size) {
+                if (si + 1 >= m_segs.size()) break;
+                ++si;
+                pos = { m_segs[si].index, 0 };
+                continue;
+            }
+            if (!f || f_seg != s.index) {
+                if (f) std::fclose(f);
+                f = std::fopen(seg_path(s.index).c_str(), "rb");
+                f_seg = s.index;
+                if (!f || std::fseek(f, static_cast<long>(pos.off), SEEK_SET) != 0) break;
+            }
+            Record r;
+            uint64_t rs = 0;
+            if (!read_record(f, &r, rs)) break;
+            pos.off += rs;
+            out.push_back(std::move(r));
+            m_peek_end.push_back(pos);
+        }
+        if (f) std::fclose(f);
+
+        // записи в памяти идут после всех сегментов: дочитываем, только если диск исчерпан
+        if (m_peek_end.size() == disk_pending()) {
+            const size_t n = std::min(max - out.size(), m_mem.size());
+            out.insert(out.end(), m_mem.begin(), m_mem.begin() + static_cast<std::ptrdiff_t>(n));
+        }
+        return out.size();
+    }
+
+    void Outbox::commit(size_t n) {
+        const size_t disk = std::min(n, m_peek_end.size());
+        size_t mem = std::min(n - disk, m_mem.size());
+        if (disk) commit_disk(disk);
+        m_peek_end.clear();
+        for (; mem; --mem) {
+            const uint64_t sz = kHeader + 2 + m_mem.front().stream.size() + m_mem.front().body.size();
+            m_total_bytes -= sz;
+            m_mem_bytes -= sz;
+            m_mem.pop_front();
+            --m_pending;
+        }
+    }
+
+    void Outbox::commit_disk(size_t n) {
+        for (size_t i = 0; i < n; ++i) {
+            if (m_peek_end[i].seg != m_rd.seg) {
+                m_rd.seg = m_peek_end[i].seg;
+                m_rd_consumed = 0;
+            }
+            ++m_rd_consumed;
+        }
+        m_rd = m_peek_end[n - 1];
+        m_pending -= n;
+
+        // полностью доставленные сегменты (кроме пишущегося) удаляем
+        while (m_segs.size() > (m_durable ? 1u : 0u) && (m_segs.front().index < m_rd.seg ||
+            (m_segs.front().index == m_rd.seg && m_rd.off >= m_segs.front().size))) {
+            const Segment s = m_segs.front();
+            std::error_code ec;
+            fs::remove(seg_path(s.index), ec);
+            m_total_bytes -= s.size;
+            m_segs.pop_front();
+            if (m_segs.empty()) {
+                forget_disk();
+                return;
+            }
+            if (m_rd.seg <= s.index) {
+                m_rd = { m_segs.front().index, 0 };
+                m_rd_consumed = 0;
+            }
+        }
+        save_cursor();
+    }
+
+    size_t Outbox::disk_pending() const noexcept {
+        return m_pending - m_mem.size();
+    }
+
+    void Outbox::dead_letter(const Record& r, int status) {
+        if (m_dir.empty()) return;
+        const std::string path = (fs::path(m_dir) / "dead-letter.log").string();
+        std::FILE* f = std::fopen(path.c_str(), "ab");
+        if (!f) return;
+        std::fprintf(f, "%d %s %s\n", status, r.stream.c_str(), r.body.c_str());
+        std::fclose(f);
+    }
+
+    void Outbox::save_cursor() {
+        if (m_segs.empty()) return;
+        const std::string tmp = (fs::path(m_dir) / "cursor.tmp").string();
+        const std::string dst = (fs::path(m_dir) / "cursor").string();
+        std::FILE* f = std::fopen(tmp.c_str(), "wb");
+        if (!f) return;
+        std::fprintf(f, "%" PRIu64 " %" PRIu64 "\n", m_rd.seg, m_rd.off);
+        fsync_file(f);
+        std::fclose(f);
+        std::error_code ec;
+        fs::rename(tmp, dst, ec);
+    }
+
+    bool Outbox::load_cursor(Pos& p) const {
+        const std::string path = (fs::path(m_dir) / "cursor").string();
+        std::FILE* f = std::fopen(path.c_str(), "rb");
+        if (!f) return false;
+        uint64_t seg = 0, off = 0;
+        const bool ok = std::fscanf(f, "%" SCNu64 " %" SCNu64, &seg, &off) == 2;
+        std::fclose(f);
+        if (!ok) return false;
+        p = { seg, off };
+        return true;
+    }
+
+} // namespace alerts
@@ -0,0 +1,319 @@
+#include "AlertState.h"
+#include "Settings.h"
+
+#include <algorithm>
+#include <cstring>
+
+namespace alerts {
+
+    namespace {
+        constexpr size_t kKeyLen = 40;   // префикс имени канала, хранимый в записи
+        constexpr size_t kMaxProbe = 32;
+
+        uint64_t hash_key(std::string_view stream, Condition cond) noexcept {
+            uint64_t h = 1469598103934665603ull; // FNV-1a
+            for (unsigned char c : stream) { h ^= c; h *= 1099511628211ull; }
+            h ^= (static_cast<uint64_t>(cond) + 1) * 0x9E3779B97F4A7C15ull;
+            h ^= h >> 29;
+            return h;
+        }
+
+        // Ключ по id: 0x01 + 4 байта id — с именем канала не пересекается
+        struct IdKey {
+            char b[5];
+            std::string_view view() const noexcept { return { b, sizeof(b) }; }
+        };
+
+        IdKey id_key(uint32_t id) noexcept {
+            IdKey k;
+            k.b[0] = '\x01';
+            std::memcpy(k.b + 1, &id, sizeof(id));
+            return k;
+        }
+
+        uint64_t hash_id(uint32_t id, Condition cond) noexcept {
+            uint64_t h = ((static_cast<uint64_t>(id) << 8) | static_cast<uint64_t>(cond)) * 0x9E3779B97F4A7C15ull;
+            h ^= h >> 29;
+            return h;
+        }
+    } // namespace
+
+    const char* to_string(Condition c) noexcept {
+        switch (c) {
+        case Condition::Fps:       return "fps";
+        case Condition::Bitrate:   return "bitrate";
+        case Condition::Stall:     return "stall";
+        case Condition::CcErrors:  return "cc_errors";
+        case Condition::PcrJitter: return "pcr_jitter";
+        case Condition::MdiDf:     return "mdi_df";
+        case Condition::MdiMlr:    return "mdi_mlr";
+        default:                   return "unknown";
+        }
+    }
+
+    const char* to_string(Level l) noexcept {
+        switch (l) {
+        case Level::Ok:   return "ok";
+        case Level::Warn: return "warn";
+        case Level::Crit: return "crit";
+        default:          return "ok";
+        }
+    }
+
+    struct StateEngine::Entry {
+        enum : uint8_t { Empty = 0, Used = 1, Tomb = 2 };
+
+        uint64_t  hash = 0;
+        uint8_t   slot = Empty;
+        Condition cond = Condition::Fps;
+        uint8_t   key_len = 0;
+        char      key[kKeyLen]{};
+
+        Level   level = Level::Ok;
+        Level   candidate = Level::Ok;
+        Level   last_notified = Level::Ok;
+        bool    flapping = false;
+        int64_t candidate_since = 0;
+        int64_t last_update = 0;
+
+        int64_t  flap_win_start = 0;
+        uint32_t flap_count = 0;
+        int64_t  flap_until = 0;
+
+        bool matches(uint64_t h, std::string_view s, Condition c) const noexcept {
+            if (slot != Used || hash != h || cond != c) return false;
+            const size_t n = std::min(s.size(), kKeyLen);
+            return key_len == n && std::memcmp(key, s.data(), n) == 0;
+        }
+
+        void assign(uint64_t h, std::string_view s, Condition c, int64_t now) noexcept {
+            *this = Entry{};
+            slot = Used;
+            hash = h;
+            cond = c;
+            key_len = static_cast<uint8_t>(std::min(s.size(), kKeyLen));
+            std::memcpy(key, s.data(), key_len);
+            candidate_since = now;
+            last_update = now;
+        }
+    };
+
+    StateEngine& StateEngine::instance() {
+        static StateEngine e;
+        return e;
+    }
+
+    StateEngine::StateEngine() {
+        const size_t want = static_cast<size_t>(
+            std::max(64, multiscreen::Settings::instance().snapshot()->alert_state.table_size));
+        size_t cap = 64;
+        while (cap < want) cap <<= 1;
+        m_tab = std::make_unique<Entry[]>(cap);
+        m_mask = cap - 1;
+    }
+
+    const StateEngine::Entry* StateEngine::find(uint64_t h, std::string_view stream, Condition cond) const {
+        for (size_t i = 0; i < kMaxProbe; ++i) {
+            const Entry& e = m_tab[(h + i) & m_mask];
+            if (e.slot == Entry::Empty) return nullptr;
+            if (e.matches(h, stream, cond)) return &e;
+        }
+        return nullptr;
+    }
+
+    StateEngine::Entry* StateEngine::find_or_insert(uint64_t h, std::string_view stream, Condition cond, int64_t now_ms) {
+        Entry* free_slot = nullptr;
+        Entry* victim = nullptr;
+
+        for (size_t i = 0; i < kMaxProbe; ++i) {
+            Entry& e = m_tab[(h + i) & m_mask];
+            if (e.matches(h, stream, cond)) return &e;
+            if (e.slot != Entry::Used) {
+                if (!free_slot) free_slot = &e;
+                if (e.slot == Entry::Empty) break;
+                continue;
+            }
+            // кандидат на вытеснение: спокойная запись, дольше всех без обновлений
+            if (e.level == Level::Ok && !e.flapping && e.last_notified == Level::Ok &&
+                (!victim || e.last_update < victim->last_update)) {
+                victim = &e;
+            }
+        }
+
+        if (free_slot) {
+            ++m_used;
+            free_slot->assign(h, stream, cond, now_ms);
+            return free_slot;
+        }
+        if (victim) {
+            ++m_evictions;
+            victim->assign(h, stream, cond, now_ms);
+            return victim;
+        }
+        ++m_rejected;
+        return nullptr;
+    }
+
+    Transition StateEngine::evaluate(std::string_view stream, Condition cond, double value,
+        double warn, double crit, bool lower_is_worse, int64_t now_ms)
+    {
+        return evaluate_at(hash_key(stream, cond), stream, cond, value, warn, crit, lower_is_worse, now_ms);
+    }
+
+    Transition StateEngine::evaluate(uint32_t stream_id, Condition cond, double value,
+        double warn, double crit, bool lower_is_worse, int64_t now_ms)
+    {
+        const IdKey k = id_key(stream_id);
+        return evaluate_at(hash_id(stream_id, cond), k.view(), cond, value, warn, crit, lower_is_worse, now_ms);
+    }
+
+    Transition StateEngine::evaluate_at(uint64_t h, std::string_view stream, Condition cond, double value,
+        double warn, double crit, bool lower_is_worse, int64_t now_ms)
+    {
+        const auto snap = multiscreen::Settings::instance().snapshot();
+        const auto& cfg = snap->alert_state;
+        const double hyst = cfg.hysteresis_pct / 100.0;
+
+        // порог уровня; если уже в нём — выход только с запасом hysteresis
+        auto hit = [&](double thr, bool inside) {
+            if (lower_is_worse) return value <= (inside ? thr * (1.0 + hyst) : thr);
+            return value >= (inside ? thr * (1.0 - hyst) : thr);
+        };
+
+        std::lock_guard<std::mutex> lk(m_mx);
+        Entry* e = find_or_insert(h, stream, cond, now_ms);
+
+        Transition t;
+        if (!e) {
+            // таблица переполнена: отдаём «сырой» уровень без уведомления
+            t.level = hit(crit, false) ? Level::Crit : (hit(warn, false) ? Level::Warn : Level::Ok);
+            t.prev = t.level;
+            return t;
+        }
+
+        Level raw = Level::Ok;
+        if (hit(warn, e->level >= Level::Warn)) raw = Level::Warn;
+        if (hit(crit, e->level >= Level::Crit)) raw = Level::Crit;
+
+        t.prev = e->level;
+        e->last_update = now_ms;
+
+        if (raw == e->level) {
+            e->candidate = e->level;
+            e->candidate_since = now_ms;
+        }
+        else {
+            if (raw != e->candidate) {
+                e->candidate = raw;
+                e->candidate_since = now_ms;
+            }
+            const int dwell = (raw > e->level) ? cfg.enter_dwell_ms : cfg.exit_dwell_ms;
+            if (now_ms - e->candidate_since >= dwell) {
+                e->level = raw;
+                e->candidate_since = now_ms;
+                t.changed = true;
+
+                // учёт смен уровня в окне flap_window_ms
+                if (now_ms - e->flap_win_start > cfg.flap_window_ms) {
+                    e->flap_win_start = now_ms;
+                    e->flap_count = 0;
+                }
+                ++e->flap_count;
+
+                if (e->flapping) {
+                    e->flap_until = now_ms + cfg.flap_hold_ms;
+                    ++m_suppressed;
+                }
+                else if (cfg.flap_transitions > 0 && e->flap_count >= static_cast<uint32_t>(cfg.flap_transitions)) {
+                    // одно уведомление о начале флаппинга, дальше — тишина до успокоения
+                    e->flapping = true;
+                    e->flap_until = now_ms + cfg.flap_hold_ms;
+                    t.notify = true;
+                }
+                else if (e->level != e->last_notified) {
+                    t.notify = true;
+                }
+            }
+        }
+
+        // флаппинг закончился: сообщаем устоявшийся уровень, если он отличается от отправленного
+        if (e->flapping && !t.changed && now_ms >= e->flap_until) {
+            e->flapping = false;
+            e->flap_count = 0;
+            e->flap_win_start = now_ms;
+            if (e->level != e->last_notified) t.notify = true;
+        }
+
+        t.level = e->level;
+        t.flapping = e->flapping;
+        if (t.notify) e->last_notified = e->level;
+
+        if (e->candidate != e->level) {
+            const int dwell = (e->candidate > e->level) ? cfg.enter_dwell_ms : cfg.exit_dwell_ms;
+            t.recheck_at_ms = e->candidate_since + dwell;
+        }
+        if (e->flapping && (t.recheck_at_ms == 0 || e->flap_until < t.recheck_at_ms)) {
+            t.recheck_at_ms = e->flap_until;
+        }
+        return t;
+    }
+
+    Level StateEngine::level(std::string_view stream, Condition cond) const {
+        return level_at(hash_key(stream, cond), stream, cond);
+    }
+
+    Level StateEngine::level(uint32_t stream_id, Condition cond) const {
+        const IdKey k = id_key(stream_id);
+        return level_at(hash_id(stream_id, cond), k.view(), cond);
+    }
+
+    Level StateEngine::level_at(uint64_t h, std::string_view key, Condition cond) const {
+        std::lock_guard<std::mutex> lk(m_mx);
+        const Entry* e = find(h, key, cond);
+        return e ? e->level : Level::Ok;
+    }
+
+    void StateEngine::forget(std::string_view stream) {
+        uint64_t hashes[static_cast<size_t>(Condition::Count)];
+        for (uint8_t c = 0; c < static_cast<uint8_t>(Condition::Count); ++c)
+            hashes[c] = hash_key(stream, static_cast<Condition>(c));
+        forget_at(stream, hashes);
+    }
+
+    void StateEngine::forget(uint32_t stream_id) {
+        uint64_t hashes[static_cast<size_t>(Condition::Count)];
+        for (uint8_t c = 0; c < static_cast<uint8_t>(Condition::Count); ++c)
+            hashes[c] = hash_id(stream_id, static_cast<Condition>(c));
+        const IdKey k = id_key(stream_id);
+        forget_at(k.view(), hashes);
+    }
+
+    void StateEngine::forget_at(std::string_view key, const uint64_t* hashes) {
+        std::lock_guard<std::mutex> lk(m_mx);
+        for (uint8_t c = 0; c < static_cast<uint8_t>(Condition::Count); ++c) {
+            const auto cond = static_cast<Condition>(c);
+            const uint64_t h = hashes[c];
+            for (size_t i = 0; i < kMaxProbe; ++i) {
+                Entry& e = m_tab[(h + i) & m_mask];
+                if (e.slot == Entry::Empty) break;
+                if (e.matches(h, key, cond)) {
+                    e.slot = Entry::Tomb;
+                    --m_used;
+                    break;
+                }
+            }
+        }
+    }
+
+    StateEngineStats StateEngine::stats() const {
+        std::lock_guard<std::mutex> lk(m_mx);
+        StateEngineStats s;
+        s.capacity = m_mask + 1;
+        s.used = m_used;
+        s.evictions = m_evictions;
+        s.rejected = m_rejected;
+        s.suppressed = m_suppressed;
+        return s;
+    }
+
+} // namespace alerts
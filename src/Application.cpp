@@ -3,8 +3,23 @@
 #include "FFmpegIncludes.h"
 #include "StreamManager.h"
 #include "WebServer.h"
+#include "AlertDispatcher.h"
+#include "ThreadPlacement.h"
+#include "FFLogRouter.h"
+#include "Stream.h"
+#include "TsScanner.h"
+#include "Tr101290.h"
+#include "UdpReceiver.h"
+#include "RtpReorder.h"
+#include "HlsReader.h"
+#include "Recorder.h"
+#include "TsCapture.h"
+#include "TsFanout.h"
+#include "GopCache.h"
+#include "HlsPreview.h"
 
 #include <nlohmann/json.hpp>
+#include <algorithm>
 #include <filesystem>
 #include <fstream>
 #include <thread>
@@ -38,7 +53,7 @@ namespace multiscreen {
             fs::current_path() / name // CWD/config
         };
         for (auto& c : cands) if (fs::exists(c)) return c;
-        return e / name; //    
+        return e / name; // по умолчанию создадим здесь
     }
 
     static void ensure_default_configs(const fs::path& dir) {
@@ -54,7 +69,7 @@ namespace multiscreen {
             std::ofstream(cfg) << j.dump(2);
         }
 
-        //  streams.json      4 
+        // если streams.json нет — создадим сразу с 4 каналами
         if (!fs::exists(streams)) {
             nlohmann::json j = {
                 {"streams", nlohmann::json::array({
@@ -80,10 +95,12 @@ namespace multiscreen {
         ensure_default_configs(cfgDir);
         Logger::info(std::string("Using config dir: ") + cfgDir.string());
 
-        //  config.json
+        // читаем config.json
         int  web_port = 8080;
         bool web_enable = true;
         bool streams_enable = true;
+        nlohmann::json cpu = nlohmann::json::object();
+        int ff_level = AV_LOG_WARNING, ff_rate = 10, ff_burst = 30;
         try {
             std::ifstream f(cfgDir / "config.json");
             if (f) {
@@ -91,6 +108,158 @@ namespace multiscreen {
                 if (j.contains("web") && j["web"].contains("port"))   web_port = j["web"]["port"].get<int>();
                 if (j.contains("web") && j["web"].contains("enable")) web_enable = j["web"]["enable"].get<bool>();
                 if (j.contains("streams") && j["streams"].contains("enable")) streams_enable = j["streams"]["enable"].get<bool>();
+                if (j.contains("cpu") && j["cpu"].is_object()) cpu = j["cpu"];
+                if (j.contains("ingest") && j["ingest"].is_object()) {
+                    const auto& ji = j["ingest"];
+                    if (ji.contains("ts_tap") && ji["ts_tap"].is_boolean()) Stream::set_ts_tap(ji["ts_tap"].get<bool>());
+                    if (ji.contains("simd") && ji["simd"].is_string()) TsScanner::select_isa(ji["simd"].get<std::string>());
+                    if (ji.contains("udp") && ji["udp"].is_object()) {
+                        const auto& ju = ji["udp"];
+                        if (ju.contains("native") && ju["native"].is_boolean()) Stream::set_udp_native(ju["native"].get<bool>());
+                        if (ju.contains("rcvbuf_kb") && ju["rcvbuf_kb"].is_number_integer())
+                            UdpReceiver::set_default_rcvbuf(std::clamp(ju["rcvbuf_kb"].get<int>(), 0, 1 << 20) * 1024);
+                    }
+                    if (ji.contains("hls") && ji["hls"].is_object()) {
+                        const auto& jh = ji["hls"];
+                        if (jh.contains("native") && jh["native"].is_boolean()) Stream::set_hls_native(jh["native"].get<bool>());
+                        int prefetch = 3, timeout = 5000, live_start = 3;
+                        if (jh.contains("prefetch") && jh["prefetch"].is_number_integer()) prefetch = jh["prefetch"].get<int>();
+                        if (jh.contains("timeout_ms") && jh["timeout_ms"].is_number_integer()) timeout = jh["timeout_ms"].get<int>();
+                        if (jh.contains("live_start_segments") && jh["live_start_segments"].is_number_integer()) live_start = jh["live_start_segments"].get<int>();
+                        HlsReader::set_defaults(prefetch, timeout, live_start);
+                    }
+                    if (ji.contains("rtp") && ji["rtp"].is_object()) {
+                        const auto& jr = ji["rtp"];
+                        int depth = 32, delay = 50;
+                        if (jr.contains("reorder_packets") && jr["reorder_packets"].is_number_integer()) depth = jr["reorder_packets"].get<int>();
+                        if (jr.contains("max_delay_ms") && jr["max_delay_ms"].is_number_integer()) delay = jr["max_delay_ms"].get<int>();
+                        RtpReorder::set_defaults(depth, delay);
+                        int merge_slots = 1024, skew = 50;
+                        if (jr.contains("merge_packets") && jr["merge_packets"].is_number_integer()) merge_slots = jr["merge_packets"].get<int>();
+                        if (jr.contains("max_skew_ms") && jr["max_skew_ms"].is_number_integer()) skew = jr["max_skew_ms"].get<int>();
+                        RtpReorder::set_merge_defaults(merge_slots, skew);
+                        if (jr.contains("fec") && jr["fec"].is_object()) {
+                            const auto& jf = jr["fec"];
+                            bool fec = true;
+                            int fec_slots = 512, fec_delay = 200;
+                            if (jf.contains("enable") && jf["enable"].is_boolean()) fec = jf["enable"].get<bool>();
+                            if (jf.contains("window_packets") && jf["window_packets"].is_number_integer()) fec_slots = jf["window_packets"].get<int>();
+                            if (jf.contains("max_delay_ms") && jf["max_delay_ms"].is_number_integer()) fec_delay = jf["max_delay_ms"].get<int>();
+                            RtpReorder::set_fec_defaults(fec, fec_slots, fec_delay);
+                        }
+                    }
+                    if (ji.contains("tr101290") && ji["tr101290"].is_object()) {
+                        const auto& jt = ji["tr101290"];
+                        TrLimits tl;
+                        auto ms = [&jt](const char* key, int& v) {
+                            if (jt.contains(key) && jt[key].is_number_integer()) v = std::max(0, jt[key].get<int>());
+                            };
+                        ms("pat_ms", tl.pat_ms);
+                        ms("pmt_ms", tl.pmt_ms);
+                        ms("pid_ms", tl.pid_ms);
+                        ms("pcr_repetition_ms", tl.pcr_repetition_ms);
+                        ms("pcr_discontinuity_ms", tl.pcr_discontinuity_ms);
+                        ms("pcr_accuracy_ns", tl.pcr_accuracy_ns);
+                        ms("pts_ms", tl.pts_ms);
+                        Tr101290::set_limits(tl);
+                    }
+                }
+                if (j.contains("recorder") && j["recorder"].is_object()) {
+                    const auto& jr = j["recorder"];
+                    RecorderOptions ro;
+                    auto mb = [&jr](const char* key, uint64_t& v) {
+                        if (jr.contains(key) && jr[key].is_number_integer()) v = static_cast<uint64_t>(std::max<int64_t>(0, jr[key].get<int64_t>())) << 20;
+                        };
+                    if (jr.contains("enable") && jr["enable"].is_boolean()) ro.enable = jr["enable"].get<bool>();
+                    if (jr.contains("dir") && jr["dir"].is_string()) ro.dir = jr["dir"].get<std::string>();
+                    if (jr.contains("streams") && jr["streams"].is_array())
+                        for (const auto& n : jr["streams"]) if (n.is_string()) ro.streams.push_back(n.get<std::string>());
+                    mb("segment_mb", ro.segment_bytes);
+                    mb("buffer_mb", ro.buffer_bytes);
+                    mb("stream_quota_mb", ro.stream_quota_bytes);
+                    mb("total_quota_mb", ro.total_quota_bytes);
+                    if (jr.contains("max_age_hours") && jr["max_age_hours"].is_number_integer()) ro.max_age_hours = std::max(0, jr["max_age_hours"].get<int>());
+                    if (jr.contains("flush_ms") && jr["flush_ms"].is_number_integer()) ro.flush_ms = jr["flush_ms"].get<int>();
+                    if (jr.contains("direct_io") && jr["direct_io"].is_boolean()) ro.direct_io = jr["direct_io"].get<bool>();
+                    // до создания стримов: каналы записи подключаются в конструкторе Stream
+                    Recorder::instance().configure(ro);
+                }
+                if (j.contains("live") && j["live"].is_object()) {
+                    const auto& jl = j["live"];
+                    bool enable = true;
+                    int max_clients = 16, queue_kb = 4096;
+                    if (jl.contains("enable") && jl["enable"].is_boolean()) enable = jl["enable"].get<bool>();
+                    if (jl.contains("max_clients") && jl["max_clients"].is_number_integer()) max_clients = jl["max_clients"].get<int>();
+                    if (jl.contains("queue_kb") && jl["queue_kb"].is_number_integer()) queue_kb = std::max(0, jl["queue_kb"].get<int>());
+                    // до старта WebServer: под каждого клиента /live в пуле HTTP есть свой поток
+                    TsFanout::set_defaults(enable, max_clients, static_cast<size_t>(queue_kb) * 1024);
+                }
+                if (j.contains("gop_cache") && j["gop_cache"].is_object()) {
+                    const auto& jg = j["gop_cache"];
+                    bool enable = true;
+                    int stream_kb = 16384, total_mb = 512;
+                    if (jg.contains("enable") && jg["enable"].is_boolean()) enable = jg["enable"].get<bool>();
+                    if (jg.contains("stream_kb") && jg["stream_kb"].is_number_integer()) stream_kb = std::max(0, jg["stream_kb"].get<int>());
+                    if (jg.contains("total_mb") && jg["total_mb"].is_number_integer()) total_mb = std::max(0, jg["total_mb"].get<int>());
+                    GopCache::set_defaults(enable, static_cast<size_t>(stream_kb) * 1024, static_cast<size_t>(total_mb) << 20);
+                }
+                if (j.contains("preview") && j["preview"].is_object()) {
+                    const auto& jp = j["preview"];
+                    bool enable = true;
+                    double segment_seconds = 2.0;
+                    int segments = 6, idle_timeout_s = 30;
+                    if (jp.contains("enable") && jp["enable"].is_boolean()) enable = jp["enable"].get<bool>();
+                    if (jp.contains("segment_seconds") && jp["segment_seconds"].is_number()) segment_seconds = jp["segment_seconds"].get<double>();
+                    if (jp.contains("segments") && jp["segments"].is_number_integer()) segments = jp["segments"].get<int>();
+                    if (jp.contains("idle_timeout_s") && jp["idle_timeout_s"].is_number_integer()) idle_timeout_s = jp["idle_timeout_s"].get<int>();
+                    HlsPreview::set_defaults(enable, segment_seconds, segments, idle_timeout_s);
+                }
+                if (j.contains("capture") && j["capture"].is_object()) {
+                    const auto& jc = j["capture"];
+                    CaptureOptions co;
+                    if (jc.contains("enable") && jc["enable"].is_boolean()) co.enable = jc["enable"].get<bool>();
+                    if (jc.contains("dir") && jc["dir"].is_string()) co.dir = jc["dir"].get<std::string>();
+                    if (jc.contains("pre_seconds") && jc["pre_seconds"].is_number_integer()) co.pre_seconds = jc["pre_seconds"].get<int>();
+                    if (jc.contains("post_seconds") && jc["post_seconds"].is_number_integer()) co.post_seconds = jc["post_seconds"].get<int>();
+                    if (jc.contains("buffer_mb") && jc["buffer_mb"].is_number_integer())
+                        co.buffer_bytes = static_cast<uint64_t>(std::max(0, jc["buffer_mb"].get<int>())) << 20;
+                    if (jc.contains("total_quota_mb") && jc["total_quota_mb"].is_number_integer())
+                        co.total_quota_bytes = static_cast<uint64_t>(std::max<int64_t>(0, jc["total_quota_mb"].get<int64_t>())) << 20;
+                    if (jc.contains("trigger") && jc["trigger"].is_string()) co.on_warning = jc["trigger"].get<std::string>() != "critical";
+                    // кольца создаются в конструкторе Stream
+                    IncidentCapture::instance().configure(co);
+                }
+                if (j.contains("logging") && j["logging"].is_object()) {
+                    const auto& jl = j["logging"];
+                    LogOptions lo;
+                    if (jl.contains("file") && jl["file"].is_string()) lo.file = jl["file"].get<std::string>();
+                    if (jl.contains("level") && jl["level"].is_string()) lo.min_level = Logger::parseLevel(jl["level"].get<std::string>());
+                    if (jl.contains("max_size_mb") && jl["max_size_mb"].is_number_integer())
+                        lo.max_bytes = static_cast<uint64_t>(std::max(0, jl["max_size_mb"].get<int>())) << 20;
+                    if (jl.contains("max_files") && jl["max_files"].is_number_integer()) lo.max_files = jl["max_files"].get<int>();
+                    if (jl.contains("rotate_hours") && jl["rotate_hours"].is_number_integer()) lo.rotate_hours = std::max(0, jl["rotate_hours"].get<int>());
+                    if (jl.contains("flush_ms") && jl["flush_ms"].is_number_integer()) lo.flush_ms = jl["flush_ms"].get<int>();
+                    if (jl.contains("thread_buffer") && jl["thread_buffer"].is_number_integer())
+                        lo.thread_buffer = static_cast<size_t>(std::max(0, jl["thread_buffer"].get<int>()));
+                    if (jl.contains("ring_capacity") && jl["ring_capacity"].is_number_integer())
+                        lo.ring_capacity = static_cast<size_t>(std::max(0, jl["ring_capacity"].get<int>()));
+                    Logger::configure(lo);
+
+                    // лог FFmpeg: уровень вывода и лимит строк на стрим
+                    if (jl.contains("ffmpeg") && jl["ffmpeg"].is_object()) {
+                        const auto& jf = jl["ffmpeg"];
+                        if (jf.contains("level") && jf["level"].is_string()) {
+                            switch (Logger::parseLevel(jf["level"].get<std::string>(), LogLevel::Warning)) {
+                            case LogLevel::Debug:   ff_level = AV_LOG_DEBUG; break;
+                            case LogLevel::Info:    ff_level = AV_LOG_INFO; break;
+                            case LogLevel::Warning: ff_level = AV_LOG_WARNING; break;
+                            case LogLevel::Error:   ff_level = AV_LOG_ERROR; break;
+                            }
+                        }
+                        if (jf.contains("rate_per_sec") && jf["rate_per_sec"].is_number_integer()) ff_rate = jf["rate_per_sec"].get<int>();
+                        if (jf.contains("burst") && jf["burst"].is_number_integer()) ff_burst = jf["burst"].get<int>();
+                    }
+                }
             }
             else {
                 Logger::warning("config.json not found; defaults will be used");
@@ -100,16 +269,29 @@ namespace multiscreen {
             Logger::warning(std::string("Failed to read config.json: ") + e.what());
         }
 
+        // CPU-профили — до старта любых рабочих потоков; главный поток относится к control-plane
+        ThreadPlacement::instance().configure(cpu);
+        ThreadPlacement::instance().bind_current(ThreadRole::Control, "multiscreen");
+        Logger::info(std::string("TS scanner: ") + TsScanner::to_string(TsScanner::isa()));
+
         avformat_network_init();
+        FFLogRouter::instance().configure(ff_level, ff_rate, ff_burst);
+        FFLogRouter::instance().install();
+
+        // отправка вебхуков — в отдельном потоке, до запуска watchdog
+        alerts::Dispatcher::instance().start();
+        // запись TS: индекс каталога читается до первых пакетов
+        Recorder::instance().start();
+        IncidentCapture::instance().start();
 
         m_mgr = std::make_unique<StreamManager>();
 
-        //   config/streams.json
+        // пробуем загрузить config/streams.json
         if (streams_enable) {
             const auto sPath = (cfgDir / "streams.json").string();
             bool ok = m_mgr->loadConfig(sPath);
 
-            //   /   4 ,     
+            // если файл битый/пустой — подставим 4 канала, чтобы точно не было пусто
             if (!ok || m_mgr->size() == 0) {
                 Logger::warning("streams.json missing/invalid or empty; using built-in 4 channels");
                 m_mgr->loadFromList({
@@ -145,6 +327,9 @@ namespace multiscreen {
     void Application::shutdown() {
         if (m_web) { m_web->stop(); m_web.reset(); }
         if (m_mgr) { m_mgr->stopAll(); m_mgr.reset(); }
+        Recorder::instance().stop();
+        IncidentCapture::instance().stop();
+        alerts::Dispatcher::instance().stop();
         avformat_network_deinit();
         Logger::shutdown();
     }
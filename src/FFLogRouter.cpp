@@ -1,6 +1,55 @@
 #include "FFLogRouter.h"
-#include <cstdarg>
+#include "Logger.h"
+#include <algorithm>
+#include <chrono>
 #include <cstdio>
+#include <cstring>
+
+extern "C" {
+#include <libavcodec/avcodec.h>
+}
+
+namespace {
+    // ключ удалённой записи: пробу не обрываем, слот можно занять снова
+    const void* const kTomb = reinterpret_cast<const void*>(uintptr_t(1));
+
+    thread_local FFLogRouter::Source* t_source = nullptr;
+
+    size_t slot_hash(const void* p) noexcept {
+        uint64_t x = static_cast<uint64_t>(reinterpret_cast<uintptr_t>(p));
+        x ^= x >> 33; x *= 0xff51afd7ed558ccdULL; x ^= x >> 33;
+        return static_cast<size_t>(x);
+    }
+
+    int64_t now_us() noexcept {
+        using namespace std::chrono;
+        return duration_cast<microseconds>(steady_clock::now().time_since_epoch()).count();
+    }
+
+    enum class Known : uint8_t { None, Cc, Pes };
+
+    // Сопоставление по строке формата — без vsnprintf
+    Known classify(const char* fmt) noexcept {
+        if (!fmt) return Known::None;
+        if (std::strncmp(fmt, "Continuity check failed", 23) == 0) return Known::Cc;
+        if (std::strncmp(fmt, "PES packet size mismatch", 24) == 0 || std::strncmp(fmt, "Packet corrupt", 14) == 0) return Known::Pes;
+        return Known::None;
+    }
+
+    bool is_decoder(void* avcl) noexcept {
+        const AVClass* avc = avcl ? *static_cast<const AVClass* const*>(avcl) : nullptr;
+        if (!avc) return false;
+        const AVClassCategory cat = avc->get_category ? avc->get_category(avcl) : avc->category;
+        return cat == AV_CLASS_CATEGORY_DECODER;
+    }
+
+    multiscreen::LogLevel map_level(int level) noexcept {
+        if (level <= AV_LOG_ERROR)   return multiscreen::LogLevel::Error;
+        if (level <= AV_LOG_WARNING) return multiscreen::LogLevel::Warning;
+        if (level <= AV_LOG_INFO)    return multiscreen::LogLevel::Info;
+        return multiscreen::LogLevel::Debug;
+    }
+}
 
 FFLogRouter& FFLogRouter::instance() {
     static FFLogRouter inst;
@@ -8,52 +57,179 @@ FFLogRouter& FFLogRouter::instance() {
 }
 
 void FFLogRouter::install() {
-    std::lock_guard<std::mutex> lk(mtx_);
-    if (installed_) return;
+    if (installed_.exchange(true)) return;
+    codec_class_ = avcodec_get_class();
+    av_log_set_level(max_level_.load(std::memory_order_relaxed));
     av_log_set_callback(&FFLogRouter::ffCallback);
-    //     (  continuity errors)
-    av_log_set_level(AV_LOG_WARNING);
-    installed_ = true;
 }
 
-void FFLogRouter::registerSource(void* ctx, Handler h) {
-    if (!ctx) return;
-    std::lock_guard<std::mutex> lk(mtx_);
-    handlers_[ctx] = std::move(h);
+void FFLogRouter::configure(int max_level, int rate_per_sec, int burst) {
+    max_level = std::clamp(max_level, AV_LOG_PANIC, AV_LOG_DEBUG);
+    max_level_.store(max_level, std::memory_order_relaxed);
+    // внутренние проверки FFmpeg вида av_log_get_level() >= ... тоже не должны делать лишнего
+    av_log_set_level(max_level);
+    if (rate_per_sec <= 0) {
+        interval_us_.store(0, std::memory_order_relaxed);   // без лимита
+        tolerance_us_.store(INT64_MAX / 2, std::memory_order_relaxed);
+        return;
+    }
+    const int64_t t = 1000000 / std::min(rate_per_sec, 1000000);
+    interval_us_.store(t, std::memory_order_relaxed);
+    tolerance_us_.store(t * std::max(0, burst - 1), std::memory_order_relaxed);
 }
 
-void FFLogRouter::unregisterSource(void* ctx) {
-    if (!ctx) return;
-    std::lock_guard<std::mutex> lk(mtx_);
-    handlers_.erase(ctx);
+bool FFLogRouter::registerSource(const void* ctx, Source* src) {
+    if (!ctx || !src) return false;
+    const size_t h = slot_hash(ctx);
+    for (size_t i = 0; i < kProbe; ++i) {
+        Slot& s = slots_[(h + i) & (kSlots - 1)];
+        const void* k = s.key.load(std::memory_order_acquire);
+        if (k == ctx) { s.src.store(src, std::memory_order_release); return true; }
+        if ((k == nullptr || k == kTomb) && s.key.compare_exchange_strong(k, ctx, std::memory_order_acq_rel)) {
+            s.src.store(src, std::memory_order_release);
+            return true;
+        }
+    }
+    return false;
 }
 
-void FFLogRouter::ffCallback(void* avcl, int level, const char* fmt, va_list vl) {
-    char buf[1024];
-#if defined(_MSC_VER)
-    vsnprintf_s(buf, sizeof(buf), _TRUNCATE, fmt, vl);
-#else
-    vsnprintf(buf, sizeof(buf), fmt, vl);
-#endif
-    //       std::string
-    FFLogRouter::instance().dispatch(avcl, level, std::string(buf));
+void FFLogRouter::unregisterSource(const void* ctx) {
+    if (!ctx) return;
+    const size_t h = slot_hash(ctx);
+    for (size_t i = 0; i < kProbe; ++i) {
+        Slot& s = slots_[(h + i) & (kSlots - 1)];
+        const void* k = s.key.load(std::memory_order_acquire);
+        if (k == ctx) {
+            s.src.store(nullptr, std::memory_order_release);
+            s.key.store(kTomb, std::memory_order_release);
+            return;
+        }
+        if (k == nullptr) return;
+    }
 }
 
-void FFLogRouter::dispatch(void* avcl, int level, const std::string& line) {
-    Handler h;
+FFLogRouter::Source* FFLogRouter::lookup(const void* ctx) const noexcept {
+    const size_t h = slot_hash(ctx);
+    for (size_t i = 0; i < kProbe; ++i) {
+        const Slot& s = slots_[(h + i) & (kSlots - 1)];
+        const void* k = s.key.load(std::memory_order_acquire);
+        if (k == ctx) return s.src.load(std::memory_order_acquire);
+        if (k == nullptr) return nullptr;
+    }
+    return nullptr;
+}
 
-    //     
-    {
-        std::lock_guard<std::mutex> lk(mtx_);
-        auto it = handlers_.find(avcl);
-        if (it != handlers_.end()) {
-            h = it->second;
+FFLogRouter::Source* FFLogRouter::resolve(void* avcl) const noexcept {
+    if (avcl) {
+        if (Source* s = lookup(avcl)) return s;
+        // frame-threading декодирует копиями AVCodecContext; opaque копируется вместе с ними
+        if (codec_class_ && *static_cast<const AVClass* const*>(avcl) == codec_class_) {
+            const void* op = static_cast<const AVCodecContext*>(avcl)->opaque;
+            if (op) if (Source* s = lookup(op)) return s;
         }
     }
+    return t_source;
+}
+
+// GCRA: эквивалент токен-бакета на одном атомике (rate = 1/interval, ёмкость = tolerance/interval + 1)
+bool FFLogRouter::admit(Source& src) noexcept {
+    const int64_t t = interval_us_.load(std::memory_order_relaxed);
+    if (t == 0) return true;
+    const int64_t tau = tolerance_us_.load(std::memory_order_relaxed);
+    const int64_t now = now_us();
+    int64_t tat = src.tat_us.load(std::memory_order_relaxed);
+    for (;;) {
+        const int64_t base = std::max(tat, now);
+        if (base - now > tau) return false;
+        if (src.tat_us.compare_exchange_weak(tat, base + t, std::memory_order_relaxed)) return true;
+    }
+}
+
+void FFLogRouter::emit(Source* src, int level, const char* line) {
+    auto out = [src](int lvl, const std::string& text) {
+        src->counters.lines.fetch_add(1, std::memory_order_relaxed);
+        if (src->handler) { src->handler(lvl, text); return; }
+        const std::string who = src->name.empty() ? std::string("ffmpeg: ") : src->name + ": ffmpeg: ";
+        multiscreen::Logger::log(map_level(lvl), src->stream, multiscreen::logcode::FFmpeg, who + text);
+        };
+    if (const uint64_t n = src->pending.exchange(0, std::memory_order_relaxed))
+        out(AV_LOG_WARNING, "suppressed " + std::to_string(n) + " line(s) by rate limit");
+    out(level, line);
+}
+
+void FFLogRouter::flush(Source& src) {
+    const uint64_t n = src.pending.exchange(0, std::memory_order_relaxed);
+    if (!n) return;
+    src.counters.lines.fetch_add(1, std::memory_order_relaxed);
+    const std::string text = "suppressed " + std::to_string(n) + " line(s) by rate limit";
+    if (src.handler) { src.handler(AV_LOG_WARNING, text); return; }
+    multiscreen::Logger::log(multiscreen::LogLevel::Warning, src.stream, multiscreen::logcode::FFmpeg,
+        (src.name.empty() ? std::string("ffmpeg: ") : src.name + ": ffmpeg: ") + text);
+}
+
+FFLogRouter::Scope::Scope(Source* src) : prev_(t_source) {
+    t_source = src;
+}
+
+FFLogRouter::Scope::~Scope() {
+    t_source = prev_;
+}
+
+FFLogRouter::Stats FFLogRouter::stats() const noexcept {
+    Stats s;
+    s.formatted = formatted_.load(std::memory_order_relaxed);
+    s.suppressed = suppressed_.load(std::memory_order_relaxed);
+    s.unattributed = unattributed_.load(std::memory_order_relaxed);
+    return s;
+}
+
+void FFLogRouter::ffCallback(void* avcl, int level, const char* fmt, va_list vl) {
+    FFLogRouter& r = instance();
+
+    // 1) ранний фильтр: ниже порога смотрим только на continuity check (mpegts пишет его в DEBUG)
+    const int max = r.max_level_.load(std::memory_order_relaxed);
+    Known known = Known::None;
+    if (level > max) {
+        if (level > AV_LOG_DEBUG) return;
+        known = classify(fmt);
+        if (known == Known::None) return;
+    }
+    else {
+        known = classify(fmt);
+    }
 
-    //       
-    if (h) {
-        h(level, line);
+    // 2) источник: таблица контекстов, затем источник потока
+    Source* src = r.resolve(avcl);
+    if (!src) {
+        r.unattributed_.fetch_add(1, std::memory_order_relaxed);
+        src = &r.orphan_;
     }
-    //   :   (       FFmpeg)
+
+    // 3) счётчики — всегда, независимо от лимита и уровня вывода
+    auto& c = src->counters;
+    if (known == Known::Cc) c.cc_errors.fetch_add(1, std::memory_order_relaxed);
+    else if (known == Known::Pes) c.pes_errors.fetch_add(1, std::memory_order_relaxed);
+    else if (level <= AV_LOG_ERROR && is_decoder(avcl)) c.decode_errors.fetch_add(1, std::memory_order_relaxed);
+    if (level > max) return;
+
+    // 4) лимит строк на источник
+    if (!r.admit(*src)) {
+        c.suppressed.fetch_add(1, std::memory_order_relaxed);
+        src->pending.fetch_add(1, std::memory_order_relaxed);
+        r.suppressed_.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+
+    // 5) только теперь форматируем
+    char buf[512];
+#if defined(_MSC_VER)
+    vsnprintf_s(buf, sizeof(buf), _TRUNCATE, fmt, vl);
+#else
+    vsnprintf(buf, sizeof(buf), fmt, vl);
+#endif
+    size_t n = std::strlen(buf);
+    while (n && (buf[n - 1] == '\n' || buf[n - 1] == '\r' || buf[n - 1] == ' ')) buf[--n] = '\0';
+    if (!n) return;
+    r.formatted_.fetch_add(1, std::memory_order_relaxed);
+    r.emit(src, level, buf);
 }
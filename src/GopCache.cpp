@@ -0,0 +1,207 @@
+#include "GopCache.h"
+
+#include <algorithm>
+
+namespace multiscreen {
+    namespace {
+        std::atomic<bool>     g_enable{ true };
+        std::atomic<size_t>   g_stream_bytes{ 16u << 20 };
+        std::atomic<size_t>   g_total_bytes{ 512u << 20 };
+        std::atomic<uint64_t> g_used{ 0 };          // по всем стримам
+
+        constexpr size_t kMaxPackets = 4096;        // ~2 мин при 25 к/с и аудио: дальше GOP не держим
+
+        bool is_param_nal(AVCodecID codec, uint8_t b) noexcept {
+            if (codec == AV_CODEC_ID_H264) {
+                const int t = b & 0x1f;
+                return t == 7 || t == 8;                   // SPS, PPS
+            }
+            const int t = (b >> 1) & 0x3f;
+            return t == 32 || t == 33 || t == 34;          // VPS, SPS, PPS
+        }
+
+        bool is_vcl_nal(AVCodecID codec, uint8_t b) noexcept {
+            if (codec == AV_CODEC_ID_H264) {
+                const int t = b & 0x1f;
+                return t >= 1 && t <= 5;
+            }
+            return ((b >> 1) & 0x3f) < 32;
+        }
+
+        // Общий предел: проверка и резерв одной операцией, иначе стримы вместе его превышают
+        bool reserve(size_t size) noexcept {
+            const uint64_t total = g_total_bytes.load(std::memory_order_relaxed);
+            uint64_t used = g_used.load(std::memory_order_relaxed);
+            do {
+                if (used + size > total) return false;
+            } while (!g_used.compare_exchange_weak(used, used + size, std::memory_order_relaxed));
+            return true;
+        }
+    } // anonymous
+
+    void GopCache::set_defaults(bool enable, size_t stream_bytes, size_t total_bytes) noexcept {
+        g_enable.store(enable, std::memory_order_relaxed);
+        g_stream_bytes.store(std::clamp<size_t>(stream_bytes, 256u << 10, 256u << 20), std::memory_order_relaxed);
+        g_total_bytes.store(std::max<size_t>(total_bytes, 1u << 20), std::memory_order_relaxed);
+    }
+
+    bool GopCache::enabled() noexcept { return g_enable.load(std::memory_order_relaxed); }
+    uint64_t GopCache::total_bytes() noexcept { return g_used.load(std::memory_order_relaxed); }
+
+    GopCache::Snapshot::~Snapshot() {
+        for (AVPacket*& p : packets) av_packet_free(&p);
+    }
+
+    GopCache::~GopCache() {
+        std::lock_guard<std::mutex> lk(m_mx);
+        drop();
+        for (AVPacket*& p : m_spare) av_packet_free(&p);
+    }
+
+    void GopCache::drop() {
+        for (AVPacket* p : m_pkts) {
+            av_packet_unref(p);
+            m_spare.push_back(p);
+        }
+        m_pkts.clear();
+        g_used.fetch_sub(m_bytes, std::memory_order_relaxed);
+        m_bytes = 0;
+        m_valid = false;
+        m_key_ts = m_last_ts = AV_NOPTS_VALUE;
+    }
+
+    void GopCache::reset() {
+        std::lock_guard<std::mutex> lk(m_mx);
+        drop();
+        m_init = false;
+        m_params.clear();
+    }
+
+    // Наборы параметров: новые extradata из side data или NAL перед первым слайсом ключевого кадра
+    void GopCache::scan_params(AVCodecID codec, const AVPacket* pkt) {
+        size_t side_size = 0;
+        if (const uint8_t* side = av_packet_get_side_data(pkt, AV_PKT_DATA_NEW_EXTRADATA, &side_size)) {
+            m_params.assign(reinterpret_cast<const char*>(side), side_size);
+            return;
+        }
+        if (codec != AV_CODEC_ID_H264 && codec != AV_CODEC_ID_HEVC) return;
+        if (!(pkt->flags & AV_PKT_FLAG_KEY) || pkt->size < 4) return;
+        // avcC/hvcC (длины NAL вместо стартовых кодов): параметры только в extradata
+        if (pkt->data[0] || pkt->data[1] || (pkt->data[2] != 1 && (pkt->data[2] || pkt->data[3] != 1))) return;
+        const uint8_t* end = pkt->data + pkt->size;
+        std::string found;
+        const uint8_t* nal = nullptr;   // начало текущего NAL (после стартового кода)
+        for (const uint8_t* q = pkt->data; q + 3 <= end;) {
+            if (q[0] || q[1] || q[2] != 1) {
+                ++q;
+                continue;
+            }
+            if (nal) {
+                const uint8_t* stop = (q - 1 >= nal && q[-1] == 0) ? q - 1 : q;   // 4-байтный стартовый код
+                if (is_param_nal(codec, nal[0])) {
+                    found.append("\0\0\0\1", 4);
+                    found.append(reinterpret_cast<const char*>(nal), static_cast<size_t>(stop - nal));
+                }
+            }
+            q += 3;
+            nal = nullptr;
+            if (q >= end || is_vcl_nal(codec, q[0])) break;
+            nal = q;
+        }
+        if (nal && is_param_nal(codec, nal[0])) {
+            found.append("\0\0\0\1", 4);
+            found.append(reinterpret_cast<const char*>(nal), static_cast<size_t>(end - nal));
+        }
+        if (!found.empty()) m_params.swap(found);
+    }
+
+    void GopCache::push(const AVFormatContext* in, int video_index, const AVPacket* pkt) {
+        if (video_index < 0 || pkt->stream_index < 0 || static_cast<unsigned>(pkt->stream_index) >= in->nb_streams) return;
+        const AVStream* st = in->streams[pkt->stream_index];
+        const AVMediaType type = st->codecpar->codec_type;
+        if (type != AVMEDIA_TYPE_VIDEO && type != AVMEDIA_TYPE_AUDIO) return;
+        const bool video = pkt->stream_index == video_index;
+        const bool key = video && (pkt->flags & AV_PKT_FLAG_KEY);
+
+        std::lock_guard<std::mutex> lk(m_mx);
+        if (!enabled()) {
+            if (!m_pkts.empty()) drop();
+            return;
+        }
+        if (!m_init) {
+            const AVCodecParameters* vpar = in->streams[video_index]->codecpar;
+            if (vpar->extradata_size > 0)
+                m_params.assign(reinterpret_cast<const char*>(vpar->extradata), static_cast<size_t>(vpar->extradata_size));
+            m_video_tb = in->streams[video_index]->time_base;
+            m_init = true;
+        }
+        if (video) scan_params(st->codecpar->codec_id, pkt);
+        if (key) {
+            drop();
+            m_valid = true;
+            ++m_gops;
+        }
+        if (!m_valid) return;   // после переполнения или до первого ключевого кадра
+
+        const size_t size = static_cast<size_t>(std::max(pkt->size, 0));
+        if (m_bytes + size > g_stream_bytes.load(std::memory_order_relaxed) || m_pkts.size() >= kMaxPackets || !reserve(size)) {
+            // неполный GOP бесполезен: ждём следующий ключевой кадр
+            drop();
+            ++m_overflows;
+            return;
+        }
+        AVPacket* p = nullptr;
+        if (!m_spare.empty()) {
+            p = m_spare.back();
+            m_spare.pop_back();
+        }
+        else if (!(p = av_packet_alloc())) {
+            g_used.fetch_sub(size, std::memory_order_relaxed);
+            return;
+        }
+        if (av_packet_ref(p, pkt) < 0) {
+            m_spare.push_back(p);
+            g_used.fetch_sub(size, std::memory_order_relaxed);
+            return;
+        }
+        p->time_base = st->time_base;
+        m_pkts.push_back(p);
+        m_bytes += size;
+        if (video) {
+            const int64_t ts = pkt->dts != AV_NOPTS_VALUE ? pkt->dts : pkt->pts;
+            if (ts != AV_NOPTS_VALUE) {
+                if (key) m_key_ts = ts;
+                m_last_ts = ts;
+            }
+        }
+    }
+
+    bool GopCache::snapshot(Snapshot& out) const {
+        std::lock_guard<std::mutex> lk(m_mx);
+        out.params = m_params;
+        if (!m_valid || m_pkts.empty()) return false;
+        out.gop = m_gops;
+        out.packets.reserve(out.packets.size() + m_pkts.size());
+        for (const AVPacket* p : m_pkts) {
+            AVPacket* c = av_packet_clone(p);
+            if (!c) return false;
+            out.packets.push_back(c);
+        }
+        return true;
+    }
+
+    GopStats GopCache::stats() const {
+        GopStats s;
+        std::lock_guard<std::mutex> lk(m_mx);
+        s.valid = m_valid;
+        s.packets = static_cast<uint32_t>(m_pkts.size());
+        s.bytes = m_bytes;
+        if (m_key_ts != AV_NOPTS_VALUE && m_last_ts != AV_NOPTS_VALUE)
+            s.duration_ms = static_cast<int>(av_rescale_q(m_last_ts - m_key_ts, m_video_tb, AVRational{ 1, 1000 }));
+        s.params = !m_params.empty();
+        s.gops = m_gops;
+        s.overflows = m_overflows;
+        return s;
+    }
+
+} // namespace multiscreen
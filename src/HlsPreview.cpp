@@ -0,0 +1,319 @@
+#include "HlsPreview.h"
+#include "Logger.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+
+extern "C" {
+#include <libavutil/opt.h>
+}
+
+namespace multiscreen {
+    namespace {
+        std::atomic<bool>    g_enable{ true };
+        std::atomic<int64_t> g_segment_ms{ 2000 };
+        std::atomic<int>     g_segments{ 6 };
+        std::atomic<int64_t> g_idle_ms{ 30000 };
+
+        constexpr int    kIoBuffer = 188 * 174;           // буфер AVIO мультиплексора
+        constexpr size_t kMaxSegment = 32u << 20;         // без ключевых кадров сегмент режется и так
+        constexpr int64_t kFirstWaitMs = 5000;            // + segment_seconds: самый длинный GOP, который ждём
+        constexpr int64_t kMinPrimeMs = 500;              // короче — кэш не режем, ждём полный сегмент
+
+        int64_t steady_now_ms() noexcept {
+            using namespace std::chrono;
+            return duration_cast<milliseconds>(steady_clock::now().time_since_epoch()).count();
+        }
+    } // anonymous
+
+    void HlsPreview::set_defaults(bool enable, double segment_seconds, int segments, int idle_timeout_s) noexcept {
+        g_enable.store(enable, std::memory_order_relaxed);
+        g_segment_ms.store(static_cast<int64_t>(std::clamp(segment_seconds, 0.5, 10.0) * 1000.0), std::memory_order_relaxed);
+        g_segments.store(std::clamp(segments, 3, 30), std::memory_order_relaxed);
+        g_idle_ms.store(static_cast<int64_t>(std::clamp(idle_timeout_s, 5, 600)) * 1000, std::memory_order_relaxed);
+    }
+
+    bool HlsPreview::enabled() noexcept { return g_enable.load(std::memory_order_relaxed); }
+
+    HlsPreview::HlsPreview(const std::string& name, std::shared_ptr<GopCache> gop)
+        : m_name(name), m_gop(std::move(gop)) {}
+
+    HlsPreview::~HlsPreview() {
+        close_mux();
+        av_packet_free(&m_pkt);
+    }
+
+    // -------- потоки HTTP --------
+
+    void HlsPreview::touch() noexcept {
+        m_requests.fetch_add(1, std::memory_order_relaxed);
+        if (!enabled()) return;
+        // сначала метка, потом флаг: idle() перепроверяет метку после сброса флага
+        m_last_access_ms.store(steady_now_ms());
+        m_active.store(true);
+    }
+
+    std::string HlsPreview::playlist() {
+        touch();
+        if (!enabled()) return {};
+        std::unique_lock<std::mutex> lk(m_mx);
+        const int64_t wait_ms = g_segment_ms.load(std::memory_order_relaxed) + kFirstWaitMs;
+        if (!m_cv.wait_for(lk, std::chrono::milliseconds(wait_ms), [this] { return !m_ring.empty(); }))
+            return {};
+
+        double target = 1.0;
+        for (const auto& s : m_ring) target = std::max(target, std::ceil(s->duration));
+        std::string out = "#EXTM3U\n#EXT-X-VERSION:3\n";
+        out += "#EXT-X-TARGETDURATION:" + std::to_string(static_cast<int>(target)) + "\n";
+        out += "#EXT-X-MEDIA-SEQUENCE:" + std::to_string(m_ring.front()->seq) + "\n";
+        if (m_disc_seq) out += "#EXT-X-DISCONTINUITY-SEQUENCE:" + std::to_string(m_disc_seq) + "\n";
+        char extinf[64];
+        for (const auto& s : m_ring) {
+            if (s->discontinuity) out += "#EXT-X-DISCONTINUITY\n";
+            std::snprintf(extinf, sizeof(extinf), "#EXTINF:%.3f,\n", s->duration);
+            out += extinf;
+            out += std::to_string(s->seq) + ".ts\n";
+        }
+        return out;
+    }
+
+    std::shared_ptr<const HlsPreview::Segment> HlsPreview::segment(uint64_t seq) {
+        touch();
+        std::lock_guard<std::mutex> lk(m_mx);
+        if (m_ring.empty() || seq < m_ring.front()->seq) return nullptr;
+        const uint64_t i = seq - m_ring.front()->seq;
+        return i < m_ring.size() ? m_ring[i] : nullptr;
+    }
+
+    PreviewStats HlsPreview::stats() const {
+        PreviewStats s;
+        s.active = active();
+        s.requests = m_requests.load(std::memory_order_relaxed);
+        s.mux_errors = m_errors_pub.load(std::memory_order_relaxed);
+        std::lock_guard<std::mutex> lk(m_mx);
+        s.segments = static_cast<uint32_t>(m_ring.size());
+        s.ring_bytes = m_ring_bytes;
+        s.sequence = m_ring.empty() ? 0 : m_ring.back()->seq;
+        s.produced = m_produced;
+        return s;
+    }
+
+    // -------- поток стрима --------
+
+    int HlsPreview::write_cb(void* opaque, const uint8_t* buf, int size) {
+        static_cast<HlsPreview*>(opaque)->m_cur.append(reinterpret_cast<const char*>(buf), static_cast<size_t>(size));
+        return size;
+    }
+
+    bool HlsPreview::open_mux(const AVFormatContext* in, const std::string& params) {
+        if (avformat_alloc_output_context2(&m_oc, nullptr, "mpegts", nullptr) < 0 || !m_oc) {
+            m_oc = nullptr;
+            return false;
+        }
+        m_map.assign(in->nb_streams, -1);
+        m_lead = -1;
+        int first_audio = -1;
+        for (unsigned i = 0; i < in->nb_streams; ++i) {
+            const AVStream* is = in->streams[i];
+            const AVCodecParameters* par = is->codecpar;
+            if (par->codec_id == AV_CODEC_ID_NONE) continue;
+            if (par->codec_type == AVMEDIA_TYPE_VIDEO) {
+                if (is->disposition & AV_DISPOSITION_ATTACHED_PIC) continue;
+            }
+            else if (par->codec_type != AVMEDIA_TYPE_AUDIO) {
+                continue;   // субтитры/данные браузеру не нужны
+            }
+            AVStream* os = avformat_new_stream(m_oc, nullptr);
+            if (!os || avcodec_parameters_copy(os->codecpar, par) < 0) {
+                close_mux();
+                return false;
+            }
+            os->codecpar->codec_tag = 0;
+            os->time_base = is->time_base;
+            m_map[i] = os->index;
+            if (par->codec_type == AVMEDIA_TYPE_VIDEO && m_lead < 0) m_lead = static_cast<int>(i);
+            if (par->codec_type == AVMEDIA_TYPE_AUDIO && first_audio < 0) first_audio = static_cast<int>(i);
+        }
+        if (m_lead < 0) m_lead = first_audio;
+        if (m_lead < 0) {
+            close_mux();
+            return false;
+        }
+        // текущие SPS/PPS из кэша GOP: мультиплексор вставит их перед ключевым кадром, если в нём нет своих
+        AVCodecParameters* lead_par = m_oc->streams[m_map[m_lead]]->codecpar;
+        if (!params.empty() && lead_par->codec_type == AVMEDIA_TYPE_VIDEO) {
+            auto* ed = static_cast<uint8_t*>(av_mallocz(params.size() + AV_INPUT_BUFFER_PADDING_SIZE));
+            if (ed) {
+                std::memcpy(ed, params.data(), params.size());
+                av_freep(&lead_par->extradata);
+                lead_par->extradata = ed;
+                lead_par->extradata_size = static_cast<int>(params.size());
+            }
+        }
+
+        auto* buf = static_cast<unsigned char*>(av_malloc(kIoBuffer));
+        if (buf) m_oc->pb = avio_alloc_context(buf, kIoBuffer, 1, this, nullptr, &HlsPreview::write_cb, nullptr);
+        if (!m_oc->pb) {
+            av_free(buf);
+            close_mux();
+            return false;
+        }
+        m_oc->flags |= AVFMT_FLAG_CUSTOM_IO;
+        m_cur.clear();
+        if (avformat_write_header(m_oc, nullptr) < 0) {
+            close_mux();
+            return false;
+        }
+        if (!m_pkt) m_pkt = av_packet_alloc();
+        m_lead_tb = in->streams[m_lead]->time_base;
+        m_seg_start = AV_NOPTS_VALUE;
+        // после простоя или смены входа номера продолжаются, а плеер видит разрыв
+        m_discontinuity = m_next_seq > 0;
+        return m_pkt != nullptr;
+    }
+
+    void HlsPreview::close_mux() {
+        if (!m_oc) return;
+        if (m_oc->pb) {
+            av_freep(&m_oc->pb->buffer);
+            avio_context_free(&m_oc->pb);
+        }
+        avformat_free_context(m_oc);   // без трейлера: недописанный сегмент всё равно выбрасывается
+        m_oc = nullptr;
+        m_cur.clear();
+        m_seg_start = m_lead_end = AV_NOPTS_VALUE;
+    }
+
+    void HlsPreview::cut(double duration) {
+        av_write_frame(m_oc, nullptr);   // буферизованные PES — в текущий сегмент
+        avio_flush(m_oc->pb);
+        auto seg = std::make_shared<Segment>();
+        seg->seq = m_next_seq++;
+        seg->duration = duration;
+        seg->discontinuity = m_discontinuity;
+        seg->data.swap(m_cur);
+        m_cur.reserve(seg->data.size());
+        m_discontinuity = false;
+        // PAT/PMT в начале каждого сегмента: плеер может начать с любого
+        av_opt_set(m_oc->priv_data, "mpegts_flags", "+resend_headers", 0);
+
+        const size_t limit = static_cast<size_t>(g_segments.load(std::memory_order_relaxed));
+        {
+            std::lock_guard<std::mutex> lk(m_mx);
+            m_ring_bytes += seg->data.size();
+            m_ring.push_back(std::move(seg));
+            while (m_ring.size() > limit) {
+                if (m_ring.front()->discontinuity) ++m_disc_seq;
+                m_ring_bytes -= m_ring.front()->data.size();
+                m_ring.pop_front();
+            }
+            ++m_produced;
+        }
+        m_cv.notify_all();
+    }
+
+    void HlsPreview::idle() {
+        close_mux();
+        m_discontinuity = false;
+        {
+            std::lock_guard<std::mutex> lk(m_mx);
+            m_ring.clear();
+            m_ring_bytes = 0;
+        }
+        m_active.store(false);
+        // запрос мог прийти между проверкой простоя и сбросом флага
+        if (steady_now_ms() - m_last_access_ms.load() < g_idle_ms.load(std::memory_order_relaxed))
+            m_active.store(true);
+    }
+
+    void HlsPreview::reset() {
+        close_mux();
+        m_failed = false;
+    }
+
+    void HlsPreview::feed(const AVFormatContext* in, const AVPacket* pkt) {
+        if (!enabled() || steady_now_ms() - m_last_access_ms.load(std::memory_order_relaxed) >= g_idle_ms.load(std::memory_order_relaxed)) {
+            idle();
+            return;
+        }
+        if (m_failed) return;
+        if (!m_oc) {
+            GopCache::Snapshot snap;
+            const bool primed = m_gop && m_gop->snapshot(snap) && snap.gop != m_bad_gop;
+            if (!open_mux(in, snap.params)) {
+                m_failed = true;
+                Logger::warning("preview: " + m_name + ": cannot remux input to MPEG-TS");
+                return;
+            }
+            if (primed) prime(in, snap);
+            if (!m_oc) return;   // GOP кэша не лёг в мультиплексор: дальше — с ключевого кадра входа
+        }
+        write(in, pkt);
+    }
+
+    // Кэшированный GOP — сразу первый сегмент: первый зритель не ждёт следующего ключевого кадра.
+    // Следующий сегмент начнётся внутри GOP; плеер, начавший с первого, этого не заметит
+    void HlsPreview::prime(const AVFormatContext* in, const GopCache::Snapshot& snap) {
+        for (const AVPacket* p : snap.packets) {
+            write(in, p);
+            if (!m_oc) {
+                m_bad_gop = snap.gop;   // тот же снимок откажет снова: ждём новый GOP
+                return;
+            }
+        }
+        if (m_seg_start == AV_NOPTS_VALUE || m_lead_end == AV_NOPTS_VALUE) return;
+        const int64_t dur_ms = av_rescale_q(m_lead_end - m_seg_start, m_lead_tb, AVRational{ 1, 1000 });
+        if (dur_ms >= kMinPrimeMs) {
+            cut(static_cast<double>(dur_ms) / 1000.0);
+            m_seg_start = m_lead_end;
+        }
+    }
+
+    void HlsPreview::write(const AVFormatContext* in, const AVPacket* pkt) {
+        if (!m_oc) return;
+        if (pkt->stream_index < 0 || static_cast<size_t>(pkt->stream_index) >= m_map.size()) return;
+        const int oi = m_map[pkt->stream_index];
+        if (oi < 0) return;
+        const int64_t ts = pkt->dts != AV_NOPTS_VALUE ? pkt->dts : pkt->pts;
+        if (ts == AV_NOPTS_VALUE) return;
+
+        if (pkt->stream_index == m_lead) {
+            const bool key = (pkt->flags & AV_PKT_FLAG_KEY) != 0;
+            if (m_seg_start == AV_NOPTS_VALUE) {
+                if (!key) return;   // первый сегмент — с ключевого кадра
+                m_seg_start = ts;
+                m_cur.clear();      // то, что мультиплексор успел выдать до него
+            }
+            else {
+                const int64_t seg_ms = g_segment_ms.load(std::memory_order_relaxed);
+                const int64_t dur_ms = av_rescale_q(ts - m_seg_start, m_lead_tb, AVRational{ 1, 1000 });
+                if ((key && dur_ms >= seg_ms) || dur_ms >= 4 * seg_ms || m_cur.size() >= kMaxSegment) {
+                    cut(static_cast<double>(std::max<int64_t>(dur_ms, 0)) / 1000.0);
+                    m_seg_start = ts;
+                }
+            }
+        }
+        else if (m_seg_start == AV_NOPTS_VALUE) {
+            return;
+        }
+
+        if (av_packet_ref(m_pkt, pkt) < 0) return;
+        m_pkt->stream_index = oi;
+        m_pkt->pos = -1;
+        av_packet_rescale_ts(m_pkt, in->streams[pkt->stream_index]->time_base, m_oc->streams[oi]->time_base);
+        const int rc = av_write_frame(m_oc, m_pkt);
+        av_packet_unref(m_pkt);
+        if (rc < 0) {
+            // скачок времени назад и т.п.: недописанный сегмент выбрасываем, продолжаем с ключевого кадра
+            m_errors_pub.store(++m_errors, std::memory_order_relaxed);
+            close_mux();
+        }
+        else if (pkt->stream_index == m_lead) {
+            m_lead_end = ts + std::max<int64_t>(pkt->duration, 0);
+        }
+    }
+
+} // namespace multiscreen
@@ -0,0 +1,517 @@
+#include "HlsReader.h"
+#include "Logger.h"
+#include "ThreadPlacement.h"
+
+#include <httplib.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+
+namespace multiscreen {
+    namespace {
+        std::atomic<int> g_prefetch{ 3 };
+        std::atomic<int> g_timeout_ms{ 5000 };
+        std::atomic<int> g_live_start{ 3 };
+
+        constexpr int    kMaxAttempts = 3;       // на сегмент, включая первую попытку
+        constexpr double kMinReloadS = 0.2;
+        constexpr double kDefaultTargetS = 6.0;  // плейлист без #EXT-X-TARGETDURATION
+
+        bool starts_with(const std::string& s, const char* prefix) {
+            return s.compare(0, std::strlen(prefix), prefix) == 0;
+        }
+
+        // scheme://host[:port] и путь с запросом (как split_url у вебхуков)
+        void split_url(const std::string& url, std::string& origin, std::string& path) {
+            origin.clear();
+            path = "/";
+            const auto ppos = url.find("://");
+            if (ppos == std::string::npos) return;
+            const auto slash = url.find('/', ppos + 3);
+            if (slash == std::string::npos) origin = url;
+            else {
+                origin = url.substr(0, slash);
+                path = url.substr(slash);
+            }
+        }
+
+        // URI из плейлиста относительно адреса самого плейлиста (RFC 3986, без ./ и ../)
+        std::string resolve(const std::string& base, const std::string& ref) {
+            if (ref.find("://") != std::string::npos) return ref;
+            if (starts_with(ref, "//")) return base.substr(0, base.find(':') + 1) + ref;
+            std::string origin, path;
+            split_url(base, origin, path);
+            if (!ref.empty() && ref[0] == '/') return origin + ref;
+            path = path.substr(0, path.find_first_of("?#"));
+            return origin + path.substr(0, path.rfind('/') + 1) + ref;
+        }
+
+        // значение атрибута NAME=... из списка через запятую (кавычки снимаются)
+        std::string attribute(const std::string& line, const char* name) {
+            const std::string key = std::string(name) + "=";
+            size_t pos = line.find(':');
+            while (pos != std::string::npos) {
+                ++pos;
+                if (line.compare(pos, key.size(), key) == 0) {
+                    pos += key.size();
+                    if (pos < line.size() && line[pos] == '"') {
+                        const auto end = line.find('"', pos + 1);
+                        return line.substr(pos + 1, end == std::string::npos ? std::string::npos : end - pos - 1);
+                    }
+                    return line.substr(pos, line.find(',', pos) - pos);
+                }
+                // следующий атрибут: запятая вне кавычек
+                bool quoted = false;
+                for (; pos < line.size(); ++pos) {
+                    if (line[pos] == '"') quoted = !quoted;
+                    else if (line[pos] == ',' && !quoted) break;
+                }
+                if (pos >= line.size()) break;
+            }
+            return {};
+        }
+    } // anonymous
+
+    struct HlsReader::Playlist {
+        struct Item {
+            std::string uri;
+            double      duration = 0.0;
+            bool        discontinuity = false;
+        };
+        struct Variant {
+            std::string uri;
+            int64_t     bandwidth = 0;
+        };
+        bool        master = false;
+        bool        ended = false;
+        double      target_s = 0.0;
+        int64_t     first_seq = 0;
+        std::string unsupported;        // почему этот приём не годится (пусто — годится)
+        std::vector<Item> items;
+        std::vector<Variant> variants;
+    };
+
+    void HlsReader::set_defaults(int prefetch, int timeout_ms, int live_start_segments) noexcept {
+        g_prefetch.store(std::clamp(prefetch, 1, kMaxPrefetch), std::memory_order_relaxed);
+        g_timeout_ms.store(std::clamp(timeout_ms, 500, 60000), std::memory_order_relaxed);
+        g_live_start.store(std::clamp(live_start_segments, 1, 100), std::memory_order_relaxed);
+    }
+
+    bool HlsReader::supported(const std::string& url) noexcept {
+        std::string scheme = url.substr(0, std::min<size_t>(url.find("://"), 8));
+        std::transform(scheme.begin(), scheme.end(), scheme.begin(), [](unsigned char c) { return static_cast<char>(std::tolower(c)); });
+        if (scheme == "http") return true;
+#if defined(CPPHTTPLIB_OPENSSL_SUPPORT)
+        if (scheme == "https") return true;
+#endif
+        return false;
+    }
+
+    HlsReader::HlsReader() = default;
+
+    HlsReader::~HlsReader() { close(); }
+
+    bool HlsReader::parse(const std::string& text, const std::string& base, Playlist& out) {
+        out = Playlist{};
+        bool header = false;
+        bool stream_inf = false;
+        int64_t bandwidth = 0;
+        double duration = 0.0;
+        bool discontinuity = false;
+        size_t pos = 0;
+        while (pos < text.size()) {
+            size_t eol = text.find('\n', pos);
+            if (eol == std::string::npos) eol = text.size();
+            std::string line = text.substr(pos, eol - pos);
+            pos = eol + 1;
+            while (!line.empty() && (line.back() == '\r' || line.back() == ' ' || line.back() == '\t')) line.pop_back();
+            if (line.empty()) continue;
+            if (!header) {
+                if (!starts_with(line, "#EXTM3U") && !starts_with(line, "\xEF\xBB\xBF#EXTM3U")) return false;
+                header = true;
+                continue;
+            }
+            if (starts_with(line, "#EXT-X-STREAM-INF:")) {
+                out.master = true;
+                stream_inf = true;
+                bandwidth = std::atoll(attribute(line, "BANDWIDTH").c_str());
+            }
+            else if (starts_with(line, "#EXT-X-TARGETDURATION:")) out.target_s = std::atof(line.c_str() + 22);
+            else if (starts_with(line, "#EXT-X-MEDIA-SEQUENCE:")) out.first_seq = std::atoll(line.c_str() + 22);
+            else if (starts_with(line, "#EXTINF:")) duration = std::atof(line.c_str() + 8);
+            else if (line == "#EXT-X-DISCONTINUITY") discontinuity = true;
+            else if (line == "#EXT-X-ENDLIST") out.ended = true;
+            else if (starts_with(line, "#EXT-X-KEY:")) {
+                if (attribute(line, "METHOD") != "NONE") out.unsupported = "encrypted segments (EXT-X-KEY)";
+            }
+            else if (starts_with(line, "#EXT-X-MAP:")) out.unsupported = "fMP4 segments (EXT-X-MAP)";
+            else if (starts_with(line, "#EXT-X-BYTERANGE")) out.unsupported = "byte-range segments";
+            else if (line[0] == '#') continue;
+            else if (stream_inf) {
+                out.variants.push_back({ resolve(base, line), bandwidth });
+                stream_inf = false;
+            }
+            else if (!out.master) {
+                out.items.push_back({ resolve(base, line), duration, discontinuity });
+                duration = 0.0;
+                discontinuity = false;
+            }
+        }
+        return header;
+    }
+
+    int HlsReader::fetch(int slot, const std::string& url, std::string& body, std::string& final_url, std::string& err) {
+        std::string origin, path;
+        split_url(url, origin, path);
+        if (origin.empty()) {
+            err = "bad url: " + url;
+            return -EINVAL;
+        }
+        Http& h = m_http[static_cast<size_t>(slot)];
+        httplib::Client* cli = nullptr;
+        {
+            // m_stop и busy — под одним мьютексом с close(): запрос, прошедший проверку,
+            // close() увидит как busy и прервёт его stop()
+            std::lock_guard<std::mutex> lk(m_http_mx);
+            if (m_stop.load(std::memory_order_relaxed)) return -ECANCELED;
+            if (!h.cli || h.origin != origin) {
+                h.cli = std::make_unique<httplib::Client>(origin);
+                h.origin = origin;
+                if (!h.cli->is_valid()) {
+                    h.cli.reset();
+                    err = "unsupported url: " + url;
+                    return -EPROTONOSUPPORT;
+                }
+                const auto timeout = std::chrono::milliseconds(m_timeout_ms);
+                h.cli->set_keep_alive(true);
+                h.cli->set_follow_location(true);
+                h.cli->set_connection_timeout(timeout);
+                h.cli->set_read_timeout(timeout);
+                h.cli->set_write_timeout(timeout);
+            }
+            cli = h.cli.get();
+            h.busy = true;
+        }
+        auto res = cli->Get(path);
+        {
+            std::lock_guard<std::mutex> lk(m_http_mx);
+            h.busy = false;
+        }
+        if (!res) {
+            err = httplib::to_string(res.error());
+            return m_stop.load(std::memory_order_relaxed) ? -ECANCELED : -EIO;
+        }
+        if (res->status != 200) {
+            err = "HTTP " + std::to_string(res->status);
+            return res->status == 404 || res->status == 410 ? -ENOENT : -EIO;
+        }
+        final_url = res->location.empty() ? url : resolve(url, res->location);
+        body = std::move(res->body);
+        return 0;
+    }
+
+    int HlsReader::open(const std::string& url, const std::string& name, uint32_t id, std::string& err) {
+        close();
+        m_name = name;
+        m_id = id;
+        m_prefetch = g_prefetch.load(std::memory_order_relaxed);
+        m_timeout_ms = g_timeout_ms.load(std::memory_order_relaxed);
+        m_live_start = g_live_start.load(std::memory_order_relaxed);
+        m_cur.clear();
+        m_cur_pos = 0;
+        m_stop.store(false, std::memory_order_relaxed);
+
+        // master -> вариант; цепочка длиннее одного шага — не HLS
+        std::string body, final_url;
+        Playlist pl;
+        int64_t bandwidth = 0;
+        int rc = fetch(0, url, body, final_url, err);
+        if (rc == 0 && !parse(body, final_url, pl)) {
+            err = "not an m3u8 playlist";
+            rc = -EINVAL;
+        }
+        if (rc == 0 && pl.master) {
+            const auto best = std::max_element(pl.variants.begin(), pl.variants.end(),
+                [](const Playlist::Variant& a, const Playlist::Variant& b) { return a.bandwidth < b.bandwidth; });
+            if (best == pl.variants.end()) {
+                err = "master playlist without variants";
+                rc = -EINVAL;
+            }
+            else {
+                bandwidth = best->bandwidth;
+                const std::string variant = best->uri;
+                rc = fetch(0, variant, body, final_url, err);
+                if (rc == 0 && (!parse(body, final_url, pl) || pl.master)) {
+                    err = "bad media playlist: " + variant;
+                    rc = -EINVAL;
+                }
+            }
+        }
+        if (rc == 0 && !pl.unsupported.empty()) {
+            err = pl.unsupported;
+            rc = -ENOTSUP;
+        }
+        if (rc == 0 && pl.items.empty() && pl.ended) {
+            err = "empty playlist";
+            rc = -ENODATA;
+        }
+        if (rc < 0) {
+            close();
+            return rc;
+        }
+
+        m_playlist_url = final_url;
+        {
+            std::lock_guard<std::mutex> lk(m_mx);
+            m_segments.clear();
+            ++m_gen;
+            m_positioned = false;
+            m_next_out = 0;
+            m_last_listed = -1;
+            m_inflight = 0;
+            m_playlist_down = false;
+            m_stats.playlist = m_playlist_url;
+            m_stats.bandwidth = bandwidth;
+            m_stats.sequence = -1;
+            ++m_stats.playlist_reloads;
+            apply(pl);
+        }
+        m_playlist_thr = std::thread(&HlsReader::playlist_loop, this);
+        for (int i = 0; i < m_prefetch; ++i) m_workers.emplace_back(&HlsReader::worker_loop, this, i + 1);
+        return 0;
+    }
+
+    void HlsReader::close() noexcept {
+        {
+            std::lock_guard<std::mutex> lk(m_mx);
+            m_stop.store(true, std::memory_order_relaxed);
+        }
+        m_work_cv.notify_all();
+        m_ready_cv.notify_all();
+        m_reload_cv.notify_all();
+        {
+            // Прервать запросы в полёте, не дожидаясь таймаута. stop() до того, как Get открыл
+            // сокет, ничего не прерывает — повторяем, пока занятые клиенты не вернутся
+            std::unique_lock<std::mutex> lk(m_http_mx);
+            m_stop.store(true, std::memory_order_relaxed);
+            for (bool first = true;; first = false) {
+                bool busy = false;
+                for (Http& h : m_http) {
+                    if (h.cli && (first || h.busy)) h.cli->stop();
+                    busy = busy || h.busy;
+                }
+                if (!busy) break;
+                lk.unlock();
+                std::this_thread::sleep_for(std::chrono::milliseconds(5));
+                lk.lock();
+            }
+        }
+        if (m_playlist_thr.joinable()) m_playlist_thr.join();
+        for (std::thread& t : m_workers)
+            if (t.joinable()) t.join();
+        m_workers.clear();
+        std::lock_guard<std::mutex> lk(m_mx);
+        m_segments.clear();
+        m_inflight = 0;
+    }
+
+    // Новая версия плейлиста: в очередь — только номера, которых ещё не было
+    void HlsReader::apply(const Playlist& pl) {
+        m_target_s = pl.target_s > 0.0 ? pl.target_s : kDefaultTargetS;
+        m_ended = pl.ended;
+        m_stats.live = !pl.ended;
+        m_stats.target_duration_s = m_target_s;
+        const auto n = static_cast<int64_t>(pl.items.size());
+        if (!n) return;
+        const int64_t last = pl.first_seq + n - 1;
+        if (m_positioned && last < m_last_listed - n) {
+            // нумерация началась заново (перезапуск упаковщика): всё старое выбросить
+            ++m_gen;
+            m_segments.clear();
+            m_positioned = false;
+            m_last_listed = -1;
+        }
+        if (!m_positioned) {
+            // live — не ближе live_start сегментов к краю (RFC 8216, 6.3.3), VOD — с начала
+            m_next_out = pl.ended ? pl.first_seq : std::max(pl.first_seq, last - m_live_start + 1);
+            m_positioned = true;
+        }
+        for (int64_t i = 0; i < n; ++i) {
+            const int64_t seq = pl.first_seq + i;
+            if (seq < m_next_out || seq <= m_last_listed) continue;
+            const auto& it = pl.items[static_cast<size_t>(i)];
+            Segment s;
+            s.uri = it.uri;
+            s.duration = it.duration;
+            s.discontinuity = it.discontinuity;
+            m_segments.emplace(seq, std::move(s));
+        }
+        if (last > m_last_listed) {
+            m_last_listed = last;
+            m_last_growth = Clock::now();
+            m_work_cv.notify_all();
+        }
+    }
+
+    void HlsReader::playlist_loop() {
+        ThreadPlacement::Scope placement(ThreadRole::Ingest, "hlsp:" + m_name);
+        bool grown = true;
+        std::string body, final_url, err;
+        Playlist pl;
+        for (;;) {
+            {
+                std::unique_lock<std::mutex> lk(m_mx);
+                if (m_ended) return;   // VOD: список больше не меняется
+                const double wait_s = std::max(kMinReloadS, grown ? m_target_s : m_target_s / 2);
+                m_reload_cv.wait_for(lk, std::chrono::duration<double>(wait_s), [this] { return m_stop.load(std::memory_order_relaxed); });
+                if (m_stop.load(std::memory_order_relaxed)) return;
+            }
+            int rc = fetch(0, m_playlist_url, body, final_url, err);
+            if (rc == 0 && (!parse(body, final_url, pl) || pl.master)) {
+                err = "bad media playlist";
+                rc = -EINVAL;
+            }
+            if (rc == -ECANCELED) return;
+
+            std::lock_guard<std::mutex> lk(m_mx);
+            ++m_stats.playlist_reloads;
+            if (rc < 0) {
+                ++m_stats.playlist_errors;
+                if (!m_playlist_down) Logger::log(LogLevel::Warning, m_id, logcode::StreamInputLost, m_name + ": hls playlist: " + err);
+                m_playlist_down = true;
+                grown = false;
+                continue;
+            }
+            if (m_playlist_down) Logger::log(LogLevel::Info, m_id, logcode::StreamOpened, m_name + ": hls playlist is back");
+            m_playlist_down = false;
+            const int64_t before = m_last_listed;
+            const uint64_t gen = m_gen;
+            apply(pl);
+            grown = m_last_listed > before || gen != m_gen;
+        }
+    }
+
+    // Загрузчик: самый ранний ещё не взятый сегмент в окне [m_next_out, m_next_out + prefetch)
+    void HlsReader::worker_loop(int slot) {
+        ThreadPlacement::Scope placement(ThreadRole::Ingest, "hls" + std::to_string(slot) + ":" + m_name);
+        std::string body, final_url, err;
+        std::unique_lock<std::mutex> lk(m_mx);
+        while (!m_stop.load(std::memory_order_relaxed)) {
+            const auto now = Clock::now();
+            auto next_retry = now + std::chrono::seconds(1);
+            auto pick = m_segments.end();
+            for (auto it = m_segments.begin(); it != m_segments.end() && it->first < m_next_out + m_prefetch; ++it) {
+                const Segment& s = it->second;
+                if (s.state != SegState::Queued) continue;
+                if (s.retry_at > now) {
+                    next_retry = std::min(next_retry, s.retry_at);
+                    continue;
+                }
+                pick = it;
+                break;
+            }
+            if (pick == m_segments.end()) {
+                m_work_cv.wait_until(lk, next_retry);
+                continue;
+            }
+
+            const int64_t seq = pick->first;
+            const uint64_t gen = m_gen;
+            const std::string uri = pick->second.uri;
+            const double duration = pick->second.duration;
+            pick->second.state = SegState::Loading;
+            ++m_inflight;
+            lk.unlock();
+            const auto t0 = Clock::now();
+            const int rc = fetch(slot, uri, body, final_url, err);
+            const double ms = std::chrono::duration<double, std::milli>(Clock::now() - t0).count();
+            lk.lock();
+            --m_inflight;
+
+            auto it = m_segments.find(seq);
+            if (gen != m_gen || it == m_segments.end()) continue;
+            Segment& s = it->second;
+            if (rc == 0) {
+                s.data = std::move(body);
+                s.state = SegState::Ready;
+                ++m_stats.segments;
+                m_stats.bytes += s.data.size();
+                m_stats.last_download_ms = ms;
+                m_stats.avg_download_ms = m_stats.avg_download_ms > 0.0 ? m_stats.avg_download_ms + (ms - m_stats.avg_download_ms) / 8.0 : ms;
+                m_stats.max_download_ms = std::max(m_stats.max_download_ms, ms);
+                if (duration > 0.0 && ms > duration * 1000.0) ++m_stats.slow_segments;
+            }
+            else if (rc == -ECANCELED) {
+                s.state = SegState::Queued;
+                continue;
+            }
+            else {
+                ++m_stats.download_errors;
+                if (++s.attempts >= kMaxAttempts) s.state = SegState::Failed;
+                else {
+                    s.state = SegState::Queued;
+                    s.retry_at = Clock::now() + std::chrono::milliseconds(250 * s.attempts);
+                }
+            }
+            m_ready_cv.notify_all();
+        }
+    }
+
+    int HlsReader::read(uint8_t* buf, int size, int timeout_ms) {
+        if (m_cur_pos >= m_cur.size()) {
+            std::unique_lock<std::mutex> lk(m_mx);
+            const auto deadline = Clock::now() + std::chrono::milliseconds(timeout_ms);
+            for (;;) {
+                if (m_stop.load(std::memory_order_relaxed)) return -ECANCELED;
+                auto it = m_segments.find(m_next_out);
+                if (it == m_segments.end()) {
+                    // номера между m_next_out и следующим в списке так и не появились в плейлисте
+                    const auto next = m_segments.lower_bound(m_next_out);
+                    if (next != m_segments.end()) {
+                        m_stats.missing += static_cast<uint64_t>(next->first - m_next_out);
+                        m_next_out = next->first;
+                        continue;
+                    }
+                    if (m_ended && m_next_out > m_last_listed) return -ENODATA;
+                }
+                else if (it->second.state == SegState::Ready) {
+                    if (it->second.discontinuity) ++m_stats.discontinuities;
+                    m_cur = std::move(it->second.data);
+                    m_cur_pos = 0;
+                    m_stats.sequence = it->first;
+                    m_segments.erase(it);
+                    ++m_next_out;
+                    m_work_cv.notify_all();   // окно загрузки сдвинулось
+                    if (m_cur.empty()) continue;
+                    break;
+                }
+                else if (it->second.state == SegState::Failed) {
+                    ++m_stats.missing;
+                    m_segments.erase(it);
+                    ++m_next_out;
+                    m_work_cv.notify_all();
+                    continue;
+                }
+                if (m_ready_cv.wait_until(lk, deadline) == std::cv_status::timeout) return 0;
+            }
+        }
+        const size_t n = std::min(m_cur.size() - m_cur_pos, static_cast<size_t>(size));
+        std::memcpy(buf, m_cur.data() + m_cur_pos, n);
+        m_cur_pos += n;
+        return static_cast<int>(n);
+    }
+
+    HlsStats HlsReader::stats() const {
+        std::lock_guard<std::mutex> lk(m_mx);
+        HlsStats s = m_stats;
+        s.inflight = m_inflight;
+        for (const auto& [seq, seg] : m_segments)
+            if (seg.state == SegState::Ready) ++s.ready;
+        if (m_positioned && !m_ended && !m_stop.load(std::memory_order_relaxed))
+            s.stale_ms = static_cast<int>(std::chrono::duration_cast<std::chrono::milliseconds>(Clock::now() - m_last_growth).count());
+        return s;
+    }
+
+} // namespace multiscreen
@@ -0,0 +1,135 @@
+#include "LogRing.h"
+
+#include <algorithm>
+#include <cstring>
+
+namespace multiscreen {
+    namespace {
+        constexpr size_t kDefaultCapacity = 8192;
+        constexpr uint32_t kMaxStreamIndex = 1u << 20;   // защита от мусорных id при resize
+
+        // Обрезка по границе символа UTF-8, чтобы не отдавать в JSON половину буквы
+        size_t utf8_cut(std::string_view s, size_t max) {
+            if (s.size() <= max) return s.size();
+            size_t n = max;
+            while (n > 0 && (static_cast<unsigned char>(s[n]) & 0xC0) == 0x80) --n;
+            return n;
+        }
+    } // anonymous
+
+    LogRing& LogRing::instance() {
+        static LogRing r;
+        return r;
+    }
+
+    LogRing::LogRing() : m_slots(kDefaultCapacity) {}
+
+    void LogRing::reserve(size_t capacity) {
+        capacity = std::clamp<size_t>(capacity, 64, 1 << 22);
+        std::lock_guard<std::mutex> lk(m_mx);
+        if (capacity == m_slots.size()) return;
+        // номера продолжаются, старые записи становятся недоступны (seq в слотах обнулены)
+        m_slots.assign(capacity, LogRecord{});
+        m_heads.clear();
+    }
+
+    size_t LogRing::capacity() const {
+        std::lock_guard<std::mutex> lk(m_mx);
+        return m_slots.size();
+    }
+
+    void LogRing::append(int64_t ts_ms, LogLevel level, uint32_t stream, uint16_t code, std::string_view msg) {
+        std::lock_guard<std::mutex> lk(m_mx);
+        const uint64_t seq = ++m_last;
+        LogRecord& r = m_slots[(seq - 1) % m_slots.size()];
+        r.seq = seq;
+        r.ts_ms = ts_ms;
+        r.stream = stream;
+        r.code = code;
+        r.level = static_cast<uint8_t>(level);
+        r.len = static_cast<uint8_t>(utf8_cut(msg, LogRecord::kMsgMax));
+        std::memcpy(r.msg, msg.data(), r.len);
+        r.prev = 0;
+        if (stream < kMaxStreamIndex) {
+            if (m_heads.size() <= stream) m_heads.resize(stream + 1, 0);
+            r.prev = m_heads[stream];
+            m_heads[stream] = seq;
+        }
+    }
+
+    void LogRing::publish() {
+        m_cv.notify_all();
+    }
+
+    const LogRecord* LogRing::at_unlocked(uint64_t seq) const noexcept {
+        if (seq == 0 || seq > m_last || m_last - seq >= m_slots.size()) return nullptr;
+        const LogRecord& r = m_slots[(seq - 1) % m_slots.size()];
+        return r.seq == seq ? &r : nullptr;
+    }
+
+    bool LogRing::match(const LogRecord& r, const LogQuery& q) const noexcept {
+        if (r.level < static_cast<uint8_t>(q.min_level)) return false;
+        if (q.stream != kNoStream && r.stream != q.stream) return false;
+        if (q.code && r.code != q.code) return false;
+        if (q.since_ms && r.ts_ms < q.since_ms) return false;
+        if (q.until_ms && r.ts_ms > q.until_ms) return false;
+        return true;
+    }
+
+    std::vector<LogRecord> LogRing::latest(const LogQuery& q) const {
+        std::vector<LogRecord> out;
+        std::lock_guard<std::mutex> lk(m_mx);
+        const bool by_stream = q.stream != kNoStream;
+        uint64_t s = by_stream ? (q.stream < m_heads.size() ? m_heads[q.stream] : 0) : m_last;
+        while (out.size() < q.limit) {
+            const LogRecord* r = at_unlocked(s);
+            if (!r || r->seq <= q.after_seq) break;
+            if (match(*r, q)) out.push_back(*r);
+            s = by_stream ? r->prev : s - 1;
+        }
+        std::reverse(out.begin(), out.end());
+        return out;
+    }
+
+    std::vector<LogRecord> LogRing::after(const LogQuery& q, uint64_t* scanned) const {
+        std::vector<LogRecord> out;
+        std::lock_guard<std::mutex> lk(m_mx);
+        *scanned = m_last;
+        if (q.stream != kNoStream) {
+            // цепочка стрима идёт от новых к старым: собираем seq и читаем в прямом порядке
+            std::vector<uint64_t> chain;
+            uint64_t s = q.stream < m_heads.size() ? m_heads[q.stream] : 0;
+            for (const LogRecord* r = at_unlocked(s); r && r->seq > q.after_seq; r = at_unlocked(r->prev))
+                chain.push_back(r->seq);
+            for (auto it = chain.rbegin(); it != chain.rend() && out.size() < q.limit; ++it) {
+                const LogRecord* r = at_unlocked(*it);
+                if (match(*r, q)) out.push_back(*r);
+                if (out.size() == q.limit) *scanned = *it;
+            }
+            return out;
+        }
+        const uint64_t oldest = m_last >= m_slots.size() ? m_last - m_slots.size() + 1 : 1;
+        for (uint64_t s = std::max(q.after_seq + 1, oldest); s <= m_last; ++s) {
+            const LogRecord* r = at_unlocked(s);
+            if (r && match(*r, q)) out.push_back(*r);
+            if (out.size() == q.limit) { *scanned = s; break; }
+        }
+        return out;
+    }
+
+    bool LogRing::wait(uint64_t after_seq, std::chrono::milliseconds timeout) const {
+        std::unique_lock<std::mutex> lk(m_mx);
+        return m_cv.wait_for(lk, timeout, [&] { return m_last > after_seq; });
+    }
+
+    uint64_t LogRing::last_seq() const {
+        std::lock_guard<std::mutex> lk(m_mx);
+        return m_last;
+    }
+
+    void LogRing::forget_stream(uint32_t stream) {
+        std::lock_guard<std::mutex> lk(m_mx);
+        if (stream < m_heads.size()) m_heads[stream] = 0;
+    }
+
+} // namespace multiscreen
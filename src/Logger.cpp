@@ -1,53 +1,282 @@
 #include "Logger.h"
-#include <iomanip>
-#include <ctime>
+#include "LogRing.h"
+#include "utils/bounded_queue.hpp"
 #include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <condition_variable>
+#include <ctime>
+#include <filesystem>
+#include <fstream>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+namespace fs = std::filesystem;
 
 namespace multiscreen {
+    namespace {
+        constexpr size_t kSharedCapacity = 4096;
+
+        struct Record {
+            std::chrono::system_clock::time_point ts{};
+            uint64_t    seq = 0;       // глобальный порядок вызовов log()
+            LogLevel    level = LogLevel::Info;
+            uint32_t    stream = kNoStream;
+            uint16_t    code = logcode::None;
+            std::string message;
+        };
+
+        // Буфер одного потока: пишет только владелец, забирает только поток записи
+        struct ThreadBuf {
+            explicit ThreadBuf(size_t cap) : q(cap) {}
+            util::BoundedQueue<Record> q;
+            std::atomic<bool> closed{ false };   // владелец завершился — после опустошения буфер удаляется
+        };
+
+        struct State {
+            std::atomic<int>      min_level{ static_cast<int>(LogLevel::Debug) };
+            std::atomic<size_t>   thread_buffer{ 256 };
+            std::atomic<uint64_t> seq{ 0 };
+            std::atomic<uint64_t> dropped{ 0 };
+            std::atomic<uint64_t> written{ 0 };
+            std::atomic<uint64_t> bytes{ 0 };
+            std::atomic<uint64_t> rotations{ 0 };
+            std::atomic<uint64_t> batches{ 0 };
+
+            // для потоков, чей thread_local уже разрушен (логирование из деструкторов на выходе)
+            util::BoundedQueue<Record> shared{ kSharedCapacity };
+
+            std::mutex bufs_mx;   // только регистрация буферов и их обход потоком записи
+            std::vector<std::shared_ptr<ThreadBuf>> bufs;
+
+            std::mutex              wake_mx;
+            std::condition_variable wake_cv;
+            std::atomic<bool>       wake{ false };
+            bool                    stop = false;   // под wake_mx
+
+            std::mutex  life_mx;    // initialize/shutdown
+            std::thread writer;
+            bool        running = false;
 
-    std::recursive_mutex Logger::s_mutex;
-    std::ofstream        Logger::s_file;
-    std::deque<LogEntry> Logger::s_recent;
+            std::mutex opts_mx;
+            LogOptions opts;
+            bool       opts_dirty = true;
 
-    static std::string tsToString(std::chrono::system_clock::time_point tp) {
-        std::time_t t = std::chrono::system_clock::to_time_t(tp);
-        std::tm tm{};
+        };
+
+        // Намеренно не разрушается: логировать могут деструкторы других статиков на выходе
+        State& st() {
+            static State* s = new State();
+            return *s;
+        }
+
+        thread_local ThreadBuf* t_buf = nullptr;
+        thread_local uint32_t   t_stream = kNoStream;
+        thread_local bool       t_gone = false;
+
+        struct ThreadSlot {
+            std::shared_ptr<ThreadBuf> buf;
+            ~ThreadSlot() {
+                if (buf) buf->closed.store(true, std::memory_order_release);
+                t_buf = nullptr;
+                t_gone = true;
+            }
+        };
+        thread_local ThreadSlot t_slot;
+
+        // Буфер текущего потока; регистрируется один раз при первом log() из потока
+        ThreadBuf* local_buf() {
+            if (t_buf || t_gone) return t_buf;
+            auto& s = st();
+            auto b = std::make_shared<ThreadBuf>(s.thread_buffer.load(std::memory_order_relaxed));
+            {
+                std::lock_guard<std::mutex> lk(s.bufs_mx);
+                s.bufs.push_back(b);
+            }
+            t_slot.buf = b;
+            t_buf = b.get();
+            return t_buf;
+        }
+
+        // Форматирование времени: localtime/strftime — не чаще раза в секунду
+        class TsCache {
+        public:
+            const std::string& format(std::chrono::system_clock::time_point tp) {
+                const std::time_t t = std::chrono::system_clock::to_time_t(tp);
+                if (t != m_sec) {
+                    std::tm tm{};
 #if defined(_WIN32)
-        localtime_s(&tm, &t);
+                    localtime_s(&tm, &t);
 #else
-        localtime_r(&t, &tm);
+                    localtime_r(&t, &tm);
 #endif
-        char buf[64];
-        std::strftime(buf, sizeof(buf), "%Y-%m-%d %H:%M:%S", &tm);
-        return buf;
-    }
+                    char buf[64];
+                    const size_t n = std::strftime(buf, sizeof(buf), "%Y-%m-%d %H:%M:%S", &tm);
+                    m_text.assign(buf, n);
+                    m_sec = t;
+                }
+                return m_text;
+            }
+
+        private:
+            std::time_t m_sec = std::numeric_limits<std::time_t>::min();
+            std::string m_text;
+        };
+
+        // Файл лога: принадлежит только потоку записи
+        class LogFile {
+        public:
+            void apply(const LogOptions& o) {
+                m_opts = o;
+                if (o.file != m_path) {
+                    close();
+                    m_path = o.file;
+                    open();
+                }
+            }
+
+            void write(const std::string& buf) {
+                if (buf.empty()) return;
+                if (need_rotate(buf.size())) rotate();
+                if (!m_out.is_open()) return;
+                m_out.write(buf.data(), static_cast<std::streamsize>(buf.size()));
+                m_out.flush();
+                m_bytes += buf.size();
+                st().bytes.store(m_bytes, std::memory_order_relaxed);
+            }
+
+            void close() {
+                if (m_out.is_open()) m_out.close();
+            }
+
+        private:
+            void open() {
+                try {
+                    fs::path p(m_path);
+                    if (p.has_parent_path()) fs::create_directories(p.parent_path());
+                    m_out.open(m_path, std::ios::app | std::ios::binary);
+                    std::error_code ec;
+                    const auto sz = fs::file_size(p, ec);
+                    m_bytes = ec ? 0 : static_cast<uint64_t>(sz);
+                }
+                catch (...) {
+                    m_bytes = 0;   // глушим исключения логгера
+                }
+                m_opened = std::chrono::steady_clock::now();
+                st().bytes.store(m_bytes, std::memory_order_relaxed);
+            }
+
+            bool need_rotate(size_t incoming) const {
+                if (m_bytes == 0) return false;
+                if (m_opts.max_bytes && m_bytes + incoming > m_opts.max_bytes) return true;
+                return m_opts.rotate_hours > 0 &&
+                    std::chrono::steady_clock::now() - m_opened >= std::chrono::hours(m_opts.rotate_hours);
+            }
+
+            // app.log -> app.log.1 -> … -> app.log.N (самый старый удаляется)
+            void rotate() {
+                close();
+                const int n = std::max(1, m_opts.max_files);
+                std::error_code ec;
+                fs::remove(m_path + "." + std::to_string(n), ec);
+                for (int i = n - 1; i >= 1; --i)
+                    fs::rename(m_path + "." + std::to_string(i), m_path + "." + std::to_string(i + 1), ec);
+                fs::rename(m_path, m_path + ".1", ec);
+                open();
+                st().rotations.fetch_add(1, std::memory_order_relaxed);
+            }
+
+            LogOptions    m_opts;
+            std::string   m_path;
+            std::ofstream m_out;
+            uint64_t      m_bytes = 0;
+            std::chrono::steady_clock::time_point m_opened{};
+        };
+
+        void wake_writer() {
+            auto& s = st();
+            if (!s.wake.exchange(true, std::memory_order_acq_rel)) s.wake_cv.notify_one();
+        }
+
+        // Забрать всё накопленное; буферы завершившихся потоков удаляются после опустошения
+        void collect(std::vector<Record>& out) {
+            auto& s = st();
+            auto drain = [&out](util::BoundedQueue<Record>& q) {
+                while (auto r = q.try_pop()) out.push_back(std::move(*r));
+                };
+            {
+                std::lock_guard<std::mutex> lk(s.bufs_mx);
+                for (size_t i = 0; i < s.bufs.size();) {
+                    const bool closed = s.bufs[i]->closed.load(std::memory_order_acquire);
+                    drain(s.bufs[i]->q);
+                    if (closed) {
+                        s.bufs[i] = std::move(s.bufs.back());
+                        s.bufs.pop_back();
+                    }
+                    else ++i;
+                }
+            }
+            drain(s.shared);
+            std::sort(out.begin(), out.end(), [](const Record& a, const Record& b) { return a.seq < b.seq; });
+        }
+    } // anonymous
 
     void Logger::initialize(const std::string& filename) {
-        try {
-            std::filesystem::path p(filename);
-            if (p.has_parent_path()) std::filesystem::create_directories(p.parent_path());
-            //  :     
-            std::unique_lock<std::recursive_mutex> lk(s_mutex, std::try_to_lock);
-            if (lk.owns_lock()) {
-                s_file.open(filename, std::ios::app);
-                if (s_file.is_open()) {
-                    auto now = std::chrono::system_clock::now();
-                    s_file << tsToString(now) << " [INFO] Logger initialized" << std::endl;
+        LogOptions o;
+        {
+            std::lock_guard<std::mutex> lk(st().opts_mx);
+            o = st().opts;
+        }
+        o.file = filename;
+        initialize(o);
+    }
+
+    void Logger::initialize(const LogOptions& opts) {
+        auto& s = st();
+        configure(opts);
+        {
+            std::lock_guard<std::mutex> lk(s.life_mx);
+            if (!s.running) {
+                {
+                    std::lock_guard<std::mutex> wl(s.wake_mx);
+                    s.stop = false;
                 }
+                s.writer = std::thread(&Logger::writer_loop);
+                s.running = true;
             }
         }
-        catch (...) {
-            //   
+        info("Logger initialized");
+    }
+
+    void Logger::configure(const LogOptions& opts) {
+        auto& s = st();
+        {
+            std::lock_guard<std::mutex> lk(s.opts_mx);
+            s.opts = opts;
+            s.opts.max_files = std::max(1, opts.max_files);
+            s.opts.flush_ms = std::clamp(opts.flush_ms, 1, 10000);
+            s.opts.thread_buffer = std::clamp<size_t>(opts.thread_buffer, 16, 1 << 16);
+            s.opts_dirty = true;
+            s.thread_buffer.store(s.opts.thread_buffer, std::memory_order_relaxed);   // для новых потоков
         }
+        s.min_level.store(static_cast<int>(opts.min_level), std::memory_order_relaxed);
+        wake_writer();
     }
 
     void Logger::shutdown() {
-        std::unique_lock<std::recursive_mutex> lk(s_mutex, std::try_to_lock);
-        if (lk.owns_lock() && s_file.is_open()) {
-            auto now = std::chrono::system_clock::now();
-            s_file << tsToString(now) << " [INFO] Logger shutdown" << std::endl;
-            s_file.close();
+        auto& s = st();
+        std::lock_guard<std::mutex> lk(s.life_mx);
+        if (!s.running) return;
+        info("Logger shutdown");
+        {
+            std::lock_guard<std::mutex> wl(s.wake_mx);
+            s.stop = true;
         }
+        s.wake_cv.notify_one();
+        if (s.writer.joinable()) s.writer.join();
+        s.running = false;
     }
 
     const char* Logger::levelToStr(LogLevel l) {
@@ -60,29 +289,153 @@ namespace multiscreen {
         }
     }
 
+    LogLevel Logger::parseLevel(const std::string& v, LogLevel def) {
+        std::string s(v);
+        std::transform(s.begin(), s.end(), s.begin(), [](unsigned char c) { return static_cast<char>(std::tolower(c)); });
+        if (s == "debug") return LogLevel::Debug;
+        if (s == "info") return LogLevel::Info;
+        if (s == "warn" || s == "warning") return LogLevel::Warning;
+        if (s == "error") return LogLevel::Error;
+        return def;
+    }
+
+    Logger::StreamScope::StreamScope(uint32_t stream) : m_prev(t_stream) {
+        t_stream = stream;
+    }
+
+    Logger::StreamScope::~StreamScope() {
+        t_stream = m_prev;
+    }
+
     void Logger::log(LogLevel level, const std::string& message) {
-        auto now = std::chrono::system_clock::now();
-        std::unique_lock<std::recursive_mutex> lk(s_mutex, std::try_to_lock);
-        if (!lk.owns_lock()) return; //     
-        s_recent.push_back({ now, level, message });
-        if (s_recent.size() > s_max_recent) s_recent.pop_front();
-        if (s_file.is_open()) {
-            s_file << tsToString(now) << " [" << levelToStr(level) << "] " << message << std::endl;
+        log(level, t_stream, logcode::None, message);
+    }
+
+    void Logger::log(LogLevel level, uint32_t stream, uint16_t code, const std::string& message) {
+        auto& s = st();
+        if (static_cast<int>(level) < s.min_level.load(std::memory_order_relaxed)) return;
+
+        Record r;
+        r.ts = std::chrono::system_clock::now();
+        r.seq = s.seq.fetch_add(1, std::memory_order_relaxed);
+        r.level = level;
+        r.stream = stream;
+        r.code = code;
+        r.message = message;
+
+        ThreadBuf* b = local_buf();
+        util::BoundedQueue<Record>& q = b ? b->q : s.shared;
+        if (!q.try_push(std::move(r))) {
+            wake_writer();
+            // предупреждения и ошибки нужнее всего именно в шторм: ждём поток записи до ~5 мс
+            bool ok = false;
+            for (int i = 0; i < 50 && level >= LogLevel::Warning && !ok; ++i) {
+                std::this_thread::sleep_for(std::chrono::microseconds(100));
+                ok = q.try_push(std::move(r));
+            }
+            if (!ok) s.dropped.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+        // обычные записи ждут очередного пакета (flush_ms); ошибки и заполненный наполовину буфер — сразу
+        if (level >= LogLevel::Error || q.size_approx() * 2 >= q.capacity()) wake_writer();
+    }
+
+    void Logger::writer_loop() {
+        auto& s = st();
+        LogFile file;
+        TsCache ts;
+        LogOptions opts;
+        std::vector<Record> batch;
+        std::string buf;
+        uint64_t dropped_reported = 0;
+
+        for (;;) {
+            {
+                std::lock_guard<std::mutex> lk(s.opts_mx);
+                if (s.opts_dirty) {
+                    opts = s.opts;
+                    s.opts_dirty = false;
+                    file.apply(opts);
+                    LogRing::instance().reserve(opts.ring_capacity);
+                }
+            }
+
+            bool stopping;
+            {
+                std::unique_lock<std::mutex> lk(s.wake_mx);
+                s.wake_cv.wait_for(lk, std::chrono::milliseconds(opts.flush_ms),
+                    [&s] { return s.stop || s.wake.load(std::memory_order_acquire); });
+                stopping = s.stop;
+            }
+            s.wake.store(false, std::memory_order_release);
+
+            batch.clear();
+            collect(batch);
+
+            // потери — отдельной строкой в самом логе, а не молча
+            const uint64_t dropped = s.dropped.load(std::memory_order_relaxed);
+            if (dropped != dropped_reported) {
+                Record r;
+                r.ts = std::chrono::system_clock::now();
+                r.level = LogLevel::Warning;
+                r.message = "Logger: dropped " + std::to_string(dropped - dropped_reported) +
+                    " message(s), thread buffers full (total " + std::to_string(dropped) + ")";
+                batch.push_back(std::move(r));
+                dropped_reported = dropped;
+            }
+
+            if (!batch.empty()) {
+                buf.clear();
+                for (const auto& r : batch) {
+                    buf += ts.format(r.ts);
+                    buf += " [";
+                    buf += levelToStr(r.level);
+                    buf += "] ";
+                    buf += r.message;
+                    buf += '\n';
+                }
+                file.write(buf);
+                s.written.fetch_add(batch.size(), std::memory_order_relaxed);
+                s.batches.fetch_add(1, std::memory_order_relaxed);
+
+                // структурная копия для /api/logs: фиксированное кольцо, без аллокаций
+                auto& ring = LogRing::instance();
+                for (const auto& r : batch) {
+                    const int64_t ms = std::chrono::duration_cast<std::chrono::milliseconds>(r.ts.time_since_epoch()).count();
+                    ring.append(ms, r.level, r.stream, r.code, r.message);
+                }
+                ring.publish();
+            }
+
+            if (stopping && batch.empty()) break;
         }
+        file.close();
     }
 
     std::vector<LogEntry> Logger::getRecentLogs(size_t count) {
-        std::unique_lock<std::recursive_mutex> lk(s_mutex, std::try_to_lock);
-        if (!lk.owns_lock()) return {};
-        count = std::min(count, s_recent.size());
+        LogQuery q;
+        q.limit = count;
+        const auto recs = LogRing::instance().latest(q);
         std::vector<LogEntry> v;
-        v.reserve(count);
-        auto it = s_recent.end();
-        for (size_t i = 0; i < count; ++i) {
-            --it;
-            v.push_back(*it);
+        v.reserve(recs.size());
+        for (auto it = recs.rbegin(); it != recs.rend(); ++it) {   // новые первыми, как и раньше
+            v.push_back({ std::chrono::system_clock::time_point(std::chrono::milliseconds(it->ts_ms)),
+                static_cast<LogLevel>(it->level), std::string(it->message()) });
         }
         return v;
     }
 
+    LogStats Logger::stats() {
+        auto& s = st();
+        LogStats out;
+        out.written = s.written.load(std::memory_order_relaxed);
+        out.dropped = s.dropped.load(std::memory_order_relaxed);
+        out.bytes = s.bytes.load(std::memory_order_relaxed);
+        out.rotations = s.rotations.load(std::memory_order_relaxed);
+        out.batches = s.batches.load(std::memory_order_relaxed);
+        std::lock_guard<std::mutex> lk(s.bufs_mx);
+        out.threads = s.bufs.size();
+        return out;
+    }
+
 } // namespace multiscreen
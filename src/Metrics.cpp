@@ -1,9 +1,13 @@
 #include "Metrics.h"
 #include "Settings.h"
 #include "Alerts.h"
+#include "AlertState.h"
 
 #include <chrono>
 #include <algorithm>
+#include <cstdio>
+#include <limits>
+#include <string>
 
 using namespace std::chrono;
 using alerts::Severity;
@@ -45,7 +49,13 @@ namespace multiscreen {
     }
 
     void Metrics::onPacketTs(const uint8_t* pkt, size_t len) noexcept {
-        handleTsPacket(pkt, len);
+        std::lock_guard<std::mutex> lk(m_cc_mu_);
+        m_ts_.feed(pkt, len);
+        const uint64_t total = m_ts_.snapshot().cc_errors;
+        if (total != m_ts_cc_seen_) {
+            noteCcErrors(static_cast<uint32_t>(total - m_ts_cc_seen_));
+            m_ts_cc_seen_ = total;
+        }
     }
 
     // === getters ===
@@ -66,10 +76,12 @@ namespace multiscreen {
         const int64_t horizon = now - 60000;
 
         std::lock_guard<std::mutex> lk(m_cc_mu_);
-        while (!m_cc_err_times_ms_.empty() && m_cc_err_times_ms_.front() < horizon) {
+        while (!m_cc_err_times_ms_.empty() && m_cc_err_times_ms_.front().first < horizon) {
             m_cc_err_times_ms_.pop_front();
         }
-        return static_cast<int>(m_cc_err_times_ms_.size());
+        uint64_t total = 0;
+        for (const auto& e : m_cc_err_times_ms_) total += e.second;
+        return static_cast<int>(std::min<uint64_t>(total, std::numeric_limits<int>::max()));
     }
 
     int64_t Metrics::stallMsNow() const noexcept {
@@ -80,70 +92,16 @@ namespace multiscreen {
     }
 
     // ===== TS continuity handling =====
-    void Metrics::handleTsPacket(const uint8_t* pkt, size_t len) noexcept {
-        uint16_t pid = 0;
-        bool payload = false;
-        bool discontinuity = false;
-        uint8_t cc = 0;
-        if (!tsParseHeader(pkt, len, pid, payload, discontinuity, cc)) return;
-
-        std::lock_guard<std::mutex> lk(m_cc_mu_);
-
-        auto& st = m_cc_map_[pid];
-        if (discontinuity) {
-            st.valid = false; //   CC
-            return;
-        }
-
-        if (!st.valid) {
-            st.valid = true;
-            st.last_cc = cc;
-            return;
-        }
-
-        if (payload) {
-            const uint8_t expected = static_cast<uint8_t>((st.last_cc + 1) & 0x0F);
-            if (cc != expected) {
-                noteCcError();
-                //    
-            }
-            st.last_cc = cc;
-        }
-    }
-
-    bool Metrics::tsParseHeader(const uint8_t* pkt, size_t len,
-        uint16_t& pid, bool& payload_present,
-        bool& discontinuity, uint8_t& cc) noexcept
-    {
-        if (!pkt || len < 188) return false;
-        if (pkt[0] != 0x47) return false;
-
-        pid = static_cast<uint16_t>(((pkt[1] & 0x1F) << 8) | pkt[2]);
-        const uint8_t afc = static_cast<uint8_t>((pkt[3] >> 4) & 0x03);
-        cc = static_cast<uint8_t>(pkt[3] & 0x0F);
-
-        const bool adaptation = (afc == 2) || (afc == 3);
-        payload_present = (afc == 1) || (afc == 3);
-        discontinuity = false;
-
-        if (adaptation) {
-            size_t off = 4;
-            if (off >= len) return true;
-            const uint8_t afl = pkt[off++];
-            if (afl > 0 && off + afl <= len) {
-                const uint8_t flags = pkt[off];
-                discontinuity = ((flags & 0x80) != 0); // bit7
-            }
-        }
-        return true;
-    }
-
-    void Metrics::noteCcError() noexcept {
+    // под m_cc_mu_; ошибки одного вызова onPacketTs() — одна запись окна
+    void Metrics::noteCcErrors(uint32_t count) noexcept {
         const int64_t now = nowMsSteady();
-        m_cc_err_times_ms_.push_back(now);
+        if (!m_cc_err_times_ms_.empty() && m_cc_err_times_ms_.back().first == now)
+            m_cc_err_times_ms_.back().second += count;
+        else
+            m_cc_err_times_ms_.emplace_back(now, count);
 
         const int64_t horizon = now - 60000;
-        while (!m_cc_err_times_ms_.empty() && m_cc_err_times_ms_.front() < horizon) {
+        while (!m_cc_err_times_ms_.empty() && m_cc_err_times_ms_.front().first < horizon) {
             m_cc_err_times_ms_.pop_front();
         }
     }
@@ -160,34 +118,45 @@ namespace multiscreen {
         {
             std::lock_guard<std::mutex> lk(m_cc_mu_);
             const int64_t horizon = now - 60000;
-            while (!m_cc_err_times_ms_.empty() && m_cc_err_times_ms_.front() < horizon) {
+            while (!m_cc_err_times_ms_.empty() && m_cc_err_times_ms_.front().first < horizon) {
                 m_cc_err_times_ms_.pop_front();
             }
         }
     }
 
     // ===== polling & alerts =====
+    static Severity to_severity(alerts::Level l) noexcept {
+        switch (l) {
+        case alerts::Level::Crit: return Severity::Critical;
+        case alerts::Level::Warn: return Severity::Warning;
+        default:                  return Severity::Info;
+        }
+    }
+
     void Metrics::pollAndAlert(const char* name) {
         gcWindows_();
 
-        const auto& s = Settings::instance();
-        const auto& th = s.thresholds();
+        const auto snap = Settings::instance().snapshot();
+        const auto& th = snap->thresholds;
+        const char* who = (name ? name : "Stream");
+        const int64_t now = nowMsSteady();
+
+        // Уровни ведёт alerts::StateEngine (гистерезис/выдержка/флаппинг); шлём только его уведомления.
+        // Отдельный префикс ключа: render-метрики не смешиваются с автоматами watchdog того же канала.
+        auto& eng = alerts::StateEngine::instance();
+        const std::string key = std::string("render/") + who;
 
         // Stall
         {
             const int64_t stall = stallMsNow();
-            Severity sev = Severity::Info;
-            bool fire = false;
-
-            if (stall >= th.stall.crit_ms) { sev = Severity::Critical; fire = true; }
-            else if (stall >= th.stall.warn_ms) { sev = Severity::Warning; fire = true; }
-
-            if (fire) {
+            const auto t = eng.evaluate(key, alerts::Condition::Stall, static_cast<double>(stall),
+                th.stall.warn_ms, th.stall.crit_ms, false, now);
+            if (t.notify) {
                 char title[128];
-                snprintf(title, sizeof(title), "%s: Stall %lld ms",
-                    (name ? name : "Stream"),
+                snprintf(title, sizeof(title), "%s: Stall %s%s (%lld ms)", who,
+                    alerts::to_string(t.level), (t.flapping ? ", flapping" : ""),
                     static_cast<long long>(stall));
-                alerts::send_webhook(title, "No progress detected", sev);
+                alerts::send_webhook(title, "No progress detected", to_severity(t.level), key + "/" + alerts::to_string(alerts::Condition::Stall));
             }
         }
 
@@ -195,30 +164,30 @@ namespace multiscreen {
         {
             const int expected = m_expected_fps_.load(std::memory_order_relaxed);
             const double fps = renderFps(2.0);
-            Severity sev = Severity::Info;
-            bool fire = false;
-
-            if (fps <= th.fps.crit_ratio * expected) { sev = Severity::Critical; fire = true; }
-            else if (fps <= th.fps.warn_ratio * expected) { sev = Severity::Warning; fire = true; }
-
-            if (fire) {
+            const double ratio = (expected > 0) ? fps / expected : 1.0;
+            const auto t = eng.evaluate(key, alerts::Condition::Fps, ratio,
+                th.fps.warn_ratio, th.fps.crit_ratio, true, now);
+            if (t.notify) {
                 char title[128];
-                snprintf(title, sizeof(title), "%s: Low FPS %.1f (exp %d)",
-                    (name ? name : "Stream"), fps, expected);
-                alerts::send_webhook(title, "Render FPS below threshold", sev);
+                snprintf(title, sizeof(title), "%s: FPS %s%s (%.1f, exp %d)", who,
+                    alerts::to_string(t.level), (t.flapping ? ", flapping" : ""), fps, expected);
+                alerts::send_webhook(title, "Render FPS below threshold", to_severity(t.level), key + "/" + alerts::to_string(alerts::Condition::Fps));
             }
         }
 
-        // CC errors/min (legacy ,  )
+        // CC errors/min (legacy порог, если задан)
         {
-            const int per_min = ccErrorsPerMin();
-            const int legacy_cc_limit = s.cc_errors_per_min(); // 0 =  
-
-            if (legacy_cc_limit > 0 && per_min >= legacy_cc_limit) {
-                char title[128];
-                snprintf(title, sizeof(title), "%s: CC errors/min = %d (>= %d)",
-                    (name ? name : "Stream"), per_min, legacy_cc_limit);
-                alerts::send_webhook(title, "Transport continuity errors", Severity::Warning);
+            const int legacy_cc_limit = snap->legacy.cc_errors_per_min; // 0 = нет порога
+            if (legacy_cc_limit > 0) {
+                const int per_min = ccErrorsPerMin();
+                const auto t = eng.evaluate(key, alerts::Condition::CcErrors, per_min,
+                    legacy_cc_limit, std::numeric_limits<double>::max(), false, now);
+                if (t.notify) {
+                    char title[128];
+                    snprintf(title, sizeof(title), "%s: CC errors %s%s (%d/min, limit %d)", who,
+                        alerts::to_string(t.level), (t.flapping ? ", flapping" : ""), per_min, legacy_cc_limit);
+                    alerts::send_webhook(title, "Transport continuity errors", to_severity(t.level), key + "/" + alerts::to_string(alerts::Condition::CcErrors));
+                }
             }
         }
     }
@@ -0,0 +1,556 @@
+#include "Recorder.h"
+#include "Logger.h"
+#include "ThreadPlacement.h"
+#include "utils/storage.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cinttypes>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <limits>
+
+#if defined(__linux__)
+#include <fcntl.h>
+#include <unistd.h>
+#define MS_REC_DIRECT 1
+#endif
+
+#if defined(_WIN32)
+#include <malloc.h>
+#endif
+
+namespace fs = std::filesystem;
+using namespace std::chrono_literals;
+
+namespace multiscreen {
+    namespace {
+        using util::steady_ms;
+        using util::wall_ms;
+
+        uint8_t* aligned_new(size_t bytes) noexcept {
+#if defined(_WIN32)
+            return static_cast<uint8_t*>(_aligned_malloc(bytes, RecordChannel::kAlign));
+#else
+            return static_cast<uint8_t*>(std::aligned_alloc(RecordChannel::kAlign, bytes));
+#endif
+        }
+
+        void aligned_delete(uint8_t* p) {
+#if defined(_WIN32)
+            _aligned_free(p);
+#else
+            std::free(p);
+#endif
+        }
+
+        // "1700000000000.ts" -> 1700000000000; -1 — не наш файл
+        int64_t stem_ms(const fs::path& p) {
+            const std::string s = p.stem().string();
+            if (s.empty() || s.size() > 19 || !std::all_of(s.begin(), s.end(), [](char c) { return c >= '0' && c <= '9'; }))
+                return -1;
+            return std::strtoll(s.c_str(), nullptr, 10);
+        }
+    } // anonymous
+
+    // -------- RecordChannel: поток стрима --------
+
+    RecordChannel::RecordChannel(std::string name, std::string key, size_t blocks, int64_t flush_us)
+        : m_name(std::move(name)), m_key(std::move(key)), m_flush_us(flush_us),
+          m_slab(aligned_new(blocks * kBlock), &aligned_delete), m_blocks(m_slab ? blocks : 0) {
+        for (size_t i = 0; i < m_blocks.size(); ++i) m_blocks[i].data = m_slab.get() + i * kBlock;
+    }
+
+    RecordChannel::~RecordChannel() = default;
+
+    void RecordChannel::on_ts_packets(const uint8_t* base, const uint32_t*, size_t n, int64_t now_us) noexcept {
+        const size_t len = n * TsScanner::kPacket;
+        m_in += len;
+        append(base, len, now_us);
+    }
+
+    // kBlock кратен пакету, поэтому пакет никогда не режется между блоками
+    void RecordChannel::append(const uint8_t* p, size_t len, int64_t now_us) noexcept {
+        while (len) {
+            const uint64_t head = m_head.load(std::memory_order_relaxed);
+            if (!m_open) {
+                if (head - m_tail.load(std::memory_order_acquire) >= m_blocks.size()) {
+                    // диск не успевает: ingest не ждёт, байты учитываются как потерянные
+                    if (!m_dropping) ++m_drop_events;
+                    m_dropping = true;
+                    m_dropped += len;
+                    return;
+                }
+                m_dropping = false;
+                Block& b = m_blocks[head % m_blocks.size()];
+                b.len = 0;
+                b.first_ms = wall_ms();
+                m_open = true;
+                m_open_us = now_us;
+            }
+            Block& b = m_blocks[head % m_blocks.size()];
+            const size_t take = std::min(len, kBlock - b.len);
+            std::memcpy(b.data + b.len, p, take);
+            b.len += static_cast<uint32_t>(take);
+            p += take;
+            len -= take;
+            if (b.len == kBlock) seal();
+        }
+    }
+
+    void RecordChannel::seal() noexcept {
+        if (!m_open) return;
+        const uint64_t head = m_head.load(std::memory_order_relaxed);
+        Block& b = m_blocks[head % m_blocks.size()];
+        b.last_ms = wall_ms();
+        m_open = false;
+        if (b.len) m_head.store(head + 1, std::memory_order_release);
+    }
+
+    // поток Recorder опрашивает кольца сам: ingest не делает системных вызовов ради записи
+    void RecordChannel::on_ts_chunk(int64_t now_us) noexcept {
+        if (m_open && now_us - m_open_us >= m_flush_us) seal();
+        m_shared.in.store(m_in, std::memory_order_relaxed);
+        m_shared.dropped.store(m_dropped, std::memory_order_relaxed);
+        m_shared.drop_events.store(m_drop_events, std::memory_order_relaxed);
+    }
+
+    void RecordChannel::flush() noexcept {
+        seal();
+        m_shared.in.store(m_in, std::memory_order_relaxed);
+        m_shared.dropped.store(m_dropped, std::memory_order_relaxed);
+        m_shared.drop_events.store(m_drop_events, std::memory_order_relaxed);
+    }
+
+    // -------- Recorder --------
+
+    Recorder& Recorder::instance() {
+        static Recorder r;
+        return r;
+    }
+
+    Recorder::~Recorder() { stop(); }
+
+    void Recorder::configure(const RecorderOptions& opts) {
+        m_opts = opts;
+        const uint64_t seg = std::max<uint64_t>(opts.segment_bytes, RecordChannel::kBlock);
+        m_segment_bytes = (seg + RecordChannel::kBlock - 1) / RecordChannel::kBlock * RecordChannel::kBlock;
+        m_opts.flush_ms = std::clamp(opts.flush_ms, 100, 60000);
+        m_enabled.store(opts.enable && !opts.dir.empty(), std::memory_order_relaxed);
+    }
+
+    void Recorder::start() {
+        if (!enabled() || m_run.exchange(true)) return;
+        std::error_code ec;
+        fs::create_directories(m_opts.dir, ec);
+        if (ec) Logger::error("recorder: cannot create " + m_opts.dir + ": " + ec.message());
+        scan_dir();
+        const RecorderTotals t = totals();
+        Logger::info("recorder: " + m_opts.dir + ", " + std::to_string(t.segments) + " segment(s), " +
+            std::to_string(t.disk_bytes >> 20) + " MB on disk");
+        m_thr = std::thread([this] { run(); });
+    }
+
+    void Recorder::stop() {
+        if (!m_run.exchange(false)) return;
+        m_cv.notify_all();
+        if (m_thr.joinable()) m_thr.join();
+    }
+
+    std::shared_ptr<RecordChannel> Recorder::attach(const std::string& stream) {
+        if (!enabled()) return nullptr;
+        if (!m_opts.streams.empty() && std::find(m_opts.streams.begin(), m_opts.streams.end(), stream) == m_opts.streams.end())
+            return nullptr;
+        const std::string key = util::dir_key(stream);
+        const size_t blocks = static_cast<size_t>(std::max<uint64_t>(2, m_opts.buffer_bytes / RecordChannel::kBlock));
+
+        std::lock_guard<std::mutex> lk(m_mx);
+        for (const auto& c : m_channels)
+            if (c->m_key == key && !c->m_closed.load(std::memory_order_acquire)) {
+                Logger::warning("recorder: " + stream + ": directory " + key + " is already recorded by " + c->name());
+                return nullptr;
+            }
+        auto ch = std::make_shared<RecordChannel>(stream, key, blocks, int64_t(m_opts.flush_ms) * 1000);
+        if (!ch->m_slab) {
+            Logger::error("recorder: " + stream + ": cannot allocate " + std::to_string(blocks * RecordChannel::kBlock >> 20) + " MB buffer");
+            return nullptr;
+        }
+        m_channels.push_back(ch);
+        m_stores[key];
+        return ch;
+    }
+
+    void Recorder::detach(const std::shared_ptr<RecordChannel>& ch) {
+        if (!ch) return;
+        ch->flush();
+        ch->m_closed.store(true, std::memory_order_release);
+        if (!m_run.load(std::memory_order_acquire)) {
+            // потока записи нет (остановлен или не запускался): канал просто забывается
+            std::lock_guard<std::mutex> lk(m_mx);
+            m_channels.erase(std::remove(m_channels.begin(), m_channels.end(), ch), m_channels.end());
+        }
+    }
+
+    void Recorder::scan_dir() {
+        std::error_code ec;
+        fs::directory_iterator dirs(m_opts.dir, ec), end;
+        if (ec) return;
+        std::lock_guard<std::mutex> lk(m_mx);
+        for (; dirs != end; dirs.increment(ec)) {
+            if (ec) break;
+            if (!dirs->is_directory(ec)) continue;
+            std::vector<SegFile> found;
+            fs::directory_iterator files(dirs->path(), ec);
+            for (; !ec && files != end; files.increment(ec)) {
+                const fs::path& p = files->path();
+                if (p.extension() != ".ts") continue;
+                const int64_t start = stem_ms(p);
+                if (start < 0) continue;
+                SegFile s;
+                s.path = p.string();
+                s.start_ms = s.end_ms = start;
+                s.bytes = files->file_size(ec);
+                if (ec) { ec.clear(); continue; }
+                fs::path idx = p;
+                idx.replace_extension(".idx");
+                std::ifstream in(idx);
+                unsigned long long off = 0;
+                long long first = 0, last = 0;
+                while (in >> off >> first >> last) {
+                    if (off >= s.bytes) break;   // блок не дописан до остановки
+                    s.index.push_back({ off, first });
+                    s.end_ms = std::max<int64_t>(s.end_ms, last);
+                }
+                found.push_back(std::move(s));
+            }
+            ec.clear();
+            if (found.empty()) continue;
+            std::sort(found.begin(), found.end(), [](const SegFile& a, const SegFile& b) { return a.start_ms < b.start_ms; });
+            Store& st = m_stores[dirs->path().filename().string()];
+            for (SegFile& s : found) {
+                st.bytes += s.bytes;
+                m_total_bytes += s.bytes;
+                st.segs.push_back(std::move(s));
+            }
+        }
+    }
+
+    // -------- поток записи --------
+
+    void Recorder::run() {
+        ThreadPlacement::Scope placement(ThreadRole::Control, "recorder");
+        int64_t last_retention = 0;
+        std::vector<std::shared_ptr<RecordChannel>> chans;
+        for (;;) {
+            const bool running = m_run.load(std::memory_order_acquire);
+            {
+                std::lock_guard<std::mutex> lk(m_mx);
+                chans = m_channels;
+            }
+            bool work = false;
+            for (const auto& c : chans) work |= drain(*c);
+
+            // поток стрима больше не пишет и кольцо пусто — сегмент закрывается
+            for (const auto& c : chans) {
+                const bool closed = c->m_closed.load(std::memory_order_acquire);
+                if (running && (!closed || c->m_tail.load(std::memory_order_relaxed) != c->m_head.load(std::memory_order_acquire)))
+                    continue;
+                close_segment(*c);
+                if (closed) {
+                    std::lock_guard<std::mutex> lk(m_mx);
+                    m_channels.erase(std::remove(m_channels.begin(), m_channels.end(), c), m_channels.end());
+                }
+            }
+            chans.clear();
+            if (!running) break;
+
+            const int64_t now = steady_ms();
+            if (now - last_retention >= 1000) {
+                std::lock_guard<std::mutex> lk(m_mx);
+                enforce_retention();
+                last_retention = now;
+            }
+            if (!work) {
+                std::unique_lock<std::mutex> lk(m_wait_mx);
+                m_cv.wait_for(lk, 50ms, [this] { return !m_run.load(std::memory_order_acquire); });
+            }
+        }
+    }
+
+    bool Recorder::drain(RecordChannel& ch) {
+        uint64_t tail = ch.m_tail.load(std::memory_order_relaxed);
+        const uint64_t head = ch.m_head.load(std::memory_order_acquire);
+        if (tail == head) return false;
+        for (; tail != head; ++tail) {
+            write_block(ch, ch.m_blocks[tail % ch.m_blocks.size()]);
+            ch.m_tail.store(tail + 1, std::memory_order_release);
+        }
+        return true;
+    }
+
+    Recorder::SegFile* Recorder::current(RecordChannel& ch) {
+        auto it = m_stores.find(ch.m_key);
+        if (it == m_stores.end()) return nullptr;
+        for (auto s = it->second.segs.rbegin(); s != it->second.segs.rend(); ++s)
+            if (s->start_ms == ch.m_w.seg_start) return &*s;
+        return nullptr;
+    }
+
+    bool Recorder::open_segment(RecordChannel& ch, int64_t start_ms) {
+        RecordChannel::Writer& w = ch.m_w;
+        const fs::path dir = fs::path(m_opts.dir) / ch.m_key;
+        std::error_code ec;
+        fs::create_directories(dir, ec);
+        {
+            // одно имя на миллисекунду: следующий сегмент всегда позже предыдущего
+            std::lock_guard<std::mutex> lk(m_mx);
+            const Store& st = m_stores[ch.m_key];
+            if (!st.segs.empty() && start_ms <= st.segs.back().start_ms) start_ms = st.segs.back().start_ms + 1;
+        }
+        const fs::path path = dir / (std::to_string(start_ms) + ".ts");
+
+#if defined(MS_REC_DIRECT)
+        const int flags = O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC;
+        w.direct = false;
+        w.fd = -1;
+        if (m_opts.direct_io) {
+            w.fd = ::open(path.c_str(), flags | O_DIRECT, 0644);
+            w.direct = w.fd >= 0;
+        }
+        if (w.fd < 0) w.fd = ::open(path.c_str(), flags, 0644);   // ФС без O_DIRECT (tmpfs и т.п.)
+        const bool ok = w.fd >= 0;
+#else
+        w.direct = false;
+        w.file = std::fopen(path.string().c_str(), "wb");
+        const bool ok = w.file != nullptr;
+#endif
+        if (!ok) {
+            if (!w.failing) Logger::error("recorder: " + ch.name() + ": cannot create " + path.string() + ": " + std::strerror(errno));
+            w.failing = true;
+            return false;
+        }
+        fs::path idx = path;
+        idx.replace_extension(".idx");
+        w.idx = std::fopen(idx.string().c_str(), "w");   // без индекса выдача идёт сегментами целиком
+        w.open = true;
+        w.offset = 0;
+        w.seg_start = start_ms;
+        ch.m_shared.direct.store(w.direct, std::memory_order_relaxed);
+
+        SegFile s;
+        s.path = path.string();
+        s.start_ms = s.end_ms = start_ms;
+        s.open = true;
+        std::lock_guard<std::mutex> lk(m_mx);
+        m_stores[ch.m_key].segs.push_back(std::move(s));
+        return true;
+    }
+
+    void Recorder::close_segment(RecordChannel& ch) {
+        RecordChannel::Writer& w = ch.m_w;
+        if (!w.open) return;
+#if defined(MS_REC_DIRECT)
+        if (w.fd >= 0) ::close(w.fd);
+        w.fd = -1;
+#else
+        if (w.file) std::fclose(w.file);
+        w.file = nullptr;
+#endif
+        if (w.idx) std::fclose(w.idx);
+        w.idx = nullptr;
+        w.open = false;
+        std::lock_guard<std::mutex> lk(m_mx);
+        if (SegFile* s = current(ch)) s->open = false;
+    }
+
+    void Recorder::write_block(RecordChannel& ch, const RecordChannel::Block& b) {
+        RecordChannel::Writer& w = ch.m_w;
+        auto lose = [&] {
+            ch.m_shared.writer_dropped.fetch_add(b.len, std::memory_order_relaxed);
+        };
+        if (!w.open) {
+            if (steady_ms() < w.retry_ms) {
+                lose();
+                return;
+            }
+            if (!open_segment(ch, b.first_ms)) {
+                ch.m_shared.write_errors.fetch_add(1, std::memory_order_relaxed);
+                w.retry_ms = steady_ms() + 1000;
+                lose();
+                return;
+            }
+        }
+
+        const auto t0 = std::chrono::steady_clock::now();
+        bool ok = true;
+        int err = 0;
+#if defined(MS_REC_DIRECT)
+        // O_DIRECT требует длину и смещение, кратные блоку ФС: неполный блок переводит
+        // остаток сегмента на обычную запись, следующий сегмент снова открывается с O_DIRECT
+        auto set_buffered = [&] {
+            const int fl = ::fcntl(w.fd, F_GETFL);
+            if (fl >= 0) ::fcntl(w.fd, F_SETFL, fl & ~O_DIRECT);
+            w.direct = false;
+            ch.m_shared.direct.store(false, std::memory_order_relaxed);
+        };
+        if (w.direct && b.len % RecordChannel::kAlign) set_buffered();
+        size_t done = 0;
+        while (done < b.len) {
+            const ssize_t n = ::pwrite(w.fd, b.data + done, b.len - done, static_cast<off_t>(w.offset + done));
+            if (n > 0) { done += static_cast<size_t>(n); continue; }
+            if (n < 0 && errno == EINTR) continue;
+            if (n < 0 && errno == EINVAL && w.direct) { set_buffered(); continue; }
+            err = n < 0 ? errno : ENOSPC;
+            ok = false;
+            break;
+        }
+#else
+        if (std::fwrite(b.data, 1, b.len, w.file) != b.len || std::fflush(w.file) != 0) {
+            err = errno;
+            ok = false;
+        }
+#endif
+        const double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t0).count();
+
+        if (!ok) {
+            ch.m_shared.write_errors.fetch_add(1, std::memory_order_relaxed);
+            lose();
+            if (!w.failing) Logger::error("recorder: " + ch.name() + ": write failed: " + std::strerror(err));
+            w.failing = true;
+            w.retry_ms = steady_ms() + 1000;
+            close_segment(ch);
+            return;
+        }
+        if (w.failing) Logger::info("recorder: " + ch.name() + ": writing again");
+        w.failing = false;
+        w.retry_ms = 0;
+
+        if (w.idx) {
+            std::fprintf(w.idx, "%" PRIu64 " %" PRId64 " %" PRId64 "\n", w.offset, b.first_ms, b.last_ms);
+            std::fflush(w.idx);
+        }
+        {
+            std::lock_guard<std::mutex> lk(m_mx);
+            if (SegFile* s = current(ch)) {
+                s->index.push_back({ w.offset, b.first_ms });
+                s->bytes += b.len;
+                s->end_ms = b.last_ms;
+                m_stores[ch.m_key].bytes += b.len;
+                m_total_bytes += b.len;
+            }
+            m_avg_write_ms = m_avg_write_ms == 0.0 ? ms : m_avg_write_ms * 0.9 + ms * 0.1;
+            m_max_write_ms = std::max(m_max_write_ms, ms);
+        }
+        w.offset += b.len;
+        ch.m_shared.written.fetch_add(b.len, std::memory_order_relaxed);
+        if (w.offset >= m_segment_bytes) close_segment(ch);
+    }
+
+    // -------- хранение --------
+
+    void Recorder::drop_front(Store& st) {
+        SegFile& s = st.segs.front();
+        std::error_code ec;
+        fs::remove(s.path, ec);
+        fs::path idx = s.path;
+        idx.replace_extension(".idx");
+        fs::remove(idx, ec);
+        st.bytes -= std::min(st.bytes, s.bytes);
+        m_total_bytes -= std::min(m_total_bytes, s.bytes);
+        ++m_deleted;
+        st.segs.pop_front();
+    }
+
+    void Recorder::enforce_retention() {
+        const auto removable = [](const Store& st) { return !st.segs.empty() && !st.segs.front().open; };
+        const int64_t age_limit = m_opts.max_age_hours > 0
+            ? wall_ms() - int64_t(m_opts.max_age_hours) * 3600 * 1000 : std::numeric_limits<int64_t>::min();
+        const uint64_t stream_quota = m_opts.stream_quota_bytes ? m_opts.stream_quota_bytes : UINT64_MAX;
+        for (auto& [key, st] : m_stores)
+            while (removable(st) && (st.bytes > stream_quota || st.segs.front().end_ms < age_limit)) drop_front(st);
+
+        // общая квота: самый старый сегмент среди всех стримов
+        while (m_opts.total_quota_bytes && m_total_bytes > m_opts.total_quota_bytes) {
+            Store* victim = nullptr;
+            for (auto& [key, st] : m_stores)
+                if (removable(st) && (!victim || st.segs.front().start_ms < victim->segs.front().start_ms)) victim = &st;
+            if (!victim) break;
+            drop_front(*victim);
+        }
+    }
+
+    // -------- статистика и выдача --------
+
+    RecordStats Recorder::stats(const RecordChannel& ch) const {
+        RecordStats s;
+        s.active = true;
+        s.direct_io = ch.m_shared.direct.load(std::memory_order_relaxed);
+        s.bytes_in = ch.m_shared.in.load(std::memory_order_relaxed);
+        s.written = ch.m_shared.written.load(std::memory_order_relaxed);
+        s.dropped_bytes = ch.m_shared.dropped.load(std::memory_order_relaxed) + ch.m_shared.writer_dropped.load(std::memory_order_relaxed);
+        s.drop_events = ch.m_shared.drop_events.load(std::memory_order_relaxed);
+        s.write_errors = ch.m_shared.write_errors.load(std::memory_order_relaxed);
+        s.buffer_blocks = static_cast<uint32_t>(ch.m_blocks.size());
+        s.buffer_used = static_cast<uint32_t>(ch.m_head.load(std::memory_order_acquire) - ch.m_tail.load(std::memory_order_acquire));
+
+        std::lock_guard<std::mutex> lk(m_mx);
+        auto it = m_stores.find(ch.m_key);
+        if (it != m_stores.end() && !it->second.segs.empty()) {
+            s.segments = static_cast<uint32_t>(it->second.segs.size());
+            s.disk_bytes = it->second.bytes;
+            s.oldest_ms = it->second.segs.front().start_ms;
+            s.newest_ms = it->second.segs.back().end_ms;
+        }
+        return s;
+    }
+
+    RecorderTotals Recorder::totals() const {
+        RecorderTotals t;
+        t.enabled = enabled();
+        t.dir = m_opts.dir;
+        t.total_quota_bytes = m_opts.total_quota_bytes;
+        std::lock_guard<std::mutex> lk(m_mx);
+        for (const auto& [key, st] : m_stores) {
+            if (st.segs.empty()) continue;
+            ++t.streams;
+            t.segments += static_cast<uint32_t>(st.segs.size());
+        }
+        t.disk_bytes = m_total_bytes;
+        t.deleted_segments = m_deleted;
+        t.avg_write_ms = m_avg_write_ms;
+        t.max_write_ms = m_max_write_ms;
+        return t;
+    }
+
+    std::vector<RecordSegmentInfo> Recorder::segments(const std::string& stream) const {
+        std::vector<RecordSegmentInfo> out;
+        std::lock_guard<std::mutex> lk(m_mx);
+        auto it = m_stores.find(util::dir_key(stream));
+        if (it == m_stores.end()) return out;
+        out.reserve(it->second.segs.size());
+        for (const SegFile& s : it->second.segs) out.push_back({ s.start_ms, s.end_ms, s.bytes });
+        return out;
+    }
+
+    bool Recorder::find(const std::string& stream, int64_t from_ms, int64_t to_ms, std::vector<RecordPiece>& out) const {
+        out.clear();
+        std::lock_guard<std::mutex> lk(m_mx);
+        auto it = m_stores.find(util::dir_key(stream));
+        if (it == m_stores.end() || it->second.segs.empty()) return false;
+        for (const SegFile& s : it->second.segs) {
+            if (s.end_ms < from_ms || s.start_ms > to_ms || !s.bytes) continue;
+            // начало — блок, в котором лежит from_ms; конец — первый блок позже to_ms
+            uint64_t begin = 0, end = s.bytes;
+            for (const IndexEntry& e : s.index) {
+                if (e.first_ms <= from_ms) begin = e.offset;
+                else if (e.first_ms > to_ms) { end = e.offset; break; }
+            }
+            if (end > begin) out.push_back({ s.path, begin, end - begin });
+        }
+        return true;
+    }
+
+} // namespace multiscreen
@@ -0,0 +1,193 @@
+#include "RtpFec.h"
+#include "RtpReorder.h"
+#include "TsScanner.h"
+
+#include <algorithm>
+#include <cstring>
+
+#if defined(__x86_64__) || defined(_M_X64)
+#define MS_FEC_X86 1
+#include <immintrin.h>
+#endif
+
+#if defined(__GNUC__) || defined(__clang__)
+#define MS_TARGET_AVX2 __attribute__((target("avx2")))
+#else
+#define MS_TARGET_AVX2
+#endif
+
+namespace multiscreen {
+    namespace {
+        constexpr size_t kFecHeader = 16;       // RFC 2733 + расширение SMPTE 2022-1
+
+        int32_t seq_diff(uint16_t a, uint16_t b) noexcept {
+            return static_cast<int16_t>(static_cast<uint16_t>(a - b));
+        }
+
+        void xor_scalar(uint8_t* dst, const uint8_t* src, size_t n) noexcept {
+            size_t i = 0;
+            for (; i + 8 <= n; i += 8) {
+                uint64_t a, b;
+                std::memcpy(&a, dst + i, 8);
+                std::memcpy(&b, src + i, 8);
+                a ^= b;
+                std::memcpy(dst + i, &a, 8);
+            }
+            for (; i < n; ++i) dst[i] ^= src[i];
+        }
+
+#if defined(MS_FEC_X86)
+        void xor_sse2(uint8_t* dst, const uint8_t* src, size_t n) noexcept {
+            size_t i = 0;
+            for (; i + 16 <= n; i += 16) {
+                const __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(dst + i));
+                const __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i));
+                _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i), _mm_xor_si128(a, b));
+            }
+            xor_scalar(dst + i, src + i, n - i);
+        }
+
+        // 1316 байт = 41 * 32 + 4: хвост добивает скалярный цикл
+        MS_TARGET_AVX2 void xor_avx2(uint8_t* dst, const uint8_t* src, size_t n) noexcept {
+            size_t i = 0;
+            for (; i + 32 <= n; i += 32) {
+                const __m256i a = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(dst + i));
+                const __m256i b = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + i));
+                _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + i), _mm256_xor_si256(a, b));
+            }
+            xor_scalar(dst + i, src + i, n - i);
+        }
+#endif
+    } // anonymous
+
+    // набор инструкций — тот же, что выбран для TsScanner (ingest.simd)
+    RtpFec::RtpFec(RtpReorder& owner)
+        : m_owner(owner), m_xor(&xor_scalar), m_slab(new uint8_t[kEntries * kPayload]) {
+#if defined(MS_FEC_X86)
+        switch (TsScanner::isa()) {
+        case TsScanner::Isa::Avx2: m_xor = &xor_avx2; break;
+        case TsScanner::Isa::Sse2: m_xor = &xor_sse2; break;
+        default: break;
+        }
+#endif
+    }
+
+    void RtpFec::reset() noexcept {
+        m_entries.fill(Entry{});
+        m_next = 0;
+        m_dirty = false;
+    }
+
+    bool RtpFec::covers(const Entry& e, uint16_t seq) const noexcept {
+        const uint16_t d = static_cast<uint16_t>(seq - e.base);
+        return d % e.offset == 0 && d / e.offset < e.na;
+    }
+
+    void RtpFec::media(uint16_t seq) noexcept {
+        for (Entry& e : m_entries) {
+            if (!e.pending) continue;
+            // свой номер или прошли мимо единственного недостающего — он стал дырой
+            if (covers(e, seq) || (e.waiting && seq_diff(seq, e.wait_seq) > 0)) {
+                e.check = true;
+                m_dirty = true;
+            }
+        }
+    }
+
+    bool RtpFec::fec(const uint8_t* data, uint32_t len, int64_t) noexcept {
+        if (len < 12 + kFecHeader || (data[0] >> 6) != 2) return false;
+        uint32_t off = 12 + 4u * (data[0] & 0x0F);
+        if ((data[0] & 0x10) && off + 4 <= len) off += 4 + 4u * ((uint32_t(data[off + 2]) << 8) | data[off + 3]);
+        if (off + kFecHeader >= len) return false;
+        const uint8_t* h = data + off;
+        const uint8_t type = (h[12] >> 3) & 0x07;
+        const uint8_t offset = h[13];
+        const uint8_t na = h[14];
+        // только XOR; 2022-1: L, D <= 20, L * D <= 100
+        if (type != 0 || !offset || !na || na > 32) return false;
+        const uint32_t plen = len - off - static_cast<uint32_t>(kFecHeader);
+        if (plen > kPayload) return false;
+
+        const uint16_t base = static_cast<uint16_t>((h[0] << 8) | h[1]);
+        ++m_packets;
+        if (offset > 1) {
+            m_cols = offset;
+            m_rows = na;
+        }
+        else if (!m_cols) m_cols = na;   // только строки: известна лишь длина строки
+
+        for (const Entry& e : m_entries)
+            if (e.pending && e.base == base && e.offset == offset && e.na == na) return true;   // повтор
+        const size_t i = m_next;
+        m_next = (m_next + 1) % kEntries;
+        Entry& e = m_entries[i];
+        e = Entry{};
+        e.base = base;
+        e.offset = offset;
+        e.na = na;
+        e.len_rec = static_cast<uint16_t>((h[2] << 8) | h[3]);
+        e.len = plen;
+        e.pending = true;
+        e.check = true;
+        std::memcpy(entry_data(i), h + kFecHeader, plen);
+        m_dirty = true;
+        return true;
+    }
+
+    void RtpFec::resolve(int64_t now_us) noexcept {
+        // восстановленный номер сам помечает группы другого направления: несколько проходов
+        for (int pass = 0; m_dirty && pass < 8; ++pass) {
+            m_dirty = false;
+            for (size_t i = 0; i < kEntries; ++i) {
+                Entry& e = m_entries[i];
+                if (!e.pending || !e.check) continue;
+                e.check = false;
+                try_recover(e, i, now_us);
+            }
+        }
+    }
+
+    bool RtpFec::try_recover(Entry& e, size_t index, int64_t now_us) noexcept {
+        int missing = 0;
+        uint16_t miss = 0;
+        uint32_t len = 0;
+        for (uint32_t k = 0; k < e.na; ++k) {
+            const uint16_t seq = static_cast<uint16_t>(e.base + k * e.offset);
+            if (m_owner.fec_payload(seq, len)) continue;
+            miss = seq;
+            if (++missing > 1) break;
+        }
+        e.waiting = false;
+        if (missing == 0) {
+            e.pending = false;
+            return false;
+        }
+        if (missing > 1) return false;   // ждём остальных или восстановления другим направлением
+        if (!m_owner.fec_wanted(miss)) {
+            // позади окна — группа больше не нужна; впереди — ещё в пути
+            if (seq_diff(miss, m_owner.m_expected) < 0 || m_owner.fec_payload(miss, len)) e.pending = false;
+            else {
+                e.waiting = true;
+                e.wait_seq = miss;
+            }
+            return false;
+        }
+
+        uint8_t* out = m_work.data();
+        std::memcpy(out, entry_data(index), e.len);
+        uint32_t rec_len = e.len_rec;
+        for (uint32_t k = 0; k < e.na; ++k) {
+            const uint16_t seq = static_cast<uint16_t>(e.base + k * e.offset);
+            if (seq == miss) continue;
+            const uint8_t* p = m_owner.fec_payload(seq, len);
+            m_xor(out, p, std::min(len, e.len));
+            rec_len ^= len;
+        }
+        e.pending = false;
+        if (!rec_len || rec_len > e.len) return false;   // длины не сошлись: FEC не от этого потока
+        ++m_recovered;
+        m_owner.fec_insert(miss, out, rec_len, now_us);
+        return true;
+    }
+
+} // namespace multiscreen
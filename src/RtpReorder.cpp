@@ -0,0 +1,458 @@
+#include "RtpReorder.h"
+#include "RtpFec.h"
+
+#include <algorithm>
+#include <bit>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+
+namespace multiscreen {
+    namespace {
+        std::atomic<int> g_depth{ 32 };
+        std::atomic<int> g_max_delay_ms{ 50 };
+        std::atomic<int> g_merge_slots{ 1024 };
+        std::atomic<int> g_max_skew_ms{ 50 };
+        std::atomic<bool> g_fec_enable{ true };
+        std::atomic<int> g_fec_slots{ 512 };
+        std::atomic<int> g_fec_delay_ms{ 200 };
+
+        constexpr int32_t kMaxDropout = 3000;   // RFC 3550, прил. A.1
+        constexpr int32_t kMaxMisorder = 100;
+        constexpr double  kClockPerUs = 0.09;   // MP2T (PT 33): 90 кГц
+        constexpr int64_t kSkewWindowUs = 1000000;
+        constexpr int64_t kLegUpUs = 1000000;
+
+        int32_t seq_diff(uint16_t a, uint16_t b) noexcept {
+            return static_cast<int16_t>(static_cast<uint16_t>(a - b));
+        }
+    } // anonymous
+
+    void RtpReorder::set_defaults(int depth, int max_delay_ms) noexcept {
+        g_depth.store(std::clamp(depth, 1, static_cast<int>(kSlots)), std::memory_order_relaxed);
+        g_max_delay_ms.store(std::clamp(max_delay_ms, 0, 10000), std::memory_order_relaxed);
+    }
+
+    void RtpReorder::set_merge_defaults(int slots, int max_skew_ms) noexcept {
+        // степень двойки: индекс ячейки seq % N не должен рваться на переполнении 16-битного номера
+        const auto n = std::bit_ceil(static_cast<unsigned>(std::clamp(slots, static_cast<int>(kSlots), static_cast<int>(kMaxMergeSlots))));
+        g_merge_slots.store(static_cast<int>(n), std::memory_order_relaxed);
+        g_max_skew_ms.store(std::clamp(max_skew_ms, 0, 10000), std::memory_order_relaxed);
+    }
+
+    void RtpReorder::set_fec_defaults(bool enable, int slots, int max_delay_ms) noexcept {
+        const auto n = std::bit_ceil(static_cast<unsigned>(std::clamp(slots, static_cast<int>(kSlots), static_cast<int>(kMaxMergeSlots))));
+        g_fec_enable.store(enable, std::memory_order_relaxed);
+        g_fec_slots.store(static_cast<int>(n), std::memory_order_relaxed);
+        g_fec_delay_ms.store(std::clamp(max_delay_ms, 0, 10000), std::memory_order_relaxed);
+    }
+
+    bool RtpReorder::fec_enabled() noexcept {
+        return g_fec_enable.load(std::memory_order_relaxed);
+    }
+
+    uint64_t RtpReorder::Leg::lost() const noexcept {
+        if (!started) return lost_before;
+        const int64_t expected = int64_t(cycles) + max_seq - base + 1;
+        return lost_before + static_cast<uint64_t>(std::max<int64_t>(0, expected - int64_t(received)));
+    }
+
+    // окно FEC должно вместить матрицу L x D целиком: столбцовый FEC приходит после её конца
+    RtpReorder::RtpReorder(bool merge, bool fec)
+        : m_merge(merge),
+          m_capacity(std::max(merge ? static_cast<size_t>(g_merge_slots.load(std::memory_order_relaxed)) : kSlots,
+                              fec ? static_cast<size_t>(g_fec_slots.load(std::memory_order_relaxed)) : kSlots)),
+          m_slab(new uint8_t[m_capacity * kSlotSize]),
+          m_slots(new Slot[m_capacity]) {
+        m_local.merge = merge;
+        if (fec) m_fec = std::make_unique<RtpFec>(*this);
+        reset();
+    }
+
+    RtpReorder::~RtpReorder() = default;
+
+    void RtpReorder::reset() noexcept {
+        if (m_merge) {
+            m_depth = m_capacity;
+            m_max_delay_us = int64_t(g_max_skew_ms.load(std::memory_order_relaxed)) * 1000;
+        }
+        else {
+            m_depth = static_cast<size_t>(g_depth.load(std::memory_order_relaxed));
+            m_max_delay_us = int64_t(g_max_delay_ms.load(std::memory_order_relaxed)) * 1000;
+        }
+        if (m_fec) {
+            m_depth = m_capacity;
+            m_fec_delay_us = int64_t(g_fec_delay_ms.load(std::memory_order_relaxed)) * 1000;
+            m_fec->reset();
+        }
+        std::fill(m_slots.get(), m_slots.get() + m_capacity, Slot{});
+        m_started = false;
+        m_held = 0;
+        for (Leg& l : m_legs) {
+            l.lost_before = l.lost();
+            l.started = false;
+            l.bad_seq = -1;
+            l.jit_valid = false;
+            l.jitter = 0.0;
+        }
+        m_has_direct = false;
+        m_skipping = false;
+        m_flush = false;
+        m_skew_valid = false;
+        m_skew_us = m_skew_peak_us = m_skew_max_us = 0.0;
+        m_skew_win_us = 0;
+        publish();
+    }
+
+    // RFC 3550, прил. A.1 без испытательного срока: ветвь считается начатой с первого пакета
+    void RtpReorder::leg_sequence(Leg& l, uint16_t seq) noexcept {
+        if (!l.started) {
+            l.started = true;
+            l.max_seq = seq;
+            l.cycles = 0;
+            l.base = seq;
+            l.received = 0;
+        }
+        const uint16_t udelta = static_cast<uint16_t>(seq - l.max_seq);
+        if (udelta < kMaxDropout) {
+            if (seq < l.max_seq) l.cycles += 65536;
+            l.max_seq = seq;
+        }
+        ++l.received;
+    }
+
+    bool RtpReorder::push(const uint8_t* data, uint32_t len, int64_t arrival_us, int leg) noexcept {
+        // заголовок: V=2, CSRC, расширение, выравнивание (RFC 3550, 5.1)
+        if (len < 12 || (data[0] >> 6) != 2) {
+            ++m_local.invalid;
+            publish();
+            return true;
+        }
+        uint32_t off = 12 + 4u * (data[0] & 0x0F);
+        uint32_t end = len;
+        if ((data[0] & 0x10) && off + 4 <= len) off += 4 + 4u * ((uint32_t(data[off + 2]) << 8) | data[off + 3]);
+        else if (data[0] & 0x10) off = len + 1;
+        if ((data[0] & 0x20) && off < end) {
+            const uint32_t pad = data[len - 1];
+            end = pad && pad <= end - off ? end - pad : 0;
+        }
+        if (off > end) {
+            ++m_local.invalid;
+            publish();
+            return true;
+        }
+        const uint16_t seq = static_cast<uint16_t>((data[2] << 8) | data[3]);
+        const uint32_t ts = (uint32_t(data[4]) << 24) | (uint32_t(data[5]) << 16) | (uint32_t(data[6]) << 8) | data[7];
+        const uint32_t ssrc = (uint32_t(data[8]) << 24) | (uint32_t(data[9]) << 16) | (uint32_t(data[10]) << 8) | data[11];
+        leg = std::clamp(leg, 0, kLegs - 1);
+        Leg& l = m_legs[leg];
+        const uint8_t bit = static_cast<uint8_t>(1u << leg);
+
+        if (l.started && ssrc != l.ssrc) {
+            // другой источник: отпустить задержанное старого и начать заново с этой датаграммы
+            ++m_local.resyncs;
+            l.lost_before = l.lost();
+            l.started = false;
+            l.ssrc = ssrc;
+            m_flush = true;
+            return false;
+        }
+        if (!m_started) {
+            m_started = true;
+            m_expected = seq;
+            m_local.ssrc = ssrc;
+        }
+
+        // ветвь, отстающая на всё окно слияния, — ещё не скачок номера
+        const int32_t misorder = std::max<int32_t>(kMaxMisorder, static_cast<int32_t>(m_depth));
+        const int32_t delta = seq_diff(seq, m_expected);
+        if (delta > kMaxDropout || delta < -misorder) {
+            // скачок номера: перезапуск отправителя подтверждает следующий по порядку пакет
+            if (l.bad_seq == seq) {
+                ++m_local.resyncs;
+                for (Leg& x : m_legs) {
+                    x.lost_before = x.lost();
+                    x.started = false;
+                    x.bad_seq = -1;
+                }
+                m_flush = true;
+                return false;
+            }
+            l.bad_seq = (seq + 1) & 0xFFFF;
+            ++m_local.invalid;
+            publish();
+            return true;
+        }
+        l.bad_seq = -1;
+        if (delta >= static_cast<int32_t>(m_depth)) {
+            // не влезает в окно: отпустить всё до seq - depth, дыры — потери; датаграмму — повторно
+            m_skipping = true;
+            m_skip_to = static_cast<uint16_t>(seq - m_depth + 1);
+            return false;
+        }
+
+        ++m_local.packets;
+        ++l.packets;
+        l.ssrc = ssrc;
+        l.last_us = arrival_us;
+        m_local.payload_type = data[1] & 0x7F;
+        // не по порядку — внутри своей ветви; отставание запасной ветви — не переупорядочивание
+        const bool out_of_order = l.started && seq_diff(seq, l.max_seq) < 0;
+        leg_sequence(l, seq);
+
+        // jitter ветви по порядку прихода, включая дубли (RFC 3550, прил. A.8)
+        const double transit = double(arrival_us) * kClockPerUs - double(ts);
+        if (l.jit_valid) {
+            double d = transit - l.jit_transit;
+            // переполнение 32-битного timestamp
+            if (d > 2147483648.0) d -= 4294967296.0;
+            else if (d < -2147483648.0) d += 4294967296.0;
+            l.jitter += (std::fabs(d) - l.jitter) / 16.0;
+        }
+        l.jit_transit = transit;
+        l.jit_valid = true;
+
+        Slot& s = slot(seq);
+        if (delta < 0) {
+            if (-delta > static_cast<int32_t>(m_capacity) || s.seq != seq) ++m_local.late;
+            else if (s.skipped) {
+                ++m_local.late;
+                s.legs |= bit;
+            }
+            else if (s.legs & bit) ++m_local.duplicates;
+            else if (!(s.legs & kLegMask)) s.legs |= bit;   // уже восстановлен FEC
+            else {
+                // копия уже отданного номера из другой ветви
+                skew_sample(leg, s.arrival_us, arrival_us);
+                if (leg == 0 && m_local.recovered) --m_local.recovered;
+                s.legs |= bit;
+            }
+            publish();
+            return true;
+        }
+
+        const uint32_t plen = end - off;
+        if (s.used && s.seq == seq) {
+            if (s.legs & bit) ++m_local.duplicates;
+            else if (s.legs & kLegMask) skew_sample(leg, s.arrival_us, arrival_us);
+            s.legs |= bit;
+            publish();
+            return true;
+        }
+        // пока жив FEC, каждый пакет нужен как история XOR — прямой выдачи нет
+        const bool keep = m_fec && m_fec->active();
+        if (delta == 0 && !keep) {
+            m_direct = { data + off, plen, arrival_us };
+            m_has_direct = true;
+            s = Slot{ 0, arrival_us, seq, bit, false, false, false };
+        }
+        else {
+            std::memcpy(slot_data(seq), data + off, std::min<uint32_t>(plen, kSlotSize));
+            s = Slot{ std::min<uint32_t>(plen, kSlotSize), arrival_us, seq, bit, true, true, false };
+            ++m_held;
+        }
+        if (out_of_order) ++m_local.reordered;
+        if (m_fec) {
+            m_fec->media(seq);
+            m_fec->resolve(arrival_us);
+        }
+        publish();
+        return true;
+    }
+
+    void RtpReorder::push_fec(const uint8_t* data, uint32_t len, int64_t arrival_us) noexcept {
+        if (!m_fec) return;
+        if (m_fec->fec(data, len, arrival_us)) m_fec->resolve(arrival_us);
+        publish();
+    }
+
+    const uint8_t* RtpReorder::fec_payload(uint16_t seq, uint32_t& len) noexcept {
+        const Slot& s = slot(seq);
+        if (!s.kept || s.seq != seq) return nullptr;
+        len = s.len;
+        return slot_data(seq);
+    }
+
+    // Дыра, которую ещё можно отдать: в окне, ячейка пуста, после номера что-то уже пришло
+    bool RtpReorder::fec_wanted(uint16_t seq) noexcept {
+        if (!m_started || !m_legs[0].started) return false;
+        const int32_t d = seq_diff(seq, m_expected);
+        if (d < 0 || d >= static_cast<int32_t>(m_depth)) return false;
+        if (d == 0 && m_has_direct) return false;
+        const Slot& s = slot(seq);
+        if (s.seq == seq && (s.used || s.kept)) return false;
+        return seq_diff(seq, m_legs[0].max_seq) < 0;
+    }
+
+    void RtpReorder::fec_insert(uint16_t seq, const uint8_t* data, uint32_t len, int64_t arrival_us) noexcept {
+        len = std::min<uint32_t>(len, kSlotSize);
+        std::memcpy(slot_data(seq), data, len);
+        slot(seq) = Slot{ len, arrival_us, seq, kFecLeg, true, true, false };
+        ++m_held;
+        m_fec->media(seq);
+    }
+
+    // Расхождение ветвей по второй копии номера: знак — запасная (1) минус основная (0)
+    void RtpReorder::skew_sample(int leg, int64_t first_us, int64_t arrival_us) noexcept {
+        const double d = double(arrival_us - first_us) * (leg == 1 ? 1.0 : -1.0);
+        m_skew_us = m_skew_valid ? m_skew_us + (d - m_skew_us) / 16.0 : d;
+        m_skew_valid = true;
+        m_skew_peak_us = std::max(m_skew_peak_us, std::fabs(d));
+        if (!m_skew_win_us) m_skew_win_us = arrival_us;
+        if (arrival_us - m_skew_win_us >= kSkewWindowUs) {
+            m_skew_max_us = m_skew_peak_us;
+            m_skew_peak_us = 0.0;
+            m_skew_win_us = arrival_us;
+        }
+    }
+
+    void RtpReorder::expire(int64_t now_us) noexcept {
+        if (!m_held || m_skipping || m_flush) return;
+        const bool fec = m_fec && m_fec->active();
+        const int64_t max_delay = fec ? std::max(m_max_delay_us, m_fec_delay_us) : m_max_delay_us;
+        int64_t oldest = now_us;
+        uint16_t first = m_expected;
+        bool found = false;
+        for (size_t i = 1; i < m_depth; ++i) {
+            const uint16_t seq = static_cast<uint16_t>(m_expected + i);
+            const Slot& s = slot(seq);
+            if (!s.used || s.seq != seq) continue;
+            if (!found) first = seq;
+            found = true;
+            oldest = std::min(oldest, s.arrival_us);
+            if (!m_merge && !fec) continue;
+            // окно слияния/FEC велико: первый задержанный почти всегда и самый старый
+            break;
+        }
+        if (found && now_us - oldest >= max_delay) {
+            m_skipping = true;
+            m_skip_to = first;
+        }
+    }
+
+    const RtpPayload* RtpReorder::peek() noexcept {
+        for (;;) {
+            if (m_has_direct) return &m_direct;
+            const Slot& s = slot(m_expected);
+            if (s.used && s.seq == m_expected) {
+                m_view = { slot_data(m_expected), s.len, s.arrival_us };
+                return &m_view;
+            }
+            if (m_flush) {
+                if (m_held) {
+                    skip_one();
+                    continue;
+                }
+                m_flush = false;
+                m_skipping = false;
+                m_started = false;
+                publish();
+                return nullptr;
+            }
+            if (m_skipping) {
+                if (seq_diff(m_skip_to, m_expected) > 0) {
+                    ++m_local.lost;
+                    if (m_fec && m_fec->active()) ++m_local.fec_unrecoverable;
+                    skip_one();
+                    continue;
+                }
+                m_skipping = false;
+                publish();
+            }
+            return nullptr;
+        }
+    }
+
+    void RtpReorder::skip_one() noexcept {
+        Slot& s = slot(m_expected);
+        s.seq = m_expected;
+        s.legs = 0;
+        s.used = false;
+        s.kept = false;
+        s.skipped = true;
+        ++m_expected;
+    }
+
+    void RtpReorder::pop() noexcept {
+        Slot& s = slot(m_expected);
+        if (m_has_direct) m_has_direct = false;
+        else {
+            s.used = false;
+            --m_held;
+        }
+        // отдано из запасной: основная, если копия всё же придёт, вычтет обратно
+        if (m_merge && !(s.legs & 1u))
+            m_shared.recovered.store(++m_local.recovered, std::memory_order_relaxed);
+        ++m_expected;
+    }
+
+    void RtpReorder::publish() noexcept {
+        m_shared.packets.store(m_local.packets, std::memory_order_relaxed);
+        m_shared.lost.store(m_local.lost, std::memory_order_relaxed);
+        m_shared.reordered.store(m_local.reordered, std::memory_order_relaxed);
+        m_shared.duplicates.store(m_local.duplicates, std::memory_order_relaxed);
+        m_shared.late.store(m_local.late, std::memory_order_relaxed);
+        m_shared.invalid.store(m_local.invalid, std::memory_order_relaxed);
+        m_shared.recovered.store(m_local.recovered, std::memory_order_relaxed);
+        m_shared.resyncs.store(m_local.resyncs, std::memory_order_relaxed);
+        m_shared.ssrc.store(m_local.ssrc, std::memory_order_relaxed);
+        m_shared.held.store(m_held, std::memory_order_relaxed);
+        m_shared.payload_type.store(m_local.payload_type, std::memory_order_relaxed);
+        m_shared.skew_ms.store(m_skew_us / 1000.0, std::memory_order_relaxed);
+        m_shared.skew_max_ms.store(std::max(m_skew_max_us, m_skew_peak_us) / 1000.0, std::memory_order_relaxed);
+        if (m_fec) {
+            m_shared.fec.store(m_fec->active(), std::memory_order_relaxed);
+            m_shared.fec_packets.store(m_fec->packets(), std::memory_order_relaxed);
+            m_shared.fec_recovered.store(m_fec->recovered(), std::memory_order_relaxed);
+            m_shared.fec_unrecoverable.store(m_local.fec_unrecoverable, std::memory_order_relaxed);
+            m_shared.fec_cols.store(m_fec->cols(), std::memory_order_relaxed);
+            m_shared.fec_rows.store(m_fec->rows(), std::memory_order_relaxed);
+        }
+        for (int i = 0; i < kLegs; ++i) {
+            const Leg& l = m_legs[i];
+            auto& sh = m_shared.legs[i];
+            sh.packets.store(l.packets, std::memory_order_relaxed);
+            sh.lost.store(l.lost(), std::memory_order_relaxed);
+            sh.jitter_ms.store(l.jitter / kClockPerUs / 1000.0, std::memory_order_relaxed);
+            sh.last_us.store(l.last_us, std::memory_order_relaxed);
+        }
+    }
+
+    RtpStats RtpReorder::stats() const noexcept {
+        using namespace std::chrono;
+        const int64_t now = duration_cast<microseconds>(steady_clock::now().time_since_epoch()).count();
+        RtpStats s;
+        s.packets = m_shared.packets.load(std::memory_order_relaxed);
+        s.lost = m_shared.lost.load(std::memory_order_relaxed);
+        s.reordered = m_shared.reordered.load(std::memory_order_relaxed);
+        s.duplicates = m_shared.duplicates.load(std::memory_order_relaxed);
+        s.late = m_shared.late.load(std::memory_order_relaxed);
+        s.invalid = m_shared.invalid.load(std::memory_order_relaxed);
+        s.resyncs = m_shared.resyncs.load(std::memory_order_relaxed);
+        s.ssrc = m_shared.ssrc.load(std::memory_order_relaxed);
+        s.held = m_shared.held.load(std::memory_order_relaxed);
+        s.payload_type = m_shared.payload_type.load(std::memory_order_relaxed);
+        s.merge = m_merge;
+        for (int i = 0; i < kLegs; ++i) {
+            const auto& sh = m_shared.legs[i];
+            RtpLegStats& l = s.legs[i];
+            l.packets = sh.packets.load(std::memory_order_relaxed);
+            l.lost = sh.lost.load(std::memory_order_relaxed);
+            l.jitter_ms = sh.jitter_ms.load(std::memory_order_relaxed);
+            const int64_t last = sh.last_us.load(std::memory_order_relaxed);
+            l.up = last && now - last < kLegUpUs;
+        }
+        s.jitter_ms = s.legs[0].jitter_ms;
+        s.recovered = m_shared.recovered.load(std::memory_order_relaxed);
+        s.skew_ms = m_shared.skew_ms.load(std::memory_order_relaxed);
+        s.skew_max_ms = m_shared.skew_max_ms.load(std::memory_order_relaxed);
+        s.fec = m_shared.fec.load(std::memory_order_relaxed);
+        s.fec_packets = m_shared.fec_packets.load(std::memory_order_relaxed);
+        s.fec_recovered = m_shared.fec_recovered.load(std::memory_order_relaxed);
+        s.fec_unrecoverable = m_shared.fec_unrecoverable.load(std::memory_order_relaxed);
+        s.fec_cols = m_shared.fec_cols.load(std::memory_order_relaxed);
+        s.fec_rows = m_shared.fec_rows.load(std::memory_order_relaxed);
+        return s;
+    }
+
+} // namespace multiscreen
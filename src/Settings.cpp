@@ -13,17 +13,79 @@ namespace multiscreen {
         return v;
     }
 
+    // Исходный документ + эффективные значения поверх: UI видит то же, что и watchdog
+    static std::string render_json(const Settings::Snapshot& s, json j) {
+        auto obj = [](json& parent, const char* key) -> json& {
+            if (!parent.contains(key) || !parent[key].is_object()) parent[key] = json::object();
+            return parent[key];
+            };
+        if (!j.is_object()) j = json::object();
+
+        const auto& th = s.thresholds;
+        auto& jt = obj(j, "thresholds");
+        auto& jf = obj(jt, "fps");
+        jf["warn_ratio"] = th.fps.warn_ratio;
+        jf["crit_ratio"] = th.fps.crit_ratio;
+        auto& jb = obj(jt, "bitrate");
+        jb["warn_kbps"] = th.bitrate.warn_kbps;
+        jb["crit_kbps"] = th.bitrate.crit_kbps;
+        auto& js = obj(jt, "stall");
+        js["warn_ms"] = th.stall.warn_ms;
+        js["crit_ms"] = th.stall.crit_ms;
+        auto& jj = obj(jt, "pcr_jitter");
+        jj["warn_ms"] = th.pcr_jitter.warn_ms;
+        jj["crit_ms"] = th.pcr_jitter.crit_ms;
+        auto& jm = obj(jt, "mdi");
+        jm["df_warn_ms"] = th.mdi.df_warn_ms;
+        jm["df_crit_ms"] = th.mdi.df_crit_ms;
+        jm["mlr_warn"] = th.mdi.mlr_warn;
+        jm["mlr_crit"] = th.mdi.mlr_crit;
+
+        const auto& wh = s.webhook;
+        auto& jw = obj(obj(j, "alerts"), "webhook");
+        jw["enabled"] = wh.enabled;
+        jw["url"] = wh.url;
+        jw["timeout_ms"] = wh.timeout_ms;
+        jw["batch_window_ms"] = wh.batch_window_ms;
+        jw["max_batch"] = wh.max_batch;
+        jw["queue_capacity"] = wh.queue_capacity;
+
+        const auto& ob = s.outbox;
+        auto& jo = obj(obj(j, "alerts"), "outbox");
+        jo["enabled"] = ob.enabled;
+        jo["dir"] = ob.dir;
+        jo["segment_kb"] = ob.segment_kb;
+        jo["max_mb"] = ob.max_mb;
+        jo["backoff_initial_ms"] = ob.backoff_initial_ms;
+        jo["backoff_max_ms"] = ob.backoff_max_ms;
+
+        const auto& as = s.alert_state;
+        auto& jas = obj(obj(j, "alerts"), "state");
+        jas["enter_dwell_ms"] = as.enter_dwell_ms;
+        jas["exit_dwell_ms"] = as.exit_dwell_ms;
+        jas["hysteresis_pct"] = as.hysteresis_pct;
+        jas["flap_window_ms"] = as.flap_window_ms;
+        jas["flap_transitions"] = as.flap_transitions;
+        jas["flap_hold_ms"] = as.flap_hold_ms;
+        jas["table_size"] = as.table_size;
+        return j.dump();
+    }
+
+    Settings::Settings() {
+        auto s = std::make_shared<Snapshot>();
+        s->json_text = render_json(*s, json::object());
+        m_snap.store(std::move(s), std::memory_order_release);
+    }
+
     Settings& Settings::instance() {
         static Settings s;
         return s;
     }
 
     bool Settings::load(const std::string& path) {
-        m_source_path = path;
-
         std::ifstream in(path);
         if (!in.is_open()) {
-            return false; // оставляем дефолты
+            return false; // оставляем текущий снимок
         }
 
         json j;
@@ -31,91 +93,150 @@ namespace multiscreen {
             in >> j;
         }
         catch (...) {
-            return false; // оставляем дефолты
+            return false; // оставляем текущий снимок
         }
+        if (!j.is_object()) return false;
+
+        // Собираем новый снимок целиком и только потом публикуем
+        auto s = std::make_shared<Snapshot>();
+        s->source_path = path;
+        s->version = snapshot()->version + 1;
+
+        auto& th = s->thresholds;
+        auto& wh = s->webhook;
 
         // --- UI schema ---
         if (j.contains("thresholds") && j["thresholds"].is_object()) {
-            auto& jt = j["thresholds"];
+            const auto& jt = j["thresholds"];
 
             if (jt.contains("fps") && jt["fps"].is_object()) {
-                auto& jf = jt["fps"];
-                if (jf.contains("warn_ratio")) m_thresholds.fps.warn_ratio = std::clamp(jf["warn_ratio"].get<double>(), 0.0, 10.0);
-                if (jf.contains("crit_ratio")) m_thresholds.fps.crit_ratio = std::clamp(jf["crit_ratio"].get<double>(), 0.0, 10.0);
+                const auto& jf = jt["fps"];
+                if (jf.contains("warn_ratio") && jf["warn_ratio"].is_number())
+                    th.fps.warn_ratio = std::clamp(jf["warn_ratio"].get<double>(), 0.0, 1.0);
+                if (jf.contains("crit_ratio") && jf["crit_ratio"].is_number())
+                    th.fps.crit_ratio = std::clamp(jf["crit_ratio"].get<double>(), 0.0, 1.0);
             }
 
             if (jt.contains("bitrate") && jt["bitrate"].is_object()) {
-                auto& jb = jt["bitrate"];
-                if (jb.contains("warn_kbps")) m_thresholds.bitrate.warn_kbps = std::max(0, jb["warn_kbps"].get<int>());
-                if (jb.contains("crit_kbps")) m_thresholds.bitrate.crit_kbps = std::max(0, jb["crit_kbps"].get<int>());
+                const auto& jb = jt["bitrate"];
+                if (jb.contains("warn_kbps") && jb["warn_kbps"].is_number_integer())
+                    th.bitrate.warn_kbps = std::max(0, jb["warn_kbps"].get<int>());
+                if (jb.contains("crit_kbps") && jb["crit_kbps"].is_number_integer())
+                    th.bitrate.crit_kbps = std::max(0, jb["crit_kbps"].get<int>());
             }
 
             if (jt.contains("stall") && jt["stall"].is_object()) {
-                auto& js = jt["stall"];
-                if (js.contains("warn_ms")) m_thresholds.stall.warn_ms = std::max(0, js["warn_ms"].get<int>());
-                if (js.contains("crit_ms")) m_thresholds.stall.crit_ms = std::max(0, js["crit_ms"].get<int>());
+                const auto& js = jt["stall"];
+                if (js.contains("warn_ms") && js["warn_ms"].is_number_integer())
+                    th.stall.warn_ms = std::max(0, js["warn_ms"].get<int>());
+                if (js.contains("crit_ms") && js["crit_ms"].is_number_integer())
+                    th.stall.crit_ms = std::max(0, js["crit_ms"].get<int>());
             }
+
+            auto non_negative = [](const json& o, const char* key, double& v) {
+                if (o.contains(key) && o[key].is_number()) v = std::max(0.0, o[key].get<double>());
+                };
+            if (jt.contains("pcr_jitter") && jt["pcr_jitter"].is_object()) {
+                const auto& jj = jt["pcr_jitter"];
+                non_negative(jj, "warn_ms", th.pcr_jitter.warn_ms);
+                non_negative(jj, "crit_ms", th.pcr_jitter.crit_ms);
+            }
+
+            if (jt.contains("mdi") && jt["mdi"].is_object()) {
+                const auto& jm = jt["mdi"];
+                non_negative(jm, "df_warn_ms", th.mdi.df_warn_ms);
+                non_negative(jm, "df_crit_ms", th.mdi.df_crit_ms);
+                non_negative(jm, "mlr_warn", th.mdi.mlr_warn);
+                non_negative(jm, "mlr_crit", th.mdi.mlr_crit);
+            }
+
+            // --- legacy плоские пороги ---
+            if (jt.contains("decode_fps_min") && jt["decode_fps_min"].is_number_integer())
+                s->legacy.decode_fps_min = std::max(0, jt["decode_fps_min"].get<int>());
+            if (jt.contains("bitrate_drop_pct") && jt["bitrate_drop_pct"].is_number_integer())
+                s->legacy.bitrate_drop_pct = clamp_int(jt["bitrate_drop_pct"].get<int>(), 0, 100);
+            if (jt.contains("cc_errors_per_min") && jt["cc_errors_per_min"].is_number_integer())
+                s->legacy.cc_errors_per_min = std::max(0, jt["cc_errors_per_min"].get<int>());
         }
 
         if (j.contains("alerts") && j["alerts"].is_object()) {
-            auto& ja = j["alerts"];
+            const auto& ja = j["alerts"];
 
             // Новая схема
             if (ja.contains("webhook") && ja["webhook"].is_object()) {
-                auto& jw = ja["webhook"];
-                if (jw.contains("enabled"))    m_webhook.enabled = jw["enabled"].get<bool>();
-                if (jw.contains("url"))        m_webhook.url = jw["url"].get<std::string>();
-                if (jw.contains("timeout_ms")) m_webhook.timeout_ms = std::max(0, jw["timeout_ms"].get<int>());
+                const auto& jw = ja["webhook"];
+                if (jw.contains("enabled") && jw["enabled"].is_boolean())
+                    wh.enabled = jw["enabled"].get<bool>();
+                if (jw.contains("url") && jw["url"].is_string())
+                    wh.url = jw["url"].get<std::string>();
+                if (jw.contains("timeout_ms") && jw["timeout_ms"].is_number_integer())
+                    wh.timeout_ms = std::max(200, jw["timeout_ms"].get<int>());
+                if (jw.contains("batch_window_ms") && jw["batch_window_ms"].is_number_integer())
+                    wh.batch_window_ms = clamp_int(jw["batch_window_ms"].get<int>(), 0, 10000);
+                if (jw.contains("max_batch") && jw["max_batch"].is_number_integer())
+                    wh.max_batch = clamp_int(jw["max_batch"].get<int>(), 1, 1000);
+                if (jw.contains("queue_capacity") && jw["queue_capacity"].is_number_integer())
+                    wh.queue_capacity = clamp_int(jw["queue_capacity"].get<int>(), 16, 1 << 20);
+            }
+
+            if (ja.contains("outbox") && ja["outbox"].is_object()) {
+                const auto& jo = ja["outbox"];
+                auto& ob = s->outbox;
+                if (jo.contains("enabled") && jo["enabled"].is_boolean())
+                    ob.enabled = jo["enabled"].get<bool>();
+                if (jo.contains("dir") && jo["dir"].is_string())
+                    ob.dir = jo["dir"].get<std::string>();
+                if (jo.contains("segment_kb") && jo["segment_kb"].is_number_integer())
+                    ob.segment_kb = clamp_int(jo["segment_kb"].get<int>(), 4, 1 << 20);
+                if (jo.contains("max_mb") && jo["max_mb"].is_number_integer())
+                    ob.max_mb = clamp_int(jo["max_mb"].get<int>(), 1, 1 << 20);
+                if (jo.contains("backoff_initial_ms") && jo["backoff_initial_ms"].is_number_integer())
+                    ob.backoff_initial_ms = clamp_int(jo["backoff_initial_ms"].get<int>(), 10, 600000);
+                if (jo.contains("backoff_max_ms") && jo["backoff_max_ms"].is_number_integer())
+                    ob.backoff_max_ms = clamp_int(jo["backoff_max_ms"].get<int>(), ob.backoff_initial_ms, 3600000);
+            }
+
+            if (ja.contains("state") && ja["state"].is_object()) {
+                const auto& js = ja["state"];
+                auto& as = s->alert_state;
+                auto rd = [&js](const char* key, int& dst, int lo, int hi) {
+                    if (js.contains(key) && js[key].is_number_integer())
+                        dst = clamp_int(js[key].get<int>(), lo, hi);
+                    };
+                rd("enter_dwell_ms", as.enter_dwell_ms, 0, 600000);
+                rd("exit_dwell_ms", as.exit_dwell_ms, 0, 600000);
+                rd("hysteresis_pct", as.hysteresis_pct, 0, 90);
+                rd("flap_window_ms", as.flap_window_ms, 1000, 3600000);
+                rd("flap_transitions", as.flap_transitions, 0, 1000);
+                rd("flap_hold_ms", as.flap_hold_ms, 0, 3600000);
+                rd("table_size", as.table_size, 64, 1 << 20);
             }
 
             // legacy: alerts.cooldown_sec
-            if (ja.contains("cooldown_sec")) {
-                m_webhook.cooldown_sec = std::max(0, ja["cooldown_sec"].get<int>());
+            if (ja.contains("cooldown_sec") && ja["cooldown_sec"].is_number_integer()) {
+                wh.cooldown_sec = std::max(0, ja["cooldown_sec"].get<int>());
             }
         }
 
+        s->json_text = render_json(*s, std::move(j));
+        m_snap.store(std::move(s), std::memory_order_release);
         return true;
     }
 
-    // --- Back-compat геттеры ---
+    // --- Back-compat геттеры (читают снимок, без файлового I/O) ---
     int Settings::decode_fps_min() const noexcept {
-        try {
-            std::ifstream in(m_source_path);
-            if (!in.is_open()) return 0;
-            json j; in >> j;
-            if (j.contains("thresholds") && j["thresholds"].contains("decode_fps_min")) {
-                return std::max(0, j["thresholds"]["decode_fps_min"].get<int>());
-            }
-        }
-        catch (...) {}
+        const auto s = snapshot();
+        if (s->legacy.decode_fps_min > 0) return s->legacy.decode_fps_min;
         int ref_fps = 30;
-        return clamp_int(static_cast<int>(ref_fps * m_thresholds.fps.warn_ratio), 0, 1000);
+        return clamp_int(static_cast<int>(ref_fps * s->thresholds.fps.warn_ratio), 0, 1000);
     }
 
     int Settings::bitrate_drop_pct() const noexcept {
-        try {
-            std::ifstream in(m_source_path);
-            if (!in.is_open()) return 0;
-            json j; in >> j;
-            if (j.contains("thresholds") && j["thresholds"].contains("bitrate_drop_pct")) {
-                return clamp_int(j["thresholds"]["bitrate_drop_pct"].get<int>(), 0, 100);
-            }
-        }
-        catch (...) {}
-        return 0;
+        return snapshot()->legacy.bitrate_drop_pct;
     }
 
     int Settings::cc_errors_per_min() const noexcept {
-        try {
-            std::ifstream in(m_source_path);
-            if (!in.is_open()) return 0;
-            json j; in >> j;
-            if (j.contains("thresholds") && j["thresholds"].contains("cc_errors_per_min")) {
-                return std::max(0, j["thresholds"]["cc_errors_per_min"].get<int>());
-            }
-        }
-        catch (...) {}
-        return 0;
+        return snapshot()->legacy.cc_errors_per_min;
     }
 
 } // namespace multiscreen
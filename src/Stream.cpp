@@ -1,7 +1,11 @@
 #include "Stream.h"
+#include "Settings.h"
+#include "ThreadPlacement.h"
 #include <sstream>
 #include <iomanip>
 #include <algorithm>
+#include <cctype>
+#include <cstring>
 
 extern "C" {
 #include <libavutil/avutil.h>
@@ -11,44 +15,236 @@ extern "C" {
 
 namespace multiscreen {
 
-    Stream::Stream(const std::string& name, const std::string& url)
-        : m_name(name), m_url(url) {
+    static int64_t steady_ms(std::chrono::steady_clock::time_point t) {
+        return std::chrono::duration_cast<std::chrono::milliseconds>(t.time_since_epoch()).count();
     }
 
-    Stream::~Stream() { stop(); }
+    static std::atomic<uint64_t> g_next_uid{ 1 };
 
-    void Stream::start() {
-        if (m_run.load()) return;
-        m_run = true;
+    static std::string av_error_text(int rc) {
+        char buf[AV_ERROR_MAX_STRING_SIZE] = {};
+        if (av_strerror(rc, buf, sizeof(buf)) < 0) return "error " + std::to_string(rc);
+        return buf;
+    }
+
+    static constexpr int kBackoffMinMs = 500;
+    static constexpr int kBackoffMaxMs = 10000;
+
+    // буфер ответвления TS: целое число пакетов, ~64 КБ
+    static constexpr int kTapBuffer = static_cast<int>(TsScanner::kPacket) * 348;
+    static std::atomic<bool> g_ts_tap{ true };
+    static std::atomic<bool> g_udp_native{ true };
+    static std::atomic<bool> g_hls_native{ true };
+    static constexpr int kUdpPollMs = 100;   // шаг ожидания датаграмм и сегментов HLS: реакция на Stop/Restart
+
+    static bool hls_native_wanted(const std::string& url) {
+        if (!g_hls_native.load(std::memory_order_relaxed)) return false;
+        std::string u = url;
+        std::transform(u.begin(), u.end(), u.begin(), [](unsigned char c) { return static_cast<char>(std::tolower(c)); });
+        return u.find(".m3u8") != std::string::npos && HlsReader::supported(url);
+    }
+
+    // Ответвление только там, где вход — один поток байт с TS: HLS — только своим приёмом
+    // (иначе сегменты открывает демультиплексор), RTP/RTSP/RTMP несут не TS
+    static bool tap_wanted(const std::string& url) {
+        std::string u = url;
+        std::transform(u.begin(), u.end(), u.begin(), [](unsigned char c) { return static_cast<char>(std::tolower(c)); });
+        if (u.find(".m3u8") != std::string::npos) return hls_native_wanted(url);
+        const bool native = UdpReceiver::supported() && g_udp_native.load(std::memory_order_relaxed);
+        if (u.find('|') != std::string::npos) return native;   // слияние SMPTE 2022-7 — только своим приёмом
+        const auto sep = u.find("://");
+        if (sep == std::string::npos) return true;   // локальный файл
+        const std::string scheme = u.substr(0, sep);
+        return scheme == "udp" || scheme == "srt" || scheme == "tcp" ||
+            scheme == "http" || scheme == "https" || scheme == "file" ||
+            (scheme == "rtp" && native);
+    }
+
+    // SMPTE 2022-7: две ветви одного RTP-потока через '|', каждая — udp:// или rtp://
+    static bool split_legs(const std::string& url, std::string& primary, std::string& secondary) {
+        const auto bar = url.find('|');
+        if (bar == std::string::npos) return false;
+        primary = url.substr(0, bar);
+        secondary = url.substr(bar + 1);
+        return true;
+    }
+
+    static bool is_rtp_url(const std::string& url) {
+        return url.size() > 6 && (av_strncasecmp(url.c_str(), "rtp://", 6) == 0 || url.find('|') != std::string::npos);
+    }
+
+    // rtp:// — только так: RTP снимает RtpReorder, иначе — демультиплексор RTP FFmpeg без ответвления
+    static bool udp_native_wanted(const std::string& url) {
+        if (!UdpReceiver::supported() || !g_udp_native.load(std::memory_order_relaxed)) return false;
+        return (url.size() > 6 && av_strncasecmp(url.c_str(), "udp://", 6) == 0) || is_rtp_url(url);
+    }
+
+    const char* to_string(StreamState s) noexcept {
+        switch (s) {
+        case StreamState::Idle:     return "idle";
+        case StreamState::Opening:  return "opening";
+        case StreamState::Running:  return "running";
+        case StreamState::Draining: return "draining";
+        case StreamState::Backoff:  return "backoff";
+        }
+        return "idle";
+    }
+
+    Stream::Stream(const std::string& name, const std::string& url, uint32_t id)
+        : m_name(name), m_url(url), m_id(id), m_uid(g_next_uid.fetch_add(1, std::memory_order_relaxed)) {
+        m_fflog.stream = id;
+        m_fflog.name = name;
+        m_ts.add_sink(&m_tr);
+        m_ts.add_sink(&m_timing);
+        m_rec = Recorder::instance().attach(name);
+        if (m_rec) m_ts.add_sink(m_rec.get());
+        // один пул чанков на захват и раздачу: пакеты копируются один раз
+        const size_t live_chunks = TsFanout::pool_chunks();
+        m_chunks = IncidentCapture::instance().attach(live_chunks);
+        if (!m_chunks && live_chunks) m_chunks = std::make_shared<TsChunkRing>(0, 0, live_chunks);
+        if (m_chunks) m_ts.add_sink(m_chunks.get());
+        m_fanout = std::make_shared<TsFanout>(m_chunks);
+        m_gop = std::make_shared<GopCache>();
+        m_preview = std::make_shared<HlsPreview>(name, m_gop);
+        // ключ для копий AVCodecContext в потоках frame-threading (через opaque)
+        FFLogRouter::instance().registerSource(&m_fflog, &m_fflog);
+        // поток живёт всё время жизни объекта и в Idle просто ждёт команду
         m_thr = std::thread(&Stream::thread_loop, this);
     }
 
-    void Stream::stop() {
-        m_run = false;
+    Stream::~Stream() {
+        retire();
         if (m_thr.joinable()) m_thr.join();
         close_input();
+        Recorder::instance().detach(m_rec);
+        m_fanout->close();
+        FFLogRouter::instance().unregisterSource(&m_fflog);
     }
 
-    StreamStats Stream::stats() {
-        std::lock_guard<std::mutex> lk(m_mx);
-        StreamStats st;
-        st.name = m_name;
-        st.url = m_url;
+    void Stream::post(StreamCommand cmd, uint64_t job) {
+        const char* already = nullptr;
+        {
+            std::lock_guard<std::mutex> lk(m_cmd_mx);
+            const StreamState st = state();
+            if (cmd == StreamCommand::Start && m_cmds.empty() &&
+                (st == StreamState::Opening || st == StreamState::Running)) {
+                // уже запущен или открывается — I/O не трогаем, в ответе фактическое состояние
+                already = st == StreamState::Opening ? "already opening" : "already running";
+            }
+            else {
+                m_cmds.push_back(Command{ cmd, job });
+                if (cmd != StreamCommand::Start) m_interrupt.store(true, std::memory_order_relaxed);
+                job = 0;
+            }
+        }
+        m_cmd_cv.notify_all();
+        if (job) finish_job(job, true, already);
+    }
 
-        st.running = m_run.load();
-        st.input_fps = m_input_fps_hint;
+    void Stream::wait_idle() {
+        std::unique_lock<std::mutex> lk(m_cmd_mx);
+        m_cmd_cv.wait(lk, [this] {
+            return m_quit || (m_cmds.empty() && state() == StreamState::Idle);
+        });
+    }
+
+    void Stream::stop() {
+        post(StreamCommand::Stop);
+        wait_idle();
+    }
+
+    void Stream::retire() noexcept {
+        {
+            std::lock_guard<std::mutex> lk(m_cmd_mx);
+            m_quit = true;
+            m_interrupt.store(true, std::memory_order_relaxed);
+        }
+        m_cmd_cv.notify_all();
+    }
+
+    void Stream::set_ts_tap(bool on) noexcept {
+        g_ts_tap.store(on, std::memory_order_relaxed);
+    }
+
+    void Stream::set_udp_native(bool on) noexcept {
+        g_udp_native.store(on, std::memory_order_relaxed);
+    }
+
+    void Stream::set_hls_native(bool on) noexcept {
+        g_hls_native.store(on, std::memory_order_relaxed);
+    }
+
+    void Stream::set_state(StreamState st) noexcept {
+        m_state.store(st, std::memory_order_relaxed);
+    }
+
+    void Stream::finish_job(uint64_t job, bool ok, const std::string& msg) {
+        if (job && m_job_sink) m_job_sink(job, ok, msg);
+    }
 
-        // ---- Decode FPS: EWMA,  ƨ CLAMP  input_fps ----
+    void Stream::finish_start_jobs(bool ok, const std::string& msg) {
+        for (uint64_t job : m_start_jobs) finish_job(job, ok, msg);
+        m_start_jobs.clear();
+    }
+
+    int Stream::interrupt_cb(void* opaque) {
+        // вызывается ffmpeg изнутри блокирующего I/O; ненулевой ответ прерывает операцию
+        return static_cast<Stream*>(opaque)->m_interrupt.load(std::memory_order_relaxed) ? 1 : 0;
+    }
+
+    void Stream::publish(WatchKind kind, uint8_t band) {
+        if (!m_sink) return;
+        WatchEvent ev;
+        ev.uid = m_uid;
+        ev.kind = kind;
+        ev.band = band;
+        {
+            std::lock_guard<std::mutex> lk(m_mx);
+            ev.input_fps = m_input_fps_hint;
+            ev.decode_fps = decode_fps_unlocked();
+            ev.kbps = m_kbps;
+        }
+        const TsTimingSnapshot t = m_timing.snapshot();
+        ev.timing = t.valid;
+        ev.pcr_oj_ms = t.pcr_oj_ms;
+        ev.mdi_df_ms = t.mdi_df_ms;
+        ev.mdi_mlr = t.mdi_mlr;
+        ev.t_ms = steady_ms(std::chrono::steady_clock::now());
+        m_sink(std::move(ev));
+    }
+
+    double Stream::decode_fps_unlocked() const {
+        // ---- Decode FPS: EWMA, затем ЖЁСТКИЙ CLAMP к input_fps ----
         double dfps = m_dec_fps_ema;
         if (m_input_fps_hint > 0.0) {
             if (dfps > m_input_fps_hint) dfps = m_input_fps_hint;
             if (dfps <= 0.0)           dfps = m_input_fps_hint; // fallback
         }
         else {
-            //      ,  
+            // входной не известен — покажем то, что насчитано
             if (dfps < 0.0) dfps = 0.0;
         }
-        st.decode_fps = dfps;
+        return dfps;
+    }
+
+    StreamStats Stream::stats() {
+        std::lock_guard<std::mutex> lk(m_mx);
+        StreamStats st;
+        st.name = m_name;
+        st.url = m_url;
+
+        const StreamState state = this->state();
+        st.state = to_string(state);
+        st.running = state == StreamState::Opening || state == StreamState::Running || state == StreamState::Backoff;
+        st.reconnects = m_reconnects;
+        st.input_fps = m_input_fps_hint;
+        st.decode_fps = decode_fps_unlocked();
+
+        const int64_t progress = progress_ms();
+        if (st.running && progress > 0) {
+            const int64_t idle = steady_ms(std::chrono::steady_clock::now()) - progress;
+            st.stall_ms = static_cast<int>(std::clamp<int64_t>(idle, 0, INT32_MAX));
+        }
 
         st.render_fps = m_render_fps;
 
@@ -58,7 +254,34 @@ namespace multiscreen {
 
         st.rate_mode = m_rate_mode;
         st.decoder = m_decoder_label;
-        st.cc_errors = m_cc_errors;
+        st.ts_tap = m_ts_active.load(std::memory_order_relaxed);
+        const TsScanSnapshot ts = m_ts.snapshot();
+        st.cc_errors = st.ts_tap ? ts.cc_errors : m_fflog.counters.cc_errors.load(std::memory_order_relaxed);
+        st.ts_packets = ts.packets;
+        st.ts_sync_losses = ts.sync_losses;
+        st.ts_tei = ts.tei;
+        st.ts_pids = ts.pids;
+        st.tr101290 = m_tr.totals();
+        st.timing = m_timing.snapshot();
+        st.udp_native = m_udp_active.load(std::memory_order_acquire);
+        if (st.udp_native) {
+            st.udp = m_legs[0].rx->stats();
+            st.rtp_mode = m_rtp_mode.load(std::memory_order_relaxed);
+            if (st.rtp_mode) {
+                if (const auto rtp = m_rtp_pub.load()) st.rtp = rtp->stats();
+            }
+            if (st.rtp_mode && st.rtp.merge) st.udp_secondary = m_legs[1].rx->stats();
+        }
+        st.hls_native = m_hls_active.load(std::memory_order_acquire);
+        if (st.hls_native) st.hls = m_hls->stats();
+        if (m_rec) st.record = Recorder::instance().stats(*m_rec);
+        if (m_chunks && m_chunks->window()) st.capture = IncidentCapture::instance().stats(*m_chunks);
+        st.live = m_fanout->stats();
+        st.preview = m_preview->stats();
+        st.gop = m_gop->stats();
+        st.pes_errors = m_fflog.counters.pes_errors.load(std::memory_order_relaxed);
+        st.decode_errors = m_fflog.counters.decode_errors.load(std::memory_order_relaxed);
+        st.log_suppressed = m_fflog.counters.suppressed.load(std::memory_order_relaxed);
 
         st.sid = m_sid;
         st.pmt_pid = m_pmt_pid;
@@ -72,93 +295,240 @@ namespace multiscreen {
     }
 
     void Stream::thread_loop() {
-        while (m_run.load()) {
-            if (!open_input()) {
-                { std::lock_guard<std::mutex> lk(m_mx); m_last_error = "open failed"; }
-                std::this_thread::sleep_for(std::chrono::seconds(1));
-                continue;
+        ThreadPlacement::Scope placement(ThreadRole::Ingest, "in:" + m_name);
+        Logger::StreamScope log_scope(m_id);
+        FFLogRouter::Scope ff_scope(&m_fflog);
+        StreamState st = StreamState::Idle;
+        for (;;) {
+            set_state(st);
+            switch (st) {
+            case StreamState::Idle: {
+                std::unique_lock<std::mutex> lk(m_cmd_mx);
+                m_cmd_cv.wait(lk, [this] { return m_quit || !m_cmds.empty(); });
+                st = StreamState::Draining; // разбор команд — общий для всех состояний
+                break;
             }
-
-            AVPacket* pkt = av_packet_alloc();
-            AVFrame* frm = av_frame_alloc();
-            if (!pkt || !frm) {
-                { std::lock_guard<std::mutex> lk(m_mx); m_last_error = "no mem"; }
-                av_packet_free(&pkt); av_frame_free(&frm);
+            case StreamState::Opening:
+                if (open_input()) {
+                    Logger::log(LogLevel::Info, m_id, logcode::StreamOpened, m_name + ": input opened");
+                    m_backoff_ms = kBackoffMinMs;
+                    finish_start_jobs(true, "running");
+                    st = StreamState::Running;
+                }
+                else if (m_interrupt.load(std::memory_order_relaxed)) {
+                    st = StreamState::Draining; // открытие прервано командой — её и исполним
+                }
+                else {
+                    close_input();
+                    // первая неудача серии — warning, повторы на backoff — debug (тысячи мёртвых входов не топят лог)
+                    Logger::log(m_backoff_ms <= kBackoffMinMs ? LogLevel::Warning : LogLevel::Debug, m_id, logcode::StreamOpenFailed,
+                        m_name + ": open failed (" + av_error_text(m_av_err) + "), retry in " + std::to_string(m_backoff_ms) + " ms");
+                    { std::lock_guard<std::mutex> lk(m_mx); m_last_error = "open failed"; ++m_reconnects; }
+                    finish_start_jobs(false, "open failed, retrying");
+                    st = StreamState::Backoff;
+                }
+                break;
+            case StreamState::Running:
+                read_loop();
                 close_input();
-                std::this_thread::sleep_for(std::chrono::seconds(1));
-                continue;
+                if (m_interrupt.load(std::memory_order_relaxed)) {
+                    st = StreamState::Draining;
+                }
+                else {
+                    Logger::log(LogLevel::Warning, m_id, logcode::StreamInputLost,
+                        m_name + ": input lost (" + (m_av_err ? av_error_text(m_av_err) : std::string("no error")) + "), reconnecting");
+                    { std::lock_guard<std::mutex> lk(m_mx); ++m_reconnects; }
+                    st = StreamState::Backoff;
+                }
+                break;
+            case StreamState::Backoff: {
+                // пауза перед реконнектом растёт экспоненциально; любая команда её прерывает
+                std::unique_lock<std::mutex> lk(m_cmd_mx);
+                const bool woke = m_cmd_cv.wait_for(lk, std::chrono::milliseconds(m_backoff_ms),
+                    [this] { return m_quit || !m_cmds.empty(); });
+                m_backoff_ms = std::min(m_backoff_ms * 2, kBackoffMaxMs);
+                st = woke ? StreamState::Draining : StreamState::Opening;
+                break;
             }
-
-            //   kbps
-            {
-                std::lock_guard<std::mutex> lk(m_mx);
-                m_bw_t0 = std::chrono::steady_clock::now();
-                m_bw_bits_total = 0;
-                m_kbps = m_vkbps = m_akbps = 0;
-                m_kbps_win_sum = m_kbps_win_cnt = 0;
+            case StreamState::Draining:
+                close_input();
+                st = drain();
+                if (m_exited.load(std::memory_order_relaxed)) return;
+                break;
             }
+        }
+    }
 
-            // -
-            while (m_run.load()) {
-                int r = av_read_frame(m_fmt, pkt);
-                if (r < 0) {
-                    if (r == AVERROR_EOF) break;
-                    //  /  
+    StreamState Stream::drain() {
+        enum class Target { Stay, Idle, Open, Exit };
+        Target target = Target::Stay;
+        std::vector<uint64_t> stop_jobs;
+        {
+            std::lock_guard<std::mutex> lk(m_cmd_mx);
+            for (const auto& c : m_cmds) {
+                switch (c.cmd) {
+                case StreamCommand::Stop:
+                    target = Target::Idle;
+                    if (c.job) stop_jobs.push_back(c.job);
+                    break;
+                case StreamCommand::Start:
+                case StreamCommand::Restart:
+                    target = Target::Open;
+                    if (c.job) m_start_jobs.push_back(c.job);
                     break;
                 }
+            }
+            m_cmds.clear();
+            if (m_quit) target = Target::Exit;
+            m_interrupt.store(m_quit, std::memory_order_relaxed);
+            if (target == Target::Stay) target = m_active ? Target::Open : Target::Idle;
+            if (target == Target::Idle) set_state(StreamState::Idle); // виден wait_idle() атомарно с очисткой очереди
+        }
+
+        const bool was_active = m_active;
+        if (target == Target::Open) {
+            // (пере)запуск: stall считаем с этого момента, источник, который так и не открылся, тоже «мёртв»
+            const int64_t now = steady_ms(std::chrono::steady_clock::now());
+            m_last_byte_ms.store(now, std::memory_order_relaxed);
+            m_last_frame_ms.store(now, std::memory_order_relaxed);
+            m_backoff_ms = kBackoffMinMs;
+            m_active = true;
+            publish(WatchKind::Started);
+        }
+        else {
+            m_active = false;
+            for (uint64_t job : stop_jobs) finish_job(job, true, "stopped");
+            finish_start_jobs(false, target == Target::Exit ? "stream removed" : "stopped");
+            if (was_active) publish(WatchKind::Stopped);
+            if (was_active || target == Target::Exit) {
+                Logger::log(LogLevel::Info, m_id, target == Target::Exit ? logcode::StreamRemoved : logcode::StreamStopped,
+                    m_name + (target == Target::Exit ? ": removed" : ": stopped"));
+            }
+        }
+
+        if (target == Target::Exit) {
+            {
+                std::lock_guard<std::mutex> lk(m_cmd_mx);
+                m_exited.store(true, std::memory_order_release);
+            }
+            m_cmd_cv.notify_all();
+            return StreamState::Idle;
+        }
+        if (target == Target::Idle) {
+            m_cmd_cv.notify_all(); // будим wait_idle()
+            return StreamState::Idle;
+        }
+        return StreamState::Opening;
+    }
+
+    void Stream::read_loop() {
+        AVPacket* pkt = av_packet_alloc();
+        AVFrame* frm = av_frame_alloc();
+        if (!pkt || !frm) {
+            { std::lock_guard<std::mutex> lk(m_mx); m_last_error = "no mem"; }
+            av_packet_free(&pkt); av_frame_free(&frm);
+            return;
+        }
+
+        // окна для kbps; открытие входа — тоже прогресс (stall считаем от него)
+        {
+            std::lock_guard<std::mutex> lk(m_mx);
+            m_bw_t0 = std::chrono::steady_clock::now();
+            m_last_byte_ms.store(steady_ms(m_bw_t0), std::memory_order_relaxed);
+            m_last_frame_ms.store(steady_ms(m_bw_t0), std::memory_order_relaxed);
+            m_bw_bits_total = 0;
+            m_kbps = m_vkbps = m_akbps = 0;
+            m_kbps_win_sum = m_kbps_win_cnt = 0;
+        }
+
+        // декод-цикл; команда Stop/Restart прерывает и блокирующий av_read_frame (interrupt_cb)
+        while (!m_interrupt.load(std::memory_order_relaxed)) {
+            int r = av_read_frame(m_fmt, pkt);
+            if (r < 0) {
+                m_av_err = r;
+                if (r == AVERROR_EOF) break;
+                // сетевые ошибки/таймаут — реконнект
+                break;
+            }
 
-                //   (    kbps)
-                bool is_video = (pkt->stream_index == m_vst_index);
-                bool is_audio = (!is_video && m_vst_index >= 0 && m_fmt &&
-                    pkt->stream_index >= 0 &&
-                    m_fmt->streams[pkt->stream_index]->codecpar->codec_type == AVMEDIA_TYPE_AUDIO);
-                update_bitrate_window(pkt->size * 8, is_video, is_audio);
-
-                //       
-                if (is_video && m_vdec) {
-                    if (avcodec_send_packet(m_vdec, pkt) == 0) {
-                        while (m_run.load()) {
-                            int rr = avcodec_receive_frame(m_vdec, frm);
-                            if (rr == 0) {
-                                on_video_frame_decoded();
-                                av_frame_unref(frm);
-                            }
-                            else if (rr == AVERROR(EAGAIN) || rr == AVERROR_EOF) {
-                                break;
-                            }
-                            else {
-                                //       
-                                break;
-                            }
+            // учёт битрейта (входящие пакеты – общий kbps)
+            bool is_video = (pkt->stream_index == m_vst_index);
+            bool is_audio = (!is_video && m_vst_index >= 0 && m_fmt &&
+                pkt->stream_index >= 0 &&
+                m_fmt->streams[pkt->stream_index]->codecpar->codec_type == AVMEDIA_TYPE_AUDIO);
+            update_bitrate_window(pkt->size * 8, is_video, is_audio);
+
+            // отправим видеопакеты в декодер ради счётчика кадров
+            if (is_video && m_vdec) {
+                if (avcodec_send_packet(m_vdec, pkt) == 0) {
+                    for (;;) {
+                        int rr = avcodec_receive_frame(m_vdec, frm);
+                        if (rr == 0) {
+                            on_video_frame_decoded();
+                            av_frame_unref(frm);
+                        }
+                        else {
+                            // EAGAIN/EOF — ждём следующий пакет; ошибка декодера — тоже выходим
+                            break;
                         }
                     }
                 }
-
-                av_packet_unref(pkt);
             }
 
-            av_packet_free(&pkt);
-            av_frame_free(&frm);
-            close_input();
+            // предпросмотр HLS: без зрителей — одна атомарная загрузка;
+            // до кэша GOP, чтобы новый зритель получил снимок без текущего пакета
+            if (m_preview->active()) m_preview->feed(m_fmt, pkt);
+            m_gop->push(m_fmt, m_vst_index, pkt);
 
-            //    
-            if (m_run.load()) std::this_thread::sleep_for(std::chrono::milliseconds(500));
+            av_packet_unref(pkt);
         }
+
+        av_packet_free(&pkt);
+        av_frame_free(&frm);
     }
 
     bool Stream::open_input() {
         close_input();
 
-        // 
-        if (avformat_open_input(&m_fmt, m_url.c_str(), nullptr, nullptr) < 0) {
-            return false;
+        // формат; interrupt_cb даёт командам прервать connect/probe/read
+        m_fmt = avformat_alloc_context();
+        if (!m_fmt) return false;
+        m_fmt->interrupt_callback.callback = &Stream::interrupt_cb;
+        m_fmt->interrupt_callback.opaque = this;
+        const AVFormatContext* fmt_key = m_fmt;
+        FFLogRouter::instance().registerSource(fmt_key, &m_fflog);
+
+        // ответвление TS: демультиплексор читает через m_tap, байты по пути проходят TsScanner
+        if (g_ts_tap.load(std::memory_order_relaxed) && tap_wanted(m_url) && !m_hls_ffmpeg) {
+            m_av_err = open_tap();
+            if (m_av_err == AVERROR(ENOTSUP) && hls_native_wanted(m_url)) {
+                // шифрование, fMP4 и т.п.: этот вход дальше читает демультиплексор HLS FFmpeg
+                m_hls_ffmpeg = true;
+                m_av_err = 0;
+            }
+            else if (m_av_err < 0) {
+                FFLogRouter::instance().unregisterSource(fmt_key);
+                avformat_free_context(m_fmt);
+                m_fmt = nullptr;
+                return false;
+            }
+            else m_fmt->pb = m_tap;   // avformat_open_input сам выставит AVFMT_FLAG_CUSTOM_IO
         }
+        // сегменты HLS склеены в один TS: имя .m3u8 не должно увести пробу в демультиплексор HLS
+        const AVInputFormat* ifmt = m_hls_active.load(std::memory_order_relaxed) ? av_find_input_format("mpegts") : nullptr;
+        m_av_err = avformat_open_input(&m_fmt, m_url.c_str(), ifmt, nullptr);
+        if (m_av_err < 0) {
+            FFLogRouter::instance().unregisterSource(fmt_key);
+            close_tap();
+            return false; // контекст освобождён ffmpeg (свой pb — нет)
+        }
+        m_ts_active.store(m_tap != nullptr, std::memory_order_relaxed);
         avformat_find_stream_info(m_fmt, nullptr);
 
-        //   
+        // найдём видео поток
         m_vst_index = av_find_best_stream(m_fmt, AVMEDIA_TYPE_VIDEO, -1, -1, nullptr, 0);
 
-        //  (    decode)
+        // видеодекодер (нужен для подсчёта кадров decode)
         if (m_vst_index >= 0) {
             AVStream* vst = m_fmt->streams[m_vst_index];
             pick_input_fps(vst);
@@ -167,15 +537,26 @@ namespace multiscreen {
             if (vcodec) {
                 m_vdec = avcodec_alloc_context3(vcodec);
                 avcodec_parameters_to_context(m_vdec, vst->codecpar);
+                m_vdec->opaque = &m_fflog;
+                FFLogRouter::instance().registerSource(m_vdec, &m_fflog);
 
 #if defined(_WIN32)
-                //      D3D11VA/other HW     GPU
+                // при желании здесь можно подключить D3D11VA/other HW — тогда подпишем как GPU
                 m_decoder_label = "CPU";
 #else
                 m_decoder_label = "CPU";
 #endif
 
-                if (avcodec_open2(m_vdec, vcodec, nullptr) < 0) {
+                // при thread_count > 1 FFmpeg поднимает свои потоки внутри avcodec_open2:
+                // на это время поток стрима переходит на набор decode, и они его наследуют
+                m_vdec->thread_count = ThreadPlacement::instance().decode_threads();
+                int rc;
+                {
+                    ThreadPlacement::DecodeSpawn spawn("dec:" + m_name);
+                    rc = avcodec_open2(m_vdec, vcodec, nullptr);
+                }
+                if (rc < 0) {
+                    FFLogRouter::instance().unregisterSource(m_vdec);
                     avcodec_free_context(&m_vdec);
                     m_vdec = nullptr;
                 }
@@ -185,14 +566,14 @@ namespace multiscreen {
             }
         }
         else {
-            //        FPS  
+            // не нашли видео – хотя бы дефолт FPS для отображения
             m_input_fps_hint = 25.0;
         }
 
-        // PSI/PMT/SID/PID ( )    AVProgram
+        // PSI/PMT/SID/PID (если есть) – заберём из AVProgram
         probe_program_info();
 
-        //   fps  kbps
+        // старт окон fps и kbps
         {
             std::lock_guard<std::mutex> lk(m_mx);
             m_dec_sample_t0 = std::chrono::steady_clock::now();
@@ -209,15 +590,268 @@ namespace multiscreen {
         return true;
     }
 
+    std::string Stream::capture(const std::string& reason, bool critical) {
+        return IncidentCapture::instance().trigger(m_chunks, m_name, reason, critical);
+    }
+
     void Stream::close_input() {
+        auto& router = FFLogRouter::instance();
         if (m_vdec) {
+            router.unregisterSource(m_vdec);
             avcodec_free_context(&m_vdec);
             m_vdec = nullptr;
         }
+        m_preview->reset();   // потоки входа уходят вместе с m_fmt
+        m_gop->reset();
         if (m_fmt) {
+            router.unregisterSource(m_fmt);
             avformat_close_input(&m_fmt);
             m_fmt = nullptr;
         }
+        close_tap();
+        router.flush(m_fflog);
+    }
+
+    int Stream::open_tap() {
+        const int rc = hls_native_wanted(m_url) ? open_hls()
+            : udp_native_wanted(m_url) ? open_udp()
+            : avio_open2(&m_io, m_url.c_str(), AVIO_FLAG_READ, &m_fmt->interrupt_callback, nullptr);
+        if (rc < 0) return rc;
+        auto* buf = static_cast<unsigned char*>(av_malloc(kTapBuffer));
+        if (buf) m_tap = avio_alloc_context(buf, kTapBuffer, 0, this, &Stream::tap_read, nullptr, &Stream::tap_seek);
+        if (!m_tap) {
+            av_free(buf);
+            close_tap();
+            return AVERROR(ENOMEM);
+        }
+        m_tap->seekable = m_io ? m_io->seekable : 0;
+        m_ts.restart();
+        m_tr.restart();
+        m_timing.restart();
+        return 0;
+    }
+
+    int Stream::open_udp() {
+        std::string urls[2];
+        const bool merge = split_legs(m_url, urls[0], urls[1]);
+        if (!merge) urls[0] = m_url;
+        m_leg_count = merge ? 2 : 1;
+
+        // при слиянии хватает одной ветви: вторая может лежать, вход от этого не рвётся
+        int opened = 0, last_rc = 0;
+        for (int i = 0; i < m_leg_count; ++i) {
+            UdpLeg& leg = m_legs[i];
+            if (!leg.rx) leg.rx = std::make_unique<UdpReceiver>();
+            leg.next = leg.count = 0;
+            UdpEndpoint ep;
+            std::string err;
+            int rc = UdpEndpoint::parse(urls[i], ep, err) ? leg.rx->open(ep, err) : -EINVAL;
+            if (rc < 0) {
+                Logger::log(merge ? LogLevel::Warning : LogLevel::Debug, m_id, logcode::StreamOpenFailed,
+                    m_name + (merge ? (i ? ": secondary: " : ": primary: ") : ": udp: ") + err);
+                last_rc = rc;
+                continue;
+            }
+            ++opened;
+        }
+        if (!opened) return AVERROR(-last_rc);
+
+        // SMPTE 2022-1: столбцы на порту +2, строки на +4 той же группы; их нет — вход без FEC
+        const bool rtp = is_rtp_url(m_url);
+        const bool fec = rtp && !merge && RtpReorder::fec_enabled();
+        m_fec_legs = 0;
+        for (int k = 0; k < 2; ++k) {
+            UdpLeg& leg = m_legs[2 + k];
+            leg.next = leg.count = 0;
+            if (!fec) {
+                if (leg.rx) leg.rx->close();
+                continue;
+            }
+            if (!leg.rx) leg.rx = std::make_unique<UdpReceiver>();
+            UdpEndpoint ep;
+            std::string err;
+            if (!UdpEndpoint::parse(urls[0], ep, err) || ep.port > 65535 - 4) continue;
+            ep.port = static_cast<uint16_t>(ep.port + 2 * (k + 1));
+            if (leg.rx->open(ep, err) < 0) {
+                Logger::log(LogLevel::Debug, m_id, logcode::StreamOpenFailed, m_name + (k ? ": fec rows: " : ": fec columns: ") + err);
+                continue;
+            }
+            ++m_fec_legs;
+        }
+        if (rtp && (!m_rtp || m_rtp->merge() != merge || m_rtp->fec() != fec)) {
+            m_rtp = std::make_shared<RtpReorder>(merge, fec);
+            m_rtp_pub.store(m_rtp);
+        }
+        if (rtp) m_rtp->reset();
+        m_rtp_mode.store(rtp, std::memory_order_relaxed);
+        m_udp_active.store(true, std::memory_order_release);
+        return 0;
+    }
+
+    int Stream::open_hls() {
+        if (!m_hls) m_hls = std::make_unique<HlsReader>();
+        std::string err;
+        const int rc = m_hls->open(m_url, m_name, m_id, err);
+        if (rc < 0) {
+            const bool fallback = rc == -ENOTSUP;
+            Logger::log(fallback ? LogLevel::Info : LogLevel::Debug, m_id, logcode::StreamOpenFailed,
+                m_name + ": hls: " + err + (fallback ? " (FFmpeg HLS demuxer is used)" : ""));
+            return AVERROR(-rc);
+        }
+        m_hls_active.store(true, std::memory_order_release);
+        return 0;
+    }
+
+    void Stream::close_tap() {
+        if (m_tap) {
+            av_freep(&m_tap->buffer);
+            avio_context_free(&m_tap);
+        }
+        if (m_io) avio_closep(&m_io);
+        for (UdpLeg& leg : m_legs)
+            if (leg.rx) leg.rx->close();
+        m_udp_active.store(false, std::memory_order_relaxed);
+        if (m_hls) m_hls->close();
+        m_hls_active.store(false, std::memory_order_relaxed);
+        if (m_rec) m_rec->flush();   // хвост записи — на диск, не дожидаясь следующего входа
+        if (m_chunks) m_chunks->flush();
+        m_ts_active.store(false, std::memory_order_relaxed);
+    }
+
+    // Датаграммы пачки целиком, сколько влезет в буфер демультиплексора; каждая идёт
+    // в TsScanner со своей меткой времени ядра. Для rtp:// между ними стоит RtpReorder:
+    // в буфер уходит только полезная нагрузка, по порядку номеров.
+    int Stream::udp_read(uint8_t* buf, int size) {
+        const bool rtp = m_rtp_mode.load(std::memory_order_relaxed);
+        int out = 0;
+        for (;;) {
+            if (rtp) {
+                if (const RtpPayload* p = m_rtp->peek()) {
+                    if (out + static_cast<int>(p->len) > size) break;
+                    std::memcpy(buf + out, p->data, p->len);
+                    m_ts.feed(p->data, p->len, p->arrival_us);
+                    out += static_cast<int>(p->len);
+                    m_rtp->pop();
+                    continue;
+                }
+            }
+            // следующая датаграмма — из той ветви, где она пришла раньше
+            int li = -1;
+            for (int i = 0; i < m_leg_count; ++i) {
+                const UdpLeg& l = m_legs[i];
+                if (l.next >= l.count) continue;
+                if (li < 0 || l.rx->datagram(l.next).arrival_us < m_legs[li].rx->datagram(m_legs[li].next).arrival_us) li = i;
+            }
+            if (li >= 0) {
+                UdpLeg& leg = m_legs[li];
+                const UdpDatagram& d = leg.rx->datagram(leg.next);
+                if (rtp) {
+                    // false — буфер сначала отпускает задержанное, датаграмма ждёт
+                    if (m_rtp->push(d.data, d.len, d.arrival_us, li)) ++leg.next;
+                    continue;
+                }
+                if (out + static_cast<int>(d.len) > size) break;
+                std::memcpy(buf + out, d.data, d.len);
+                m_ts.feed(d.data, d.len, d.arrival_us);
+                out += static_cast<int>(d.len);
+                ++leg.next;
+                continue;
+            }
+            if (out > 0) break;
+            if (m_interrupt.load(std::memory_order_relaxed)) return AVERROR_EXIT;
+            if (const int rc = udp_receive(); rc < 0) return rc;
+            if (rtp) {
+                using namespace std::chrono;
+                m_rtp->expire(duration_cast<microseconds>(steady_clock::now().time_since_epoch()).count());
+            }
+        }
+        return out;
+    }
+
+    // Новые пачки во все ветви. Одна ветвь — ожидание прямо в recvmmsg/poll; несколько — все
+    // без ожидания, poll по всем только если пусто везде. Ошибка одной ветви слияния
+    // входа не рвёт, пока другая жива. FEC-ветви сразу уходят в RtpReorder целиком.
+    int Stream::udp_receive() {
+        if (m_leg_count == 1 && !m_fec_legs) {
+            UdpLeg& leg = m_legs[0];
+            const int n = leg.rx->receive(kUdpPollMs);
+            if (n < 0) return AVERROR(-n);
+            leg.next = 0;
+            leg.count = static_cast<size_t>(n);
+            return 0;
+        }
+        for (int pass = 0; pass < 2; ++pass) {
+            if (pass) {
+                UdpReceiver* rx[4] = {};
+                for (size_t i = 0; i < m_legs.size(); ++i) rx[i] = m_legs[i].rx.get();
+                const int w = UdpReceiver::wait_any(rx, m_legs.size(), kUdpPollMs);
+                if (w <= 0) return w < 0 ? AVERROR(-w) : 0;
+            }
+            size_t got = 0;
+            int alive = 0, last_err = 0;
+            for (int i = 0; i < static_cast<int>(m_legs.size()); ++i) {
+                UdpLeg& leg = m_legs[i];
+                leg.next = leg.count = 0;
+                if (i >= m_leg_count && i < 2) continue;
+                if (!leg.rx || !leg.rx->is_open()) continue;
+                const int n = leg.rx->receive(0);
+                if (n < 0) {
+                    if (i < m_leg_count) last_err = n;
+                    continue;
+                }
+                got += static_cast<size_t>(n);
+                if (i >= m_leg_count) {
+                    for (int k = 0; k < n; ++k) {
+                        const UdpDatagram& d = leg.rx->datagram(static_cast<size_t>(k));
+                        m_rtp->push_fec(d.data, d.len, d.arrival_us);
+                    }
+                    continue;
+                }
+                ++alive;
+                leg.count = static_cast<size_t>(n);
+            }
+            if (!alive) return AVERROR(-last_err);
+            if (got) return 0;
+        }
+        return 0;
+    }
+
+    // Сегменты HLS подряд; ожидание — шагами kUdpPollMs, чтобы Stop/Restart не ждали сеть
+    int Stream::hls_read(uint8_t* buf, int size) {
+        for (;;) {
+            if (m_interrupt.load(std::memory_order_relaxed)) return AVERROR_EXIT;
+            const int n = m_hls->read(buf, size, kUdpPollMs);
+            if (n > 0) {
+                m_ts.feed(buf, static_cast<size_t>(n));
+                return n;
+            }
+            if (n < 0) return n == -ENODATA ? AVERROR_EOF : AVERROR(-n);
+        }
+    }
+
+    int Stream::tap_read(void* opaque, uint8_t* buf, int size) {
+        auto* self = static_cast<Stream*>(opaque);
+        if (self->m_hls_active.load(std::memory_order_relaxed)) return self->hls_read(buf, size);
+        if (self->m_udp_active.load(std::memory_order_relaxed)) return self->udp_read(buf, size);
+        const int n = avio_read_partial(self->m_io, buf, size);
+        if (n > 0) {
+            self->m_ts.feed(buf, static_cast<size_t>(n));
+            return n;
+        }
+        return n == 0 ? AVERROR_EOF : n;
+    }
+
+    int64_t Stream::tap_seek(void* opaque, int64_t offset, int whence) {
+        auto* self = static_cast<Stream*>(opaque);
+        if (!self->m_io) return AVERROR(ENOSYS);   // сеть: перемотки нет
+        if (whence == AVSEEK_SIZE) return avio_size(self->m_io);
+        const int64_t pos = avio_seek(self->m_io, offset, whence & ~AVSEEK_FORCE);
+        if (pos >= 0) {
+            // разрыв: незаконченный пакет, CC и привязка PCR ко времени недействительны
+            self->m_ts.restart();
+            self->m_timing.restart();
+        }
+        return pos;
     }
 
     void Stream::pick_input_fps(AVStream* st) {
@@ -228,72 +862,106 @@ namespace multiscreen {
             if (fps <= 1e-6 && st->r_frame_rate.num && st->r_frame_rate.den)
                 fps = av_q2d(st->r_frame_rate);
         }
-        if (fps <= 1e-6) fps = 25.0; // ,      FPS
+        if (fps <= 1e-6) fps = 25.0; // дефолт, если источник не даёт явного FPS
         std::lock_guard<std::mutex> lk(m_mx);
         m_input_fps_hint = fps;
-        if (m_dec_fps_ema <= 0.0) m_dec_fps_ema = fps; //  
+        if (m_dec_fps_ema <= 0.0) m_dec_fps_ema = fps; // быстрый прогрев
     }
 
     void Stream::on_video_frame_decoded() {
         using clock = std::chrono::steady_clock;
 
-        std::lock_guard<std::mutex> lk(m_mx);
-        m_dec_sample_frames++;
+        const auto now = clock::now();
+        m_last_frame_ms.store(steady_ms(now), std::memory_order_relaxed);
 
-        auto now = clock::now();
-        auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(now - m_dec_sample_t0).count();
-        if (ms >= 1000) {
-            const double dt = ms / 1000.0;
-            const double inst = (dt > 0.0) ? (m_dec_sample_frames / dt) : 0.0;
+        int band = -1; // >=0 — полоса fps сменилась, публикуем после снятия замка
+        {
+            std::lock_guard<std::mutex> lk(m_mx);
+            m_dec_sample_frames++;
 
-            // EWMA  (0.20.3  )
-            constexpr double alpha = 0.25;
-            m_dec_fps_ema = (m_dec_fps_ema <= 0.0) ? inst : (m_dec_fps_ema + alpha * (inst - m_dec_fps_ema));
+            auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(now - m_dec_sample_t0).count();
+            if (ms >= 1000) {
+                const double dt = ms / 1000.0;
+                const double inst = (dt > 0.0) ? (m_dec_sample_frames / dt) : 0.0;
 
-            m_dec_sample_frames = 0;
-            m_dec_sample_t0 = now;
+                // EWMA сглаживание (0.2–0.3 — «комфортно»)
+                constexpr double alpha = 0.25;
+                m_dec_fps_ema = (m_dec_fps_ema <= 0.0) ? inst : (m_dec_fps_ema + alpha * (inst - m_dec_fps_ema));
+
+                m_dec_sample_frames = 0;
+                m_dec_sample_t0 = now;
+
+                const auto snap = Settings::instance().snapshot();
+                const uint8_t b = fps_band(m_input_fps_hint, decode_fps_unlocked(), *snap);
+                if (b != m_fps_band) { m_fps_band = b; band = b; }
+            }
         }
+        if (band >= 0) publish(WatchKind::FpsBand, static_cast<uint8_t>(band));
     }
 
     void Stream::update_bitrate_window(int pkt_bits, bool is_video, bool is_audio) {
         using clock = std::chrono::steady_clock;
         auto now = clock::now();
 
-        std::lock_guard<std::mutex> lk(m_mx);
-        m_bw_bits_total += pkt_bits;
-
-        auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(now - m_bw_t0).count();
-        if (ms >= 1000) {
-            const double dt = ms / 1000.0;
-            int kbps = (int)std::llround((double)m_bw_bits_total / 1000.0 / dt); // kbits/s ~ kbps
-            m_kbps = kbps;
-
-            //   V/A (  )
-            if (is_video) m_vkbps = kbps;
-            if (is_audio) m_akbps = kbps;
-
-            //   VBR/CBR:      
-            m_kbps_win_sum += kbps; m_kbps_win_cnt++;
-            if (m_kbps_win_cnt >= 6) { //  ~6
-                double mean = (double)m_kbps_win_sum / (double)m_kbps_win_cnt;
-                if (mean > 1.0 && std::abs(kbps - mean) / mean < 0.10) m_rate_mode = "CBR";
-                else m_rate_mode = "VBR";
-                m_kbps_win_sum = 0; m_kbps_win_cnt = 0;
-            }
+        m_last_byte_ms.store(steady_ms(now), std::memory_order_relaxed);
+        // без декодера кадров не будет: прогресс декода = прогресс приёма
+        if (!m_vdec) m_last_frame_ms.store(steady_ms(now), std::memory_order_relaxed);
 
-            m_bw_bits_total = 0;
-            m_bw_t0 = now;
+        bool heartbeat = false;
+        int band = -1; // >=0 — полоса kbps сменилась
+        {
+            std::lock_guard<std::mutex> lk(m_mx);
+            m_bw_bits_total += pkt_bits;
+
+            auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(now - m_bw_t0).count();
+            if (ms >= 1000) {
+                const double dt = ms / 1000.0;
+                int kbps = (int)std::llround((double)m_bw_bits_total / 1000.0 / dt); // kbits/s ~ kbps
+                m_kbps = kbps;
+
+                // упрощённое разделение V/A (последний тип пакета)
+                if (is_video) m_vkbps = kbps;
+                if (is_audio) m_akbps = kbps;
+
+                // простая эвристика VBR/CBR: считаем среднее по окну и сравниваем
+                m_kbps_win_sum += kbps; m_kbps_win_cnt++;
+                if (m_kbps_win_cnt >= 6) { // окно ~6с
+                    double mean = (double)m_kbps_win_sum / (double)m_kbps_win_cnt;
+                    if (mean > 1.0 && std::abs(kbps - mean) / mean < 0.10) m_rate_mode = "CBR";
+                    else m_rate_mode = "VBR";
+                    m_kbps_win_sum = 0; m_kbps_win_cnt = 0;
+                }
+
+                m_bw_bits_total = 0;
+                m_bw_t0 = now;
+
+                const auto snap = Settings::instance().snapshot();
+                const uint8_t b = bitrate_band(kbps, *snap);
+                if (b != m_kbps_band) { m_kbps_band = b; band = b; }
+                heartbeat = true;
+            }
+        }
+        if (band >= 0) publish(WatchKind::BitrateBand, static_cast<uint8_t>(band));
+        if (heartbeat) {
+            // окна TsTiming закрываются в этом же потоке (из tap_read), полосу проверяем с тем же шагом
+            const TsTimingSnapshot t = m_timing.snapshot();
+            const uint8_t tb = timing_band(t.valid, t.pcr_oj_ms, t.mdi_df_ms, t.mdi_mlr, *Settings::instance().snapshot());
+            if (tb != m_timing_band) {
+                m_timing_band = tb;
+                publish(WatchKind::TimingBand, tb);
+            }
+            publish(WatchKind::Heartbeat);
         }
     }
 
     void Stream::probe_program_info() {
-        //  MPEG-TS AVFormat  AVProgram'   SID/PMT/PCR/ES PID.
+        // Для MPEG-TS AVFormat формирует AVProgram'ы – заберём SID/PMT/PCR/ES PID.
         m_sid = -1; m_pmt_pid = -1; m_pcr_pid = -1; m_video_pid = -1;
         m_audio_pids.clear(); m_service_name.clear();
 
         if (!m_fmt) return;
 
-        //   active program    ( )
+        // если есть active program – возьмём её (или первую)
         AVProgram* best = nullptr;
         if (m_fmt->nb_programs > 0) best = m_fmt->programs[0];
         if (!best) return;
@@ -318,7 +986,7 @@ namespace multiscreen {
             }
         }
 
-        // service name,  
+        // service name, если доступно
         AVDictionaryEntry* e = nullptr;
         if (best->metadata && (e = av_dict_get(best->metadata, "service_name", nullptr, 0))) {
             m_service_name = e->value ? e->value : "";
@@ -2,10 +2,15 @@
 #include "Logger.h"
 #include "Settings.h"
 #include "Alerts.h"
+#include "AlertDispatcher.h"
+#include "AlertState.h"
 #include "Stream.h"
+#include "TsCapture.h"
+#include "ThreadPlacement.h"
+#include "LogRing.h"
+#include "utils/timer_wheel.hpp"
 
 #include <nlohmann/json.hpp>
-#include <httplib.h>
 
 #include <algorithm>
 #include <atomic>
@@ -18,102 +23,34 @@
 #include <utility>
 #include <vector>
 #include <climits>
+#include <limits>
 
 using json = nlohmann::json;
 using namespace std::chrono_literals;
 
 namespace multiscreen {
 
-    // ================= thresholds & webhook (settings.json) =================
+    // ================= webhook (пороги и адрес — из снимка Settings) =================
     namespace {
 
-        struct Thresholds {
-            double      fps_warn_ratio = 0.70;
-            double      fps_crit_ratio = 0.40;
-            int         bitrate_warn_kbps = 300;
-            int         bitrate_crit_kbps = 100;
-            int         stall_warn_ms = 3000;
-            int         stall_crit_ms = 7000;
-
-            bool        webhook_enabled = false;
-            std::string webhook_url;
-            int         webhook_timeout_ms = 1500;
-        };
-
-        static Thresholds load_thresholds_once() {
-            static std::once_flag once;
-            static Thresholds th;
-            std::call_once(once, [] {
-                std::ifstream f("config/settings.json");
-                if (!f.good()) return;
-                try {
-                    json j = json::object();
-                    f >> j;
-
-                    const auto tj = (j.contains("thresholds") && j["thresholds"].is_object())
-                        ? j["thresholds"] : json::object();
-                    const auto wj = (j.contains("alerts") && j["alerts"].is_object()
-                        && j["alerts"].contains("webhook") && j["alerts"]["webhook"].is_object())
-                        ? j["alerts"]["webhook"] : json::object();
-
-                    if (tj.contains("fps") && tj["fps"].is_object()) {
-                        const auto& fps = tj["fps"];
-                        if (fps.contains("warn_ratio") && fps["warn_ratio"].is_number())
-                            th.fps_warn_ratio = std::clamp(fps["warn_ratio"].get<double>(), 0.0, 1.0);
-                        if (fps.contains("crit_ratio") && fps["crit_ratio"].is_number())
-                            th.fps_crit_ratio = std::clamp(fps["crit_ratio"].get<double>(), 0.0, 1.0);
-                    }
-                    if (tj.contains("bitrate") && tj["bitrate"].is_object()) {
-                        const auto& br = tj["bitrate"];
-                        if (br.contains("warn_kbps") && br["warn_kbps"].is_number_integer())
-                            th.bitrate_warn_kbps = std::max(0, br["warn_kbps"].get<int>());
-                        if (br.contains("crit_kbps") && br["crit_kbps"].is_number_integer())
-                            th.bitrate_crit_kbps = std::max(0, br["crit_kbps"].get<int>());
-                    }
-                    if (tj.contains("stall") && tj["stall"].is_object()) {
-                        const auto& st = tj["stall"];
-                        if (st.contains("warn_ms") && st["warn_ms"].is_number_integer())
-                            th.stall_warn_ms = std::max(0, st["warn_ms"].get<int>());
-                        if (st.contains("crit_ms") && st["crit_ms"].is_number_integer())
-                            th.stall_crit_ms = std::max(0, st["crit_ms"].get<int>());
-                    }
-
-                    if (wj.contains("enabled") && wj["enabled"].is_boolean())
-                        th.webhook_enabled = wj["enabled"].get<bool>();
-                    if (wj.contains("url") && wj["url"].is_string())
-                        th.webhook_url = wj["url"].get<std::string>();
-                    if (wj.contains("timeout_ms") && wj["timeout_ms"].is_number_integer())
-                        th.webhook_timeout_ms = std::max(200, wj["timeout_ms"].get<int>());
-                }
-                catch (...) {
-                    // keep defaults
-                }
-                });
-            return th;
-        }
-
         static void send_webhook(
-            const Thresholds& th,
+            const Settings::Webhook& wh,
             const std::string& channel_name,
             const std::string& service_name,
             const std::string& new_status,
-            double input_fps, double decode_fps, int bitrate_kbps, int stall_ms /*=0*/)
+            const std::string& reason, bool flapping,
+            double input_fps, double decode_fps, int bitrate_kbps, int stall_ms /*=0*/,
+            const std::string& capture)
         {
-            if (!th.webhook_enabled || th.webhook_url.empty()) return;
-
-            static std::mutex http_mx;
-            std::lock_guard<std::mutex> lk(http_mx);
-
-            httplib::Client cli(th.webhook_url.c_str());
-            cli.set_connection_timeout(0, th.webhook_timeout_ms * 1000);
-            cli.set_read_timeout(0, th.webhook_timeout_ms * 1000);
-            cli.set_write_timeout(0, th.webhook_timeout_ms * 1000);
+            if (!wh.enabled || wh.url.empty()) return;
 
             json payload = {
                 {"event","stream_status"},
                 {"channel", channel_name},
                 {"service", service_name},
                 {"status", new_status},
+                {"reason", reason},
+                {"flapping", flapping},
                 {"metrics", {
                     {"input_fps", input_fps},
                     {"decode_fps", decode_fps},
@@ -124,17 +61,162 @@ namespace multiscreen {
                 {"ts", std::chrono::duration_cast<std::chrono::milliseconds>(
                           std::chrono::system_clock::now().time_since_epoch()).count()}
             };
-            (void)cli.Post("/", payload.dump(), "application/json");
+            // файл пишется ещё post_seconds после тревоги: путь известен сразу, готовность — по времени
+            if (!capture.empty()) {
+                payload["capture"] = { {"path", capture},
+                    {"ready_ms", payload["ts"].get<int64_t>() + IncidentCapture::instance().post_seconds() * 1000 + 2000} };
+            }
+            // не блокирует: POST выполнит поток alerts::Dispatcher
+            alerts::Dispatcher::instance().enqueue(channel_name, payload.dump());
+        }
+
+        static int64_t steady_ms() {
+            return std::chrono::duration_cast<std::chrono::milliseconds>(
+                std::chrono::steady_clock::now().time_since_epoch()).count();
+        }
+
+        // Что монитор знает о стриме: последние значения из событий и состояние таймера
+        struct Watch {
+            uint64_t uid = 0;               // Stream::uid() экземпляра, которому верим
+            double  input_fps = 0.0;
+            double  decode_fps = 0.0;
+            int     kbps = 0;
+            double  pcr_oj_ms = 0.0;        // тайминг по TS-ответвлению
+            double  mdi_df_ms = 0.0;
+            double  mdi_mlr = 0.0;
+            bool    timing = false;         // значения тайминга свежие
+            bool    timing_seen = false;    // были хоть раз: с этого момента автоматы тайминга ведутся
+            int64_t deadline_ms = 0;        // актуальный таймер в колесе (0 — нет); остальные устарели
+            bool    running = false;
+            bool    have_values = false;    // было хоть одно окно измерений; до него fps/битрейт не оцениваем
+            bool    stall_pending = false;  // stall не в ok или ждёт выдержки — heartbeat надо оценивать
+            uint8_t fps_band = 255;         // полосы на момент последней оценки
+            uint8_t kbps_band = 255;
+            uint8_t timing_band = 255;
+        };
+
+        struct WatchTimer {
+            uint32_t id = 0;
+            int64_t  deadline_ms = 0;
+        };
+
+        static uint8_t condition_bit(alerts::Condition c) noexcept {
+            return static_cast<uint8_t>(1u << static_cast<unsigned>(c));
+        }
+
+        // "fps,bitrate,stall[,flapping]" из битов WatchStatus::reasons
+        static std::string reason_string(uint8_t bits, bool with_flapping) {
+            std::string out;
+            for (auto c : { alerts::Condition::Fps, alerts::Condition::Bitrate, alerts::Condition::Stall,
+                alerts::Condition::PcrJitter, alerts::Condition::MdiDf, alerts::Condition::MdiMlr }) {
+                if (!(bits & condition_bit(c))) continue;
+                if (!out.empty()) out += ',';
+                out += alerts::to_string(c);
+            }
+            if (with_flapping && (bits & WatchStatus::kFlapping)) out += out.empty() ? "flapping" : ",flapping";
+            return out;
         }
 
     } // anonymous
 
-    // ==================  StreamManager ==================
+    // ================== реализация StreamManager ==================
 
     StreamManager::~StreamManager() {
         stopAll();
     }
 
+    std::shared_ptr<Stream> StreamManager::make_stream(uint32_t id, const std::string& name, const std::string& url) {
+        LogRing::instance().forget_stream(id); // id мог принадлежать снятому стриму
+        auto sp = std::make_shared<Stream>(name, url, id);
+        sp->set_watch_sink([this, id](WatchEvent&& ev) { ev.id = id; post_event(std::move(ev)); });
+        sp->set_job_sink([this](uint64_t job, bool ok, const std::string& msg) { finish_job(job, ok, msg); });
+        return sp;
+    }
+
+    void StreamManager::retire_unlocked(StreamHandlePtr h) {
+        if (!h) return;
+        alerts::StateEngine::instance().forget(h->id);
+        WatchEvent ev; ev.id = h->id; ev.uid = h->stream->uid(); ev.kind = WatchKind::Removed;
+        post_event(std::move(ev));
+        h->stream->retire(); // не ждём: I/O прервётся interrupt_cb, поток выйдет сам
+        m_retired.push_back(std::move(h));
+    }
+
+    void StreamManager::reap_retired() {
+        std::vector<StreamHandlePtr> done;
+        {
+            std::lock_guard<std::mutex> lk(m_mutex);
+            auto it = std::partition(m_retired.begin(), m_retired.end(),
+                [](const StreamHandlePtr& h) { return !h->stream->finished(); });
+            std::move(it, m_retired.end(), std::back_inserter(done));
+            m_retired.erase(it, m_retired.end());
+        }
+        // поток завершён — id можно отдавать новому стриму; старые снимки ещё могут держать запись, это безопасно
+        for (const auto& h : done) m_reg.release_id(h->id);
+    }
+
+    static int64_t wall_ms() {
+        return std::chrono::duration_cast<std::chrono::milliseconds>(
+            std::chrono::system_clock::now().time_since_epoch()).count();
+    }
+
+    uint64_t StreamManager::submit(const std::string& name, StreamCommand cmd) {
+        const auto h = m_reg.find(name); // без замков: снимок реестра
+        if (!h) return 0;
+
+        StreamJob job;
+        job.stream = name;
+        job.action = cmd == StreamCommand::Start ? "start" : cmd == StreamCommand::Stop ? "stop" : "restart";
+        job.state = "queued";
+        job.created_ms = wall_ms();
+        {
+            std::lock_guard<std::mutex> lk(m_jobs_mx);
+            job.id = m_next_job++;
+            m_jobs.push_back(job);
+            constexpr size_t kJobsKept = 256;
+            while (m_jobs.size() > kJobsKept) m_jobs.pop_front();
+        }
+        h->stream->post(cmd, job.id); // результат придёт в finish_job из потока стрима
+        return job.id;
+    }
+
+    void StreamManager::finish_job(uint64_t id, bool ok, const std::string& msg) {
+        std::lock_guard<std::mutex> lk(m_jobs_mx);
+        for (auto it = m_jobs.rbegin(); it != m_jobs.rend(); ++it) {
+            if (it->id != id) continue;
+            it->state = ok ? "done" : "failed";
+            it->message = msg;
+            it->finished_ms = wall_ms();
+            return;
+        }
+    }
+
+    std::vector<StreamJob> StreamManager::getJobs() const {
+        std::lock_guard<std::mutex> lk(m_jobs_mx);
+        return std::vector<StreamJob>(m_jobs.rbegin(), m_jobs.rend());
+    }
+
+    bool StreamManager::getJob(uint64_t id, StreamJob& out) const {
+        std::lock_guard<std::mutex> lk(m_jobs_mx);
+        for (auto it = m_jobs.rbegin(); it != m_jobs.rend(); ++it) {
+            if (it->id == id) { out = *it; return true; }
+        }
+        return false;
+    }
+
+    void StreamManager::post_event(WatchEvent&& ev) {
+        if (!m_events.try_push(std::move(ev))) {
+            // очередь полна: теряем событие, следующий heartbeat пересчитает полосы
+            m_events_dropped.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+        {
+            std::lock_guard<std::mutex> lk(m_ev_mx);
+            m_ev_pending = true;
+        }
+        m_ev_cv.notify_one();
+    }
+
     bool StreamManager::loadConfig(const std::string& jsonPath) {
         std::ifstream f(jsonPath, std::ios::binary);
         if (!f) {
@@ -176,39 +258,31 @@ namespace multiscreen {
 
     void StreamManager::loadFromList(const std::vector<std::pair<std::string, std::string>>& lst) {
         std::lock_guard<std::mutex> lk(m_mutex);
+        auto old = m_reg.reset(lst, [this](uint32_t id, const std::string& n, const std::string& u) {
+            return make_stream(id, n, u);
+            });
+        for (auto& h : old) retire_unlocked(std::move(h));
+    }
 
-        for (auto& kv : m_streams) {
-            if (kv.second) kv.second->stop();
-        }
-        m_streams.clear();
-        m_wd.clear();
-
-        for (const auto& p : lst) {
-            const std::string& name = p.first;
-            const std::string& url = p.second;
-
-            auto sp = std::make_shared<Stream>(name, url);
-            m_streams[name] = sp;
+    size_t StreamManager::size() const {
+        return m_reg.size();
+    }
 
-            m_wd[name] = WDState{};
-            m_wd[name].last_status = "ok";
-            m_wd[name].last_cc = 0;
-            m_wd[name].last_cc_t = std::chrono::steady_clock::now();
-        }
+    uint32_t StreamManager::streamId(const std::string& name) const {
+        auto h = m_reg.find(name);
+        return h ? h->id : kNoStream;
     }
 
-    size_t StreamManager::size() const {
-        std::lock_guard<std::mutex> lk(m_mutex);
-        return m_streams.size();
+    std::string StreamManager::streamName(uint32_t id) const {
+        auto h = m_reg.find(id);
+        return h ? h->name : std::string();
     }
 
     void StreamManager::startAll() {
-        {
-            std::lock_guard<std::mutex> lk(m_mutex);
-            for (auto& kv : m_streams) {
-                if (kv.second) kv.second->start();
-            }
-        }
+        // post() не блокирует
+        const auto snap = m_reg.snapshot();
+        for (const auto& h : snap->list) h->stream->start();
+
         if (!m_mon_run.load()) {
             m_mon_run = true;
             if (m_mon.joinable()) m_mon.join();
@@ -217,155 +291,272 @@ namespace multiscreen {
     }
 
     void StreamManager::stopAll() {
-        m_mon_run = false;
+        {
+            std::lock_guard<std::mutex> lk(m_ev_mx);
+            m_mon_run = false;
+        }
+        m_ev_cv.notify_one();
         if (m_mon.joinable()) m_mon.join();
 
-        std::lock_guard<std::mutex> lk(m_mutex);
-        for (auto& kv : m_streams) {
-            if (kv.second) kv.second->stop();
+        // команды всем сразу, ждём уже вне замка — стримы гасятся параллельно
+        const auto snap = m_reg.snapshot();
+        for (const auto& h : snap->list) h->stream->post(StreamCommand::Stop);
+        std::vector<StreamHandlePtr> retired;
+        {
+            std::lock_guard<std::mutex> lk(m_mutex);
+            retired.swap(m_retired);
         }
+        for (const auto& h : snap->list) h->stream->wait_idle();
+        for (const auto& h : retired) m_reg.release_id(h->id);
     }
 
     bool StreamManager::addStream(const std::string& name, const std::string& url) {
         std::lock_guard<std::mutex> lk(m_mutex);
-
-        auto it = m_streams.find(name);
-        if (it != m_streams.end()) {
-            if (it->second) it->second->stop();
-            it->second.reset();
-        }
-
-        auto sp = std::make_shared<Stream>(name, url);
-        m_streams[name] = sp;
-
-        m_wd[name] = WDState{};
-        m_wd[name].last_status = "ok";
-        m_wd[name].last_cc = 0;
-        m_wd[name].last_cc_t = std::chrono::steady_clock::now();
-
-        sp->start();
+        StreamHandlePtr replaced;
+        auto h = m_reg.insert(name, url, [this](uint32_t id, const std::string& n, const std::string& u) {
+            return make_stream(id, n, u);
+            }, &replaced);
+        retire_unlocked(std::move(replaced));
+        h->stream->start();
         return true;
     }
 
     bool StreamManager::addStream(const std::string& name, const std::string& url, const std::string& /*decoder*/) {
-        std::lock_guard<std::mutex> lk(m_mutex);
-
-        auto it = m_streams.find(name);
-        if (it != m_streams.end()) {
-            if (it->second) it->second->stop();
-            it->second.reset();
-        }
-
-        auto sp = std::make_shared<Stream>(name, url);
-        m_streams[name] = sp;
-
-        m_wd[name] = WDState{};
-        m_wd[name].last_status = "ok";
-        m_wd[name].last_cc = 0;
-        m_wd[name].last_cc_t = std::chrono::steady_clock::now();
-
-        sp->start();
-        return true;
+        return addStream(name, url);
     }
 
     bool StreamManager::removeStream(const std::string& name) {
         std::lock_guard<std::mutex> lk(m_mutex);
-        auto it = m_streams.find(name);
-        if (it == m_streams.end()) return false;
-        if (it->second) it->second->stop();
-        m_streams.erase(it);
-        m_wd.erase(name);
+        auto h = m_reg.erase(name);
+        if (!h) return false;
+        retire_unlocked(std::move(h));
         return true;
     }
 
-    bool StreamManager::startStream(const std::string& name) {
-        std::lock_guard<std::mutex> lk(m_mutex);
-        auto it = m_streams.find(name);
-        if (it == m_streams.end() || !it->second) return false;
-        it->second->start();
-        return true;
+    uint64_t StreamManager::startStream(const std::string& name) {
+        return submit(name, StreamCommand::Start);
     }
 
-    bool StreamManager::stopStream(const std::string& name) {
-        std::lock_guard<std::mutex> lk(m_mutex);
-        auto it = m_streams.find(name);
-        if (it == m_streams.end() || !it->second) return false;
-        it->second->stop();
-        return true;
+    uint64_t StreamManager::stopStream(const std::string& name) {
+        return submit(name, StreamCommand::Stop);
     }
 
-    bool StreamManager::restartStream(const std::string& name) {
-        std::lock_guard<std::mutex> lk(m_mutex);
-        auto it = m_streams.find(name);
-        if (it == m_streams.end() || !it->second) return false;
-        it->second->stop();
-        it->second->start();
-        return true;
+    uint64_t StreamManager::restartStream(const std::string& name) {
+        return submit(name, StreamCommand::Restart);
     }
 
     std::vector<StreamStats> StreamManager::getAllStats() {
+        // стабильный снимок дескрипторов: ни замка менеджера, ни поиска по именам
+        const auto snap = m_reg.snapshot();
         std::vector<StreamStats> out;
-        std::lock_guard<std::mutex> lk(m_mutex);
-        out.reserve(m_streams.size());
-        for (auto& kv : m_streams) {
-            auto s = kv.second->stats();
-            auto wd_it = m_wd.find(kv.first);
-            if (wd_it != m_wd.end()) {
-                s.status = wd_it->second.last_status;
-            }
+        out.reserve(snap->list.size());
+        for (const auto& h : snap->list) {
+            auto s = h->stream->stats();
+            s.status = alerts::to_string(static_cast<alerts::Level>(h->wd.level.load(std::memory_order_relaxed)));
+            s.status_reason = reason_string(h->wd.reasons.load(std::memory_order_relaxed), true);
             out.push_back(std::move(s));
         }
         return out;
     }
 
-    void StreamManager::monitor_loop() {
-        const Thresholds TH = load_thresholds_once();
+    bool StreamManager::getTr101290(const std::string& name, Tr101290Report& out) const {
+        const auto h = m_reg.find(name);
+        if (!h) return false;
+        out = h->stream->tr101290();
+        return true;
+    }
 
-        while (m_mon_run.load()) {
-            std::vector<std::pair<std::string, StreamStats>> stats;
-            {
-                std::lock_guard<std::mutex> lk(m_mutex);
-                stats.reserve(m_streams.size());
-                for (auto& kv : m_streams) {
-                    if (!kv.second) continue;
-                    stats.emplace_back(kv.first, kv.second->stats());
-                }
-            }
+    bool StreamManager::captureStream(const std::string& name, std::string& path) {
+        const auto h = m_reg.find(name);
+        if (!h) return false;
+        path = h->stream->capture("manual", true);
+        return true;
+    }
 
-            for (auto& it : stats) {
-                const std::string& name = it.first;
-                const StreamStats& st = it.second;
+    std::shared_ptr<TsFanout> StreamManager::liveFeed(const std::string& name) const {
+        const auto h = m_reg.find(name);
+        return h ? h->stream->fanout() : nullptr;
+    }
 
-                double input_fps = st.input_fps;  if (input_fps < 0.0) input_fps = 0.0;
-                double decode_fps = st.decode_fps; if (decode_fps < 0.0) decode_fps = 0.0;
+    std::shared_ptr<HlsPreview> StreamManager::preview(const std::string& name) const {
+        const auto h = m_reg.find(name);
+        return h ? h->stream->preview() : nullptr;
+    }
 
-                int bitrate = static_cast<int>(st.bitrate_kbps);
-                if (bitrate < 0) bitrate = 0;
+    void StreamManager::monitor_loop() {
+        // Вместо опроса всех стримов раз в 300 мс: оцениваем стрим только когда пришло его событие
+        // (смена полосы, старт/стоп, heartbeat с активным stall) или сработал его таймер
+        // (выдержка автомата, конец флаппинга, граница stall). Остальное время поток спит.
+        // Всё адресуется числовым id из реестра: таблица по индексу, без строк и хешей имён.
+        ThreadPlacement::Scope placement(ThreadRole::Control, "watchdog");
+        std::vector<Watch> watches;
+        util::TimerWheel<WatchTimer> wheel(10, steady_ms());
+        auto& eng = alerts::StateEngine::instance();
+
+        auto evaluate = [&](uint32_t id, Watch& w, int64_t now_ms) {
+            // запись реестра для этого экземпляра; если стрим пересоздан/удалён — событие запоздало
+            const auto h = m_reg.find(id);
+            if (!h || h->stream->uid() != w.uid) return;
+
+            const auto snap = Settings::instance().snapshot();
+            const auto& TH = snap->thresholds;
+
+            // прогресс читаем из атомарных меток стрима, а не из событий: мёртвый источник событий не шлёт
+            const int64_t progress_ms = h->stream->progress_ms();
+            const int stall_ms = (w.running && progress_ms > 0)
+                ? static_cast<int>(std::clamp<int64_t>(now_ms - progress_ms, 0, INT_MAX)) : 0;
+            const double ratio = (w.input_fps > 0.0001) ? w.decode_fps / w.input_fps : 1.0;
+
+            // тайминг: больше — хуже; нулевой порог не проверяется; без свежих данных значение 0,
+            // чтобы автомат вышел из тревоги обычным путём
+            auto timing = [&](alerts::Condition c, double v, double warn, double crit) {
+                if (!w.timing_seen || (warn <= 0.0 && crit <= 0.0)) return alerts::Transition{};
+                return eng.evaluate(id, c, w.timing ? v : 0.0, warn > 0.0 ? warn : crit,
+                    crit > 0.0 ? crit : std::numeric_limits<double>::infinity(), false, now_ms);
+            };
 
-                int stall_ms = 0; // real stall field can be wired later
+            const alerts::Transition tr[] = {
+                w.have_values ? eng.evaluate(id, alerts::Condition::Fps, ratio, TH.fps.warn_ratio, TH.fps.crit_ratio, true, now_ms)
+                              : alerts::Transition{},
+                w.have_values ? eng.evaluate(id, alerts::Condition::Bitrate, w.kbps, TH.bitrate.warn_kbps, TH.bitrate.crit_kbps, true, now_ms)
+                              : alerts::Transition{},
+                eng.evaluate(id, alerts::Condition::Stall, stall_ms, TH.stall.warn_ms, TH.stall.crit_ms, false, now_ms),
+                timing(alerts::Condition::PcrJitter, w.pcr_oj_ms, TH.pcr_jitter.warn_ms, TH.pcr_jitter.crit_ms),
+                timing(alerts::Condition::MdiDf, w.mdi_df_ms, TH.mdi.df_warn_ms, TH.mdi.df_crit_ms),
+                timing(alerts::Condition::MdiMlr, w.mdi_mlr, TH.mdi.mlr_warn, TH.mdi.mlr_crit)
+            };
+            const alerts::Condition conds[] = { alerts::Condition::Fps, alerts::Condition::Bitrate, alerts::Condition::Stall,
+                alerts::Condition::PcrJitter, alerts::Condition::MdiDf, alerts::Condition::MdiMlr };
+
+            w.fps_band = fps_band(w.input_fps, w.decode_fps, *snap);
+            w.kbps_band = bitrate_band(w.kbps, *snap);
+            w.timing_band = timing_band(w.timing, w.pcr_oj_ms, w.mdi_df_ms, w.mdi_mlr, *snap);
+            w.stall_pending = tr[2].level != alerts::Level::Ok || tr[2].recheck_at_ms != 0;
+
+            alerts::Level worst = alerts::Level::Ok;
+            bool notify = false, flap_started = false, flapping = false;
+            uint8_t reasons = 0;
+            for (size_t i = 0; i < std::size(tr); ++i) {
+                if (tr[i].level > worst) worst = tr[i].level;
+                if (tr[i].level != alerts::Level::Ok) reasons |= condition_bit(conds[i]);
+                notify = notify || tr[i].notify;
+                flapping = flapping || tr[i].flapping;
+                flap_started = flap_started || (tr[i].notify && tr[i].flapping);
+            }
+            if (flapping) reasons |= WatchStatus::kFlapping;
+
+            // монитор — единственный писатель WatchStatus, поэтому хватает relaxed
+            auto& wd = h->wd;
+            wd.level.store(static_cast<uint8_t>(worst), std::memory_order_relaxed);
+            wd.reasons.store(reasons, std::memory_order_relaxed);
+            // уведомляем о смене общего статуса, если её подтвердил автомат (не флаппинг)
+            if (flap_started || (notify && wd.notified.load(std::memory_order_relaxed) != static_cast<uint8_t>(worst))) {
+                const uint8_t prev = wd.notified.exchange(static_cast<uint8_t>(worst), std::memory_order_relaxed);
+                Logger::log(worst == alerts::Level::Ok ? LogLevel::Info : LogLevel::Warning, h->id, logcode::Watchdog,
+                    h->name + ": status " + alerts::to_string(worst) + (reasons ? " (" + reason_string(reasons, true) + ")" : std::string()));
+                // статус вырос до warn/crit: окно TS до тревоги и следующие секунды — в файл
+                std::string capture;
+                if (worst != alerts::Level::Ok && static_cast<uint8_t>(worst) > prev)
+                    capture = h->stream->capture(alerts::to_string(worst), worst == alerts::Level::Crit);
+                send_webhook(snap->webhook, h->name, h->stream->stats().service_name, alerts::to_string(worst),
+                    reason_string(reasons, false), flapping, w.input_fps, w.decode_fps, w.kbps, stall_ms, capture);
+            }
 
-                double ratio = 1.0;
-                if (input_fps > 0.0001) ratio = decode_fps / input_fps;
+            // следующий момент, когда оценка может дать другой результат
+            int64_t next = 0;
+            auto consider = [&](int64_t t) {
+                if (t <= 0) return;
+                if (t <= now_ms) t = now_ms + 1;
+                if (next == 0 || t < next) next = t;
+            };
+            for (const auto& t : tr) consider(t.recheck_at_ms);
+            if (w.running && progress_ms > 0) {
+                // таймер на границе stall: если прогресс был, оценка просто передвинет его вперёд
+                if (stall_ms < TH.stall.warn_ms) consider(progress_ms + TH.stall.warn_ms + 1);
+                else if (stall_ms < TH.stall.crit_ms) consider(progress_ms + TH.stall.crit_ms + 1);
+            }
+            // уже стоящий более ранний таймер сам перепланирует; иначе ставим новый, старый станет устаревшим
+            if (next != 0 && (w.deadline_ms == 0 || next < w.deadline_ms)) {
+                w.deadline_ms = next;
+                wheel.schedule(next, WatchTimer{ id, next });
+            }
+        };
 
-                std::string status = "ok";
-                if (ratio <= TH.fps_crit_ratio || bitrate <= TH.bitrate_crit_kbps || stall_ms >= TH.stall_crit_ms) {
-                    status = "crit";
-                }
-                else if (ratio <= TH.fps_warn_ratio || bitrate <= TH.bitrate_warn_kbps || stall_ms >= TH.stall_warn_ms) {
-                    status = "warn";
-                }
+        auto apply = [&](const WatchEvent& ev, int64_t now_ms) {
+            if (ev.id >= watches.size()) {
+                if (ev.kind != WatchKind::Started) return;
+                watches.resize(static_cast<size_t>(ev.id) + 1);
+            }
+            Watch& w = watches[ev.id];
+            if (ev.kind == WatchKind::Started && w.uid != ev.uid) {
+                w = Watch{};               // id отдан новому экземпляру
+                w.uid = ev.uid;
+            }
+            // запоздавшие события уже удалённого/пересозданного экземпляра
+            if (w.uid == 0 || w.uid != ev.uid) return;
 
-                {
-                    std::lock_guard<std::mutex> lk(m_mutex);
-                    auto& wd = m_wd[name];
-                    if (wd.last_status != status) {
-                        wd.last_status = status;
-                        send_webhook(TH, st.name, st.service_name, status, input_fps, decode_fps, bitrate, stall_ms);
-                    }
+            if (ev.kind == WatchKind::Removed) {
+                w = Watch{};
+                return;
+            }
+            if (ev.kind == WatchKind::Stopped) {
+                // остановлен вручную: не алертим, автоматы и таймеры сбрасываем
+                w = Watch{};
+                w.uid = ev.uid;
+                eng.forget(ev.id);
+                if (const auto h = m_reg.find(ev.id); h && h->stream->uid() == ev.uid) {
+                    h->wd.level.store(0, std::memory_order_relaxed);
+                    h->wd.reasons.store(0, std::memory_order_relaxed);
+                    h->wd.notified.store(0, std::memory_order_relaxed);
                 }
+                return;
+            }
+
+            w.running = true;
+            if (ev.kind != WatchKind::Started) {
+                // в Started значения от прошлого запуска: ждём первое окно измерений
+                w.input_fps = std::max(0.0, ev.input_fps);
+                w.decode_fps = std::max(0.0, ev.decode_fps);
+                w.kbps = std::max(0, ev.kbps);
+                w.have_values = true;
+                w.timing = ev.timing;
+                w.pcr_oj_ms = ev.pcr_oj_ms;
+                w.mdi_df_ms = ev.mdi_df_ms;
+                w.mdi_mlr = ev.mdi_mlr;
+                w.timing_seen = w.timing_seen || ev.timing;
             }
 
-            std::this_thread::sleep_for(300ms);
+            if (ev.kind == WatchKind::Heartbeat && !w.stall_pending) {
+                // полосы пересчитываем сами: так ловим и потерянные события, и смену порогов в Settings
+                const auto snap = Settings::instance().snapshot();
+                if (fps_band(w.input_fps, w.decode_fps, *snap) == w.fps_band &&
+                    bitrate_band(w.kbps, *snap) == w.kbps_band &&
+                    timing_band(w.timing, w.pcr_oj_ms, w.mdi_df_ms, w.mdi_mlr, *snap) == w.timing_band) return;
+            }
+            evaluate(ev.id, w, now_ms);
+        };
+
+        while (m_mon_run.load()) {
+            const int64_t now_ms = steady_ms();
+
+            while (auto ev = m_events.try_pop()) apply(*ev, now_ms);
+            reap_retired();
+
+            wheel.advance(now_ms, [&](WatchTimer& t) {
+                if (t.id >= watches.size()) return;
+                Watch& w = watches[t.id];
+                if (w.deadline_ms != t.deadline_ms) return; // ленивая отмена
+                w.deadline_ms = 0;
+                evaluate(t.id, w, now_ms);
+            });
+
+            // спим до ближайшего таймера; событие будит раньше
+            const int64_t next = wheel.size() ? wheel.next_expiry_ms() : now_ms + 1000;
+            const int64_t wait_ms = std::clamp<int64_t>(next - steady_ms(), 1, 1000);
+            std::unique_lock<std::mutex> lk(m_ev_mx);
+            m_ev_cv.wait_for(lk, std::chrono::milliseconds(wait_ms),
+                [this] { return m_ev_pending || !m_mon_run.load(); });
+            m_ev_pending = false;
         }
     }
 
@@ -0,0 +1,117 @@
+#include "StreamRegistry.h"
+
+#include <algorithm>
+
+namespace multiscreen {
+
+    StreamRegistry::StreamRegistry()
+        : m_snap(std::make_shared<const Snapshot>()) {
+    }
+
+    StreamHandlePtr StreamRegistry::find(const std::string& name) const {
+        const auto snap = snapshot();
+        auto it = snap->by_name.find(name);
+        return it != snap->by_name.end() ? it->second : nullptr;
+    }
+
+    StreamHandlePtr StreamRegistry::find(uint32_t id) const {
+        const auto snap = snapshot();
+        return id < snap->by_id.size() ? snap->by_id[id] : nullptr;
+    }
+
+    uint32_t StreamRegistry::alloc_id_unlocked() {
+        if (!m_free_ids.empty()) {
+            // наименьший свободный — таблицы по id остаются плотными
+            auto it = std::min_element(m_free_ids.begin(), m_free_ids.end());
+            const uint32_t id = *it;
+            *it = m_free_ids.back();
+            m_free_ids.pop_back();
+            return id;
+        }
+        return m_next_id++;
+    }
+
+    void StreamRegistry::release_id(uint32_t id) {
+        std::lock_guard<std::mutex> lk(m_write_mx);
+        m_free_ids.push_back(id);
+    }
+
+    void StreamRegistry::publish_unlocked(std::shared_ptr<Snapshot> next) {
+        next->version = snapshot()->version + 1;
+        m_snap.store(std::move(next), std::memory_order_release);
+    }
+
+    StreamHandlePtr StreamRegistry::insert(const std::string& name, const std::string& url, const Factory& make, StreamHandlePtr* replaced) {
+        std::lock_guard<std::mutex> lk(m_write_mx);
+        auto next = std::make_shared<Snapshot>(*snapshot());
+
+        auto h = std::make_shared<StreamHandle>();
+        h->id = alloc_id_unlocked();
+        h->name = name;
+        h->stream = make(h->id, name, url);
+        StreamHandlePtr hp = h;
+
+        auto it = next->by_name.find(name);
+        if (it != next->by_name.end()) {
+            // замена на месте: порядок в списке сохраняется
+            if (replaced) *replaced = it->second;
+            std::replace(next->list.begin(), next->list.end(), it->second, hp);
+            next->by_id[it->second->id] = nullptr;
+            it->second = hp;
+        }
+        else {
+            next->list.push_back(hp);
+            next->by_name.emplace(name, hp);
+        }
+        if (next->by_id.size() <= hp->id) next->by_id.resize(hp->id + 1);
+        next->by_id[hp->id] = hp;
+
+        publish_unlocked(std::move(next));
+        return hp;
+    }
+
+    StreamHandlePtr StreamRegistry::erase(const std::string& name) {
+        std::lock_guard<std::mutex> lk(m_write_mx);
+        const auto cur = snapshot();
+        auto it = cur->by_name.find(name);
+        if (it == cur->by_name.end()) return nullptr;
+        StreamHandlePtr old = it->second;
+
+        auto next = std::make_shared<Snapshot>(*cur);
+        next->by_name.erase(name);
+        next->list.erase(std::remove(next->list.begin(), next->list.end(), old), next->list.end());
+        next->by_id[old->id] = nullptr;
+
+        publish_unlocked(std::move(next));
+        return old;
+    }
+
+    std::vector<StreamHandlePtr> StreamRegistry::reset(const std::vector<std::pair<std::string, std::string>>& items, const Factory& make) {
+        std::lock_guard<std::mutex> lk(m_write_mx);
+        std::vector<StreamHandlePtr> old = snapshot()->list;
+
+        // дубликаты имён в конфиге: как и раньше, выигрывает последний
+        std::unordered_map<std::string, size_t> last;
+        for (size_t i = 0; i < items.size(); ++i) last[items[i].first] = i;
+
+        auto next = std::make_shared<Snapshot>();
+        next->list.reserve(last.size());
+        for (size_t i = 0; i < items.size(); ++i) {
+            const std::string& name = items[i].first;
+            if (last[name] != i) continue;
+            auto h = std::make_shared<StreamHandle>();
+            h->id = alloc_id_unlocked();
+            h->name = name;
+            h->stream = make(h->id, name, items[i].second);
+            StreamHandlePtr hp = h;
+            next->list.push_back(hp);
+            next->by_name.emplace(name, hp);
+            if (next->by_id.size() <= hp->id) next->by_id.resize(hp->id + 1);
+            next->by_id[hp->id] = hp;
+        }
+
+        publish_unlocked(std::move(next));
+        return old;
+    }
+
+} // namespace multiscreen
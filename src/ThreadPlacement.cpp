@@ -0,0 +1,435 @@
+#include "ThreadPlacement.h"
+#include "Logger.h"
+
+#include <algorithm>
+#include <cctype>
+#include <cmath>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <sstream>
+#include <thread>
+
+#if defined(_WIN32)
+#include <Windows.h>
+#elif defined(__linux__)
+#include <pthread.h>
+#include <sched.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+using json = nlohmann::json;
+namespace fs = std::filesystem;
+
+namespace multiscreen {
+    namespace {
+        constexpr int kMaxCpu = 1024;          // предел cpu_set_t; дальше не закрепляем
+        constexpr size_t kMaxThreadName = 15;  // pthread: 16 байт вместе с '\0'
+
+        // "0-3,8,10-11" -> {0,1,2,3,8,10,11}
+        std::vector<int> parse_cpu_list(const std::string& s) {
+            std::vector<int> out;
+            std::stringstream ss(s);
+            std::string part;
+            while (std::getline(ss, part, ',')) {
+                part.erase(std::remove_if(part.begin(), part.end(), [](unsigned char c) { return std::isspace(c); }), part.end());
+                if (part.empty()) continue;
+                try {
+                    const auto dash = part.find('-');
+                    int lo = std::stoi(part.substr(0, dash));
+                    int hi = dash == std::string::npos ? lo : std::stoi(part.substr(dash + 1));
+                    if (lo > hi) std::swap(lo, hi);
+                    for (int c = std::max(0, lo); c <= std::min(hi, kMaxCpu - 1); ++c) out.push_back(c);
+                }
+                catch (...) {
+                    Logger::warning("cpu: bad cpu list item '" + part + "'");
+                }
+            }
+            std::sort(out.begin(), out.end());
+            out.erase(std::unique(out.begin(), out.end()), out.end());
+            return out;
+        }
+
+        // Строка "0-3,8" или массив чисел
+        std::vector<int> read_cpu_set(const json& v) {
+            if (v.is_string()) return parse_cpu_list(v.get<std::string>());
+            std::vector<int> out;
+            if (v.is_array()) {
+                for (const auto& x : v)
+                    if (x.is_number_integer() && x.get<int>() >= 0 && x.get<int>() < kMaxCpu) out.push_back(x.get<int>());
+                std::sort(out.begin(), out.end());
+                out.erase(std::unique(out.begin(), out.end()), out.end());
+            }
+            return out;
+        }
+
+        std::string format_cpu_list(const std::vector<int>& cpus) {
+            std::string out;
+            for (size_t i = 0; i < cpus.size();) {
+                size_t j = i;
+                while (j + 1 < cpus.size() && cpus[j + 1] == cpus[j] + 1) ++j;
+                if (!out.empty()) out += ',';
+                out += std::to_string(cpus[i]);
+                if (j > i) out += '-' + std::to_string(cpus[j]);
+                i = j + 1;
+            }
+            return out;
+        }
+
+        std::vector<int> intersect(const std::vector<int>& a, const std::vector<int>& b) {
+            std::vector<int> out;
+            std::set_intersection(a.begin(), a.end(), b.begin(), b.end(), std::back_inserter(out));
+            return out;
+        }
+
+        std::string read_first_line(const fs::path& p) {
+            std::ifstream f(p);
+            std::string line;
+            if (f) std::getline(f, line);
+            return line;
+        }
+
+        uint64_t current_tid() {
+#if defined(_WIN32)
+            return GetCurrentThreadId();
+#elif defined(__linux__)
+            return static_cast<uint64_t>(::syscall(SYS_gettid));
+#else
+            return std::hash<std::thread::id>{}(std::this_thread::get_id());
+#endif
+        }
+
+        void set_current_name(const std::string& name) {
+            const std::string n = name.substr(0, kMaxThreadName);
+#if defined(_WIN32)
+            // SetThreadDescription есть начиная с Windows 10 1607
+            const int len = MultiByteToWideChar(CP_UTF8, 0, n.c_str(), -1, nullptr, 0);
+            if (len > 0) {
+                std::wstring w(static_cast<size_t>(len), L'\0');
+                MultiByteToWideChar(CP_UTF8, 0, n.c_str(), -1, w.data(), len);
+                SetThreadDescription(GetCurrentThread(), w.c_str());
+            }
+#elif defined(__linux__)
+            pthread_setname_np(pthread_self(), n.c_str());
+#else
+            (void)n;
+#endif
+        }
+
+        std::string current_name() {
+#if defined(__linux__)
+            char buf[kMaxThreadName + 1] = {};
+            if (pthread_getname_np(pthread_self(), buf, sizeof(buf)) == 0) return buf;
+#endif
+            return {};
+        }
+
+        bool set_current_cpus(const std::vector<int>& cpus) {
+            if (cpus.empty()) return false;
+#if defined(_WIN32)
+            DWORD_PTR mask = 0;
+            for (int c : cpus) if (c < 64) mask |= (DWORD_PTR(1) << c);   // только группа 0
+            return mask && SetThreadAffinityMask(GetCurrentThread(), mask) != 0;
+#elif defined(__linux__)
+            cpu_set_t set;
+            CPU_ZERO(&set);
+            for (int c : cpus) CPU_SET(c, &set);
+            return pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0;
+#else
+            return false;
+#endif
+        }
+
+        std::vector<int> current_cpus() {
+            std::vector<int> out;
+#if defined(__linux__)
+            cpu_set_t set;
+            CPU_ZERO(&set);
+            if (pthread_getaffinity_np(pthread_self(), sizeof(set), &set) == 0)
+                for (int c = 0; c < kMaxCpu; ++c) if (CPU_ISSET(c, &set)) out.push_back(c);
+#endif
+            return out;
+        }
+
+#if defined(__linux__)
+        // Путь cgroup v2 процесса ("0::/system.slice/x.service") -> каталог в /sys/fs/cgroup
+        fs::path cgroup_v2_dir() {
+            std::ifstream f("/proc/self/cgroup");
+            std::string line;
+            while (std::getline(f, line)) {
+                if (line.rfind("0::", 0) == 0) return fs::path("/sys/fs/cgroup") / fs::path(line.substr(3)).relative_path();
+            }
+            return {};
+        }
+
+        // Снимок потока из /proc/self/task/<tid>: имя, разрешённые CPU, последний CPU, переключения контекста
+        json task_info(const fs::path& dir) {
+            json t;
+            t["tid"] = std::stoull(dir.filename().string());
+            t["name"] = read_first_line(dir / "comm");
+
+            std::ifstream st(dir / "status");
+            std::string line;
+            long long vol = 0, nonvol = 0;
+            while (std::getline(st, line)) {
+                auto val = [&line]() {
+                    auto p = line.find(':');
+                    auto v = line.substr(p + 1);
+                    v.erase(0, v.find_first_not_of(" \t"));
+                    return v;
+                    };
+                if (line.rfind("Cpus_allowed_list:", 0) == 0) t["cpus_allowed"] = val();
+                else if (line.rfind("voluntary_ctxt_switches:", 0) == 0) vol = std::atoll(val().c_str());
+                else if (line.rfind("nonvoluntary_ctxt_switches:", 0) == 0) nonvol = std::atoll(val().c_str());
+            }
+            t["ctx_switches"] = { {"voluntary", vol}, {"involuntary", nonvol} };
+
+            // stat: поле 39 — CPU, на котором поток исполнялся последним; comm может содержать пробелы
+            const std::string stat = read_first_line(dir / "stat");
+            const auto rp = stat.rfind(')');
+            if (rp != std::string::npos) {
+                std::istringstream is(stat.substr(rp + 2));
+                std::string field;
+                for (int i = 3; i <= 39 && (is >> field); ++i) {
+                    if (i == 39) t["last_cpu"] = std::atoi(field.c_str());
+                }
+            }
+            return t;
+        }
+#endif
+    } // anonymous
+
+    const char* to_string(ThreadRole r) noexcept {
+        switch (r) {
+        case ThreadRole::Ingest:  return "ingest";
+        case ThreadRole::Decode:  return "decode";
+        case ThreadRole::Control: return "control";
+        case ThreadRole::Web:     return "web";
+        }
+        return "?";
+    }
+
+    ThreadPlacement& ThreadPlacement::instance() {
+        static ThreadPlacement p;
+        return p;
+    }
+
+    ThreadPlacement::ThreadPlacement() {
+        probe_system();
+    }
+
+    void ThreadPlacement::probe_system() {
+        m_online = static_cast<int>(std::max(1u, std::thread::hardware_concurrency()));
+#if defined(_WIN32)
+        DWORD_PTR proc = 0, sys = 0;
+        if (GetProcessAffinityMask(GetCurrentProcess(), &proc, &sys))
+            for (int c = 0; c < 64; ++c) if (proc & (DWORD_PTR(1) << c)) m_allowed.push_back(c);
+#elif defined(__linux__)
+        m_online = static_cast<int>(std::max(1L, ::sysconf(_SC_NPROCESSORS_CONF)));
+
+        // affinity процесса уже сужена cpuset'ом контейнера/юнита
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        if (sched_getaffinity(0, sizeof(set), &set) == 0)
+            for (int c = 0; c < kMaxCpu; ++c) if (CPU_ISSET(c, &set)) m_allowed.push_back(c);
+
+        // cgroup v2, затем v1
+        const fs::path v2 = cgroup_v2_dir();
+        std::error_code ec;
+        if (!v2.empty() && fs::exists(v2 / "cpu.max", ec)) {
+            m_cgroup_cpuset = read_first_line(v2 / "cpuset.cpus.effective");
+            std::istringstream is(read_first_line(v2 / "cpu.max"));
+            std::string quota; long long period = 0;
+            if ((is >> quota >> period) && quota != "max" && period > 0)
+                m_quota_cpus = std::atof(quota.c_str()) / static_cast<double>(period);
+        }
+        else {
+            m_cgroup_cpuset = read_first_line("/sys/fs/cgroup/cpuset/cpuset.effective_cpus");
+            const long long quota = std::atoll(read_first_line("/sys/fs/cgroup/cpu/cpu.cfs_quota_us").c_str());
+            const long long period = std::atoll(read_first_line("/sys/fs/cgroup/cpu/cpu.cfs_period_us").c_str());
+            if (quota > 0 && period > 0) m_quota_cpus = static_cast<double>(quota) / static_cast<double>(period);
+        }
+#endif
+        if (m_allowed.empty())
+            for (int c = 0; c < m_online; ++c) m_allowed.push_back(c);
+    }
+
+    void ThreadPlacement::configure(const json& cpu) {
+        std::lock_guard<std::mutex> lk(m_mx);
+        for (auto& p : m_profiles) p.clear();
+        m_decode_threads = 1;
+        m_web_threads = 0;
+        m_name_threads = true;
+
+        if (cpu.is_object()) {
+            for (size_t i = 0; i < kThreadRoleCount; ++i) {
+                const char* key = to_string(static_cast<ThreadRole>(i));
+                if (cpu.contains(key)) m_profiles[i] = read_cpu_set(cpu[key]);
+            }
+            if (cpu.contains("decode_threads") && cpu["decode_threads"].is_number_integer())
+                m_decode_threads = std::clamp(cpu["decode_threads"].get<int>(), 0, 64);
+            if (cpu.contains("web_threads") && cpu["web_threads"].is_number_integer())
+                m_web_threads = std::clamp(cpu["web_threads"].get<int>(), 0, 256);
+            if (cpu.contains("name_threads") && cpu["name_threads"].is_boolean())
+                m_name_threads = cpu["name_threads"].get<bool>();
+        }
+
+        std::string msg = "cpu: allowed " + format_cpu_list(m_allowed) + " of " + std::to_string(m_online);
+        if (!m_cgroup_cpuset.empty()) msg += ", cgroup cpuset " + m_cgroup_cpuset;
+        if (m_quota_cpus > 0) msg += ", cgroup quota " + std::to_string(m_quota_cpus) + " cpu";
+        Logger::info(msg);
+
+        for (size_t i = 0; i < kThreadRoleCount; ++i) {
+            const auto& want = m_profiles[i];
+            if (want.empty()) continue;
+            const auto eff = intersect(want, m_allowed);
+            const char* role = to_string(static_cast<ThreadRole>(i));
+            if (eff.empty())
+                Logger::warning(std::string("cpu: ") + role + " set " + format_cpu_list(want) + " is outside allowed CPUs; threads will float");
+            else if (eff.size() != want.size())
+                Logger::warning(std::string("cpu: ") + role + " set trimmed to " + format_cpu_list(eff));
+            else
+                Logger::info(std::string("cpu: ") + role + " -> " + format_cpu_list(eff));
+        }
+    }
+
+    std::vector<int> ThreadPlacement::effective_set_unlocked(ThreadRole role) const {
+        const auto& want = m_profiles[static_cast<size_t>(role)];
+        return want.empty() ? std::vector<int>{} : intersect(want, m_allowed);
+    }
+
+    size_t ThreadPlacement::effective_cpus() const {
+        std::lock_guard<std::mutex> lk(m_mx);
+        size_t n = m_allowed.size();
+        if (m_quota_cpus > 0) n = std::min(n, static_cast<size_t>(std::ceil(m_quota_cpus)));
+        return std::max<size_t>(1, n);
+    }
+
+    int ThreadPlacement::decode_threads() const {
+        std::unique_lock<std::mutex> lk(m_mx);
+        if (m_decode_threads > 0) return m_decode_threads;
+        const size_t set = effective_set_unlocked(ThreadRole::Decode).size();
+        lk.unlock();
+        // 0 = авто: по набору decode (или по доступным CPU), но не больше 8 на декодер
+        return static_cast<int>(std::clamp<size_t>(set ? set : effective_cpus(), 1, 8));
+    }
+
+    int ThreadPlacement::web_threads() const {
+        std::unique_lock<std::mutex> lk(m_mx);
+        if (m_web_threads > 0) return m_web_threads;
+        const size_t set = effective_set_unlocked(ThreadRole::Web).size();
+        lk.unlock();
+        return static_cast<int>(std::clamp<size_t>(set ? set : effective_cpus(), 2, 8));
+    }
+
+    void ThreadPlacement::bind_current(ThreadRole role, const std::string& name) {
+        Entry e;
+        e.name = name.substr(0, kMaxThreadName);
+        e.role = role;
+        bool name_threads;
+        {
+            std::lock_guard<std::mutex> lk(m_mx);
+            e.cpus = effective_set_unlocked(role);
+            name_threads = m_name_threads;
+        }
+        if (name_threads) set_current_name(e.name);
+        e.pinned = set_current_cpus(e.cpus);
+        if (!e.cpus.empty() && !e.pinned)
+            Logger::warning("cpu: failed to pin thread '" + e.name + "' to " + format_cpu_list(e.cpus));
+
+        const uint64_t tid = current_tid();
+        std::lock_guard<std::mutex> lk(m_mx);
+        m_threads[tid] = std::move(e);
+    }
+
+    void ThreadPlacement::unbind_current() {
+        const uint64_t tid = current_tid();
+        std::lock_guard<std::mutex> lk(m_mx);
+        m_threads.erase(tid);
+    }
+
+    ThreadPlacement::DecodeSpawn::DecodeSpawn(const std::string& name) {
+#if defined(__linux__)
+        auto& tp = instance();
+        std::vector<int> cpus;
+        bool name_threads;
+        {
+            std::lock_guard<std::mutex> lk(tp.m_mx);
+            cpus = tp.effective_set_unlocked(ThreadRole::Decode);
+            name_threads = tp.m_name_threads;
+        }
+        if (name_threads) {
+            m_saved_name = current_name();
+            set_current_name(name);
+        }
+        if (!cpus.empty()) {
+            m_saved_cpus = current_cpus();
+            set_current_cpus(cpus);
+        }
+        m_active = true;
+#else
+        (void)name;
+#endif
+    }
+
+    ThreadPlacement::DecodeSpawn::~DecodeSpawn() {
+        if (!m_active) return;
+        if (!m_saved_name.empty()) set_current_name(m_saved_name);
+        if (!m_saved_cpus.empty()) set_current_cpus(m_saved_cpus);
+    }
+
+    json ThreadPlacement::report() const {
+        json out;
+        std::unordered_map<uint64_t, Entry> known;
+        {
+            std::lock_guard<std::mutex> lk(m_mx);
+            json profiles = json::object();
+            for (size_t i = 0; i < kThreadRoleCount; ++i) {
+                const auto role = static_cast<ThreadRole>(i);
+                profiles[to_string(role)] = {
+                    {"configured", format_cpu_list(m_profiles[i])},
+                    {"effective", format_cpu_list(effective_set_unlocked(role))}
+                };
+            }
+            out["profiles"] = std::move(profiles);
+            out["system"] = {
+                {"online", m_online},
+                {"allowed", format_cpu_list(m_allowed)},
+                {"cgroup_cpuset", m_cgroup_cpuset},
+                {"cgroup_quota_cpus", m_quota_cpus}
+            };
+            known = m_threads;
+        }
+        out["system"]["effective_cpus"] = effective_cpus();
+        out["sizing"] = { {"decode_threads", decode_threads()}, {"web_threads", web_threads()} };
+
+        json threads = json::array();
+#if defined(__linux__)
+        // Все потоки процесса, включая не зарегистрированные (FFmpeg, httplib до первой задачи)
+        std::error_code ec;
+        for (const auto& d : fs::directory_iterator("/proc/self/task", ec)) {
+            json t;
+            try { t = task_info(d.path()); }
+            catch (...) { continue; }   // поток успел завершиться
+            auto it = known.find(t["tid"].get<uint64_t>());
+            if (it != known.end()) {
+                t["role"] = to_string(it->second.role);
+                t["requested"] = format_cpu_list(it->second.cpus);
+                t["pinned"] = it->second.pinned;
+            }
+            threads.push_back(std::move(t));
+        }
+#else
+        for (const auto& [tid, e] : known) {
+            threads.push_back({
+                {"tid", tid}, {"name", e.name}, {"role", to_string(e.role)},
+                {"requested", format_cpu_list(e.cpus)}, {"pinned", e.pinned}
+                });
+        }
+#endif
+        out["threads"] = std::move(threads);
+        return out;
+    }
+
+} // namespace multiscreen
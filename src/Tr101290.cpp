@@ -0,0 +1,544 @@
+#include "Tr101290.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+
+namespace multiscreen {
+    namespace {
+        constexpr size_t   kPsiMax = 1024;                 // PAT/PMT/CAT/NIT/SDT: section_length <= 1021
+        constexpr size_t   kSiMax = 4096;                  // EIT: до 4093
+        constexpr size_t   kSectionPool = kPsiMax * (Tr101290::kMaxPmt + 5) + kSiMax;
+        constexpr int64_t  kPcrWrap = (int64_t(1) << 33) * 300;
+        constexpr int64_t  kTickMs = 20;                   // проверки сроков — не чаще
+        constexpr int64_t  kPublishMs = 100;
+        constexpr int64_t  kCbrHoldMs = 2000;              // null-пакеты были недавно — мультиплекс CBR
+
+        std::mutex g_limits_mx;
+        TrLimits   g_limits;
+
+        // CRC-32/MPEG-2: полином 0x04C11DB7, без отражения; по всей секции вместе с CRC даёт 0
+        constexpr std::array<uint32_t, 256> make_crc_table() {
+            std::array<uint32_t, 256> t{};
+            for (uint32_t i = 0; i < 256; ++i) {
+                uint32_t c = i << 24;
+                for (int k = 0; k < 8; ++k) c = (c & 0x80000000u) ? (c << 1) ^ 0x04C11DB7u : (c << 1);
+                t[i] = c;
+            }
+            return t;
+        }
+        constexpr auto kCrcTable = make_crc_table();
+
+        uint32_t crc32_mpeg(const uint8_t* p, size_t n) noexcept {
+            uint32_t c = 0xFFFFFFFFu;
+            for (size_t i = 0; i < n; ++i) c = (c << 8) ^ kCrcTable[(c >> 24) ^ p[i]];
+            return c;
+        }
+
+        inline uint16_t be16(const uint8_t* p) noexcept { return static_cast<uint16_t>((p[0] << 8) | p[1]); }
+        inline uint32_t be32(const uint8_t* p) noexcept {
+            return (uint32_t(p[0]) << 24) | (uint32_t(p[1]) << 16) | (uint32_t(p[2]) << 8) | p[3];
+        }
+
+        inline size_t idx(TrCheck c) noexcept { return static_cast<size_t>(c); }
+
+        // индикаторы, которые взводятся отсутствием чего-либо дольше срока
+        constexpr TrCheck kTimed[] = { TrCheck::Pat, TrCheck::Pmt, TrCheck::Pid, TrCheck::PcrRepetition, TrCheck::Pts };
+
+        int period_of(const TrLimits& l, TrCheck c) noexcept {
+            switch (c) {
+            case TrCheck::Pat:           return l.pat_ms;
+            case TrCheck::Pmt:           return l.pmt_ms;
+            case TrCheck::Pid:           return l.pid_ms;
+            case TrCheck::PcrRepetition: return l.pcr_repetition_ms;
+            case TrCheck::Pts:           return l.pts_ms;
+            default:                     return 0;
+            }
+        }
+
+        int64_t unix_offset_ms() noexcept {
+            using namespace std::chrono;
+            return duration_cast<milliseconds>(system_clock::now().time_since_epoch()).count() -
+                duration_cast<milliseconds>(steady_clock::now().time_since_epoch()).count();
+        }
+
+        TrIndicators to_unix(TrIndicators ind, int64_t offset) noexcept {
+            for (auto& x : ind) if (x.last_ms) x.last_ms += offset;
+            return ind;
+        }
+    } // anonymous
+
+    const char* to_string(TrCheck c) noexcept {
+        switch (c) {
+        case TrCheck::TsSyncLoss:       return "ts_sync_loss";
+        case TrCheck::SyncByte:         return "sync_byte_error";
+        case TrCheck::Pat:              return "pat_error";
+        case TrCheck::Cc:               return "cc_error";
+        case TrCheck::Pmt:              return "pmt_error";
+        case TrCheck::Pid:              return "pid_error";
+        case TrCheck::Transport:        return "transport_error";
+        case TrCheck::Crc:              return "crc_error";
+        case TrCheck::PcrRepetition:    return "pcr_repetition_error";
+        case TrCheck::PcrDiscontinuity: return "pcr_discontinuity_error";
+        case TrCheck::PcrAccuracy:      return "pcr_accuracy_error";
+        case TrCheck::Pts:              return "pts_error";
+        case TrCheck::Count:            break;
+        }
+        return "unknown";
+    }
+
+    int priority(TrCheck c) noexcept {
+        return c <= TrCheck::Pid ? 1 : 2;
+    }
+
+    void Tr101290::set_limits(const TrLimits& l) {
+        std::lock_guard<std::mutex> lk(g_limits_mx);
+        g_limits = l;
+    }
+
+    TrLimits Tr101290::limits() {
+        std::lock_guard<std::mutex> lk(g_limits_mx);
+        return g_limits;
+    }
+
+    Tr101290::Tr101290() : m_lim(limits()), m_section_mem(new uint8_t[kSectionPool]) {
+        Slot* pat = track(0x0000);
+        pat->kind = kPat;
+        attach_section(*pat, kPsiMax);
+        // SI DVB: проверяется только CRC (CAT, NIT, SDT/BAT, EIT, TOT)
+        const std::pair<uint16_t, size_t> si[] = { {0x0001, kPsiMax}, {0x0010, kPsiMax}, {0x0011, kPsiMax},
+            {0x0012, kSiMax}, {0x0014, kPsiMax} };
+        for (const auto& [pid, cap] : si) {
+            Slot* s = track(pid);
+            s->kind = kSi;
+            attach_section(*s, static_cast<uint16_t>(cap));
+        }
+    }
+
+    Tr101290::Slot* Tr101290::track(uint16_t pid) noexcept {
+        pid &= TsScanner::kPids - 1;
+        if (const uint8_t i = m_slot_of[pid]) return &m_slots[i - 1];
+        if (m_nslots == kMaxTracked) {
+            ++m_untracked;
+            return nullptr;
+        }
+        Slot& s = m_slots[m_nslots++];
+        s = Slot{};
+        s.pid = pid;
+        m_slot_of[pid] = static_cast<uint8_t>(m_nslots);
+        return &s;
+    }
+
+    void Tr101290::attach_section(Slot& s, uint16_t cap) noexcept {
+        if (s.section >= 0 || m_nsections == m_sections.size() || m_section_used + cap > kSectionPool) return;
+        Section& sec = m_sections[m_nsections];
+        sec.buf = m_section_mem.get() + m_section_used;
+        sec.cap = cap;
+        s.section = static_cast<int16_t>(m_nsections++);
+        m_section_used += cap;
+    }
+
+    void Tr101290::restart() noexcept {
+        m_lim = limits();
+        for (size_t i = 0; i < m_nslots; ++i) {
+            Slot& s = m_slots[i];
+            s.kind &= (kPat | kSi);   // состав программ узнаем из нового PAT
+            s.es = kEsUnknown;
+            s.version = -1;
+            s.crc = 0;
+            s.pcr_valid = false;
+            s.pcr_rate = 0.0;
+            s.due.fill(0);
+        }
+        for (size_t i = 0; i < m_nsections; ++i) {
+            m_sections[i].have = 0;
+            m_sections[i].active = false;
+        }
+        m_started = false;
+        m_in_sync = false;
+        m_good_run = 0;
+        m_null_ms = 0;
+        publish();
+    }
+
+    void Tr101290::raise(Slot* s, TrCheck c, int64_t now) noexcept {
+        TrIndicator& t = m_total[idx(c)];
+        ++t.count;
+        t.last_ms = now;
+        if (s) {
+            TrIndicator& x = s->ind[idx(c)];
+            ++x.count;
+            x.last_ms = now;
+        }
+    }
+
+    // Очередное появление: просрочка с прошлого раза — ошибка, затем новый срок
+    void Tr101290::seen(Slot& s, TrCheck c, int64_t now, int period_ms) noexcept {
+        int64_t& due = s.due[idx(c)];
+        if (due && now > due) raise(&s, c, now);
+        due = now + period_ms;
+    }
+
+    void Tr101290::on_ts_packets(const uint8_t* base, const uint32_t* keys, size_t n, int64_t now_us) noexcept {
+        const int64_t now = now_us / 1000;   // сроки TR 101 290 — в миллисекундах
+        if (!m_started) {
+            m_started = true;
+            m_slots[0].due[idx(TrCheck::Pat)] = now + m_lim.pat_ms;
+        }
+        m_good_run += static_cast<uint32_t>(n);
+        if (!m_in_sync && m_good_run >= 5) m_in_sync = true;   // захват: 5 sync byte подряд
+
+        uint64_t index = m_idx;
+        for (size_t i = 0; i < n; ++i) {
+            const uint32_t key = keys[i];
+            const uint16_t pid = static_cast<uint16_t>(key & 0x1FFF);
+            ++index;
+            const uint8_t si = m_slot_of[pid];
+            Slot* s = si ? &m_slots[si - 1] : nullptr;
+            if (key & (TsScanner::kKeyTei | TsScanner::kKeyCcError)) {
+                if (key & TsScanner::kKeyTei) {
+                    raise(s, TrCheck::Transport, now);
+                    continue;
+                }
+                raise(s, TrCheck::Cc, now);
+            }
+            if (pid == TsScanner::kNullPid) {
+                m_null_ms = now;
+                continue;
+            }
+            if (s && s->kind) packet(*s, base + i * TsScanner::kPacket, key, now, index);
+        }
+        m_idx = index;
+    }
+
+    void Tr101290::on_ts_sync_error(int64_t now_us) noexcept {
+        const int64_t now = now_us / 1000;
+        raise(nullptr, TrCheck::SyncByte, now);
+        if (m_in_sync) raise(nullptr, TrCheck::TsSyncLoss, now);
+        m_in_sync = false;
+        m_good_run = 0;
+    }
+
+    void Tr101290::on_ts_chunk(int64_t now_us) noexcept {
+        const int64_t now = now_us / 1000;
+        tick(now);
+        if (now - m_pub_ms >= kPublishMs) {
+            m_pub_ms = now;
+            publish();
+        }
+    }
+
+    void Tr101290::packet(Slot& s, const uint8_t* pkt, uint32_t key, int64_t now, uint64_t index) noexcept {
+        const uint8_t afc = static_cast<uint8_t>((key >> 17) & 0x03);
+        const bool pusi = (pkt[1] & 0x40) != 0;
+        const bool scrambled = (pkt[3] & 0xC0) != 0;
+
+        if (s.kind & kEs) seen(s, TrCheck::Pid, now, m_lim.pid_ms);
+        if (scrambled && (s.kind & kPat)) raise(&s, TrCheck::Pat, now);
+        if (scrambled && (s.kind & kPmt)) raise(&s, TrCheck::Pmt, now);
+
+        size_t off = 4;
+        if (afc & 0x2) {
+            off += 1 + size_t(pkt[4]);
+            if ((s.kind & kPcr) && pkt[4] >= 7 && (pkt[5] & 0x10)) pcr(s, pkt, key, now, index);
+        }
+        if (!(afc & 0x1) || off >= TsScanner::kPacket) return;
+
+        if (s.section >= 0 && (s.kind & (kPat | kPmt | kSi))) {
+            if (key & TsScanner::kKeyCcError) {
+                // пакет потерян — собранная часть секции недействительна
+                m_sections[s.section].active = false;
+                m_sections[s.section].have = 0;
+            }
+            section_data(s, pkt + off, TsScanner::kPacket - off, pusi, now);
+        }
+        else if ((s.kind & kEs) && pusi && !scrambled) {
+            pes_start(s, pkt + off, TsScanner::kPacket - off, now);
+        }
+    }
+
+    void Tr101290::pcr(Slot& s, const uint8_t* pkt, uint32_t key, int64_t now, uint64_t index) noexcept {
+        const uint64_t base = (uint64_t(pkt[6]) << 25) | (uint64_t(pkt[7]) << 17) | (uint64_t(pkt[8]) << 9) |
+            (uint64_t(pkt[9]) << 1) | (pkt[10] >> 7);
+        const uint64_t value = base * 300 + ((uint64_t(pkt[10] & 0x01) << 8) | pkt[11]);
+
+        seen(s, TrCheck::PcrRepetition, now, m_lim.pcr_repetition_ms);
+        if (s.pcr_valid && !(key & TsScanner::kKeyDiscontinuity)) {
+            int64_t d = int64_t(value) - int64_t(s.pcr);
+            if (d < -kPcrWrap / 2) d += kPcrWrap;
+            else if (d > kPcrWrap / 2) d -= kPcrWrap;
+            if (d < 0 || d > int64_t(m_lim.pcr_discontinuity_ms) * 27000) {
+                raise(&s, TrCheck::PcrDiscontinuity, now);
+                s.pcr_rate = 0.0;
+            }
+            else {
+                // PCR_AC: отклонение от значения, предсказанного по позиции в потоке и скорости
+                // предыдущего интервала. Осмысленно только для CBR, поэтому VBR (нет null-пакетов) не проверяем.
+                const uint64_t pk = index - s.pcr_idx;
+                const bool cbr = m_null_ms && now - m_null_ms < kCbrHoldMs;
+                if (m_lim.pcr_accuracy_ns > 0 && cbr && s.pcr_rate > 0.0 && pk) {
+                    const double err_ns = (double(d) - double(pk) * s.pcr_rate) * (1000.0 / 27.0);
+                    if (std::fabs(err_ns) > m_lim.pcr_accuracy_ns) raise(&s, TrCheck::PcrAccuracy, now);
+                }
+                if (pk) s.pcr_rate = double(d) / double(pk);
+            }
+        }
+        else {
+            s.pcr_rate = 0.0;
+        }
+        s.pcr = value;
+        s.pcr_idx = index;
+        s.pcr_valid = true;
+    }
+
+    void Tr101290::pes_start(Slot& s, const uint8_t* p, size_t len, int64_t now) noexcept {
+        if (len < 14 || p[0] != 0x00 || p[1] != 0x00 || p[2] != 0x01) return;
+        const uint8_t sid = p[3];
+        // PTS_error — для видео и аудио; private_stream_1 (субтитры, телетекст) идут нерегулярно
+        if (sid >= 0xE0 && sid <= 0xEF) s.es = kEsVideo;
+        else if (sid >= 0xC0 && sid <= 0xDF) s.es = kEsAudio;
+        else return;
+        if ((p[6] & 0xC0) == 0x80 && (p[7] & 0x80)) seen(s, TrCheck::Pts, now, m_lim.pts_ms);
+    }
+
+    // pointer_field и несколько секций в одном пакете; хвост 0xFF — stuffing
+    void Tr101290::section_data(Slot& s, const uint8_t* p, size_t len, bool pusi, int64_t now) noexcept {
+        Section& sec = m_sections[s.section];
+        if (!pusi) {
+            if (sec.active) section_append(s, sec, p, len, now);
+            return;
+        }
+        if (len == 0) return;
+        const size_t ptr = p[0];
+        ++p;
+        --len;
+        if (ptr > len) {
+            sec.active = false;
+            sec.have = 0;
+            return;
+        }
+        if (sec.active) section_append(s, sec, p, ptr, now);   // конец предыдущей секции
+        p += ptr;
+        len -= ptr;
+        while (len > 0 && p[0] != 0xFF) {
+            sec.active = true;
+            sec.have = 0;
+            const size_t used = section_append(s, sec, p, len, now);
+            if (sec.active) return;   // продолжится в следующих пакетах
+            p += used;
+            len -= used;
+        }
+    }
+
+    size_t Tr101290::section_append(Slot& s, Section& sec, const uint8_t* p, size_t len, int64_t now) noexcept {
+        size_t used = 0;
+        while (used < len) {
+            size_t need = 3 - std::min<size_t>(sec.have, 3);   // сначала заголовок с section_length
+            size_t total = 0;
+            if (!need) {
+                total = 3 + (size_t(sec.buf[1] & 0x0F) << 8 | sec.buf[2]);
+                if (total <= 3 || total > sec.cap) {
+                    sec.active = false;
+                    sec.have = 0;
+                    return len;
+                }
+                need = total - sec.have;
+            }
+            const size_t take = std::min(need, len - used);
+            std::memcpy(sec.buf + sec.have, p + used, take);
+            sec.have = static_cast<uint16_t>(sec.have + take);
+            used += take;
+            if (total && sec.have == total) {
+                sec.active = false;
+                sec.have = 0;
+                section_done(s, sec.buf, total, now);
+                return used;
+            }
+        }
+        return used;
+    }
+
+    void Tr101290::section_done(Slot& s, const uint8_t* sec, size_t len, int64_t now) noexcept {
+        const uint8_t table_id = sec[0];
+        if ((s.kind & kPat) && table_id != 0x00) {
+            raise(&s, TrCheck::Pat, now);
+            return;
+        }
+        // CRC_32 есть у секций с section_syntax_indicator и у TOT
+        if ((sec[1] & 0x80) || table_id == 0x73) {
+            if (len < 8 || crc32_mpeg(sec, len) != 0) {
+                raise(&s, TrCheck::Crc, now);
+                return;
+            }
+        }
+        if (s.kind & kPat) {
+            seen(s, TrCheck::Pat, now, m_lim.pat_ms);
+            parse_pat(sec, len, now);
+        }
+        else if ((s.kind & kPmt) && table_id == 0x02) {
+            seen(s, TrCheck::Pmt, now, m_lim.pmt_ms);
+            parse_pmt(s, sec, len, now);
+        }
+    }
+
+    void Tr101290::parse_pat(const uint8_t* sec, size_t len, int64_t now) noexcept {
+        if (len < 12 || !(sec[5] & 0x01)) return;   // current_next_indicator = 0 — ещё не действует
+        Slot& pat = m_slots[0];
+        const int16_t version = static_cast<int16_t>((sec[5] >> 1) & 0x1F);
+        const uint32_t crc = be32(sec + len - 4);
+        if (pat.version == version && pat.crc == crc) return;
+        pat.version = version;
+        pat.crc = crc;
+
+        const uint32_t gen = ++m_gen;
+        for (size_t i = 8; i + 4 <= len - 4; i += 4) {
+            const uint16_t program = be16(sec + i);
+            const uint16_t pid = be16(sec + i + 2) & 0x1FFF;
+            if (program == 0) continue;   // network_PID
+            Slot* s = track(pid);
+            if (!s) continue;
+            if (!(s->kind & kPmt)) {
+                s->kind |= kPmt;
+                s->version = -1;
+                s->due[idx(TrCheck::Pmt)] = now + m_lim.pmt_ms;
+            }
+            s->program = program;
+            s->pat_gen = gen;
+            attach_section(*s, kPsiMax);
+        }
+
+        // программы, исчезнувшие из PAT (только для PAT из одной секции)
+        if (sec[7] != 0) return;
+        for (size_t i = 0; i < m_nslots; ++i) {
+            Slot& s = m_slots[i];
+            if (!(s.kind & kPmt) || s.pat_gen == gen) continue;
+            const uint16_t program = s.program;
+            s.kind &= ~kPmt;
+            s.due[idx(TrCheck::Pmt)] = 0;
+            for (size_t k = 0; k < m_nslots; ++k) {
+                Slot& e = m_slots[k];
+                if (e.program != program || !(e.kind & (kEs | kPcr))) continue;
+                e.kind &= ~(kEs | kPcr);
+                e.due[idx(TrCheck::Pid)] = e.due[idx(TrCheck::PcrRepetition)] = e.due[idx(TrCheck::Pts)] = 0;
+            }
+        }
+    }
+
+    void Tr101290::parse_pmt(Slot& s, const uint8_t* sec, size_t len, int64_t now) noexcept {
+        if (len < 16 || !(sec[5] & 0x01)) return;
+        const int16_t version = static_cast<int16_t>((sec[5] >> 1) & 0x1F);
+        const uint32_t crc = be32(sec + len - 4);
+        if (s.version == version && s.crc == crc) return;
+        s.version = version;
+        s.crc = crc;
+
+        const uint32_t gen = ++m_gen;
+        const uint16_t program = be16(sec + 3);
+        const uint16_t pcr_pid = be16(sec + 8) & 0x1FFF;
+        const size_t end = len - 4;
+        size_t i = 12 + (be16(sec + 10) & 0x0FFF);
+        while (i + 5 <= end) {
+            const uint16_t pid = be16(sec + i + 1) & 0x1FFF;
+            const size_t es_info = be16(sec + i + 3) & 0x0FFF;
+            if (Slot* e = track(pid)) {
+                if (!(e->kind & kEs)) {
+                    e->kind |= kEs;
+                    e->due[idx(TrCheck::Pid)] = now + m_lim.pid_ms;
+                }
+                e->program = program;
+                e->pmt_gen = gen;
+            }
+            i += 5 + es_info;
+        }
+        if (pcr_pid != TsScanner::kNullPid) {
+            if (Slot* p = track(pcr_pid)) {
+                if (!(p->kind & kPcr)) {
+                    p->kind |= kPcr;
+                    p->pcr_valid = false;
+                    p->due[idx(TrCheck::PcrRepetition)] = now + m_lim.pcr_repetition_ms;
+                }
+                p->program = program;
+                p->pmt_gen = gen;
+            }
+        }
+
+        // ES/PCR этой программы, которых больше нет в PMT
+        for (size_t k = 0; k < m_nslots; ++k) {
+            Slot& e = m_slots[k];
+            if (e.program != program || !(e.kind & (kEs | kPcr)) || e.pmt_gen == gen) continue;
+            e.kind &= ~(kEs | kPcr);
+            e.due[idx(TrCheck::Pid)] = e.due[idx(TrCheck::PcrRepetition)] = e.due[idx(TrCheck::Pts)] = 0;
+        }
+    }
+
+    void Tr101290::tick(int64_t now) noexcept {
+        if (!m_started || now - m_tick_ms < kTickMs) return;
+        m_tick_ms = now;
+        for (size_t i = 0; i < m_nslots; ++i) {
+            Slot& s = m_slots[i];
+            for (TrCheck c : kTimed) {
+                int64_t& due = s.due[idx(c)];
+                if (due && now > due) {
+                    raise(&s, c, now);
+                    due = now + period_of(m_lim, c);
+                }
+            }
+        }
+    }
+
+    void Tr101290::publish() noexcept {
+        std::lock_guard<std::mutex> lk(m_pub_mx);
+        m_pub_total = m_total;
+        for (size_t i = 0; i < m_nslots; ++i) {
+            const Slot& s = m_slots[i];
+            PubSlot& p = m_pub_slots[i];
+            p.pid = s.pid;
+            p.program = s.program;
+            p.kind = s.kind;
+            p.es = s.es;
+            p.ind = s.ind;
+        }
+        m_pub_nslots = m_nslots;
+        m_pub_untracked = m_untracked;
+        m_pub_active = m_started;
+    }
+
+    TrIndicators Tr101290::totals() const {
+        const int64_t offset = unix_offset_ms();
+        std::lock_guard<std::mutex> lk(m_pub_mx);
+        return to_unix(m_pub_total, offset);
+    }
+
+    Tr101290Report Tr101290::report() const {
+        const int64_t offset = unix_offset_ms();
+
+        Tr101290Report r;
+        std::lock_guard<std::mutex> lk(m_pub_mx);
+        r.active = m_pub_active;
+        r.total = to_unix(m_pub_total, offset);
+        r.untracked = m_pub_untracked;
+        r.pids.reserve(m_pub_nslots);
+        for (size_t i = 0; i < m_pub_nslots; ++i) {
+            const PubSlot& p = m_pub_slots[i];
+            const bool any = std::any_of(p.ind.begin(), p.ind.end(), [](const TrIndicator& x) { return x.count != 0; });
+            if (!p.kind && !any) continue;
+            TrPidReport pr;
+            pr.pid = p.pid;
+            pr.program = p.program;
+            auto add = [&pr](const char* k) {
+                if (!pr.kind.empty()) pr.kind += '+';
+                pr.kind += k;
+                };
+            if (p.kind & kPat) add("pat");
+            if (p.kind & kPmt) add("pmt");
+            if (p.kind & kSi) add("si");
+            if (p.kind & kEs) add(p.es == kEsVideo ? "video" : p.es == kEsAudio ? "audio" : "es");
+            if (p.kind & kPcr) add("pcr");
+            pr.ind = to_unix(p.ind, offset);
+            r.pids.push_back(std::move(pr));
+        }
+        return r;
+    }
+
+} // namespace multiscreen
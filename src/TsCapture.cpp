@@ -0,0 +1,379 @@
+#include "TsCapture.h"
+#include "TsFanout.h"
+#include "Logger.h"
+#include "ThreadPlacement.h"
+#include "utils/storage.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <new>
+
+namespace fs = std::filesystem;
+using namespace std::chrono_literals;
+
+namespace multiscreen {
+    namespace {
+        using util::dir_key;
+        using util::wall_ms;
+
+        // чанк неполный дольше этого — закрывается: окно и захват не ждут медленный стрим
+        constexpr int64_t kSealUs = 1000000;
+        // то же при клиентах /live: задержка раздачи при малом битрейте (окно в это время
+        // заполняется неполными чанками и покрывает меньше времени)
+        constexpr int64_t kLiveSealUs = 20000;
+        // после until_ms поток стрима ещё может закрыть последний чанк
+        constexpr int64_t kGraceMs = 1500;
+    } // anonymous
+
+    // -------- TsChunkRing: поток стрима --------
+
+    TsChunkRing::TsChunkRing(size_t window_chunks, int64_t pre_ms, size_t live_chunks)
+        : m_window(window_chunks > 0), m_count((m_window ? std::max<size_t>(window_chunks, 4) : 0) + live_chunks),
+          m_pre_ms(pre_ms) {
+        if (!m_window) return;   // только раздача: пул — при первом клиенте
+        if (!allocate()) throw std::bad_alloc();
+        m_ring.resize(m_count);
+    }
+
+    bool TsChunkRing::allocate() noexcept {
+        if (m_chunks) return true;
+        if (!m_count) return false;
+        try {
+            m_slab.reset(new uint8_t[m_count * kChunk]);
+            m_chunks.reset(new Chunk[m_count]);
+        }
+        catch (const std::bad_alloc&) {
+            m_slab.reset();
+            return false;
+        }
+        for (size_t i = 0; i < m_count; ++i) m_chunks[i].data = m_slab.get() + i * kChunk;
+        return true;
+    }
+
+    // Пул без окна опубликован раньше счётчика клиентов TsFanout (release/acquire)
+    bool TsChunkRing::live() const noexcept {
+        return m_fanout && m_fanout->m_nclients.load(std::memory_order_acquire);
+    }
+
+    uint32_t TsChunkRing::acquire() noexcept {
+        for (int attempt = 0; attempt < 2; ++attempt) {
+            for (size_t k = 0; k < m_count; ++k) {
+                const size_t i = (m_scan + k) % m_count;
+                if (m_chunks[i].refs.load(std::memory_order_acquire) != 0) continue;
+                // 0 -> 1 делает только поток стрима: остальные берут ссылки лишь на закрытые чанки
+                m_chunks[i].refs.store(1, std::memory_order_relaxed);
+                m_chunks[i].len = 0;
+                m_scan = i + 1;
+                return static_cast<uint32_t>(i);
+            }
+            // пул занят окном: самый старый чанк окна уступает место
+            std::lock_guard<std::mutex> lk(m_mx);
+            if (!m_size) break;
+            evict_front();
+        }
+        return kNone;
+    }
+
+    void TsChunkRing::evict_front() noexcept {
+        unref(m_ring[m_first]);
+        m_first = (m_first + 1) % m_count;
+        --m_size;
+    }
+
+    void TsChunkRing::seal(int64_t now_ms) noexcept {
+        if (m_cur == kNone) return;
+        const uint32_t i = m_cur;
+        m_cur = kNone;
+        Chunk& c = m_chunks[i];
+        if (!c.len) {
+            unref(i);
+            return;
+        }
+        c.last_ms = now_ms;
+        if (m_fanout) m_fanout->publish(&c);   // очереди клиентов берут свои ссылки
+        if (!m_window) {
+            unref(i);
+            return;
+        }
+        std::lock_guard<std::mutex> lk(m_mx);
+        if (m_size == m_count) evict_front();
+        m_ring[(m_first + m_size) % m_count] = i;
+        ++m_size;
+        while (m_size > 1 && m_chunks[m_ring[m_first]].last_ms < now_ms - m_pre_ms) evict_front();
+        if (m_job && !m_job->closed && c.first_ms < m_job->until_ms) {
+            c.refs.fetch_add(1, std::memory_order_relaxed);
+            m_job->pending.push_back(i);   // ёмкость m_count зарезервирована: без выделений
+        }
+    }
+
+    // пакеты копируются целиком: kChunk кратен 188
+    void TsChunkRing::on_ts_packets(const uint8_t* base, const uint32_t*, size_t n, int64_t now_us) noexcept {
+        if (!m_window && !live()) {
+            if (m_cur != kNone) {
+                unref(m_cur);
+                m_cur = kNone;
+            }
+            return;
+        }
+        size_t len = n * TsScanner::kPacket;
+        while (len) {
+            if (m_cur == kNone) {
+                m_cur = acquire();
+                if (m_cur == kNone) {
+                    m_dropped += len;
+                    return;
+                }
+                m_chunks[m_cur].first_ms = wall_ms();
+                m_open_us = now_us;
+            }
+            Chunk& c = m_chunks[m_cur];
+            const size_t take = std::min(len, kChunk - c.len);
+            std::memcpy(data(m_cur) + c.len, base, take);
+            c.len += static_cast<uint32_t>(take);
+            base += take;
+            len -= take;
+            if (c.len == kChunk) seal(wall_ms());
+        }
+    }
+
+    void TsChunkRing::on_ts_chunk(int64_t now_us) noexcept {
+        if (m_cur != kNone && now_us - m_open_us >= (live() ? kLiveSealUs : kSealUs)) seal(wall_ms());
+        m_dropped_pub.store(m_dropped, std::memory_order_relaxed);
+    }
+
+    void TsChunkRing::flush() noexcept {
+        seal(wall_ms());
+        m_dropped_pub.store(m_dropped, std::memory_order_relaxed);
+    }
+
+    // -------- IncidentCapture --------
+
+    IncidentCapture& IncidentCapture::instance() {
+        static IncidentCapture c;
+        return c;
+    }
+
+    IncidentCapture::~IncidentCapture() { stop(); }
+
+    void IncidentCapture::configure(const CaptureOptions& opts) {
+        m_opts = opts;
+        m_opts.pre_seconds = std::clamp(opts.pre_seconds, 0, 600);
+        m_opts.post_seconds = std::clamp(opts.post_seconds, 0, 600);
+        m_enabled.store(opts.enable && !opts.dir.empty() && opts.buffer_bytes >= TsChunkRing::kChunk, std::memory_order_relaxed);
+    }
+
+    void IncidentCapture::start() {
+        if (!enabled() || m_run.exchange(true)) return;
+        scan_dir();
+        m_thr = std::thread([this] { run(); });
+    }
+
+    void IncidentCapture::stop() {
+        if (!m_run.exchange(false)) return;
+        m_cv.notify_all();
+        if (m_thr.joinable()) m_thr.join();
+    }
+
+    std::shared_ptr<TsChunkRing> IncidentCapture::attach(size_t live_chunks) {
+        if (!enabled()) return nullptr;
+        try {
+            return std::make_shared<TsChunkRing>(static_cast<size_t>(m_opts.buffer_bytes / TsChunkRing::kChunk),
+                int64_t(m_opts.pre_seconds) * 1000, live_chunks);
+        }
+        catch (const std::bad_alloc&) {
+            Logger::error("capture: cannot allocate " + std::to_string(m_opts.buffer_bytes >> 20) + " MB ring");
+            return nullptr;
+        }
+    }
+
+    std::string IncidentCapture::trigger(const std::shared_ptr<TsChunkRing>& ring, const std::string& stream,
+        const std::string& reason, bool critical) {
+        if (!ring || !ring->window() || !m_run.load(std::memory_order_acquire) || (!critical && !m_opts.on_warning)) return {};
+        const int64_t now = wall_ms();
+        const int64_t until = now + int64_t(m_opts.post_seconds) * 1000;
+        std::shared_ptr<TsChunkRing::Job> job;
+        {
+            std::lock_guard<std::mutex> lk(ring->m_mx);
+            if (ring->m_job && !ring->m_job->closed) {
+                // тревога во время захвата: тот же файл, дописывается дольше
+                ring->m_job->until_ms = std::max(ring->m_job->until_ms, until);
+                return ring->m_job->path;
+            }
+            job = std::make_shared<TsChunkRing::Job>();
+            job->until_ms = until;
+            job->path = (fs::path(m_opts.dir) / dir_key(stream) / (std::to_string(now) + "_" + dir_key(reason) + ".ts")).string();
+            job->pending.reserve(ring->m_count);
+            for (size_t k = 0; k < ring->m_size; ++k) {
+                const uint32_t i = ring->m_ring[(ring->m_first + k) % ring->m_count];
+                ring->m_chunks[i].refs.fetch_add(1, std::memory_order_relaxed);
+                job->pending.push_back(i);
+            }
+            ring->m_job = job;
+            ring->m_last_path = job->path;
+        }
+        ring->m_captures.fetch_add(1, std::memory_order_relaxed);
+
+        CaptureFile f;
+        f.stream = stream;
+        f.path = job->path;
+        f.reason = reason;
+        f.trigger_ms = now;
+        {
+            std::lock_guard<std::mutex> lk(m_mx);
+            m_new.push_back({ ring, job });
+            m_files.push_back(std::move(f));
+        }
+        m_cv.notify_one();
+        Logger::info("capture: " + stream + ": " + reason + " -> " + job->path);
+        return job->path;
+    }
+
+    void IncidentCapture::scan_dir() {
+        std::error_code ec;
+        fs::recursive_directory_iterator it(m_opts.dir, ec), end;
+        std::vector<CaptureFile> found;
+        for (; !ec && it != end; it.increment(ec)) {
+            if (!it->is_regular_file(ec) || it->path().extension() != ".ts") continue;
+            const std::string stem = it->path().stem().string();
+            CaptureFile f;
+            f.path = it->path().string();
+            f.stream = it->path().parent_path().filename().string();
+            f.trigger_ms = std::strtoll(stem.c_str(), nullptr, 10);
+            const auto us = stem.find('_');
+            if (us != std::string::npos) f.reason = stem.substr(us + 1);
+            f.bytes = it->file_size(ec);
+            f.complete = true;
+            if (ec) { ec.clear(); continue; }
+            found.push_back(std::move(f));
+        }
+        std::sort(found.begin(), found.end(), [](const CaptureFile& a, const CaptureFile& b) { return a.trigger_ms < b.trigger_ms; });
+        std::lock_guard<std::mutex> lk(m_mx);
+        for (auto& f : found) {
+            m_total_bytes += f.bytes;
+            m_files.push_back(std::move(f));
+        }
+        enforce_quota();
+    }
+
+    // -------- поток записи --------
+
+    void IncidentCapture::run() {
+        ThreadPlacement::Scope placement(ThreadRole::Control, "capture");
+        std::vector<Active> active;
+        for (;;) {
+            const bool running = m_run.load(std::memory_order_acquire);
+            {
+                std::lock_guard<std::mutex> lk(m_mx);
+                for (auto& a : m_new) active.push_back(std::move(a));
+                m_new.clear();
+            }
+            // при остановке захваты закрываются с тем, что уже есть
+            const int64_t now = running ? wall_ms() : INT64_MAX;
+            active.erase(std::remove_if(active.begin(), active.end(), [&](Active& a) { return pump(a, now); }), active.end());
+            if (!running) break;
+            std::unique_lock<std::mutex> lk(m_wait_mx);
+            m_cv.wait_for(lk, 100ms, [this] { return !m_run.load(std::memory_order_acquire); });
+        }
+    }
+
+    bool IncidentCapture::pump(Active& a, int64_t now_ms) {
+        TsChunkRing& ring = *a.ring;
+        TsChunkRing::Job& job = *a.job;
+        if (!a.file && !a.failed) {
+            std::error_code ec;
+            fs::create_directories(fs::path(job.path).parent_path(), ec);
+            a.file = std::fopen(job.path.c_str(), "wb");
+            if (!a.file) {
+                a.failed = true;
+                Logger::error("capture: cannot create " + job.path + ": " + std::strerror(errno));
+            }
+        }
+
+        std::vector<uint32_t> chunks;
+        bool done = false;
+        {
+            std::lock_guard<std::mutex> lk(ring.m_mx);
+            chunks.swap(job.pending);
+            job.pending.reserve(ring.m_count);
+            if (now_ms >= job.until_ms + kGraceMs) {
+                job.closed = true;
+                done = true;
+                if (ring.m_job == a.job) ring.m_job.reset();
+            }
+        }
+
+        uint64_t bytes = 0;
+        int64_t first_ms = 0;
+        for (const uint32_t i : chunks) {
+            const TsChunkRing::Chunk& c = ring.m_chunks[i];
+            if (a.file && !a.failed) {
+                if (std::fwrite(ring.data(i), 1, c.len, a.file) == c.len) {
+                    bytes += c.len;
+                    if (!first_ms) first_ms = c.first_ms;
+                }
+                else {
+                    a.failed = true;
+                    Logger::error("capture: write failed: " + job.path + ": " + std::strerror(errno));
+                }
+            }
+            ring.unref(i);
+        }
+        if (a.file && (done || !chunks.empty())) std::fflush(a.file);
+        if (done && a.file) {
+            std::fclose(a.file);
+            a.file = nullptr;
+        }
+
+        std::lock_guard<std::mutex> lk(m_mx);
+        for (auto it = m_files.rbegin(); it != m_files.rend(); ++it) {
+            if (it->path != job.path) continue;
+            if (!it->start_ms) it->start_ms = first_ms;
+            it->bytes += bytes;
+            it->complete = done;
+            break;
+        }
+        m_total_bytes += bytes;
+        if (done) enforce_quota();
+        return done;
+    }
+
+    void IncidentCapture::enforce_quota() {
+        while (m_opts.total_quota_bytes && m_total_bytes > m_opts.total_quota_bytes && !m_files.empty() && m_files.front().complete) {
+            std::error_code ec;
+            fs::remove(m_files.front().path, ec);
+            m_total_bytes -= std::min(m_total_bytes, m_files.front().bytes);
+            m_files.pop_front();
+        }
+    }
+
+    // -------- статистика --------
+
+    CaptureStats IncidentCapture::stats(const TsChunkRing& ring) const {
+        CaptureStats s;
+        s.active = true;
+        s.chunks = static_cast<uint32_t>(ring.m_count);
+        s.dropped_bytes = ring.m_dropped_pub.load(std::memory_order_relaxed);
+        s.captures = ring.m_captures.load(std::memory_order_relaxed);
+        std::lock_guard<std::mutex> lk(ring.m_mx);
+        s.ring_chunks = static_cast<uint32_t>(ring.m_size);
+        for (size_t k = 0; k < ring.m_size; ++k) s.ring_bytes += ring.m_chunks[ring.m_ring[(ring.m_first + k) % ring.m_count]].len;
+        if (ring.m_size) {
+            const auto& first = ring.m_chunks[ring.m_ring[ring.m_first]];
+            const auto& last = ring.m_chunks[ring.m_ring[(ring.m_first + ring.m_size - 1) % ring.m_count]];
+            s.ring_ms = static_cast<int>(std::max<int64_t>(0, last.last_ms - first.first_ms));
+        }
+        s.capturing = ring.m_job && !ring.m_job->closed;
+        s.last_path = ring.m_last_path;
+        return s;
+    }
+
+    std::vector<CaptureFile> IncidentCapture::files() const {
+        std::lock_guard<std::mutex> lk(m_mx);
+        return { m_files.begin(), m_files.end() };
+    }
+
+} // namespace multiscreen
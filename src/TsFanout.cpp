@@ -0,0 +1,139 @@
+#include "TsFanout.h"
+
+#include <algorithm>
+#include <chrono>
+
+namespace multiscreen {
+    namespace {
+        std::atomic<bool>   g_enable{ true };
+        std::atomic<int>    g_max_clients{ 16 };
+        std::atomic<size_t> g_queue_bytes{ 4u << 20 };
+        std::atomic<int>    g_clients{ 0 };      // по всем стримам: каждый клиент держит поток HTTP
+
+        size_t queue_chunks() noexcept {
+            return std::max<size_t>(4, g_queue_bytes.load(std::memory_order_relaxed) / TsChunkRing::kChunk);
+        }
+    } // anonymous
+
+    void TsFanout::set_defaults(bool enable, int max_clients, size_t queue_bytes) noexcept {
+        g_enable.store(enable, std::memory_order_relaxed);
+        g_max_clients.store(std::clamp(max_clients, 0, 256), std::memory_order_relaxed);
+        g_queue_bytes.store(std::clamp<size_t>(queue_bytes, 4 * TsChunkRing::kChunk, 256u << 20), std::memory_order_relaxed);
+    }
+
+    bool TsFanout::enabled() noexcept { return g_enable.load(std::memory_order_relaxed); }
+    int  TsFanout::max_clients() noexcept { return enabled() ? g_max_clients.load(std::memory_order_relaxed) : 0; }
+
+    size_t TsFanout::pool_chunks() noexcept {
+        const int clients = max_clients();
+        return clients > 0 ? queue_chunks() + static_cast<size_t>(clients) + 1 : 0;
+    }
+
+    TsFanout::TsFanout(std::shared_ptr<TsChunkRing> ring)
+        : m_ring(std::move(ring)), m_queue(queue_chunks()) {
+        // до первого пакета: поток стрима ещё не читает m_fanout
+        if (m_ring) m_ring->m_fanout = this;
+    }
+
+    TsFanout::~TsFanout() = default;
+
+    // -------- клиенты: потоки HTTP --------
+
+    TsFanout::Chunk* TsFanout::Client::wait(int timeout_ms) {
+        std::unique_lock<std::mutex> lk(m_mx);
+        m_cv.wait_for(lk, std::chrono::milliseconds(timeout_ms),
+            [this] { return m_size || m_evicted.load(std::memory_order_relaxed); });
+        if (!m_size) return nullptr;
+        Chunk* c = m_q[m_first];
+        m_first = (m_first + 1) % m_q.size();
+        --m_size;
+        return c;
+    }
+
+    std::shared_ptr<TsFanout::Client> TsFanout::subscribe() {
+        if (!enabled()) return nullptr;
+        if (g_clients.fetch_add(1) >= g_max_clients.load(std::memory_order_relaxed)) {
+            g_clients.fetch_sub(1);
+            return nullptr;
+        }
+        std::lock_guard<std::mutex> lk(m_mx);
+        if (m_closed) {
+            g_clients.fetch_sub(1);
+            return nullptr;
+        }
+        if (!m_ring || !m_ring->allocate()) {
+            g_clients.fetch_sub(1);
+            return nullptr;
+        }
+        auto c = std::make_shared<Client>();
+        c->m_q.resize(m_queue);
+        m_clients.push_back(c);
+        ++m_sessions;
+        // пул кольца опубликован раньше счётчика: поток стрима читает счётчик с acquire
+        m_nclients.store(static_cast<uint32_t>(m_clients.size()), std::memory_order_release);
+        return c;
+    }
+
+    void TsFanout::unsubscribe(const std::shared_ptr<Client>& c) {
+        if (!c) return;
+        {
+            std::lock_guard<std::mutex> lk(m_mx);
+            m_clients.erase(std::remove(m_clients.begin(), m_clients.end(), c), m_clients.end());
+            m_nclients.store(static_cast<uint32_t>(m_clients.size()), std::memory_order_release);
+        }
+        g_clients.fetch_sub(1);
+        std::lock_guard<std::mutex> lk(c->m_mx);
+        for (; c->m_size; --c->m_size, c->m_first = (c->m_first + 1) % c->m_q.size()) release(c->m_q[c->m_first]);
+    }
+
+    void TsFanout::close() {
+        std::lock_guard<std::mutex> lk(m_mx);
+        m_closed = true;
+        for (const auto& c : m_clients) {
+            std::lock_guard<std::mutex> clk(c->m_mx);
+            for (; c->m_size; --c->m_size, c->m_first = (c->m_first + 1) % c->m_q.size()) release(c->m_q[c->m_first]);
+            c->m_evicted.store(true, std::memory_order_release);
+            c->m_cv.notify_all();
+        }
+    }
+
+    // -------- поток стрима --------
+
+    void TsFanout::publish(Chunk* c) noexcept {
+        if (!m_nclients.load(std::memory_order_relaxed)) return;
+        {
+            std::lock_guard<std::mutex> lk(m_mx);
+            for (const auto& cl : m_clients) {
+                if (cl->m_evicted.load(std::memory_order_relaxed)) continue;
+                std::lock_guard<std::mutex> clk(cl->m_mx);
+                if (cl->m_size == cl->m_q.size()) {
+                    // не успевает: отключаем, чтобы не держать пул и не отдавать дыру в потоке
+                    for (; cl->m_size; --cl->m_size, cl->m_first = (cl->m_first + 1) % cl->m_q.size()) release(cl->m_q[cl->m_first]);
+                    cl->m_evicted.store(true, std::memory_order_release);
+                    m_evicted.fetch_add(1, std::memory_order_relaxed);
+                }
+                else {
+                    c->refs.fetch_add(1, std::memory_order_relaxed);
+                    cl->m_q[(cl->m_first + cl->m_size) % cl->m_q.size()] = c;
+                    ++cl->m_size;
+                }
+                cl->m_cv.notify_one();
+            }
+        }
+        m_chunks.fetch_add(1, std::memory_order_relaxed);
+        m_bytes.fetch_add(c->len, std::memory_order_relaxed);
+    }
+
+    FanoutStats TsFanout::stats() const {
+        FanoutStats s;
+        s.chunks = m_chunks.load(std::memory_order_relaxed);
+        s.bytes = m_bytes.load(std::memory_order_relaxed);
+        if (m_ring) s.dropped_bytes = m_ring->dropped();
+        s.evicted = m_evicted.load(std::memory_order_relaxed);
+        std::lock_guard<std::mutex> lk(m_mx);
+        s.clients = static_cast<uint32_t>(m_clients.size());
+        s.sessions = m_sessions;
+        return s;
+    }
+
+} // namespace multiscreen
@@ -0,0 +1,402 @@
+#include "TsScanner.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+
+#if defined(__x86_64__) || defined(_M_X64)
+#define MS_TS_X86 1
+#include <immintrin.h>
+#if defined(_MSC_VER) && !defined(__clang__)
+#include <intrin.h>
+#endif
+#endif
+
+#if defined(__GNUC__) || defined(__clang__)
+#define MS_TARGET_AVX2 __attribute__((target("avx2")))
+#else
+#define MS_TARGET_AVX2
+#endif
+
+namespace multiscreen {
+    namespace {
+        constexpr uint8_t kSync = 0x47;
+        constexpr size_t  kBatch = 64;   // пакетов на один проход извлечения
+
+        // Ключ из байтов 1..3 заголовка; см. TsScanner::ExtractFn
+        inline uint32_t make_key(const uint8_t* h) noexcept {
+            return (static_cast<uint32_t>(h[1] & 0x1F) << 8) | h[2]
+                | (static_cast<uint32_t>(h[3] & 0x0F) << 13)
+                | (static_cast<uint32_t>((h[3] >> 4) & 0x03) << 17)
+                | (static_cast<uint32_t>(h[1] >> 7) << 19);
+        }
+
+        inline unsigned first_zero(unsigned mask) noexcept {
+#if defined(_MSC_VER) && !defined(__clang__)
+            unsigned long i;
+            _BitScanForward(&i, ~mask);
+            return static_cast<unsigned>(i);
+#else
+            return static_cast<unsigned>(__builtin_ctz(~mask));
+#endif
+        }
+
+        size_t extract_scalar(const uint8_t* p, size_t n, uint32_t* keys) {
+            for (size_t i = 0; i < n; ++i) {
+                const uint8_t* h = p + i * TsScanner::kPacket;
+                if (h[0] != kSync) return i;
+                keys[i] = make_key(h);
+            }
+            return n;
+        }
+
+#if defined(MS_TS_X86)
+        // Заголовок как little-endian слово x: байт0 = sync, байт1..3 — флаги/PID/CC.
+        //   PID     = (x & 0x1F00) | ((x >> 16) & 0xFF)
+        //   CC, AFC = (x >> 11) & 0x7E000   (биты 24..29 -> 13..18)
+        //   TEI     = (x << 4) & 0x80000    (бит 15 -> 19)
+        inline __m128i key_sse2(__m128i x) noexcept {
+            const __m128i pid = _mm_or_si128(_mm_and_si128(x, _mm_set1_epi32(0x1F00)),
+                _mm_and_si128(_mm_srli_epi32(x, 16), _mm_set1_epi32(0xFF)));
+            const __m128i ccafc = _mm_and_si128(_mm_srli_epi32(x, 11), _mm_set1_epi32(0x7E000));
+            const __m128i tei = _mm_and_si128(_mm_slli_epi32(x, 4), _mm_set1_epi32(0x80000));
+            return _mm_or_si128(_mm_or_si128(pid, ccafc), tei);
+        }
+
+        inline int32_t load32(const uint8_t* p) noexcept {
+            int32_t v;
+            std::memcpy(&v, p, sizeof(v));
+            return v;
+        }
+
+        size_t extract_sse2(const uint8_t* p, size_t n, uint32_t* keys) {
+            constexpr size_t S = TsScanner::kPacket;
+            const __m128i low = _mm_set1_epi32(0xFF);
+            const __m128i sync = _mm_set1_epi32(kSync);
+            size_t i = 0;
+            for (; i + 4 <= n; i += 4) {
+                const uint8_t* b = p + i * S;
+                // в SSE2 нет gather: четыре скалярных загрузки в один регистр
+                const __m128i x = _mm_setr_epi32(load32(b), load32(b + S), load32(b + 2 * S), load32(b + 3 * S));
+                const __m128i ok = _mm_cmpeq_epi32(_mm_and_si128(x, low), sync);
+                const unsigned m = static_cast<unsigned>(_mm_movemask_ps(_mm_castsi128_ps(ok)));
+                _mm_storeu_si128(reinterpret_cast<__m128i*>(keys + i), key_sse2(x));
+                if (m != 0xF) return i + first_zero(m);
+            }
+            return i + extract_scalar(p + i * S, n - i, keys + i);
+        }
+
+        MS_TARGET_AVX2 size_t extract_avx2(const uint8_t* p, size_t n, uint32_t* keys) {
+            constexpr int S = static_cast<int>(TsScanner::kPacket);
+            const __m256i idx = _mm256_setr_epi32(0, S, 2 * S, 3 * S, 4 * S, 5 * S, 6 * S, 7 * S);
+            const __m256i low = _mm256_set1_epi32(0xFF);
+            const __m256i sync = _mm256_set1_epi32(kSync);
+            size_t i = 0;
+            for (; i + 8 <= n; i += 8) {
+                const __m256i x = _mm256_i32gather_epi32(reinterpret_cast<const int*>(p + i * S), idx, 1);
+                const __m256i ok = _mm256_cmpeq_epi32(_mm256_and_si256(x, low), sync);
+                const unsigned m = static_cast<unsigned>(_mm256_movemask_ps(_mm256_castsi256_ps(ok)));
+                const __m256i pid = _mm256_or_si256(_mm256_and_si256(x, _mm256_set1_epi32(0x1F00)),
+                    _mm256_and_si256(_mm256_srli_epi32(x, 16), low));
+                const __m256i ccafc = _mm256_and_si256(_mm256_srli_epi32(x, 11), _mm256_set1_epi32(0x7E000));
+                const __m256i tei = _mm256_and_si256(_mm256_slli_epi32(x, 4), _mm256_set1_epi32(0x80000));
+                _mm256_storeu_si256(reinterpret_cast<__m256i*>(keys + i),
+                    _mm256_or_si256(_mm256_or_si256(pid, ccafc), tei));
+                if (m != 0xFF) return i + first_zero(m);
+            }
+            return i + extract_sse2(p + i * S, n - i, keys + i);
+        }
+
+        bool cpu_has_avx2() noexcept {
+#if defined(_MSC_VER) && !defined(__clang__)
+            int r[4];
+            __cpuid(r, 0);
+            if (r[0] < 7) return false;
+            __cpuid(r, 1);
+            const bool osxsave = (r[2] & (1 << 27)) != 0, avx = (r[2] & (1 << 28)) != 0;
+            if (!osxsave || !avx || (_xgetbv(0) & 0x6) != 0x6) return false;
+            __cpuidex(r, 7, 0);
+            return (r[1] & (1 << 5)) != 0;
+#else
+            __builtin_cpu_init();
+            return __builtin_cpu_supports("avx2");
+#endif
+        }
+#endif
+
+        // Лучший набор по CPUID
+        TsScanner::Isa supported_isa() noexcept {
+#if defined(MS_TS_X86)
+            return cpu_has_avx2() ? TsScanner::Isa::Avx2 : TsScanner::Isa::Sse2;
+#else
+            return TsScanner::Isa::Scalar;
+#endif
+        }
+
+        TsScanner::ExtractFn extractor(TsScanner::Isa isa) noexcept {
+            switch (isa) {
+#if defined(MS_TS_X86)
+            case TsScanner::Isa::Avx2: return &extract_avx2;
+            case TsScanner::Isa::Sse2: return &extract_sse2;
+#endif
+            default: return &extract_scalar;
+            }
+        }
+
+        // Заголовки разнесены на 188 байт, поэтому выигрыш SIMD зависит от CPU (на части
+        // моделей gather микрокодный и медленнее скалярных загрузок). Для "auto" один раз
+        // замеряем доступные варианты на синтетическом буфере (~1 мс) и берём быстрейший;
+        // SIMD должен обогнать скалярный путь хотя бы на 10%.
+        TsScanner::Isa calibrated_isa() noexcept {
+            constexpr size_t kCal = 256;
+            static uint8_t buf[kCal * TsScanner::kPacket];
+            for (size_t i = 0; i < kCal; ++i) {
+                uint8_t* h = buf + i * TsScanner::kPacket;
+                h[0] = kSync; h[1] = 0x01; h[2] = static_cast<uint8_t>(i); h[3] = static_cast<uint8_t>(0x10 | (i & 0x0F));
+            }
+            uint32_t keys[kCal];
+            auto measure = [&](TsScanner::ExtractFn fn) {
+                using clock = std::chrono::steady_clock;
+                clock::duration best = clock::duration::max();
+                for (int round = 0; round < 5; ++round) {
+                    const auto t0 = clock::now();
+                    size_t sink = 0;
+                    for (int k = 0; k < 16; ++k) sink += fn(buf, kCal, keys);
+                    const auto dt = clock::now() - t0;
+                    if (sink == 16 * kCal && dt < best) best = dt;
+                }
+                return best;
+                };
+
+            TsScanner::Isa pick = TsScanner::Isa::Scalar;
+            auto pick_time = measure(extractor(pick));
+            const auto top = supported_isa();
+            for (auto isa : { TsScanner::Isa::Sse2, TsScanner::Isa::Avx2 }) {
+                if (isa > top) break;
+                const auto t = measure(extractor(isa));
+                if (t * 10 < pick_time * 9) { pick = isa; pick_time = t; }
+            }
+            return pick;
+        }
+
+        std::atomic<int> g_isa_forced{ -1 };   // -1 = auto
+
+        int64_t steady_now_us() noexcept {
+            using namespace std::chrono;
+            return duration_cast<microseconds>(steady_clock::now().time_since_epoch()).count();
+        }
+
+        // Счётчики прохода держим в регистрах: запись в таблицу PID не заставляет
+        // компилятор перечитывать члены объекта на каждом пакете
+        struct Tally {
+            uint64_t cc_errors = 0;
+            uint64_t tei = 0;
+            uint32_t pids = 0;
+        };
+
+        inline void update(TsPidState* pids, const uint8_t* pkt, uint32_t& key, Tally& t) noexcept {
+            const uint16_t pid = static_cast<uint16_t>(key & 0x1FFF);
+            const uint8_t  cc = static_cast<uint8_t>((key >> 13) & 0x0F);
+            const uint8_t  afc = static_cast<uint8_t>((key >> 17) & 0x03);
+
+            TsPidState& st = pids[pid];
+            if (st.packets++ == 0) ++t.pids;
+            if (key & TsScanner::kKeyTei) { ++t.tei; return; }   // заголовку битого пакета не верим
+            if (pid == TsScanner::kNullPid || afc == 0) return;
+
+            const bool disc = (afc & 0x2) && pkt[4] > 0 && (pkt[5] & 0x80);
+            if (disc) key |= TsScanner::kKeyDiscontinuity;
+            if (!(st.flags & TsScanner::kCcValid) || disc) {
+                st.last_cc = cc;
+                st.flags = TsScanner::kCcValid;
+                return;
+            }
+            if (!(afc & 0x1)) return;   // без payload CC не увеличивается
+
+            if (cc == st.last_cc) {
+                // один повтор пакета допустим (ISO/IEC 13818-1), второй подряд — ошибка
+                if (st.flags & TsScanner::kCcDup) { ++st.cc_errors; ++t.cc_errors; key |= TsScanner::kKeyCcError; }
+                st.flags |= TsScanner::kCcDup;
+                return;
+            }
+            if (cc != ((st.last_cc + 1) & 0x0F)) {
+                ++st.cc_errors;
+                ++t.cc_errors;
+                key |= TsScanner::kKeyCcError | (uint32_t((cc - st.last_cc - 1) & 0x0F) << TsScanner::kKeyCcGapShift);
+            }
+            st.last_cc = cc;
+            st.flags = TsScanner::kCcValid;
+        }
+
+    } // anonymous
+
+    const char* TsScanner::to_string(Isa isa) noexcept {
+        switch (isa) {
+        case Isa::Avx2:   return "avx2";
+        case Isa::Sse2:   return "sse2";
+        case Isa::Scalar: return "scalar";
+        }
+        return "scalar";
+    }
+
+    TsScanner::Isa TsScanner::isa() noexcept {
+        const int forced = g_isa_forced.load(std::memory_order_relaxed);
+        if (forced >= 0) {
+            static const Isa top = supported_isa();
+            return std::min(static_cast<Isa>(forced), top);
+        }
+        static const Isa calibrated = calibrated_isa();
+        return calibrated;
+    }
+
+    void TsScanner::select_isa(const std::string& name) {
+        int forced = -1;
+        if (name == "avx2") forced = static_cast<int>(Isa::Avx2);
+        else if (name == "sse2") forced = static_cast<int>(Isa::Sse2);
+        else if (name == "scalar") forced = static_cast<int>(Isa::Scalar);
+        g_isa_forced.store(forced, std::memory_order_relaxed);
+    }
+
+    TsScanner::TsScanner(Isa isa)
+        : m_isa(std::min(isa, supported_isa())), m_extract(extractor(m_isa)), m_pids(new TsPidState[kPids]) {
+    }
+
+    bool TsScanner::add_sink(TsPacketSink* sink) noexcept {
+        if (!sink || m_nsinks == kMaxSinks) return false;
+        m_sinks[m_nsinks++] = sink;
+        return true;
+    }
+
+    void TsScanner::restart() noexcept {
+        m_carry_len = 0;
+        m_locked = false;
+        for (size_t i = 0; i < kPids; ++i) m_pids[i].flags = 0;
+    }
+
+    size_t TsScanner::scan(const uint8_t* p, size_t n, int64_t now_us) noexcept {
+        uint32_t keys[kBatch];
+        TsPidState* const pids = m_pids.get();
+        const ExtractFn extract = m_extract;
+        Tally t;
+        size_t done = 0;
+        while (done < n) {
+            const size_t chunk = std::min(kBatch, n - done);
+            const uint8_t* base = p + done * kPacket;
+            const size_t ok = extract(base, chunk, keys);
+            for (size_t k = 0; k < ok; ++k) update(pids, base + k * kPacket, keys[k], t);
+            if (ok) for (size_t s = 0; s < m_nsinks; ++s) m_sinks[s]->on_ts_packets(base, keys, ok, now_us);
+            done += ok;
+            if (ok < chunk) break;
+        }
+        m_local.packets += done;
+        m_local.cc_errors += t.cc_errors;
+        m_local.tei += t.tei;
+        m_local.pids += t.pids;
+        return done;
+    }
+
+    // Кандидат в начало пакета: 0x47, подтверждённый ещё двумя (сколько уместилось в буфер)
+    size_t TsScanner::resync(const uint8_t* p, size_t len) const noexcept {
+        size_t i = 0;
+        while (i < len) {
+            const void* hit = std::memchr(p + i, kSync, len - i);
+            if (!hit) return len;
+            i = static_cast<size_t>(static_cast<const uint8_t*>(hit) - p);
+            bool ok = true;
+            for (size_t k = 1; k <= 2 && i + k * kPacket < len; ++k)
+                if (p[i + k * kPacket] != kSync) { ok = false; break; }
+            if (ok) return i;
+            ++i;
+        }
+        return len;
+    }
+
+    void TsScanner::feed(const uint8_t* data, size_t len) noexcept {
+        // время прихода нужно только анализаторам: один вызов часов на кусок
+        feed(data, len, m_nsinks ? steady_now_us() : 0);
+    }
+
+    void TsScanner::feed(const uint8_t* data, size_t len, int64_t now_us) noexcept {
+        if (!data || !len) return;
+        m_local.bytes += len;
+        size_t off = 0;
+
+        // досборка пакета, разрезанного прошлым вызовом (его sync уже проверен)
+        if (m_carry_len) {
+            const size_t take = std::min(kPacket - m_carry_len, len);
+            std::memcpy(m_carry + m_carry_len, data, take);
+            m_carry_len += take;
+            off = take;
+            if (m_carry_len < kPacket) {
+                publish();
+                chunk_done(now_us);
+                return;
+            }
+            m_carry_len = 0;
+            scan(m_carry, 1, now_us);
+        }
+
+        while (off < len) {
+            if (!m_locked) {
+                const size_t skip = resync(data + off, len - off);
+                m_local.skipped_bytes += skip;
+                off += skip;
+                if (off >= len) break;
+                m_locked = true;
+            }
+            const size_t n = (len - off) / kPacket;
+            const size_t done = scan(data + off, n, now_us);
+            off += done * kPacket;
+            if (done < n) {
+                sync_error(now_us);
+                continue;
+            }
+            const size_t rest = len - off;
+            if (rest) {
+                if (data[off] != kSync) {
+                    sync_error(now_us);
+                    continue;
+                }
+                std::memcpy(m_carry, data + off, rest);
+                m_carry_len = rest;
+            }
+            break;
+        }
+        publish();
+        chunk_done(now_us);
+    }
+
+    void TsScanner::sync_error(int64_t now_us) noexcept {
+        m_locked = false;
+        ++m_local.sync_losses;
+        for (size_t s = 0; s < m_nsinks; ++s) m_sinks[s]->on_ts_sync_error(now_us);
+    }
+
+    void TsScanner::chunk_done(int64_t now_us) noexcept {
+        for (size_t s = 0; s < m_nsinks; ++s) m_sinks[s]->on_ts_chunk(now_us);
+    }
+
+    void TsScanner::publish() noexcept {
+        // единственный писатель — достаточно relaxed store
+        m_shared.packets.store(m_local.packets, std::memory_order_relaxed);
+        m_shared.bytes.store(m_local.bytes, std::memory_order_relaxed);
+        m_shared.cc_errors.store(m_local.cc_errors, std::memory_order_relaxed);
+        m_shared.tei.store(m_local.tei, std::memory_order_relaxed);
+        m_shared.sync_losses.store(m_local.sync_losses, std::memory_order_relaxed);
+        m_shared.skipped_bytes.store(m_local.skipped_bytes, std::memory_order_relaxed);
+        m_shared.pids.store(m_local.pids, std::memory_order_relaxed);
+    }
+
+    TsScanSnapshot TsScanner::snapshot() const noexcept {
+        TsScanSnapshot s;
+        s.packets = m_shared.packets.load(std::memory_order_relaxed);
+        s.bytes = m_shared.bytes.load(std::memory_order_relaxed);
+        s.cc_errors = m_shared.cc_errors.load(std::memory_order_relaxed);
+        s.tei = m_shared.tei.load(std::memory_order_relaxed);
+        s.sync_losses = m_shared.sync_losses.load(std::memory_order_relaxed);
+        s.skipped_bytes = m_shared.skipped_bytes.load(std::memory_order_relaxed);
+        s.pids = m_shared.pids.load(std::memory_order_relaxed);
+        return s;
+    }
+
+} // namespace multiscreen
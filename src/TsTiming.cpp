@@ -0,0 +1,181 @@
+#include "TsTiming.h"
+
+#include <algorithm>
+#include <chrono>
+
+namespace multiscreen {
+    namespace {
+        constexpr int64_t kPcrWrap = (int64_t(1) << 33) * 300;
+        constexpr int64_t kPcrMaxGap = 27000000;        // дольше 1 с между PCR — разрыв шкалы
+        constexpr int64_t kPcrSwitchUs = 1000000;       // PCR выбранного PID пропал — берём другой
+        constexpr double  kEwma = 0.25;
+        constexpr double  kMaxDrift = 1e-3;             // 1000 ppm: больше — не дрейф часов
+
+        int64_t steady_now_us() noexcept {
+            using namespace std::chrono;
+            return duration_cast<microseconds>(steady_clock::now().time_since_epoch()).count();
+        }
+    } // anonymous
+
+    void TsTiming::restart() noexcept {
+        m_pcr_pid = kNoPid;
+        m_pcr_seen_us = 0;
+        m_pcr_valid = false;
+        m_bytes = 0;
+        m_chunk_bytes = 0;
+        m_rate = 0.0;
+        m_drift = 0.0;
+        m_win_t0 = 0;
+        m_win_lost = 0;
+        m_win_rate_bytes = 0;
+        m_win_rate_ticks = 0;
+        m_win_pcrs = 0;
+        m_vb_started = false;
+    }
+
+    void TsTiming::on_ts_packets(const uint8_t* base, const uint32_t* keys, size_t n, int64_t now) noexcept {
+        if (!m_win_t0) m_win_t0 = now;
+        for (size_t i = 0; i < n; ++i) {
+            const uint32_t key = keys[i];
+            if (key & TsScanner::kKeyTei) continue;   // заголовку битого пакета не верим
+            if (key & TsScanner::kKeyCcError) m_win_lost += (key & TsScanner::kKeyCcGapMask) >> TsScanner::kKeyCcGapShift;
+            if (!(key & (0x2u << 17))) continue;      // нет adaptation field
+
+            const uint8_t* pkt = base + i * TsScanner::kPacket;
+            if (pkt[4] < 7 || !(pkt[5] & 0x10)) continue;
+            const uint16_t pid = static_cast<uint16_t>(key & 0x1FFF);
+            if (pid != m_pcr_pid && m_pcr_pid != kNoPid && now - m_pcr_seen_us < kPcrSwitchUs) continue;
+
+            const uint64_t b = (uint64_t(pkt[6]) << 25) | (uint64_t(pkt[7]) << 17) | (uint64_t(pkt[8]) << 9) |
+                (uint64_t(pkt[9]) << 1) | (pkt[10] >> 7);
+            const uint64_t value = b * 300 + ((uint64_t(pkt[10] & 0x01) << 8) | pkt[11]);
+            pcr(pid, value, (key & TsScanner::kKeyDiscontinuity) != 0, m_bytes + i * TsScanner::kPacket, now);
+        }
+        m_bytes += n * TsScanner::kPacket;
+        m_chunk_bytes += static_cast<uint32_t>(n * TsScanner::kPacket);
+    }
+
+    void TsTiming::pcr(uint16_t pid, uint64_t value, bool discontinuity, uint64_t pos, int64_t now) noexcept {
+        if (pid != m_pcr_pid) {
+            m_pcr_pid = pid;
+            m_pcr_valid = false;
+        }
+        m_pcr_seen_us = now;
+
+        bool continuous = false;
+        if (m_pcr_valid && !discontinuity) {
+            int64_t d = int64_t(value) - int64_t(m_pcr);
+            if (d < -kPcrWrap / 2) d += kPcrWrap;
+            else if (d > kPcrWrap / 2) d -= kPcrWrap;
+            if (d > 0 && d <= kPcrMaxGap) {
+                continuous = true;
+                m_pcr_time += d;
+                m_win_rate_bytes += pos - m_pcr_pos;
+                m_win_rate_ticks += static_cast<uint64_t>(d);
+            }
+        }
+        if (!continuous) {
+            // новая шкала PCR: смещение относительно прихода считаем заново
+            m_pcr_time = 0;
+            m_win_pcrs = 0;
+        }
+        m_pcr = value;
+        m_pcr_pos = pos;
+        m_pcr_valid = true;
+
+        // смещение (приход - PCR) за вычетом дрейфа от первого PCR окна
+        const double offset = double(now) - double(m_pcr_time) / 27.0;
+        if (m_win_pcrs == 0) {
+            m_oj_t0 = now;
+            m_oj_first = offset;
+            m_oj_min = m_oj_max = 0.0;
+        }
+        const double adj = offset - m_oj_first - m_drift * double(now - m_oj_t0);
+        m_oj_min = std::min(m_oj_min, adj);
+        m_oj_max = std::max(m_oj_max, adj);
+        m_oj_last = offset;
+        m_oj_last_t = now;
+        ++m_win_pcrs;
+    }
+
+    void TsTiming::on_ts_sync_error(int64_t) noexcept {
+        // потерянные при поиске синхронизации байты в MLR не входят: пакеты не опознаны
+    }
+
+    void TsTiming::on_ts_chunk(int64_t now) noexcept {
+        if (m_chunk_bytes) {
+            if (m_rate > 0.0) {
+                if (!m_vb_started) {
+                    m_vb_started = true;
+                    m_vb_t0 = now;
+                    m_vb_bytes = 0.0;
+                    m_vb_min = m_vb_max = 0.0;
+                }
+                // до прихода куска и после него
+                const double pre = m_vb_bytes - m_rate * double(now - m_vb_t0);
+                m_vb_min = std::min(m_vb_min, pre);
+                m_vb_max = std::max(m_vb_max, pre + m_chunk_bytes);
+                m_vb_bytes += m_chunk_bytes;
+            }
+            m_chunk_bytes = 0;
+        }
+        if (m_win_t0 && now - m_win_t0 >= kWindowUs) close_window(now);
+    }
+
+    void TsTiming::close_window(int64_t now) noexcept {
+        const double span_us = double(now - m_win_t0);
+        Window w;
+        w.mlr = double(m_win_lost) * 1e6 / span_us;
+        if (m_vb_started && m_rate > 0.0) w.df_ms = (m_vb_max - m_vb_min) / m_rate / 1000.0;
+        if (m_win_pcrs >= 2) {
+            w.oj_ms = (m_oj_max - m_oj_min) / 1000.0;
+            const int64_t dt = m_oj_last_t - m_oj_t0;
+            if (dt >= kWindowUs / 2) {
+                const double d = std::clamp((m_oj_last - m_oj_first) / double(dt), -kMaxDrift, kMaxDrift);
+                m_drift += kEwma * (d - m_drift);
+            }
+        }
+        if (m_win_rate_ticks) {
+            const double r = double(m_win_rate_bytes) * 27.0 / double(m_win_rate_ticks);
+            m_rate = m_rate > 0.0 ? m_rate + kEwma * (r - m_rate) : r;
+        }
+
+        m_hist[m_hist_pos] = w;
+        m_hist_pos = (m_hist_pos + 1) % kHistory;
+        m_hist_n = std::min(m_hist_n + 1, kHistory);
+
+        TsTimingSnapshot s;
+        s.pcr_pid = m_pcr_pid == kNoPid ? 0 : m_pcr_pid;
+        s.media_kbps = m_rate * 8000.0;
+        s.pcr_oj_ms = w.oj_ms;
+        s.mdi_df_ms = w.df_ms;
+        s.mdi_mlr = w.mlr;
+        for (size_t i = 0; i < m_hist_n; ++i) {
+            s.pcr_oj_max_ms = std::max(s.pcr_oj_max_ms, m_hist[i].oj_ms);
+            s.mdi_df_max_ms = std::max(s.mdi_df_max_ms, m_hist[i].df_ms);
+            s.mdi_mlr_max = std::max(s.mdi_mlr_max, m_hist[i].mlr);
+        }
+        {
+            std::lock_guard<std::mutex> lk(m_pub_mx);
+            m_pub = s;
+            m_pub_us = now;
+        }
+
+        m_win_t0 = now;
+        m_win_lost = 0;
+        m_win_rate_bytes = 0;
+        m_win_rate_ticks = 0;
+        m_win_pcrs = 0;
+        m_vb_started = false;
+    }
+
+    TsTimingSnapshot TsTiming::snapshot() const {
+        const int64_t now = steady_now_us();
+        std::lock_guard<std::mutex> lk(m_pub_mx);
+        TsTimingSnapshot s = m_pub;
+        // данные перестали приходить — последние значения уже ни о чём не говорят
+        s.valid = m_pub_us && now - m_pub_us < 3 * kWindowUs;
+        return s;
+    }
+
+} // namespace multiscreen
@@ -0,0 +1,378 @@
+#include "UdpReceiver.h"
+
+#include <algorithm>
+#include <cctype>
+#include <cerrno>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+
+#if defined(__linux__)
+#include <arpa/inet.h>
+#include <ifaddrs.h>
+#include <net/if.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+#endif
+
+namespace multiscreen {
+    namespace {
+        std::atomic<int> g_default_rcvbuf{ 0 };
+
+#if defined(__linux__)
+        // метка времени ядра + счётчик отброшенного (SO_RXQ_OVFL) с запасом
+        constexpr size_t kControl = CMSG_SPACE(sizeof(timespec)) + CMSG_SPACE(sizeof(uint32_t)) + 32;
+
+        int64_t clock_us(clockid_t id) noexcept {
+            timespec ts{};
+            clock_gettime(id, &ts);
+            return int64_t(ts.tv_sec) * 1000000 + ts.tv_nsec / 1000;
+        }
+
+        bool resolve(const std::string& host, uint16_t port, int family, sockaddr_storage& out, socklen_t& len) {
+            addrinfo hints{};
+            hints.ai_family = family;
+            hints.ai_socktype = SOCK_DGRAM;
+            hints.ai_flags = AI_PASSIVE | AI_NUMERICSERV;
+            addrinfo* res = nullptr;
+            const std::string service = std::to_string(port);
+            if (getaddrinfo(host.empty() ? nullptr : host.c_str(), service.c_str(), &hints, &res) != 0 || !res) return false;
+            std::memcpy(&out, res->ai_addr, res->ai_addrlen);
+            len = static_cast<socklen_t>(res->ai_addrlen);
+            freeaddrinfo(res);
+            return true;
+        }
+
+        bool is_multicast(const sockaddr_storage& a) noexcept {
+            if (a.ss_family == AF_INET)
+                return IN_MULTICAST(ntohl(reinterpret_cast<const sockaddr_in&>(a).sin_addr.s_addr));
+            if (a.ss_family == AF_INET6)
+                return IN6_IS_ADDR_MULTICAST(&reinterpret_cast<const sockaddr_in6&>(a).sin6_addr);
+            return false;
+        }
+
+        // Адрес привязки unicast-входа, как у udp:// FFmpeg: localaddr, если это адрес того же
+        // семейства, иначе любой адрес. Хост URL для unicast — отправитель, к нему не привязываемся
+        void unicast_bind_addr(const std::string& local, int family, uint16_t port, sockaddr_storage& out, socklen_t& len) {
+            out = {};
+            if (family == AF_INET) {
+                auto& a = reinterpret_cast<sockaddr_in&>(out);
+                a.sin_family = AF_INET;
+                a.sin_port = htons(port);
+                if (local.empty() || inet_pton(AF_INET, local.c_str(), &a.sin_addr) != 1) a.sin_addr.s_addr = htonl(INADDR_ANY);
+                len = sizeof(sockaddr_in);
+            }
+            else {
+                auto& a = reinterpret_cast<sockaddr_in6&>(out);
+                a.sin6_family = AF_INET6;
+                a.sin6_port = htons(port);
+                if (local.empty() || inet_pton(AF_INET6, local.c_str(), &a.sin6_addr) != 1) a.sin6_addr = in6addr_any;
+                len = sizeof(sockaddr_in6);
+            }
+        }
+
+        // Интерфейс для join: имя ("eth1"), индекс или адрес одного из интерфейсов; 0 — выберет ядро
+        int interface_index(const std::string& local, unsigned& index) {
+            index = 0;
+            if (local.empty()) return 0;
+            if ((index = if_nametoindex(local.c_str())) != 0) return 0;
+            if (std::all_of(local.begin(), local.end(), [](unsigned char c) { return std::isdigit(c); })) {
+                index = static_cast<unsigned>(std::strtoul(local.c_str(), nullptr, 10));
+                return 0;
+            }
+            in_addr a4{};
+            in6_addr a6{};
+            const bool v4 = inet_pton(AF_INET, local.c_str(), &a4) == 1;
+            const bool v6 = !v4 && inet_pton(AF_INET6, local.c_str(), &a6) == 1;
+            if (!v4 && !v6) return -EINVAL;
+            ifaddrs* list = nullptr;
+            if (getifaddrs(&list) != 0) return -errno;
+            for (ifaddrs* i = list; i && !index; i = i->ifa_next) {
+                if (!i->ifa_addr) continue;
+                if (v4 && i->ifa_addr->sa_family == AF_INET &&
+                    reinterpret_cast<sockaddr_in*>(i->ifa_addr)->sin_addr.s_addr == a4.s_addr)
+                    index = if_nametoindex(i->ifa_name);
+                if (v6 && i->ifa_addr->sa_family == AF_INET6 &&
+                    std::memcmp(&reinterpret_cast<sockaddr_in6*>(i->ifa_addr)->sin6_addr, &a6, sizeof(a6)) == 0)
+                    index = if_nametoindex(i->ifa_name);
+            }
+            freeifaddrs(list);
+            return index ? 0 : -ENODEV;
+        }
+#endif
+    } // anonymous
+
+    bool UdpEndpoint::parse(const std::string& url, UdpEndpoint& out, std::string& err) {
+        out = UdpEndpoint{};
+        const auto sep = url.find("://");
+        if (sep == std::string::npos) { err = "no scheme"; return false; }
+        std::string rest = url.substr(sep + 3);
+        std::string query;
+        if (const auto q = rest.find('?'); q != std::string::npos) {
+            query = rest.substr(q + 1);
+            rest.resize(q);
+        }
+        if (!rest.empty() && rest.back() == '/') rest.pop_back();
+        if (!rest.empty() && rest.front() == '@') rest.erase(0, 1);
+
+        std::string port;
+        if (!rest.empty() && rest.front() == '[') {
+            const auto close = rest.find(']');
+            if (close == std::string::npos) { err = "bad IPv6 address"; return false; }
+            out.host = rest.substr(1, close - 1);
+            if (close + 1 < rest.size() && rest[close + 1] == ':') port = rest.substr(close + 2);
+        }
+        else if (const auto colon = rest.rfind(':'); colon != std::string::npos) {
+            out.host = rest.substr(0, colon);
+            port = rest.substr(colon + 1);
+        }
+        const long p = std::strtol(port.c_str(), nullptr, 10);
+        if (p <= 0 || p > 65535) { err = "bad port"; return false; }
+        out.port = static_cast<uint16_t>(p);
+
+        size_t pos = 0;
+        while (pos < query.size()) {
+            size_t amp = query.find('&', pos);
+            if (amp == std::string::npos) amp = query.size();
+            const std::string kv = query.substr(pos, amp - pos);
+            pos = amp + 1;
+            const auto eq = kv.find('=');
+            const std::string key = kv.substr(0, eq);
+            const std::string val = eq == std::string::npos ? std::string() : kv.substr(eq + 1);
+            if (key == "sources") {
+                size_t s = 0;
+                while (s <= val.size()) {
+                    size_t c = val.find(',', s);
+                    if (c == std::string::npos) c = val.size();
+                    if (c > s) out.sources.push_back(val.substr(s, c - s));
+                    s = c + 1;
+                }
+            }
+            else if (key == "localaddr") out.localaddr = val;
+            else if (key == "buffer_size") out.rcvbuf = std::max(0, std::atoi(val.c_str()));
+            else if (key == "reuse" || key == "reuse_socket") out.reuse = val.empty() || std::atoi(val.c_str()) != 0;
+        }
+        return true;
+    }
+
+    void UdpReceiver::set_default_rcvbuf(int bytes) noexcept {
+        g_default_rcvbuf.store(std::max(0, bytes), std::memory_order_relaxed);
+    }
+
+#if defined(__linux__)
+
+    bool UdpReceiver::supported() noexcept { return true; }
+
+    UdpReceiver::UdpReceiver()
+        : m_slab(new uint8_t[kBatch * kMaxDatagram]),
+          m_control(new uint8_t[kBatch * kControl]()),
+          m_msgs(new uint8_t[kBatch * (sizeof(mmsghdr) + sizeof(iovec))]()) {
+        auto* msgs = reinterpret_cast<mmsghdr*>(m_msgs.get());
+        auto* iov = reinterpret_cast<iovec*>(msgs + kBatch);
+        for (size_t i = 0; i < kBatch; ++i) {
+            iov[i].iov_base = m_slab.get() + i * kMaxDatagram;
+            iov[i].iov_len = kMaxDatagram;
+            msgs[i].msg_hdr.msg_iov = &iov[i];
+            msgs[i].msg_hdr.msg_iovlen = 1;
+        }
+    }
+
+    UdpReceiver::~UdpReceiver() {
+        close();
+    }
+
+    int UdpReceiver::open(const UdpEndpoint& ep, std::string& err) {
+        close();
+        sockaddr_storage group{};
+        socklen_t group_len = 0;
+        if (!resolve(ep.host, ep.port, ep.host.empty() ? AF_INET : AF_UNSPEC, group, group_len)) {
+            err = "cannot resolve " + ep.host;
+            return -EINVAL;
+        }
+        const bool mcast = is_multicast(group);
+        const int family = group.ss_family;
+        const int level = family == AF_INET ? IPPROTO_IP : IPPROTO_IPV6;
+
+        unsigned ifindex = 0;
+        if (mcast) {
+            if (const int rc = interface_index(ep.localaddr, ifindex); rc < 0) {
+                err = "unknown interface " + ep.localaddr;
+                return rc;
+            }
+        }
+
+        m_fd = ::socket(family, SOCK_DGRAM | SOCK_CLOEXEC, 0);
+        if (m_fd < 0) {
+            err = std::string("socket: ") + std::strerror(errno);
+            return -errno;
+        }
+        auto fail = [&](const char* what) {
+            const int e = errno;
+            err = std::string(what) + ": " + std::strerror(e);
+            close();
+            return -e;
+        };
+
+        const int one = 1;
+        if (ep.reuse) setsockopt(m_fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+        // приёмный буфер: FORCE обходит rmem_max при CAP_NET_ADMIN, иначе — в пределах rmem_max
+        if (const int want = ep.rcvbuf ? ep.rcvbuf : g_default_rcvbuf.load(std::memory_order_relaxed); want > 0) {
+            if (setsockopt(m_fd, SOL_SOCKET, SO_RCVBUFFORCE, &want, sizeof(want)) != 0)
+                setsockopt(m_fd, SOL_SOCKET, SO_RCVBUF, &want, sizeof(want));
+        }
+        int have = 0;
+        socklen_t have_len = sizeof(have);
+        getsockopt(m_fd, SOL_SOCKET, SO_RCVBUF, &have, &have_len);
+        m_shared.rcvbuf.store(have, std::memory_order_relaxed);
+        const bool ts = setsockopt(m_fd, SOL_SOCKET, SO_TIMESTAMPNS, &one, sizeof(one)) == 0;
+        m_shared.kernel_ts.store(ts, std::memory_order_relaxed);
+        setsockopt(m_fd, SOL_SOCKET, SO_RXQ_OVFL, &one, sizeof(one));
+
+        if (mcast) {
+            // только своя группа, даже если другой сокет процесса слушает тот же порт на другой
+            const int off = 0;
+            if (family == AF_INET) setsockopt(m_fd, IPPROTO_IP, IP_MULTICAST_ALL, &off, sizeof(off));
+#ifdef IPV6_MULTICAST_ALL
+            if (family == AF_INET6) setsockopt(m_fd, IPPROTO_IPV6, IPV6_MULTICAST_ALL, &off, sizeof(off));
+#endif
+        }
+
+        // multicast привязываем к адресу группы: ядро не отдаст чужие группы на этом порту
+        sockaddr_storage local{};
+        socklen_t local_len = 0;
+        if (mcast) {
+            local = group;
+            local_len = group_len;
+        }
+        else {
+            unicast_bind_addr(ep.localaddr, family, ep.port, local, local_len);
+        }
+        if (::bind(m_fd, reinterpret_cast<const sockaddr*>(&local), local_len) != 0) return fail("bind");
+
+        if (mcast) {
+            if (ep.sources.empty()) {
+                group_req req{};
+                req.gr_interface = ifindex;
+                std::memcpy(&req.gr_group, &group, group_len);
+                if (setsockopt(m_fd, level, MCAST_JOIN_GROUP, &req, sizeof(req)) != 0) return fail("join");
+            }
+            for (const auto& src : ep.sources) {
+                group_source_req req{};
+                req.gsr_interface = ifindex;
+                std::memcpy(&req.gsr_group, &group, group_len);
+                socklen_t src_len = 0;
+                if (!resolve(src, 0, family, req.gsr_source, src_len)) {
+                    err = "cannot resolve source " + src;
+                    close();
+                    return -EINVAL;
+                }
+                if (setsockopt(m_fd, level, MCAST_JOIN_SOURCE_GROUP, &req, sizeof(req)) != 0) return fail("source join");
+            }
+        }
+        return 0;
+    }
+
+    void UdpReceiver::close() noexcept {
+        if (m_fd >= 0) ::close(m_fd);   // членство в группах снимается вместе с сокетом
+        m_fd = -1;
+    }
+
+    int UdpReceiver::receive(int timeout_ms) noexcept {
+        if (m_fd < 0) return -EBADF;
+        auto* msgs = reinterpret_cast<mmsghdr*>(m_msgs.get());
+        for (size_t i = 0; i < kBatch; ++i) {
+            msgs[i].msg_hdr.msg_control = m_control.get() + i * kControl;
+            msgs[i].msg_hdr.msg_controllen = kControl;
+            msgs[i].msg_hdr.msg_flags = 0;
+        }
+        // сначала без ожидания: при очереди в сокете poll не нужен
+        int n = recvmmsg(m_fd, msgs, kBatch, MSG_DONTWAIT, nullptr);
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            pollfd pfd{ m_fd, POLLIN, 0 };
+            const int pr = poll(&pfd, 1, timeout_ms);
+            if (pr == 0 || (pr < 0 && errno == EINTR)) return 0;
+            if (pr < 0) return -errno;
+            n = recvmmsg(m_fd, msgs, kBatch, MSG_DONTWAIT, nullptr);
+        }
+        if (n < 0) return (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR) ? 0 : -errno;
+
+        // метки ядра — CLOCK_REALTIME; анализаторам нужен steady: одна поправка на пачку
+        const int64_t offset = clock_us(CLOCK_MONOTONIC) - clock_us(CLOCK_REALTIME);
+        const int64_t now = clock_us(CLOCK_MONOTONIC);
+        uint64_t bytes = 0, truncated = 0;
+        uint32_t drops = 0;
+        bool have_drops = false;
+        for (int i = 0; i < n; ++i) {
+            msghdr& h = msgs[i].msg_hdr;
+            UdpDatagram& d = m_dgrams[i];
+            d.data = m_slab.get() + size_t(i) * kMaxDatagram;
+            d.len = std::min<uint32_t>(msgs[i].msg_len, kMaxDatagram);
+            d.arrival_us = now;
+            if (h.msg_flags & MSG_TRUNC) ++truncated;
+            for (cmsghdr* c = CMSG_FIRSTHDR(&h); c; c = CMSG_NXTHDR(&h, c)) {
+                if (c->cmsg_level != SOL_SOCKET) continue;
+                if (c->cmsg_type == SCM_TIMESTAMPNS) {
+                    timespec ts;
+                    std::memcpy(&ts, CMSG_DATA(c), sizeof(ts));
+                    d.arrival_us = int64_t(ts.tv_sec) * 1000000 + ts.tv_nsec / 1000 + offset;
+                }
+                else if (c->cmsg_type == SO_RXQ_OVFL) {
+                    std::memcpy(&drops, CMSG_DATA(c), sizeof(drops));
+                    have_drops = true;
+                }
+            }
+            bytes += d.len;
+        }
+        m_shared.datagrams.fetch_add(static_cast<uint64_t>(n), std::memory_order_relaxed);
+        m_shared.bytes.fetch_add(bytes, std::memory_order_relaxed);
+        m_shared.batches.fetch_add(1, std::memory_order_relaxed);
+        if (truncated) m_shared.truncated.fetch_add(truncated, std::memory_order_relaxed);
+        if (have_drops) m_shared.kernel_drops.store(drops, std::memory_order_relaxed);   // счётчик сокета нарастающий
+        return n;
+    }
+
+    int UdpReceiver::wait_any(UdpReceiver* const* rx, size_t n, int timeout_ms) noexcept {
+        std::array<pollfd, 4> pfd{};
+        nfds_t k = 0;
+        for (size_t i = 0; i < n && k < pfd.size(); ++i)
+            if (rx[i] && rx[i]->m_fd >= 0) pfd[k++] = pollfd{ rx[i]->m_fd, POLLIN, 0 };
+        if (!k) return -EBADF;
+        const int pr = poll(pfd.data(), k, timeout_ms);
+        if (pr < 0) return errno == EINTR ? 0 : -errno;
+        return pr;
+    }
+
+#else
+
+    bool UdpReceiver::supported() noexcept { return false; }
+    UdpReceiver::UdpReceiver() = default;
+    UdpReceiver::~UdpReceiver() = default;
+
+    int UdpReceiver::open(const UdpEndpoint&, std::string& err) {
+        err = "native UDP input is not available on this platform";
+        return -ENOSYS;
+    }
+
+    void UdpReceiver::close() noexcept {}
+    int  UdpReceiver::receive(int) noexcept { return -ENOSYS; }
+    int  UdpReceiver::wait_any(UdpReceiver* const*, size_t, int) noexcept { return -ENOSYS; }
+
+#endif
+
+    UdpStats UdpReceiver::stats() const noexcept {
+        UdpStats s;
+        s.datagrams = m_shared.datagrams.load(std::memory_order_relaxed);
+        s.bytes = m_shared.bytes.load(std::memory_order_relaxed);
+        s.batches = m_shared.batches.load(std::memory_order_relaxed);
+        s.truncated = m_shared.truncated.load(std::memory_order_relaxed);
+        s.kernel_drops = m_shared.kernel_drops.load(std::memory_order_relaxed);
+        s.rcvbuf = m_shared.rcvbuf.load(std::memory_order_relaxed);
+        s.kernel_ts = m_shared.kernel_ts.load(std::memory_order_relaxed);
+        return s;
+    }
+
+} // namespace multiscreen
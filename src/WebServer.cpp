@@ -1,6 +1,16 @@
 #include "WebServer.h"
 #include "StreamManager.h"
 #include "Logger.h"
+#include "Settings.h"
+#include "AlertDispatcher.h"
+#include "AlertState.h"
+#include "ThreadPlacement.h"
+#include "LogRing.h"
+#include "FFLogRouter.h"
+#include "Recorder.h"
+#include "TsCapture.h"
+#include "TsFanout.h"
+#include "HlsPreview.h"
 #include <nlohmann/json.hpp>
 #include <httplib.h>
 #include <fstream>
@@ -9,6 +19,10 @@
 #include <string>
 #include <vector>
 #include <filesystem>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
 
 using json = nlohmann::json;
 namespace fs = std::filesystem;
@@ -24,6 +38,103 @@ namespace multiscreen {
             }
             catch (...) { return false; }
         }
+
+        // команды стримам асинхронные: сразу отдаём id задания, статус — в /api/jobs/<id>
+        std::string job_reply(uint64_t job) {
+            json j = { {"ok", job != 0} };
+            if (job) j["job"] = job;
+            return j.dump();
+        }
+
+        json job_to_json(const StreamJob& jb) {
+            return json{
+                {"id", jb.id},
+                {"stream", jb.stream},
+                {"action", jb.action},
+                {"state", jb.state},
+                {"message", jb.message},
+                {"created_ms", jb.created_ms},
+                {"finished_ms", jb.finished_ms}
+            };
+        }
+
+        // TR 101 290: индикаторы с ненулевым счётчиком {имя: {count, last_ms}}
+        json tr_indicators_json(const TrIndicators& ind) {
+            json j = json::object();
+            for (size_t i = 0; i < kTrChecks; ++i) {
+                if (!ind[i].count) continue;
+                j[to_string(static_cast<TrCheck>(i))] = { {"count", ind[i].count}, {"last_ms", ind[i].last_ms} };
+            }
+            return j;
+        }
+
+        // Сводка для списка стримов: суммы по приоритетам и время последней ошибки
+        json tr_summary_json(const TrIndicators& ind) {
+            uint64_t p[2] = { 0, 0 };
+            int64_t last = 0;
+            for (size_t i = 0; i < kTrChecks; ++i) {
+                p[priority(static_cast<TrCheck>(i)) - 1] += ind[i].count;
+                last = std::max(last, ind[i].last_ms);
+            }
+            return json{ {"p1", p[0]}, {"p2", p[1]}, {"last_ms", last} };
+        }
+
+        // Фильтр журнала из query: stream (имя), level (минимальный), code, since/until (unix-мс), after (seq), limit
+        bool parse_log_query(const httplib::Request& req, const StreamManager& mgr, LogQuery& q, std::string& err) {
+            if (req.has_param("stream")) {
+                q.stream = mgr.streamId(req.get_param_value("stream"));
+                if (q.stream == kNoStream) { err = "unknown stream"; return false; }
+            }
+            auto num = [&req](const char* key) { return std::strtoll(req.get_param_value(key).c_str(), nullptr, 10); };
+            if (req.has_param("level")) q.min_level = Logger::parseLevel(req.get_param_value("level"), LogLevel::Debug);
+            if (req.has_param("code"))  q.code = static_cast<uint16_t>(std::clamp<long long>(num("code"), 0, 0xFFFF));
+            if (req.has_param("since")) q.since_ms = num("since");
+            if (req.has_param("until")) q.until_ms = num("until");
+            if (req.has_param("after")) q.after_seq = std::strtoull(req.get_param_value("after").c_str(), nullptr, 10);
+            if (req.has_param("limit")) q.limit = static_cast<size_t>(std::clamp<long long>(num("limit"), 1, 5000));
+            return true;
+        }
+
+        json log_record_to_json(const LogRecord& r, const StreamManager& mgr) {
+            json j = {
+                {"seq", r.seq},
+                {"ts", r.ts_ms},
+                {"level", Logger::levelName(static_cast<LogLevel>(r.level))},
+                {"code", r.code},
+                {"msg", std::string(r.message())}
+            };
+            if (r.stream != kNoStream) {
+                j["stream_id"] = r.stream;
+                j["stream"] = mgr.streamName(r.stream);
+            }
+            else {
+                j["stream"] = nullptr;
+            }
+            return j;
+        }
+
+        // Сообщения лога могут быть не в UTF-8 (строки FFmpeg, URL) — не роняем ответ
+        std::string dump_safe(const json& j) {
+            return j.dump(-1, ' ', false, json::error_handler_t::replace);
+        }
+
+        // Пул httplib, чьи рабочие потоки при первой задаче закрепляются за набором web
+        class PlacedTaskQueue final : public httplib::TaskQueue {
+        public:
+            explicit PlacedTaskQueue(size_t n) : m_pool(n) {}
+
+            bool enqueue(std::function<void()> fn) override {
+                return m_pool.enqueue([fn = std::move(fn)] {
+                    static std::atomic<unsigned> next{ 0 };
+                    thread_local ThreadPlacement::Scope placement(ThreadRole::Web, "web:" + std::to_string(next++));
+                    fn();
+                    });
+            }
+            void shutdown() override { m_pool.shutdown(); }
+
+        private:
+            httplib::ThreadPool m_pool;
+        };
     } // anonymous
 
     WebServer::WebServer(StreamManager& mgr) : m_mgr(mgr) {}
@@ -33,6 +144,9 @@ namespace multiscreen {
         if (m_running.load()) return true;
         m_port = port;
         m_svr = std::make_unique<httplib::Server>();
+        // клиенты /live держат поток до отключения: для них отдельные потоки сверх web_threads
+        const size_t workers = static_cast<size_t>(ThreadPlacement::instance().web_threads() + TsFanout::max_clients());
+        m_svr->new_task_queue = [workers] { return new PlacedTaskQueue(workers); };
 
         // Отдача статики из папки www включая css, js и другие
         m_svr->set_mount_point("/", "www");
@@ -50,22 +164,147 @@ namespace multiscreen {
 
         // Settings endpoint
         m_svr->Get("/api/settings", [](const httplib::Request&, httplib::Response& res) {
-            try {
-                std::ifstream f("config/settings.json", std::ios::binary);
-                if (f) {
-                    std::string body((std::istreambuf_iterator<char>(f)), std::istreambuf_iterator<char>());
-                    res.set_content(body, "application/json");
-                    return;
-                }
+            // эффективные настройки из текущего снимка — без чтения файла на каждый запрос
+            res.set_content(Settings::instance().snapshot()->json_text, "application/json");
+            });
+
+        // Фактическое размещение потоков по CPU (профили из config.json, cpuset, все потоки процесса)
+        m_svr->Get("/api/system/threads", [](const httplib::Request&, httplib::Response& res) {
+            res.set_content(ThreadPlacement::instance().report().dump(), "application/json");
+            });
+
+        // Счётчики асинхронного логгера (потери при переполнении буферов, ротации)
+        m_svr->Get("/api/system/logger", [](const httplib::Request&, httplib::Response& res) {
+            const auto s = Logger::stats();
+            json j = {
+                {"written", s.written},
+                {"dropped", s.dropped},
+                {"bytes", s.bytes},
+                {"rotations", s.rotations},
+                {"batches", s.batches},
+                {"threads", s.threads}
+            };
+            const auto f = FFLogRouter::instance().stats();
+            j["ffmpeg"] = { {"formatted", f.formatted}, {"suppressed", f.suppressed}, {"unattributed", f.unattributed} };
+            res.set_content(j.dump(), "application/json");
+            });
+
+        // Журнал из памяти: последние записи по фильтру (без grep по файлам на сервере)
+        m_svr->Get("/api/logs", [this](const httplib::Request& req, httplib::Response& res) {
+            LogQuery q;
+            std::string err;
+            if (!parse_log_query(req, m_mgr, q, err)) {
+                res.status = 404;
+                res.set_content(json({ {"ok", false}, {"error", err} }).dump(), "application/json");
+                return;
             }
-            catch (...) {}
+            auto& ring = LogRing::instance();
+            const uint64_t last = ring.last_seq();
+            json arr = json::array();
+            for (const auto& r : ring.latest(q)) arr.push_back(log_record_to_json(r, m_mgr));
+            json j = { {"records", std::move(arr)}, {"last_seq", last}, {"capacity", ring.capacity()} };
+            res.set_content(dump_safe(j), "application/json");
+            });
+
+        // Живой хвост журнала (SSE): те же фильтры; backlog=N последних записей в начале,
+        // после обрыва браузер присылает Last-Event-ID и продолжает с него
+        m_svr->Get("/api/logs/tail", [this](const httplib::Request& req, httplib::Response& res) {
+            LogQuery q;
+            std::string err;
+            if (!parse_log_query(req, m_mgr, q, err)) {
+                res.status = 404;
+                res.set_content(json({ {"ok", false}, {"error", err} }).dump(), "application/json");
+                return;
+            }
+            // каждый хвост занимает поток пула до отключения клиента
+            const int max_tails = std::max(1, ThreadPlacement::instance().web_threads() / 2);
+            if (m_tails.fetch_add(1) >= max_tails) {
+                m_tails.fetch_sub(1);
+                res.status = 503;
+                res.set_content(json({ {"ok", false}, {"error", "too many log tails"} }).dump(), "application/json");
+                return;
+            }
+
+            auto& ring = LogRing::instance();
+            std::vector<LogRecord> backlog;
+            if (req.has_header("Last-Event-ID")) {
+                // id из прошлого запуска процесса может быть больше текущего — тогда просто с «сейчас»
+                q.after_seq = std::min<uint64_t>(std::strtoull(req.get_header_value("Last-Event-ID").c_str(), nullptr, 10), ring.last_seq());
+            }
+            else if (!req.has_param("after")) {
+                const uint64_t start = ring.last_seq();
+                LogQuery bq = q;
+                bq.limit = req.has_param("backlog")
+                    ? static_cast<size_t>(std::clamp<long long>(std::strtoll(req.get_param_value("backlog").c_str(), nullptr, 10), 0, 1000))
+                    : 50;
+                if (bq.limit) backlog = ring.latest(bq);
+                q.after_seq = backlog.empty() ? start : std::max(start, backlog.back().seq);
+            }
+            q.limit = 500;   // за один проход провайдера
+
+            res.set_header("X-Accel-Buffering", "no");
+            res.set_chunked_content_provider("text/event-stream",
+                [this, q, backlog = std::move(backlog), last_write = std::chrono::steady_clock::now()](size_t, httplib::DataSink& sink) mutable {
+                    auto& ring = LogRing::instance();
+                    std::vector<LogRecord> recs;
+                    if (!backlog.empty()) {
+                        recs.swap(backlog);
+                    }
+                    else if (ring.wait(q.after_seq, std::chrono::seconds(1))) {
+                        uint64_t scanned = q.after_seq;
+                        recs = ring.after(q, &scanned);
+                        q.after_seq = scanned;
+                    }
+
+                    std::string out;
+                    for (const auto& r : recs) {
+                        out += "id: " + std::to_string(r.seq) + "\nevent: log\ndata: ";
+                        out += dump_safe(log_record_to_json(r, m_mgr));
+                        out += "\n\n";
+                    }
+                    const auto now = std::chrono::steady_clock::now();
+                    if (out.empty() && now - last_write >= std::chrono::seconds(15)) out = ": ping\n\n"; // держим прокси/браузер
+                    if (out.empty()) return true;
+                    last_write = now;
+                    return sink.write(out.data(), out.size());
+                },
+                [this](bool) { m_tails.fetch_sub(1); });
+            });
+
+        // Состояние очереди вебхуков
+        m_svr->Get("/api/alerts/stats", [this](const httplib::Request&, httplib::Response& res) {
+            const auto st = alerts::Dispatcher::instance().stats();
             json j = {
-                {"thresholds", {
-                    {"fps", {{"warn_ratio", 0.70}, {"crit_ratio", 0.40}}},
-                    {"bitrate", {{"warn_kbps", 300}, {"crit_kbps", 100}}},
-                    {"stall", {{"warn_ms", 3000}, {"crit_ms", 7000}}}
-                }},
-                {"alerts", {{"webhook", {{"enabled", false}, {"url", ""}, {"timeout_ms", 1500}}}}}
+                {"queue_depth", st.queue_depth},
+                {"queue_capacity", st.queue_capacity},
+                {"enqueued", st.enqueued},
+                {"dropped", st.dropped},
+                {"discarded", st.discarded},
+                {"sent_events", st.sent_events},
+                {"sent_batches", st.sent_batches},
+                {"failed_batches", st.failed_batches},
+                {"dead_letters", st.dead_letters},
+                {"last_send_ms", st.last_send_ms},
+                {"avg_send_ms", st.avg_send_ms},
+                {"max_send_ms", st.max_send_ms},
+                {"last_queue_ms", st.last_queue_ms},
+                {"retries", st.retries},
+                {"backoff_ms", st.backoff_ms},
+                {"outbox", {
+                    {"durable", st.outbox_durable},
+                    {"pending", st.outbox_pending},
+                    {"bytes", st.outbox_bytes},
+                    {"dropped", st.outbox_dropped}
+                }}
+            };
+            const auto es = alerts::StateEngine::instance().stats();
+            j["state"] = {
+                {"capacity", es.capacity},
+                {"used", es.used},
+                {"evictions", es.evictions},
+                {"rejected", es.rejected},
+                {"suppressed", es.suppressed},
+                {"events_dropped", m_mgr.watchEventsDropped()}
             };
             res.set_content(j.dump(), "application/json");
             });
@@ -79,6 +318,8 @@ namespace multiscreen {
                 r["name"] = s.name;
                 r["url"] = s.url;
                 r["running"] = s.running;
+                r["state"] = s.state;
+                r["reconnects"] = s.reconnects;
                 r["input_fps"] = s.input_fps;
                 r["decode_fps"] = s.decode_fps;
                 r["render_fps"] = s.render_fps;
@@ -87,6 +328,91 @@ namespace multiscreen {
                 r["audio_kbps"] = s.a_kbps;
                 r["rate_mode"] = s.rate_mode;
                 r["cc_errors"] = s.cc_errors;
+                r["pes_errors"] = s.pes_errors;
+                r["decode_errors"] = s.decode_errors;
+                r["log_suppressed"] = s.log_suppressed;
+                if (s.ts_tap) {
+                    r["ts"] = { {"packets", s.ts_packets}, {"sync_losses", s.ts_sync_losses},
+                        {"tei", s.ts_tei}, {"pids", s.ts_pids} };
+                    r["tr101290"] = tr_summary_json(s.tr101290);
+                    if (s.timing.valid) {
+                        const auto& t = s.timing;
+                        r["timing"] = { {"pcr_pid", t.pcr_pid}, {"media_kbps", std::lround(t.media_kbps)},
+                            {"pcr_oj_ms", t.pcr_oj_ms}, {"mdi_df_ms", t.mdi_df_ms}, {"mdi_mlr", t.mdi_mlr},
+                            {"pcr_oj_max_ms", t.pcr_oj_max_ms}, {"mdi_df_max_ms", t.mdi_df_max_ms}, {"mdi_mlr_max", t.mdi_mlr_max} };
+                    }
+                }
+                if (s.udp_native) {
+                    r["udp"] = { {"datagrams", s.udp.datagrams}, {"bytes", s.udp.bytes},
+                        {"per_syscall", s.udp.batches ? double(s.udp.datagrams) / double(s.udp.batches) : 0.0},
+                        {"kernel_drops", s.udp.kernel_drops}, {"truncated", s.udp.truncated},
+                        {"rcvbuf", s.udp.rcvbuf}, {"kernel_ts", s.udp.kernel_ts} };
+                }
+                if (s.rtp_mode) {
+                    r["rtp"] = { {"packets", s.rtp.packets}, {"lost", s.rtp.lost}, {"reordered", s.rtp.reordered},
+                        {"duplicates", s.rtp.duplicates}, {"late", s.rtp.late}, {"invalid", s.rtp.invalid},
+                        {"resyncs", s.rtp.resyncs}, {"ssrc", s.rtp.ssrc}, {"payload_type", s.rtp.payload_type},
+                        {"jitter_ms", s.rtp.jitter_ms}, {"held", s.rtp.held} };
+                    if (s.rtp.merge) {
+                        auto& m = r["rtp"];
+                        m["recovered"] = s.rtp.recovered;
+                        m["skew_ms"] = s.rtp.skew_ms;
+                        m["skew_max_ms"] = s.rtp.skew_max_ms;
+                        m["legs"] = json::array();
+                        for (const auto& l : s.rtp.legs)
+                            m["legs"].push_back({ {"up", l.up}, {"packets", l.packets}, {"lost", l.lost}, {"jitter_ms", l.jitter_ms} });
+                        r["udp_secondary"] = { {"datagrams", s.udp_secondary.datagrams}, {"bytes", s.udp_secondary.bytes},
+                            {"kernel_drops", s.udp_secondary.kernel_drops}, {"truncated", s.udp_secondary.truncated},
+                            {"rcvbuf", s.udp_secondary.rcvbuf} };
+                    }
+                    if (s.rtp.fec || s.rtp.fec_packets) {
+                        auto& m = r["rtp"];
+                        m["fec"] = { {"active", s.rtp.fec}, {"packets", s.rtp.fec_packets},
+                            {"recovered", s.rtp.fec_recovered}, {"unrecoverable", s.rtp.fec_unrecoverable},
+                            {"cols", s.rtp.fec_cols}, {"rows", s.rtp.fec_rows} };
+                    }
+                }
+                if (s.hls_native) {
+                    r["hls"] = { {"playlist", s.hls.playlist}, {"bandwidth", s.hls.bandwidth}, {"live", s.hls.live},
+                        {"target_duration_s", s.hls.target_duration_s}, {"sequence", s.hls.sequence},
+                        {"segments", s.hls.segments}, {"bytes", s.hls.bytes}, {"missing", s.hls.missing},
+                        {"download_errors", s.hls.download_errors}, {"slow_segments", s.hls.slow_segments},
+                        {"discontinuities", s.hls.discontinuities},
+                        {"playlist_reloads", s.hls.playlist_reloads}, {"playlist_errors", s.hls.playlist_errors},
+                        {"last_download_ms", s.hls.last_download_ms}, {"avg_download_ms", s.hls.avg_download_ms},
+                        {"max_download_ms", s.hls.max_download_ms}, {"stale_ms", s.hls.stale_ms},
+                        {"inflight", s.hls.inflight}, {"ready", s.hls.ready} };
+                }
+                if (s.record.active) {
+                    r["record"] = { {"direct_io", s.record.direct_io}, {"bytes_in", s.record.bytes_in},
+                        {"written", s.record.written}, {"dropped_bytes", s.record.dropped_bytes},
+                        {"drop_events", s.record.drop_events}, {"write_errors", s.record.write_errors},
+                        {"buffer_blocks", s.record.buffer_blocks}, {"buffer_used", s.record.buffer_used},
+                        {"segments", s.record.segments}, {"disk_bytes", s.record.disk_bytes},
+                        {"oldest_ms", s.record.oldest_ms}, {"newest_ms", s.record.newest_ms} };
+                }
+                if (s.live.sessions) {
+                    r["live"] = { {"clients", s.live.clients}, {"sessions", s.live.sessions}, {"chunks", s.live.chunks},
+                        {"bytes", s.live.bytes}, {"evicted", s.live.evicted}, {"dropped_bytes", s.live.dropped_bytes} };
+                }
+                if (s.preview.requests) {
+                    r["preview"] = { {"active", s.preview.active}, {"segments", s.preview.segments},
+                        {"ring_bytes", s.preview.ring_bytes}, {"sequence", s.preview.sequence},
+                        {"produced", s.preview.produced}, {"requests", s.preview.requests},
+                        {"mux_errors", s.preview.mux_errors} };
+                }
+                if (s.gop.gops) {
+                    r["gop"] = { {"valid", s.gop.valid}, {"packets", s.gop.packets}, {"bytes", s.gop.bytes},
+                        {"duration_ms", s.gop.duration_ms}, {"params", s.gop.params}, {"gops", s.gop.gops},
+                        {"overflows", s.gop.overflows} };
+                }
+                if (s.capture.active) {
+                    r["capture"] = { {"capturing", s.capture.capturing}, {"chunks", s.capture.chunks},
+                        {"ring_chunks", s.capture.ring_chunks}, {"ring_bytes", s.capture.ring_bytes},
+                        {"ring_ms", s.capture.ring_ms}, {"dropped_bytes", s.capture.dropped_bytes},
+                        {"captures", s.capture.captures}, {"last_path", s.capture.last_path} };
+                }
+                r["stall_ms"] = s.stall_ms;
                 r["decoder"] = s.decoder;
                 r["sid"] = s.sid;
                 r["pmt_pid"] = s.pmt_pid;
@@ -96,23 +422,243 @@ namespace multiscreen {
                 r["service_name"] = s.service_name;
                 r["last_error"] = s.last_error;
                 r["status"] = s.status;
+                r["status_reason"] = s.status_reason;
                 j.push_back(std::move(r));
             }
             res.set_content(j.dump(), "application/json; charset=utf-8");
             });
 
+        // Асинхронные задания управления стримами
+        m_svr->Get("/api/jobs", [this](const httplib::Request&, httplib::Response& res) {
+            json j = json::array();
+            for (const auto& jb : m_mgr.getJobs()) j.push_back(job_to_json(jb));
+            res.set_content(j.dump(), "application/json; charset=utf-8");
+            });
+        m_svr->Get(R"(/api/jobs/(\d+))", [this](const httplib::Request& req, httplib::Response& res) {
+            StreamJob jb;
+            if (req.matches.size() < 2 || !m_mgr.getJob(std::strtoull(req.matches[1].str().c_str(), nullptr, 10), jb)) {
+                res.status = 404;
+                res.set_content("{}", "application/json");
+                return;
+            }
+            res.set_content(job_to_json(jb).dump(), "application/json; charset=utf-8");
+            });
+
+        // Подробный отчёт TR 101 290: сводка по всем индикаторам и ошибки по PID
+        m_svr->Get(R"(/api/streams/(.+)/tr101290)", [this](const httplib::Request& req, httplib::Response& res) {
+            Tr101290Report rep;
+            if (req.matches.size() < 2 || !m_mgr.getTr101290(req.matches[1].str(), rep)) {
+                res.status = 404;
+                res.set_content("{}", "application/json");
+                return;
+            }
+            json total = json::object();
+            for (size_t i = 0; i < kTrChecks; ++i) {
+                const auto c = static_cast<TrCheck>(i);
+                total[to_string(c)] = { {"priority", priority(c)}, {"count", rep.total[i].count},
+                    {"last_ms", rep.total[i].last_ms} };
+            }
+            json pids = json::array();
+            for (const auto& p : rep.pids) {
+                pids.push_back({ {"pid", p.pid}, {"program", p.program}, {"kind", p.kind},
+                    {"errors", tr_indicators_json(p.ind)} });
+            }
+            json j = { {"name", req.matches[1].str()}, {"active", rep.active}, {"total", total},
+                {"pids", pids}, {"untracked_pids", rep.untracked} };
+            res.set_content(j.dump(), "application/json; charset=utf-8");
+            });
+
+        // Запись TS на диск: общий объём и вытеснение
+        m_svr->Get("/api/recorder", [](const httplib::Request&, httplib::Response& res) {
+            const auto t = Recorder::instance().totals();
+            json j = {
+                {"enabled", t.enabled},
+                {"dir", t.dir},
+                {"streams", t.streams},
+                {"segments", t.segments},
+                {"disk_bytes", t.disk_bytes},
+                {"total_quota_bytes", t.total_quota_bytes},
+                {"deleted_segments", t.deleted_segments},
+                {"avg_write_ms", t.avg_write_ms},
+                {"max_write_ms", t.max_write_ms}
+            };
+            res.set_content(j.dump(), "application/json");
+            });
+
+        // Сегменты записи стрима (unix-мс начала и конца)
+        m_svr->Get(R"(/api/streams/(.+)/recordings)", [](const httplib::Request& req, httplib::Response& res) {
+            const std::string name = req.matches.size() > 1 ? req.matches[1].str() : std::string();
+            json segs = json::array();
+            for (const auto& s : Recorder::instance().segments(name))
+                segs.push_back({ {"start_ms", s.start_ms}, {"end_ms", s.end_ms}, {"bytes", s.bytes} });
+            json j = { {"name", name}, {"segments", segs} };
+            res.set_content(j.dump(), "application/json; charset=utf-8");
+            });
+
+        // Запись за интервал ?from=&to= (unix-мс) одним TS; границы — с точностью до блока записи.
+        // Файлы открываются сразу: вытеснение во время отдачи ответ не обрывает
+        m_svr->Get(R"(/api/streams/(.+)/recording\.ts)", [](const httplib::Request& req, httplib::Response& res) {
+            const std::string name = req.matches.size() > 1 ? req.matches[1].str() : std::string();
+            auto num = [&req](const char* key, int64_t def) {
+                return req.has_param(key) ? static_cast<int64_t>(std::strtoll(req.get_param_value(key).c_str(), nullptr, 10)) : def;
+            };
+            const int64_t from = num("from", 0);
+            const int64_t to = num("to", INT64_MAX);
+            std::vector<RecordPiece> pieces;
+            if (!Recorder::instance().find(name, from, to, pieces) || pieces.empty()) {
+                res.status = 404;
+                res.set_content("{}", "application/json");
+                return;
+            }
+            struct Part {
+                std::ifstream f;
+                uint64_t offset = 0;
+                uint64_t length = 0;
+            };
+            auto parts = std::make_shared<std::vector<Part>>();
+            uint64_t total = 0;
+            for (const auto& p : pieces) {
+                Part part;
+                part.f.open(p.path, std::ios::binary);
+                if (!part.f) continue;
+                part.offset = p.offset;
+                part.length = p.length;
+                total += p.length;
+                parts->push_back(std::move(part));
+            }
+            if (!total) {
+                res.status = 404;
+                res.set_content("{}", "application/json");
+                return;
+            }
+            res.set_header("Content-Disposition", "attachment; filename=\"recording_" + std::to_string(from) + ".ts\"");
+            res.set_content_provider(static_cast<size_t>(total), "video/mp2t",
+                [parts](size_t offset, size_t length, httplib::DataSink& sink) {
+                    // offset — позиция в склейке кусков
+                    uint64_t pos = offset;
+                    for (auto& p : *parts) {
+                        if (pos >= p.length) { pos -= p.length; continue; }
+                        char buf[64 * 1024];
+                        const size_t n = static_cast<size_t>(std::min<uint64_t>({ sizeof(buf), p.length - pos, length }));
+                        p.f.clear();
+                        p.f.seekg(static_cast<std::streamoff>(p.offset + pos));
+                        if (!p.f.read(buf, static_cast<std::streamsize>(n))) return false;
+                        return sink.write(buf, n);
+                    }
+                    return false;
+                });
+            });
+
+        // Живой TS канала для VLC и т.п.: те же байты, что принимает монитор, без второго подключения
+        // к источнику. Чанки общие для всех клиентов; медленный клиент отключается по переполнению очереди
+        m_svr->Get(R"(/live/(.+)\.ts)", [this](const httplib::Request& req, httplib::Response& res) {
+            const std::string name = req.matches.size() > 1 ? req.matches[1].str() : std::string();
+            auto fan = m_mgr.liveFeed(name);
+            if (!fan) {
+                res.status = 404;
+                res.set_content("{}", "application/json");
+                return;
+            }
+            auto client = fan->subscribe();
+            if (!client) {
+                res.status = 503;
+                res.set_content(json({ {"ok", false}, {"error", TsFanout::enabled() ? "too many live clients" : "live disabled"} }).dump(),
+                    "application/json");
+                return;
+            }
+            res.set_header("Cache-Control", "no-cache");
+            res.set_header("X-Accel-Buffering", "no");
+            // без длины: ответ идёт до закрытия соединения, чанки пишутся в сокет как есть
+            res.set_content_provider("video/mp2t",
+                [fan, client, name](size_t, httplib::DataSink& sink) {
+                    TsFanout::Chunk* c = client->wait(1000);
+                    if (!c) {
+                        if (client->evicted()) {
+                            Logger::info("live: " + name + ": slow client disconnected");
+                            return false;
+                        }
+                        return sink.is_writable();   // вход стоит: держим клиента, пока он на связи
+                    }
+                    const bool ok = sink.write(reinterpret_cast<const char*>(c->data), c->len);
+                    fan->release(c);
+                    return ok;
+                },
+                [fan, client](bool) { fan->unsubscribe(client); });
+            });
+
+        // HLS-предпросмотр для браузера: пакеты демультиплексора перепакованы в TS без декода.
+        // Запросы плейлиста и сегментов держат перепаковку включённой, без них она останавливается
+        m_svr->Get(R"(/preview/(.+)/index\.m3u8)", [this](const httplib::Request& req, httplib::Response& res) {
+            const std::string name = req.matches.size() > 1 ? req.matches[1].str() : std::string();
+            auto pv = m_mgr.preview(name);
+            if (!pv) {
+                res.status = 404;
+                res.set_content("{}", "application/json");
+                return;
+            }
+            std::string m3u8 = pv->playlist();
+            if (m3u8.empty()) {
+                res.status = 503;
+                res.set_content(json({ {"ok", false}, {"error", HlsPreview::enabled() ? "no segments yet" : "preview disabled"} }).dump(),
+                    "application/json");
+                return;
+            }
+            res.set_header("Cache-Control", "no-cache");
+            res.set_content(m3u8, "application/vnd.apple.mpegurl");
+            });
+        m_svr->Get(R"(/preview/(.+)/(\d+)\.ts)", [this](const httplib::Request& req, httplib::Response& res) {
+            const std::string name = req.matches.size() > 2 ? req.matches[1].str() : std::string();
+            auto pv = m_mgr.preview(name);
+            std::shared_ptr<const HlsPreview::Segment> seg;
+            if (pv) {
+                try { seg = pv->segment(std::stoull(req.matches[2].str())); }
+                catch (...) {}
+            }
+            if (!seg) {
+                res.status = 404;
+                res.set_content("{}", "application/json");
+                return;
+            }
+            res.set_header("Cache-Control", "max-age=60");
+            // сегмент неизменяем: провайдер держит ссылку, кольцо может его уже вытеснить
+            res.set_content_provider(seg->data.size(), "video/mp2t",
+                [seg](size_t offset, size_t length, httplib::DataSink& sink) {
+                    return sink.write(seg->data.data() + offset, length);
+                });
+            });
+
+        // Файлы захвата по тревогам (старые вытесняются квотой)
+        m_svr->Get("/api/captures", [](const httplib::Request&, httplib::Response& res) {
+            json j = json::array();
+            for (const auto& f : IncidentCapture::instance().files()) {
+                j.push_back({ {"stream", f.stream}, {"path", f.path}, {"reason", f.reason},
+                    {"trigger_ms", f.trigger_ms}, {"start_ms", f.start_ms}, {"bytes", f.bytes}, {"complete", f.complete} });
+            }
+            res.set_content(j.dump(), "application/json; charset=utf-8");
+            });
+
         // Методы POST для управления
         m_svr->Post("/api/stream/start", [this](const httplib::Request& req, httplib::Response& res) {
             auto j = WebServer::parse_json(req.body);
-            res.set_content(json{ {"ok", m_mgr.startStream(j.value("name", std::string()))} }.dump(), "application/json");
+            res.set_content(job_reply(m_mgr.startStream(j.value("name", std::string()))), "application/json");
             });
         m_svr->Post("/api/stream/stop", [this](const httplib::Request& req, httplib::Response& res) {
             auto j = WebServer::parse_json(req.body);
-            res.set_content(json{ {"ok", m_mgr.stopStream(j.value("name", std::string()))} }.dump(), "application/json");
+            res.set_content(job_reply(m_mgr.stopStream(j.value("name", std::string()))), "application/json");
             });
         m_svr->Post("/api/stream/restart", [this](const httplib::Request& req, httplib::Response& res) {
             auto j = WebServer::parse_json(req.body);
-            res.set_content(json{ {"ok", m_mgr.restartStream(j.value("name", std::string()))} }.dump(), "application/json");
+            res.set_content(job_reply(m_mgr.restartStream(j.value("name", std::string()))), "application/json");
+            });
+        m_svr->Post("/api/stream/capture", [this](const httplib::Request& req, httplib::Response& res) {
+            auto j = WebServer::parse_json(req.body);
+            std::string path;
+            if (!m_mgr.captureStream(j.value("name", std::string()), path)) {
+                res.status = 404;
+                res.set_content(json({ {"ok", false}, {"error", "stream not found"} }).dump(), "application/json");
+                return;
+            }
+            res.set_content(json{ {"ok", !path.empty()}, {"path", path} }.dump(), "application/json");
             });
         m_svr->Post("/api/stream/delete", [this](const httplib::Request& req, httplib::Response& res) {
             auto j = WebServer::parse_json(req.body);
@@ -144,7 +690,7 @@ namespace multiscreen {
                 return;
             }
             const std::string name = req.matches[1].str();
-            res.set_content(json{ {"ok", m_mgr.startStream(name)} }.dump(), "application/json");
+            res.set_content(job_reply(m_mgr.startStream(name)), "application/json");
             });
         m_svr->Post(R"(/api/streams/(.+)/stop)", [this](const httplib::Request& req, httplib::Response& res) {
             if (req.matches.size() < 2) {
@@ -153,7 +699,7 @@ namespace multiscreen {
                 return;
             }
             const std::string name = req.matches[1].str();
-            res.set_content(json{ {"ok", m_mgr.stopStream(name)} }.dump(), "application/json");
+            res.set_content(job_reply(m_mgr.stopStream(name)), "application/json");
             });
         m_svr->Post(R"(/api/streams/(.+)/restart)", [this](const httplib::Request& req, httplib::Response& res) {
             if (req.matches.size() < 2) {
@@ -162,7 +708,7 @@ namespace multiscreen {
                 return;
             }
             const std::string name = req.matches[1].str();
-            res.set_content(json{ {"ok", m_mgr.restartStream(name)} }.dump(), "application/json");
+            res.set_content(job_reply(m_mgr.restartStream(name)), "application/json");
             });
         m_svr->Delete(R"(/api/streams/(.+))", [this](const httplib::Request& req, httplib::Response& res) {
             if (req.matches.size() < 2) {
@@ -195,6 +741,7 @@ namespace multiscreen {
         m_running = true;
 
         m_thread = std::thread([this] {
+            ThreadPlacement::Scope placement(ThreadRole::Web, "web:listen");
             Logger::info("WebServer listening on port " + std::to_string(m_port));
             m_svr->listen("0.0.0.0", m_port);
             Logger::info("WebServer stopped");
@@ -15,19 +15,19 @@ static void on_signal(int) {
 }
 
 int main(int /*argc*/, char** /*argv*/) {
-    // -  Ctrl+C / SIGTERM
+    // Грейсфул-стоп по Ctrl+C / SIGTERM
     std::signal(SIGINT, on_signal);
 #if defined(SIGTERM)
     std::signal(SIGTERM, on_signal);
 #endif
 
-    //   / (   )
-    //     Settings::load  false,  .
+    // Загружаем дополнительные пороги/алерты (как и было раньше)
+    // Если файла нет — Settings::load вернёт false, это некритично.
     multiscreen::Settings::instance().load("config/settings.json");
 
-    //   :
-    // Application  config/config.json (web.port, web.enable, streams.enable)
-    //  config/streams.json ( ),  WebServer   .
+    // Единая инициализация приложения:
+    // Application читает config/config.json (web.port, web.enable, streams.enable)
+    // и config/streams.json (список стримов), запускает WebServer и потоки стримов.
     multiscreen::Application app;
     if (!app.initialize("config")) {
         std::cerr << "[ERROR] Application.initialize failed\n";
@@ -0,0 +1,109 @@
+// tools/ts_scan_bench.cpp
+// Пропускная способность TsScanner по наборам инструкций, млрд пакетов/с:
+//   cmake -S . -B build -DMULTISCREEN_BUILD_BENCH=ON && cmake --build build --target ts_scan_bench
+//   build/ts_scan_bench [pids=40] [hot_mb=1] [cold_mb=188]
+// hot — буфер в кэше, прогоняется много раз; cold — один проход по буферу больше кэша.
+// Для сравнения — прежний разбор: мьютекс и unordered_map на каждый пакет.
+#include "TsScanner.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+using namespace multiscreen;
+
+namespace {
+    using Clock = std::chrono::steady_clock;
+
+    // Пакетов на PID кратно 16: при повторном прогоне буфера CC продолжается без разрыва
+    std::vector<uint8_t> make_ts(size_t bytes, unsigned pids) {
+        const size_t per_round = size_t(pids) * 16;
+        const size_t packets = std::max<size_t>(1, bytes / TsScanner::kPacket / per_round) * per_round;
+        std::vector<uint8_t> buf(packets * TsScanner::kPacket);
+        std::vector<uint8_t> cc(pids, 0);
+        for (size_t i = 0; i < packets; ++i) {
+            uint8_t* p = buf.data() + i * TsScanner::kPacket;
+            const unsigned k = static_cast<unsigned>(i % pids);
+            const uint16_t pid = static_cast<uint16_t>(0x100 + k);
+            p[0] = 0x47;
+            p[1] = static_cast<uint8_t>(pid >> 8);
+            p[2] = static_cast<uint8_t>(pid);
+            p[3] = static_cast<uint8_t>(0x10 | cc[k]);
+            cc[k] = (cc[k] + 1) & 0x0F;
+            for (size_t j = 4; j < TsScanner::kPacket; ++j) p[j] = static_cast<uint8_t>(i + j);
+        }
+        return buf;
+    }
+
+    // feed() получает куски ~64 КБ, как из avio_read_partial (целые пакеты: прежнему разбору без досборки)
+    template <class Fn>
+    double run(const std::vector<uint8_t>& buf, double min_s, Fn&& feed) {
+        constexpr size_t kSlice = TsScanner::kPacket * 348;
+        const size_t packets = buf.size() / TsScanner::kPacket;
+        size_t total = 0;
+        const auto t0 = Clock::now();
+        double s = 0.0;
+        do {
+            for (size_t off = 0; off < buf.size(); off += kSlice)
+                feed(buf.data() + off, std::min(kSlice, buf.size() - off));
+            total += packets;
+            s = std::chrono::duration<double>(Clock::now() - t0).count();
+        } while (s < min_s);
+        return static_cast<double>(total) / s / 1e9;
+    }
+
+    // Прежний Metrics::handleTsPacket: разбор заголовка, мьютекс и map на каждый пакет
+    struct Legacy {
+        struct Cc { bool valid = false; uint8_t last = 0; };
+        std::mutex mu;
+        std::unordered_map<uint16_t, Cc> map;
+        uint64_t errors = 0;
+
+        void feed(const uint8_t* p, size_t len) {
+            for (; len >= TsScanner::kPacket; p += TsScanner::kPacket, len -= TsScanner::kPacket) {
+                if (p[0] != 0x47) continue;
+                const uint16_t pid = static_cast<uint16_t>(((p[1] & 0x1F) << 8) | p[2]);
+                const bool payload = (p[3] & 0x10) != 0;
+                const uint8_t cc = p[3] & 0x0F;
+                std::lock_guard<std::mutex> lk(mu);
+                Cc& st = map[pid];
+                if (!st.valid) {
+                    st.valid = true;
+                    st.last = cc;
+                    continue;
+                }
+                if (payload) {
+                    if (cc != ((st.last + 1) & 0x0F) && cc != st.last) ++errors;
+                    st.last = cc;
+                }
+            }
+        }
+    };
+
+    void report(const char* what, const std::vector<uint8_t>& buf, double min_s) {
+        std::printf("%s (%zu KB):\n", what, buf.size() >> 10);
+        for (const auto isa : { TsScanner::Isa::Scalar, TsScanner::Isa::Sse2, TsScanner::Isa::Avx2 }) {
+            TsScanner sc(isa);
+            if (sc.active_isa() != isa) continue;   // не поддерживается процессором или сборкой
+            const double g = run(buf, min_s, [&](const uint8_t* p, size_t n) { sc.feed(p, n, 0); });
+            std::printf("  %-7s %.3f%s\n", TsScanner::to_string(isa), g, sc.snapshot().cc_errors ? "  (CC errors!)" : "");
+        }
+        Legacy old;
+        const double g = run(buf, min_s, [&](const uint8_t* p, size_t n) { old.feed(p, n); });
+        std::printf("  %-7s %.3f\n", "legacy", g);
+    }
+} // anonymous
+
+int main(int argc, char** argv) {
+    const unsigned pids = argc > 1 ? static_cast<unsigned>(std::max(1, std::atoi(argv[1]))) : 40;
+    const size_t hot_mb = argc > 2 ? static_cast<size_t>(std::max(1, std::atoi(argv[2]))) : 1;
+    const size_t cold_mb = argc > 3 ? static_cast<size_t>(std::max(1, std::atoi(argv[3]))) : 188;
+    std::printf("TsScanner, %u PIDs, Gpkts/s; auto selects %s\n", pids, TsScanner::to_string(TsScanner::isa()));
+    report("hot", make_ts(hot_mb << 20, pids), 1.0);
+    report("cold", make_ts(cold_mb << 20, pids), 0.0);
+    return 0;
+}
@@ -48,16 +48,18 @@ function actionsCell(s) {
     wrap.appendChild(b('INFO', 'secondary', 'info'));
     wrap.appendChild(b('Start/Stop', '', 'toggle'));
     wrap.appendChild(b('Restart', '', 'restart'));
+    wrap.appendChild(b('Preview', 'secondary', 'preview'));
     wrap.appendChild(b('Edit', 'secondary', 'edit'));
     wrap.appendChild(b('Delete', 'danger', 'delete'));
     tdA.appendChild(wrap); return tdA;
 }
 function wireRowActions(tr, s) {
     var q = a => tr.querySelector('[data-act="' + a + '"]');
-    var i = q('info'), t = q('toggle'), r = q('restart'), e = q('edit'), d = q('delete');
+    var i = q('info'), t = q('toggle'), r = q('restart'), p = q('preview'), e = q('edit'), d = q('delete');
     if (i) i.onclick = () => showInfo(s.name);
     if (t) { t.textContent = s.running ? 'Stop' : 'Start'; t.onclick = () => onToggle(s.name, s.running) }
     if (r) r.onclick = () => onRestart(s.name);
+    if (p) p.onclick = () => window.open('/preview/' + encodeURIComponent(s.name) + '/index.m3u8', '_blank');
     if (e) e.onclick = () => onEdit(s.name, s.url, s.decoder);
     if (d) d.onclick = () => onDelete(s.name);
 }